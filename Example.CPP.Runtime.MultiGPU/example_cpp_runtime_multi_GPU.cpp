@@ -13,6 +13,8 @@
 
 #include "vidi_runtime.h"
 #include "../include/rapidxml/rapidxml.hpp"
+#include "../include/rapidxml/rapidxml_iterators.hpp"
+#include "../include/vidi_utils/buffer_view.hpp"
 
 using namespace std;
 
@@ -362,16 +364,21 @@ int main(int argc, char* argv[])
         return -1;
     }
 
+    // the device list is parsed in place, inside the buffer returned by the library
     rapidxml::xml_document<> doc;
-    doc.parse<0>(buffer.data);
+    if (!vidi_utils::parse_in_situ(doc, buffer))
+    {
+        clog << "failed to read the list of compute devices" << endl;
+        vidi_deinitialize();
+        return -1;
+    }
 
     std::vector<Device> devices;
     auto devices_xml = doc.first_node("devices");
-    auto device_xml = devices_xml->first_node("device");
-    while (device_xml)
+    // only visit the <device> children, other siblings are skipped
+    for (auto & device_xml : rapidxml::children(devices_xml, "device"))
     {
-        devices.push_back(Device(device_xml->first_attribute("id")->value(), device_xml->first_attribute("index")->value()));
-        device_xml = device_xml->next_sibling();
+        devices.push_back(Device(device_xml.first_attribute("id")->value(), device_xml.first_attribute("index")->value()));
     }
 
     if (devices.empty())
@@ -5,6 +5,7 @@
  */
 
 #include "vidi.h"
+#include "../include/vidi_utils/buffer_pool.hpp"
 #include <iostream>
 
 using namespace std;
@@ -63,6 +64,28 @@ int main()
         cout << buffer.data << endl;
     }
 
+    bool pooled_ok = true;
+    {   // when buffers are needed over and over, reuse the ones the library already grew
+        static vidi_utils::buffer_site version_site("version");
+        for (int iter = 0; pooled_ok && iter < 100; ++iter)
+        {
+            // taken from this thread's pool, given back at the end of the scope
+            vidi_utils::pooled_buffer version(version_site);
+            pooled_ok = version.status() == VIDI_SUCCESS && vidi_version(version.get()) == VIDI_SUCCESS;
+        }
+        if (pooled_ok)
+            vidi_utils::buffer_pool::report(cout);
+    }
+
+    // the pooled buffers must be released before the library frees them all, on failure too
+    vidi_utils::buffer_pool::shutdown();
+    if (!pooled_ok)
+    {
+        cerr << "failed to get version";
+        vidi_deinitialize();
+        return -1;
+    }
+
     // vidi_deinitialize will free the buffer
     // otherwise, call vidi_free_buffer()
     vidi_deinitialize();
@@ -0,0 +1,127 @@
+/**
+ * @file example_cpp_change_gate.cpp
+ * @brief Example processing a still scene with sensor noise and occasional small changes through
+ * vidi_utils::change_gate, and measuring the speed of the block comparison
+ */
+
+#include "vidi_runtime.h"
+#include "../include/vidi_utils/change_gate.hpp"
+#include "../include/vidi_utils/image_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace runtime = vidi_utils::runtime;
+
+/**
+ * @brief the scene plus noise of at most +/-noise, with a bright square at (x, y) if size is not 0
+ */
+void make_frame(const vidi_utils::image_view & scene, const vidi_utils::image_view & frame, int noise,
+    VIDI_UINT x, VIDI_UINT y, VIDI_UINT size, mt19937 & rng)
+{
+    for (VIDI_UINT r = 0; r < frame.height(); ++r)
+    {
+        for (VIDI_UINT c = 0; c < frame.width(); ++c)
+        {
+            int v = scene.row(r)[c] + int(rng() % (2 * noise + 1)) - noise;
+            if (size && c >= x && c < x + size && r >= y && r < y + size)
+                v = 255;
+            frame.row(r)[c] = static_cast<unsigned char>(min(255, max(0, v)));
+        }
+    }
+}
+
+void bench_change_map(const vidi_utils::image_view & a, const vidi_utils::image_view & b, size_t n_iter)
+{
+    double megapixels = a.width() * double(a.height()) / 1e6;
+    vidi_utils::change_map reference;
+    vidi_utils::compute_change_map(a, b, 32, reference, vidi_utils::simd_scalar);
+    cout << "change map of " << a.width() << "x" << a.height() << " frames, blocks of 32" << endl;
+    for (int level = vidi_utils::simd_scalar; level <= vidi_utils::best_simd_level(); ++level)
+    {
+        vidi_utils::simd_level l = static_cast<vidi_utils::simd_level>(level);
+        vidi_utils::change_map map;
+        auto start = chrono::steady_clock::now();
+        for (size_t iter = 0; iter < n_iter; ++iter)
+            vidi_utils::compute_change_map(a, b, 32, map, l);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_iter;
+        cout << "    " << vidi_utils::simd_level_name(l) << ": " << ms << " ms, " << megapixels / ms * 1e3 << " MP/s"
+            << (map.blocks == reference.blocks ? "" : " (MISMATCH)") << endl;
+    }
+}
+
+/**
+ * @brief usage: example_cpp_change_gate [frames] [frames between changes]
+ */
+int main(int argc, char* argv[])
+{
+    size_t n_frames = argc > 1 ? atoi(argv[1]) : 300;
+    size_t change_every = argc > 2 ? max(1, atoi(argv[2])) : 25;
+
+    auto initialized = runtime::initialize(VIDI_GPU_SINGLE_DEVICE_PER_TOOL, "")
+        .and_then([] { return runtime::open_workspace_from_file("workspace", "..\\resources\\runtime\\Textile.vrws"); });
+    if (!initialized)
+    {
+        clog << initialized.error() << endl;
+        vidi_deinitialize();
+        return -1;
+    }
+
+    vidi_utils::image_pool pool;
+    mt19937 rng(42);
+    vidi_utils::pooled_image scene = pool.acquire(2448, 2048, 1, VIDI_IMG_8U);
+    vidi_utils::pooled_image frame = pool.acquire(2448, 2048, 1, VIDI_IMG_8U);
+    for (VIDI_UINT y = 0; y < scene.view().height(); ++y)
+        for (VIDI_UINT x = 0; x < scene.view().width(); ++x)
+            scene.view().row(y)[x] = static_cast<unsigned char>((x / 8 + y / 8) % 200 + 20);
+
+    make_frame(scene.view(), frame.view(), 3, 0, 0, 0, rng);
+    bench_change_map(scene.view(), frame.view(), 20);
+
+    // a defect of 12x12 pixels appears every change_every frames and stays until the next one moves it
+    vidi_utils::change_gate gate;
+    string xml;
+    size_t n_changes = 0, missed = 0;
+    VIDI_UINT x = 0, y = 0, size = 0;
+    double gate_ms = 0;
+    for (size_t k = 0; k < n_frames; ++k)
+    {
+        bool changed = k % change_every == change_every - 1;
+        if (changed)
+        {
+            x = rng() % 2400;
+            y = rng() % 2000;
+            size = 12;
+            ++n_changes;
+        }
+        make_frame(scene.view(), frame.view(), 3, x, y, size, rng);
+
+        auto start = chrono::steady_clock::now();
+        auto processed = gate.process("workspace", "default", "analyze", "my_sample", "", frame.get(), xml);
+        gate_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        if (!processed)
+        {
+            clog << processed.error() << endl;
+            break;
+        }
+        if (changed && processed.value())
+            ++missed;
+    }
+
+    vidi_utils::change_gate_stats stats = gate.stats();
+    cout << stats.frames << " frames, " << n_changes << " with a change" << endl
+        << "processed: " << stats.processed << ", reused: " << stats.reused << " ("
+        << 100.0 * stats.reused / stats.frames << "% of the processing avoided)" << endl
+        << "changes missed: " << missed << endl
+        << "gate and processing: " << gate_ms / stats.frames << " ms per frame" << endl;
+
+    vidi_deinitialize();
+    return missed ? -1 : 0;
+}
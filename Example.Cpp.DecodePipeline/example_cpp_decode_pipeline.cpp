@@ -0,0 +1,155 @@
+/**
+ * @file example_cpp_decode_pipeline.cpp
+ * @brief Example overlapping the decoding of PNG images received in memory with their processing
+ */
+
+#include "vidi.h"
+#include "../include/vidi_utils/decode_pipeline.hpp"
+#include "../include/vidi_utils/image_view.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief stands for the processing of a sample: reads every pixel a few times
+ */
+size_t process(const VIDI_IMAGE & image, int passes)
+{
+    vidi_utils::image_view view(image);
+    size_t sum = 0;
+    for (int pass = 0; pass < passes; ++pass)
+    {
+        for (VIDI_UINT y = 0; y < view.height(); ++y)
+        {
+            const unsigned char * row = view.row(y);
+            for (size_t k = 0; k < view.row_size(); ++k)
+                sum += row[k] ^ pass;
+        }
+    }
+    return sum;
+}
+
+/**
+ * @brief usage: example_cpp_decode_pipeline [images] [processing passes] [workers]
+ */
+int main(int argc, char* argv[])
+{
+    size_t n_images = argc > 1 ? atoi(argv[1]) : 200;
+    int passes = argc > 2 ? atoi(argv[2]) : 4;
+    vidi_utils::decode_options options;
+    options.n_workers = argc > 3 ? atoi(argv[3]) : 0;
+
+    if (vidi_initialize(VIDI_GPU_MODE_NO_SUPPORT, "") != VIDI_SUCCESS)
+    {
+        cerr << "failed to initialize vidi" << endl;
+        return -1;
+    }
+
+    // the PNG that would be received through a pipe or a web request
+    {
+        VIDI_IMAGE img;
+        img.channels = 1;
+        img.channel_depth = VIDI_IMG_8U;
+        img.height = 1024;
+        img.width = 1280;
+        img.step = img.width;
+        vector<uint8_t> pixels(img.height * img.step);
+        for (size_t k = 0; k < pixels.size(); ++k)
+            pixels[k] = static_cast<uint8_t>((k % img.width) ^ (k / img.width));
+        img.data = pixels.data();
+        if (vidi_save_image("received.png", &img) != VIDI_SUCCESS)
+        {
+            cerr << "failed to save image" << endl;
+            vidi_deinitialize();
+            return -1;
+        }
+    }
+    ifstream file("received.png", ios::binary);
+    vector<char> png((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    if (png.empty())
+    {
+        cerr << "failed to read 'received.png'" << endl;
+        vidi_deinitialize();
+        return -1;
+    }
+
+    // decoding and processing one after the other, as in example_cpp_image.cpp
+    size_t check_sequential = 0;
+    auto start = chrono::steady_clock::now();
+    {
+        VIDI_IMAGE img;
+        vidi_init_image(&img);
+        for (size_t k = 0; k < n_images; ++k)
+        {
+            VIDI_BUFFER buffer;
+            buffer.data = png.data();
+            buffer.size = static_cast<VIDI_UINT>(png.size());
+            if (vidi_load_image_from_memory(&buffer, VIDI_IMAGE_FORMAT_PNG, &img) != VIDI_SUCCESS)
+            {
+                cerr << "failed to load image" << endl;
+                vidi_deinitialize();
+                return -1;
+            }
+            check_sequential += process(img, passes);
+        }
+        vidi_free_image(&img);
+    }
+    double sequential_s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    // decoding on the workers of the pipeline while this thread processes
+    size_t check_pipelined = 0;
+    size_t in_order = 0;
+    vidi_utils::decode_stats stats;
+    size_t n_workers = 0;
+    start = chrono::steady_clock::now();
+    {
+        vidi_utils::decode_pipeline decoder(options);
+        thread receiver([&]()
+        {
+            for (size_t k = 0; k < n_images; ++k)
+            {
+                vector<char> data = decoder.buffer();
+                data.assign(png.begin(), png.end());
+                decoder.submit(move(data), VIDI_IMAGE_FORMAT_PNG);
+            }
+            decoder.close();
+        });
+
+        vidi_utils::decoded_image image;
+        while (decoder.next(image))
+        {
+            if (image.index() == in_order)
+                ++in_order;
+            if (!image)
+            {
+                cerr << "failed to decode image " << image.index() << " (status " << image.status() << ")" << endl;
+                continue;
+            }
+            check_pipelined += process(*image.get(), passes);
+        }
+        image.release();
+        receiver.join();
+        stats = decoder.stats();
+        n_workers = decoder.n_workers();
+    }
+    double pipelined_s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << n_images << " images of " << png.size() << " bytes" << endl
+        << "sequential: " << n_images / sequential_s << " images/s" << endl
+        << "pipelined : " << n_images / pipelined_s << " images/s with " << n_workers << " worker(s), "
+        << stats.decoded << " decoded, " << stats.failed << " failed, "
+        << stats.decode_seconds / stats.decoded * 1e3 << " ms per decode" << endl
+        << "delivered in order: " << (in_order == n_images ? "yes" : "NO")
+        << (check_sequential == check_pipelined ? "" : " (MISMATCH)") << endl;
+
+    vidi_deinitialize();
+    return 0;
+}
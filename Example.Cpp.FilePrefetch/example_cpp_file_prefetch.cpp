@@ -0,0 +1,169 @@
+/**
+ * @file example_cpp_file_prefetch.cpp
+ * @brief Example taking the disk off the critical path of a batch: files are read ahead with
+ * vidi_utils::file_prefetcher and decoded in order by vidi_utils::decode_pipeline
+ */
+
+#include "vidi.h"
+#include "../include/vidi_utils/decode_pipeline.hpp"
+#include "../include/vidi_utils/file_prefetcher.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+
+using namespace std;
+
+/**
+ * @brief evicts the files from the page cache where the system allows it, so that they are read from the disk
+ */
+void drop_from_cache(const vector<string> & paths)
+{
+#if defined(__linux__)
+    for (auto & path : paths)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            continue;
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+#else
+    (void)paths;
+#endif
+}
+
+/**
+ * @brief writes n_files synthetic images to the current directory
+ */
+bool make_images(size_t n_files, vector<string> & paths)
+{
+    VIDI_IMAGE img;
+    img.channels = 1;
+    img.channel_depth = VIDI_IMG_8U;
+    img.height = 1536;
+    img.width = 2048;
+    img.step = img.width;
+    vector<uint8_t> pixels(img.height * img.step);
+    img.data = pixels.data();
+
+    for (size_t n = 0; n < n_files; ++n)
+    {
+        for (size_t k = 0; k < pixels.size(); ++k)
+            pixels[k] = static_cast<uint8_t>((k * 2654435761u + n) >> 13);
+        ostringstream path;
+        path << "prefetch_" << n << ".png";
+        if (vidi_save_image(path.str().c_str(), &img) != VIDI_SUCCESS)
+            return false;
+        paths.push_back(path.str());
+    }
+    return true;
+}
+
+/**
+ * @brief reads and decodes every file through the prefetcher and the decode pipeline
+ */
+void run_prefetched(const vector<string> & paths, const vidi_utils::prefetch_options & options)
+{
+    drop_from_cache(paths);
+    auto start = chrono::steady_clock::now();
+
+    vidi_utils::decode_pipeline decoder;
+    vidi_utils::file_prefetcher files(paths, options);
+    vidi_utils::prefetch_stats read_stats;
+    size_t decoded = 0;
+    thread reader([&]()
+    {
+        vidi_utils::prefetched_file file;
+        while (files.next(file))
+        {
+            if (!file.ok)
+                cerr << "failed to read '" << paths[file.index] << "'" << endl;
+            decoder.submit(move(file.data), vidi_utils::image_format_of(paths[file.index]));
+            file.data = decoder.buffer();
+        }
+        decoder.close();
+        read_stats = files.stats();
+    });
+
+    vidi_utils::decoded_image image;
+    while (decoder.next(image))
+    {
+        if (image)
+            ++decoded;
+    }
+    image.release();
+    reader.join();
+
+    double s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "prefetched (" << files.backend() << "): " << decoded / s << " images/s, read "
+        << read_stats.mb_per_second() << " MB/s, " << read_stats.average_in_flight() << " reads in flight on average (max "
+        << read_stats.max_in_flight << "), " << decoded << " decoded" << endl;
+}
+
+/**
+ * @brief usage: example_cpp_file_prefetch [image files...]
+ *
+ * without files, 64 synthetic images are written to the current directory
+ */
+int main(int argc, char* argv[])
+{
+    if (vidi_initialize(VIDI_GPU_MODE_NO_SUPPORT, "") != VIDI_SUCCESS)
+    {
+        cerr << "failed to initialize vidi" << endl;
+        return -1;
+    }
+
+    vector<string> paths(argv + 1, argv + argc);
+    bool generated = paths.empty();
+    if (generated && !make_images(64, paths))
+    {
+        cerr << "failed to save image" << endl;
+        vidi_deinitialize();
+        return -1;
+    }
+
+    // one image after the other, the way the batch runs load them
+    drop_from_cache(paths);
+    auto start = chrono::steady_clock::now();
+    size_t loaded = 0;
+    {
+        VIDI_IMAGE img;
+        vidi_init_image(&img);
+        for (auto & path : paths)
+        {
+            if (vidi_load_image(path.c_str(), &img) == VIDI_SUCCESS)
+                ++loaded;
+        }
+        vidi_free_image(&img);
+    }
+    double s = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << paths.size() << " files" << endl << "sequential: " << loaded / s << " images/s" << endl;
+
+    vidi_utils::prefetch_options options;
+    options.use_io_uring = false;
+    run_prefetched(paths, options);
+    options.use_io_uring = true;
+    run_prefetched(paths, options);
+
+    if (generated)
+    {
+        for (auto & path : paths)
+            remove(path.c_str());
+    }
+
+    vidi_deinitialize();
+    return 0;
+}
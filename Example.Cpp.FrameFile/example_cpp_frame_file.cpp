@@ -0,0 +1,220 @@
+/**
+ * @file example_cpp_frame_file.cpp
+ * @brief Tool converting folders of images into a frame file, and comparing the time to get the
+ * images from the frame file with the time to decode them
+ */
+
+#include "vidi.h"
+#include "../include/vidi_utils/frame_file.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <dirent.h>
+    #include <sys/stat.h>
+#endif
+
+using namespace std;
+
+bool is_image_name(const string & name)
+{
+    string::size_type dot = name.rfind('.');
+    if (dot == string::npos)
+        return false;
+    string ext = name.substr(dot + 1);
+    transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+    return ext == "png" || ext == "bmp" || ext == "tif" || ext == "tiff";
+}
+
+/**
+ * @brief appends the images of a folder, sorted by name, or the path itself if it is not a folder
+ */
+void list_images(const string & path, vector<string> & paths)
+{
+    vector<string> names;
+#if defined(_WIN32)
+    DWORD attributes = GetFileAttributesA(path.c_str());
+    if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY))
+    {
+        paths.push_back(path);
+        return;
+    }
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((path + "\\*").c_str(), &data);
+    if (find != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && is_image_name(data.cFileName))
+                names.push_back(path + "\\" + data.cFileName);
+        } while (FindNextFileA(find, &data));
+        FindClose(find);
+    }
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        paths.push_back(path);
+        return;
+    }
+    if (DIR * dir = opendir(path.c_str()))
+    {
+        while (dirent * entry = readdir(dir))
+        {
+            if (is_image_name(entry->d_name))
+                names.push_back(path + "/" + entry->d_name);
+        }
+        closedir(dir);
+    }
+#endif
+    sort(names.begin(), names.end());
+    paths.insert(paths.end(), names.begin(), names.end());
+}
+
+/**
+ * @brief decodes every image and appends it to the frame file
+ */
+int convert(const string & output, const vector<string> & paths)
+{
+    vidi_utils::frame_file_writer writer(output);
+    if (!writer.is_open())
+    {
+        cerr << "failed to create '" << output << "'" << endl;
+        return -1;
+    }
+
+    VIDI_IMAGE img;
+    vidi_init_image(&img);
+    for (auto & path : paths)
+    {
+        if (vidi_load_image(path.c_str(), &img) != VIDI_SUCCESS)
+        {
+            cerr << "failed to load '" << path << "', skipped" << endl;
+            continue;
+        }
+        if (!writer.add(path, img))
+        {
+            cerr << "failed to write '" << path << "'" << endl;
+            vidi_free_image(&img);
+            return -1;
+        }
+    }
+    vidi_free_image(&img);
+
+    if (!writer.close())
+    {
+        cerr << "failed to write '" << output << "'" << endl;
+        return -1;
+    }
+    cout << writer.size() << " frames written to '" << output << "'" << endl;
+    return 0;
+}
+
+/**
+ * @brief what processing reads of an image: the last byte of every row
+ */
+size_t touch(const VIDI_IMAGE & image)
+{
+    vidi_utils::image_view view(image);
+    size_t sum = 0;
+    for (VIDI_UINT y = 0; y < view.height(); ++y)
+        sum += view.row(y)[view.row_size() - 1];
+    return sum;
+}
+
+/**
+ * @brief gets every image from the frame file, then decodes them again from their original files
+ */
+int bench(const string & input, size_t n_passes)
+{
+    vidi_utils::frame_file frames;
+    if (!frames.open(input))
+    {
+        cerr << frames.error_message() << endl;
+        return -1;
+    }
+    if (!frames.size())
+    {
+        cerr << "'" << input << "' holds no frames" << endl;
+        return -1;
+    }
+
+    size_t check_mapped = 0, check_decoded = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t pass = 0; pass < n_passes; ++pass)
+    {
+        for (size_t k = 0; k < frames.size(); ++k)
+        {
+            if (k + 1 < frames.size())
+                frames.will_need(k + 1);
+            check_mapped += touch(frames.image(k));
+        }
+    }
+    double mapped_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / (n_passes * frames.size());
+
+    start = chrono::steady_clock::now();
+    VIDI_IMAGE img;
+    vidi_init_image(&img);
+    for (size_t pass = 0; pass < n_passes; ++pass)
+    {
+        for (size_t k = 0; k < frames.size(); ++k)
+        {
+            if (vidi_load_image(frames.name(k).c_str(), &img) == VIDI_SUCCESS)
+                check_decoded += touch(img);
+        }
+    }
+    vidi_free_image(&img);
+    double decoded_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / (n_passes * frames.size());
+
+    cout << frames.size() << " frames, " << n_passes << " passes" << endl
+        << "mapped : " << mapped_ms << " ms per frame" << endl
+        << "decoded: " << decoded_ms << " ms per frame (" << decoded_ms / mapped_ms << "x)"
+        << (check_mapped == check_decoded ? "" : " (MISMATCH)") << endl;
+    return 0;
+}
+
+/**
+ * @brief usage:
+ *     example_cpp_frame_file convert <frames.vraw> <folder or image>...
+ *     example_cpp_frame_file bench <frames.vraw> [passes]
+ */
+int main(int argc, char* argv[])
+{
+    string mode = argc > 1 ? argv[1] : "";
+    if (argc < 3 || (mode != "convert" && mode != "bench"))
+    {
+        cerr << "usage: " << argv[0] << " convert <frames.vraw> <folder or image>..." << endl
+            << "       " << argv[0] << " bench <frames.vraw> [passes]" << endl;
+        return -1;
+    }
+
+    if (vidi_initialize(VIDI_GPU_MODE_NO_SUPPORT, "") != VIDI_SUCCESS)
+    {
+        cerr << "failed to initialize vidi" << endl;
+        return -1;
+    }
+
+    int status;
+    if (mode == "convert")
+    {
+        vector<string> paths;
+        for (int k = 3; k < argc; ++k)
+            list_images(argv[k], paths);
+        status = convert(argv[2], paths);
+    }
+    else
+    {
+        status = bench(argv[2], argc > 3 ? max(1, atoi(argv[3])) : 3);
+    }
+
+    vidi_deinitialize();
+    return status;
+}
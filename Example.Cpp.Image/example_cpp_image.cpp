@@ -5,6 +5,11 @@
  */
 
 #include "vidi.h"
+
+// uncomment to count the images and buffers alive and report the ones never freed
+//#define VIDI_UTILS_TRACK_RESOURCES
+#include "../include/vidi_utils/resource_tracking.hpp"
+
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -66,7 +71,7 @@ int main()
     {
         VIDI_UINT status;
         VIDI_IMAGE img;
-        vidi_init_image(&img); //Managed by ViDi
+        VIDI_INIT_IMAGE(&img); //Managed by ViDi
         status = vidi_load_image("img42.png", &img);
         if (status != VIDI_SUCCESS)
         {
@@ -74,6 +79,8 @@ int main()
             vidi_deinitialize();
             return -1;
         }
+        // the library allocated the pixels, let the tracking know their size
+        VIDI_TRACK_SIZE(&img);
 
         std::cout << "number of channels : " << img.channels << std::endl
             << "channel depth : " << img.channel_depth << std::endl
@@ -97,7 +104,7 @@ int main()
         VIDI_UINT status;
         VIDI_IMAGE img;
         VIDI_BUFFER buffer;    // Buffer not managed by ViDi
-        vidi_init_image(&img); // Image Managed by ViDi
+        VIDI_INIT_IMAGE(&img); // Image Managed by ViDi
 
         // load the image file and store it in buffer
         std::ifstream img_file("img42.png", std::ios::binary | std::ios::in);
@@ -117,6 +124,7 @@ int main()
                 vidi_deinitialize();
                 return -1;
             }
+            VIDI_TRACK_SIZE(&img);
 
             std::cout << "number of channels : " << img.channels << std::endl
                 << "channel depth : " << img.channel_depth << std::endl
@@ -127,6 +135,10 @@ int main()
         }
     }
 
+    // the images loaded above are never freed, vidi_deinitialize does it for us;
+    // with VIDI_UTILS_TRACK_RESOURCES defined they are listed here
+    VIDI_REPORT_LEAKS(std::clog);
+
     vidi_deinitialize();
     return 0;
 }
@@ -0,0 +1,225 @@
+/**
+ * @file example_cpp_image_archiver.cpp
+ * @brief Example saving rejected frames with vidi_utils::image_archiver instead of on the inspection thread,
+ * and comparing the compression levels of the PNG encoder
+ */
+
+#include "vidi.h"
+#include "../include/vidi_utils/image_archiver.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief smooth shading with a weave and some sensor noise, closer to a real frame than random bytes
+ */
+void synthesize(const vidi_utils::image_view & view, mt19937 & rng)
+{
+    normal_distribution<double> noise(0.0, 2.0);
+    double phase = rng() % 64;
+    for (VIDI_UINT y = 0; y < view.height(); ++y)
+    {
+        unsigned char * row = view.row(y);
+        for (VIDI_UINT x = 0; x < view.width(); ++x)
+        {
+            double v = 96 + 48.0 * x / view.width() + 24 * sin((x + phase) * 0.2) * sin(y * 0.2) + noise(rng);
+            row[x] = static_cast<unsigned char>(min(255.0, max(0.0, v)));
+        }
+    }
+}
+
+string frame_path(const char * prefix, size_t k, const char * extension)
+{
+    ostringstream os;
+    os << prefix << k << extension;
+    return os.str();
+}
+
+void remove_files(const char * prefix, size_t n, const char * extension)
+{
+    for (size_t k = 0; k < n; ++k)
+        remove(frame_path(prefix, k, extension).c_str());
+}
+
+/**
+ * @brief time to encode and write one frame on the calling thread, at every level
+ */
+void bench_levels(const vidi_utils::image_view & frame)
+{
+    double mb = frame.row_size() * double(frame.height()) / (1 << 20);
+    cout << "saving a " << frame.width() << "x" << frame.height() << " frame on the calling thread" << endl;
+    for (int level = vidi_utils::png_store; level <= vidi_utils::png_smallest; ++level)
+    {
+        vidi_utils::png_level l = static_cast<vidi_utils::png_level>(level);
+        vector<unsigned char> png;
+        auto start = chrono::steady_clock::now();
+        bool ok = vidi_utils::encode_png(frame, l, png) && vidi_utils::write_file("level.png", png);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        cout << "    png " << vidi_utils::png_level_name(l) << ": " << ms << " ms, " << mb / ms * 1000 << " MB/s, ratio "
+            << mb * (1 << 20) / png.size() << (ok ? "" : " (FAILED)") << endl;
+    }
+    remove("level.png");
+
+    VIDI_IMAGE image = frame.image();
+    auto start = chrono::steady_clock::now();
+    bool ok = vidi_utils::save_frame("level.vraw", "level", image);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "    raw: " << ms << " ms" << (ok ? "" : " (FAILED)") << endl;
+    remove("level.vraw");
+
+    start = chrono::steady_clock::now();
+    VIDI_UINT status = vidi_save_image("level.png", &image);
+    ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "    vidi_save_image: " << ms << " ms" << (status == VIDI_SUCCESS ? "" : " (FAILED)") << endl;
+    remove("level.png");
+}
+
+/**
+ * @brief an inspection loop rejecting one frame in reject_every, saving the rejects on the thread or through the archiver
+ *
+ * @return the longest time a frame took, inspection and saving together, in ms
+ */
+double inspect(vector<vidi_utils::pooled_image> & frames, size_t n_frames, size_t reject_every, double inspect_ms,
+    vidi_utils::image_archiver * archiver, double & total_ms)
+{
+    double worst = 0;
+    auto begin = chrono::steady_clock::now();
+    for (size_t k = 0; k < n_frames; ++k)
+    {
+        auto start = chrono::steady_clock::now();
+        // stands for adding the image to a sample and processing it
+        this_thread::sleep_for(chrono::microseconds(static_cast<long long>(inspect_ms * 1000)));
+        if (k % reject_every == 0)
+        {
+            string path = frame_path("reject_", k, ".png");
+            vidi_utils::image_view frame = frames[k % frames.size()].view();
+            if (archiver)
+                archiver->save_copy(path, frame);
+            else
+            {
+                vector<unsigned char> png;
+                vidi_utils::encode_png(frame, vidi_utils::png_fastest, png);
+                vidi_utils::write_file(path, png);
+            }
+        }
+        worst = max(worst, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    }
+    total_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - begin).count();
+    return worst;
+}
+
+/**
+ * @brief usage: example_cpp_image_archiver [frames] [reject one frame in] [inspection ms]
+ */
+int main(int argc, char* argv[])
+{
+    size_t n_frames = argc > 1 ? atoi(argv[1]) : 60;
+    size_t reject_every = argc > 2 ? max(1, atoi(argv[2])) : 3;
+    double inspect_ms = argc > 3 ? atof(argv[3]) : 20.0;
+
+    if (vidi_initialize(VIDI_GPU_MODE_NO_SUPPORT, "") != VIDI_SUCCESS)
+    {
+        cerr << "failed to initialize vidi" << endl;
+        return -1;
+    }
+
+    vidi_utils::image_pool pool;
+    mt19937 rng(42);
+    vector<vidi_utils::pooled_image> frames;
+    for (size_t k = 0; k < 8; ++k)
+    {
+        frames.push_back(pool.acquire(1600, 1200, 1, VIDI_IMG_8U));
+        synthesize(frames.back().view(), rng);
+    }
+    bench_levels(frames[0].view());
+
+    // rejects saved on the inspection thread
+    double sync_total = 0;
+    double sync_worst = inspect(frames, n_frames, reject_every, inspect_ms, 0, sync_total);
+    remove_files("reject_", n_frames, ".png");
+
+    // the same rejects handed to the archiver
+    vidi_utils::image_archiver_options options;
+    options.level = vidi_utils::png_fastest;
+    double async_total = 0, async_worst = 0;
+    {
+        vidi_utils::image_archiver archiver(options);
+        async_worst = inspect(frames, n_frames, reject_every, inspect_ms, &archiver, async_total);
+        archiver.close();
+        archiver.report(cout);
+    }
+    remove_files("reject_", n_frames, ".png");
+
+    cout << n_frames << " frames inspected in " << inspect_ms << " ms each, one in " << reject_every << " rejected" << endl
+        << "saved on the thread : " << sync_total / n_frames << " ms per frame, worst " << sync_worst << " ms" << endl
+        << "saved by archiver   : " << async_total / n_frames << " ms per frame, worst " << async_worst << " ms" << endl;
+
+    // images loaded by the library are handed over without a copy: the archiver frees them once written
+    {
+        vidi_utils::image_archiver archiver(options);
+        size_t handed_over = 0;
+        for (size_t k = 0; k < 8; ++k)
+        {
+            VIDI_IMAGE image;
+            vidi_init_image(&image);
+            if (vidi_load_image("..\\resources\\images\\bad000001.png", &image) != VIDI_SUCCESS)
+            {
+                cerr << "failed to load '..\\resources\\images\\bad000001.png'" << endl;
+                break;
+            }
+            if (archiver.save(frame_path("loaded_", k, ".png"), image))
+                ++handed_over;
+            else
+                vidi_free_image(&image);    // not queued: the image is still ours
+        }
+        archiver.close();
+        cout << handed_over << " loaded images handed over: ";
+        archiver.report(cout);
+    }
+    remove_files("loaded_", 8, ".png");
+
+    // a flood of rejects, faster than the workers can write: the archiver drops rather than grows
+    options.max_pending = 4;
+    options.drop_when_full = true;
+    {
+        vidi_utils::image_archiver archiver(options);
+        for (size_t k = 0; k < n_frames; ++k)
+            archiver.save_copy(frame_path("flood_", k, ".png"), frames[k % frames.size()].view());
+        archiver.close();
+        cout << "flood of " << n_frames << " rejects, at most " << options.max_pending << " pending: ";
+        archiver.report(cout);
+    }
+    remove_files("flood_", n_frames, ".png");
+
+    // raw dumps cost little more than the write itself
+    options.format = vidi_utils::archive_raw;
+    options.drop_when_full = false;
+    {
+        vidi_utils::image_archiver archiver(options);
+        for (size_t k = 0; k < n_frames; ++k)
+            archiver.save_copy(frame_path("raw_", k, vidi_utils::archive_extension(options.format)), frames[k % frames.size()].view());
+        archiver.close();
+        archiver.report(cout);
+
+        vidi_utils::frame_file check;
+        bool same = check.open(frame_path("raw_", 0, ".vraw")) && check.size() == 1;
+        for (VIDI_UINT y = 0; same && y < frames[0].view().height(); ++y)
+            same = memcmp(vidi_utils::image_view(check.image(0)).row(y), frames[0].view().row(y), frames[0].view().row_size()) == 0;
+        cout << "raw dump read back: " << (same ? "same" : "DIFFERENT") << endl;
+    }
+    remove_files("raw_", n_frames, ".vraw");
+
+    vidi_deinitialize();
+    return 0;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file example_cpp_image_pool.cpp
+ * @brief Example comparing per-frame allocation of camera frames with vidi_utils::image_pool
+ */
+
+#include "vidi.h"
+#include "../include/vidi_utils/image_pool.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+/**
+ * @brief what a camera does to a frame: write every pixel
+ */
+void grab(void * data, size_t bytes, size_t frame)
+{
+    memset(data, static_cast<int>(frame & 0xff), bytes);
+}
+
+/**
+ * @brief frames allocated with new[] and deleted once processed, as in example_cpp_image.cpp
+ */
+double run_new(VIDI_UINT width, VIDI_UINT height, VIDI_UINT channels, size_t n_frames, size_t & check)
+{
+    auto start = chrono::steady_clock::now();
+    for (size_t frame = 0; frame < n_frames; ++frame)
+    {
+        VIDI_IMAGE img;
+        img.channels = channels;
+        img.channel_depth = VIDI_IMG_8U;
+        img.height = height;
+        img.width = width;
+        img.step = img.width * img.channels;
+        img.data = new uint8_t[img.height * img.step];
+
+        grab(img.data, img.height * img.step, frame);
+        check += static_cast<uint8_t *>(img.data)[img.height * img.step - 1];
+
+        delete[]((uint8_t*)img.data);
+    }
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_frames;
+}
+
+/**
+ * @brief the same frames taken from a pool
+ */
+double run_pool(vidi_utils::image_pool & pool, VIDI_UINT width, VIDI_UINT height, VIDI_UINT channels, size_t n_frames, size_t & check)
+{
+    auto start = chrono::steady_clock::now();
+    for (size_t frame = 0; frame < n_frames; ++frame)
+    {
+        vidi_utils::pooled_image img = pool.acquire(width, height, channels, VIDI_IMG_8U);
+        if (!img)
+        {
+            cerr << "failed to allocate frame" << endl;
+            return 0;
+        }
+
+        grab(img.data(), img.get()->height * img.get()->step, frame);
+        check += img.data()[img.get()->height * img.get()->step - 1];
+    }
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_frames;
+}
+
+/**
+ * @brief usage: example_cpp_image_pool [frames]
+ */
+int main(int argc, char* argv[])
+{
+    size_t n_frames = argc > 1 ? atoi(argv[1]) : 200;
+
+    struct { VIDI_UINT width, height, channels; } sensors[] = { { 2448, 2048, 1 }, { 5472, 3648, 3 } };
+    for (auto & sensor : sensors)
+    {
+        size_t check_new = 0, check_pool = 0;
+        double new_ms = run_new(sensor.width, sensor.height, sensor.channels, n_frames, check_new);
+
+        vidi_utils::image_pool pool;
+        double pool_ms = run_pool(pool, sensor.width, sensor.height, sensor.channels, n_frames, check_pool);
+
+        cout << sensor.width << "x" << sensor.height << "x" << sensor.channels << ": new[] " << new_ms << " ms/frame, pool "
+            << pool_ms << " ms/frame (" << new_ms / pool_ms << "x)" << (check_new == check_pool ? "" : " (MISMATCH)") << endl << "    ";
+        pool.report(cout);
+    }
+
+    // with a cap on the memory in use, frames beyond it are refused instead of allocated
+    vidi_utils::image_pool_options options;
+    options.max_live_bytes = 3 * vidi_utils::image_pool().step_of(vidi_utils::image_shape(2448, 2048)) * 2048;
+    vidi_utils::image_pool capped(options);
+    vidi_utils::pooled_image held[4];
+    for (auto & img : held)
+        img = capped.acquire(2448, 2048, 1, VIDI_IMG_8U);
+    cout << "capped pool: ";
+    capped.report(cout);
+
+    return 0;
+}
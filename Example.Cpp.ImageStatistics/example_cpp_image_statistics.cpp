@@ -0,0 +1,146 @@
+/**
+ * @file example_cpp_image_statistics.cpp
+ * @brief Example checking that the vectorized image statistics match the scalar ones, measuring
+ * their throughput, and keeping blank and saturated frames away from the tools with
+ * vidi_utils::frame_prefilter
+ */
+
+#include "vidi_runtime.h"
+#include "../include/vidi_utils/image_pool.hpp"
+#include "../include/vidi_utils/image_statistics.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace runtime = vidi_utils::runtime;
+
+void randomize(const vidi_utils::image_view & view, mt19937 & rng)
+{
+    for (VIDI_UINT y = 0; y < view.height(); ++y)
+    {
+        for (size_t k = 0; k < view.row_size(); ++k)
+            view.row(y)[k] = static_cast<unsigned char>(rng());
+    }
+}
+
+bool same_statistics(const vidi_utils::image_statistics & a, const vidi_utils::image_statistics & b)
+{
+    return a.min == b.min && a.max == b.max && a.mean == b.mean && a.variance == b.variance
+        && a.saturated == b.saturated && a.histogram == b.histogram;
+}
+
+void bench(const char * name, const vidi_utils::image_view & image, vidi_utils::thread_pool & pool, size_t n_iter)
+{
+    double megapixels = image.width() * double(image.height()) / 1e6;
+    vidi_utils::image_statistics reference;
+    vidi_utils::compute_statistics(image, reference, 0, 0, true, vidi_utils::simd_scalar);
+    cout << name << ": min " << reference.min << ", max " << reference.max << ", mean " << reference.mean
+        << ", stddev " << reference.stddev() << ", " << 100 * reference.saturated << "% saturated" << endl;
+
+    for (int level = vidi_utils::simd_scalar; level <= vidi_utils::best_simd_level(); ++level)
+    {
+        vidi_utils::simd_level l = static_cast<vidi_utils::simd_level>(level);
+        for (int histogram = 0; histogram < 2; ++histogram)
+        {
+            vidi_utils::image_statistics s;
+            auto start = chrono::steady_clock::now();
+            for (size_t iter = 0; iter < n_iter; ++iter)
+                vidi_utils::compute_statistics(image, s, 0, 0, histogram != 0, l);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_iter;
+            if (!histogram)
+                s.histogram = reference.histogram;
+            cout << "    " << vidi_utils::simd_level_name(l) << (histogram ? ", histogram: " : ": ") << ms << " ms, "
+                << megapixels / ms * 1e3 << " MP/s" << (same_statistics(s, reference) ? "" : " (MISMATCH)") << endl;
+        }
+    }
+    vidi_utils::image_statistics s;
+    auto start = chrono::steady_clock::now();
+    for (size_t iter = 0; iter < n_iter; ++iter)
+        vidi_utils::compute_statistics(image, s, &pool);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_iter;
+    cout << "    " << pool.size() << " threads, histogram: " << ms << " ms, " << megapixels / ms * 1e3 << " MP/s"
+        << (same_statistics(s, reference) ? "" : " (MISMATCH)") << endl;
+}
+
+/**
+ * @brief usage: example_cpp_image_statistics [iterations]
+ */
+int main(int argc, char* argv[])
+{
+    size_t n_iter = argc > 1 ? atoi(argv[1]) : 20;
+
+    auto initialized = runtime::initialize(VIDI_GPU_SINGLE_DEVICE_PER_TOOL, "")
+        .and_then([] { return runtime::open_workspace_from_file("workspace", "..\\resources\\runtime\\Textile.vrws"); });
+    if (!initialized)
+    {
+        clog << initialized.error() << endl;
+        vidi_deinitialize();
+        return -1;
+    }
+
+    // an odd width and padded rows, so that the kernels go through their tails and skip the padding
+    vidi_utils::image_pool images;
+    vidi_utils::thread_pool pool;
+    mt19937 rng(42);
+    vidi_utils::pooled_image mono = images.acquire(2447, 2048, 1, VIDI_IMG_8U);
+    vidi_utils::pooled_image mono16 = images.acquire(2447, 2048, 1, VIDI_IMG_16U);
+    randomize(mono.view(), rng);
+    randomize(mono16.view(), rng);
+    bench("8U", mono.view(), pool, n_iter);
+    bench("16U", mono16.view(), pool, n_iter);
+
+    // frames as a lighting fault would give them, between good ones
+    vidi_utils::frame_prefilter filter(false, &pool);
+    filter.add_rule("dark", vidi_utils::reject_dark(10));
+    filter.add_rule("saturated", vidi_utils::reject_saturated(0.25));
+    filter.add_rule("flat", vidi_utils::reject_flat(2));
+
+    vidi_utils::pooled_image frame = images.acquire(2448, 2048, 1, VIDI_IMG_8U);
+    const char * kinds[] = { "good", "black", "saturated", "flat grey" };
+    size_t processed = 0;
+    for (size_t k = 0; k < 40; ++k)
+    {
+        size_t kind = k % 10 < 7 ? 0 : k % 10 - 6;
+        vidi_utils::image_view view = frame.view();
+        for (VIDI_UINT y = 0; y < view.height(); ++y)
+        {
+            for (VIDI_UINT x = 0; x < view.width(); ++x)
+            {
+                unsigned char v = static_cast<unsigned char>(40 + (x * 7 + y * 3) % 160);
+                view.row(y)[x] = kind == 1 ? static_cast<unsigned char>(rng() % 4) : kind == 2 ? static_cast<unsigned char>(v < 120 ? v : 255)
+                    : kind == 3 ? 128 : v;
+            }
+        }
+
+        string reason;
+        auto added = runtime::create_sample("workspace", "default", "my_sample")
+            .and_then([&] { return filter.sample_add_image("workspace", "default", "my_sample", frame.get(), &reason); });
+        if (added && added.value())
+        {
+            auto done = runtime::sample_process("workspace", "default", "analyze", "my_sample", "");
+            if (!done)
+                clog << done.error() << endl;
+            ++processed;
+        }
+        else if (added)
+        {
+            cout << "frame " << k << " (" << kinds[kind] << ") rejected, " << reason << endl;
+        }
+        else
+        {
+            clog << added.error() << endl;
+        }
+        runtime::free_sample("workspace", "default", "my_sample");
+    }
+    cout << processed << " frames processed" << endl;
+    filter.report(cout);
+
+    vidi_deinitialize();
+    return 0;
+}
@@ -0,0 +1,161 @@
+/**
+ * @file example_cpp_image_view.cpp
+ * @brief Example passing regions of interest of a large frame to the library without copying them,
+ * and measuring what copying them would cost
+ */
+
+#include "vidi.h"
+#include "../include/vidi_utils/image_view.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief fills a frame with a pattern depending on the position and the channel
+ */
+void fill_frame(const vidi_utils::image_view & frame)
+{
+    for (VIDI_UINT y = 0; y < frame.height(); ++y)
+    {
+        for (VIDI_UINT x = 0; x < frame.width(); ++x)
+        {
+            for (VIDI_UINT c = 0; c < frame.channels(); ++c)
+            {
+                if (frame.channel_depth() == VIDI_IMG_8U)
+                    frame.pixel<uint8_t>(x, y)[c] = static_cast<uint8_t>(x * 3 + y * 5 + c * 7);
+                else
+                    frame.pixel<uint16_t>(x, y)[c] = static_cast<uint16_t>(x * 3 + y * 5 + c * 7);
+            }
+        }
+    }
+}
+
+/**
+ * @brief what the library would read of an image: here only one pixel per row, so that the
+ * measure is the cost of producing the VIDI_IMAGE and not of reading it
+ */
+size_t touch(const VIDI_IMAGE & image)
+{
+    size_t sum = 0;
+    for (VIDI_UINT y = 0; y < image.height; ++y)
+        sum += static_cast<const uint8_t *>(image.data)[y * image.step];
+    return sum;
+}
+
+/**
+ * @brief compares the pixels of two images of the same size
+ */
+bool same_pixels(const VIDI_IMAGE & a, const VIDI_IMAGE & b)
+{
+    vidi_utils::image_view va(a), vb(b);
+    for (VIDI_UINT y = 0; y < va.height(); ++y)
+    {
+        if (memcmp(va.row(y), vb.row(y), va.row_size()) != 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief crops the tiles of a splitting grid out of the frame, by copy and as views
+ */
+void benchmark(const char * name, const vidi_utils::image_view & frame, VIDI_UINT tile, VIDI_UINT overlap, size_t n_iter)
+{
+    vector<vidi_utils::image_view> tiles = vidi_utils::grid_tiles(frame, tile, tile, overlap);
+    if (tiles.empty())
+    {
+        cerr << name << ": no " << tile << "x" << tile << " tiles with an overlap of " << overlap << endl;
+        return;
+    }
+    size_t tile_bytes = tiles.front().row_size() * tiles.front().height();
+
+    // copy-based cropping: every tile gets its own packed image
+    vector<vector<uint8_t> > storage(tiles.size(), vector<uint8_t>(tile_bytes));
+    vector<VIDI_IMAGE> copies(tiles.size());
+    size_t check_copy = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t iter = 0; iter < n_iter; ++iter)
+    {
+        for (size_t k = 0; k < tiles.size(); ++k)
+        {
+            tiles[k].copy_to(storage[k].data());
+            copies[k] = vidi_utils::image_view(storage[k].data(), tiles[k].width(), tiles[k].height(), tiles[k].channels(), tiles[k].channel_depth()).image();
+            check_copy += touch(copies[k]);
+        }
+    }
+    double copy_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_iter;
+
+    // view-based cropping: the tiles point into the frame
+    vector<VIDI_IMAGE> views(tiles.size());
+    size_t check_view = 0;
+    start = chrono::steady_clock::now();
+    for (size_t iter = 0; iter < n_iter; ++iter)
+    {
+        vector<vidi_utils::image_view> cells = vidi_utils::grid_tiles(frame, tile, tile, overlap);
+        for (size_t k = 0; k < cells.size(); ++k)
+        {
+            views[k] = cells[k].image();
+            check_view += touch(views[k]);
+        }
+    }
+    double view_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_iter;
+
+    bool same = check_copy == check_view;
+    for (size_t k = 0; same && k < tiles.size(); ++k)
+        same = same_pixels(copies[k], views[k]);
+
+    double mb = tiles.size() * tile_bytes / 1e6;
+    cout << name << ": " << tiles.size() << " tiles of " << tile << "x" << tile << " (" << mb << " MB)" << endl
+        << "    copy: " << copy_ms << " ms (" << mb / copy_ms * 1e3 << " MB/s)" << endl
+        << "    view: " << view_ms << " ms, " << copy_ms / view_ms << "x faster"
+        << (same ? "" : " (MISMATCH)") << endl;
+}
+
+/**
+ * @brief usage: example_cpp_image_view [width] [height] [tile size] [iterations]
+ */
+int main(int argc, char* argv[])
+{
+    VIDI_UINT width = argc > 1 ? atoi(argv[1]) : 5472;
+    VIDI_UINT height = argc > 2 ? atoi(argv[2]) : 3648;
+    VIDI_UINT tile = argc > 3 ? atoi(argv[3]) : 512;
+    size_t n_iter = argc > 4 ? atoi(argv[4]) : 10;
+    VIDI_UINT overlap = tile / 16;
+
+    if (vidi_initialize(VIDI_GPU_MODE_NO_SUPPORT, "") != VIDI_SUCCESS)
+    {
+        cerr << "failed to initialize vidi" << endl;
+        return -1;
+    }
+
+    // frames as they would come from a camera, with rows padded to a multiple of 64 bytes
+    VIDI_UINT color_step = (width * 3 + 63) / 64 * 64;
+    vector<uint8_t> color_data(static_cast<size_t>(color_step) * height);
+    vidi_utils::image_view color(color_data.data(), width, height, 3, VIDI_IMG_8U, color_step);
+    fill_frame(color);
+
+    VIDI_UINT mono_step = (width * 2 + 63) / 64 * 64;
+    vector<uint8_t> mono_data(static_cast<size_t>(mono_step) * height);
+    vidi_utils::image_view mono(mono_data.data(), width, height, 1, VIDI_IMG_16U, mono_step);
+    fill_frame(mono);
+
+    benchmark("8U, 3 channels", color, tile, overlap, n_iter);
+    benchmark("16U, 1 channel", mono, tile, overlap, n_iter);
+
+    // a region of interest is given to the library like any other image
+    VIDI_IMAGE roi = color.crop(width / 4, height / 4, width / 2, height / 2).image();
+    if (vidi_save_image("roi.png", &roi) != VIDI_SUCCESS)
+    {
+        cerr << "failed to save image" << endl;
+        vidi_deinitialize();
+        return -1;
+    }
+
+    vidi_deinitialize();
+    return 0;
+}
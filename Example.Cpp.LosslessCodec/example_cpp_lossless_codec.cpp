@@ -0,0 +1,181 @@
+/**
+ * @file example_cpp_lossless_codec.cpp
+ * @brief Example comparing vidi_utils::encode_lossless with PNG on the Textile and Screws images,
+ * in compression ratio and throughput, and decoding into pooled images
+ */
+
+#include "vidi.h"
+#include "../include/vidi_utils/lossless_codec.hpp"
+#include "../include/vidi_utils/png_encoder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// where the images are located
+const string resources_path("..\\resources\\images\\");
+
+// two frames of the Textile tutorial and the images of the Screws tutorial
+const char * image_list[] = { "000000.png", "bad000001.png", "good_001.png", "good_002.png", "good_003.png", "good_004.png" };
+
+/**
+ * @brief smooth shading with a weave and some sensor noise, for when the resources were not extracted
+ */
+void synthesize(const vidi_utils::image_view & view, mt19937 & rng)
+{
+    normal_distribution<double> noise(0.0, 2.0);
+    for (VIDI_UINT y = 0; y < view.height(); ++y)
+    {
+        unsigned char * row = view.row(y);
+        for (VIDI_UINT x = 0; x < view.width(); ++x)
+        {
+            double v = 96 + 48.0 * x / view.width() + 24 * sin(x * 0.2) * sin(y * 0.2) + noise(rng);
+            row[x] = static_cast<unsigned char>(min(255.0, max(0.0, v)));
+        }
+    }
+}
+
+/**
+ * @brief the 8-bit samples as a 12-bit camera would give them in a 16-bit image, with the noise of the lower bits
+ */
+void widen(const vidi_utils::image_view & src, const vidi_utils::image_view & dst, mt19937 & rng)
+{
+    for (VIDI_UINT y = 0; y < src.height(); ++y)
+    {
+        const unsigned char * s = src.row(y);
+        uint16_t * d = reinterpret_cast<uint16_t *>(dst.row(y));
+        for (size_t k = 0; k < src.width() * size_t(src.channels()); ++k)
+            d[k] = static_cast<uint16_t>(s[k] * 16 + rng() % 16);
+    }
+}
+
+bool same_pixels(const vidi_utils::image_view & a, const vidi_utils::image_view & b)
+{
+    if (a.width() != b.width() || a.height() != b.height() || a.row_size() != b.row_size())
+        return false;
+    for (VIDI_UINT y = 0; y < a.height(); ++y)
+    {
+        if (memcmp(a.row(y), b.row(y), a.row_size()) != 0)
+            return false;
+    }
+    return true;
+}
+
+template<class F>
+double time_ms(size_t n_iter, F f)
+{
+    auto start = chrono::steady_clock::now();
+    for (size_t iter = 0; iter < n_iter; ++iter)
+        f();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_iter;
+}
+
+void bench(const string & name, const vidi_utils::image_view & image, vidi_utils::image_pool & images,
+    vidi_utils::thread_pool & pool, size_t n_iter)
+{
+    double bytes = image.row_size() * double(image.height());
+    cout << name << " (" << image.width() << "x" << image.height() << "x" << image.channels()
+        << (image.channel_depth() == VIDI_IMG_16U ? ", 16 bits" : ", 8 bits") << ")" << endl;
+
+    // every level gives the same bytes; the rest of the benchmark uses the best one
+    vector<unsigned char> reference;
+    vidi_utils::encode_lossless(image, reference, 0, 64, vidi_utils::simd_scalar);
+    for (int level = vidi_utils::simd_scalar; level <= vidi_utils::best_simd_level(); ++level)
+    {
+        vidi_utils::simd_level l = static_cast<vidi_utils::simd_level>(level);
+        vector<unsigned char> encoded;
+        double encode_ms = time_ms(n_iter, [&] { vidi_utils::encode_lossless(image, encoded, 0, 64, l); });
+        vidi_utils::pooled_image decoded;
+        double decode_ms = time_ms(n_iter, [&] { decoded = vidi_utils::decode_lossless(encoded.data(), encoded.size(), images, 0, l); });
+        cout << "    lossless, " << vidi_utils::simd_level_name(l) << ": ratio " << bytes / encoded.size()
+            << ", encode " << bytes / encode_ms / 1e6 << " GB/s, decode " << bytes / decode_ms / 1e6 << " GB/s"
+            << (encoded == reference && decoded && same_pixels(decoded.view(), image) ? "" : " (MISMATCH)") << endl;
+    }
+
+    vector<unsigned char> encoded;
+    double encode_ms = time_ms(n_iter, [&] { vidi_utils::encode_lossless(image, encoded, &pool); });
+    vidi_utils::pooled_image decoded;
+    double decode_ms = time_ms(n_iter, [&] { decoded = vidi_utils::decode_lossless(encoded.data(), encoded.size(), images, &pool); });
+    cout << "    lossless, " << pool.size() << " threads: encode " << bytes / encode_ms / 1e6 << " GB/s, decode "
+        << bytes / decode_ms / 1e6 << " GB/s" << (decoded && same_pixels(decoded.view(), image) ? "" : " (MISMATCH)") << endl;
+
+    for (int level = vidi_utils::png_fastest; level <= vidi_utils::png_balanced; ++level)
+    {
+        vidi_utils::png_level l = static_cast<vidi_utils::png_level>(level);
+        vector<unsigned char> png;
+        double ms = time_ms(1, [&] { vidi_utils::encode_png(image, l, png); });
+        cout << "    png " << vidi_utils::png_level_name(l) << ": ratio " << bytes / png.size() << ", encode "
+            << bytes / ms / 1e6 << " GB/s" << endl;
+    }
+
+    VIDI_IMAGE img = image.image();
+    double ms = time_ms(1, [&] { vidi_save_image("lossless.png", &img); });
+    cout << "    vidi_save_image: " << bytes / ms / 1e6 << " GB/s" << endl;
+    remove("lossless.png");
+}
+
+/**
+ * @brief usage: example_cpp_lossless_codec [iterations]
+ */
+int main(int argc, char* argv[])
+{
+    size_t n_iter = argc > 1 ? max(1, atoi(argv[1])) : 5;
+
+    if (vidi_initialize(VIDI_GPU_MODE_NO_SUPPORT, "") != VIDI_SUCCESS)
+    {
+        cerr << "failed to initialize vidi" << endl;
+        return -1;
+    }
+
+    vidi_utils::image_pool images;
+    vidi_utils::thread_pool pool;
+    mt19937 rng(42);
+
+    VIDI_IMAGE img;
+    vidi_init_image(&img);
+    for (const char * file : image_list)
+    {
+        // images of other formats are saved as they are; the codec only takes 8 and 16 bits
+        vidi_utils::pooled_image frame;
+        if (vidi_load_image((resources_path + file).c_str(), &img) == VIDI_SUCCESS)
+        {
+            vidi_utils::image_view view(img);
+            frame = images.acquire(view.width(), view.height(), view.channels(), view.channel_depth());
+            if (frame)
+                view.copy_to(frame.view().data(), frame.view().step());
+        }
+        else
+        {
+            cerr << "failed to load '" << file << "', using a synthetic frame" << endl;
+            frame = images.acquire(2448, 2048, 1, VIDI_IMG_8U);
+            if (frame)
+                synthesize(frame.view(), rng);
+        }
+        if (!frame)
+            continue;
+        bench(file, frame.view(), images, pool, n_iter);
+
+        if (frame.view().channel_depth() == VIDI_IMG_8U)
+        {
+            vidi_utils::image_view view = frame.view();
+            vidi_utils::pooled_image wide = images.acquire(view.width(), view.height(), view.channels(), VIDI_IMG_16U);
+            if (wide)
+            {
+                widen(view, wide.view(), rng);
+                bench(string(file) + " as 12 bits", wide.view(), images, pool, n_iter);
+            }
+        }
+    }
+    vidi_free_image(&img);
+
+    vidi_deinitialize();
+    return 0;
+}
@@ -0,0 +1,136 @@
+/**
+ * @file example_cpp_mask_raster.cpp
+ * @brief Benchmark building region of interest masks with vidi_utils::mask_description against
+ * the per-pixel loop of DrawMaskBorder() in Example.Runtime.Parameters, and with vidi_utils::mask_cache
+ */
+
+#include "vidi.h"
+#include "../include/vidi_utils/mask_raster.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief the loop of DrawMaskBorder(), testing every pixel
+ *
+ * DrawMaskBorder() tests y > Height - border, leaving one row fewer at the bottom and right
+ * than at the top and left; the border here is `border` pixels wide on every side.
+ */
+void draw_border_per_pixel(vector<unsigned char> & data, int width, int height, int border)
+{
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            if (y < border || y >= height - border || x < border || x >= width - border)
+                data[y * width + x] = 1;
+            else
+                data[y * width + x] = 0;
+        }
+    }
+}
+
+/**
+ * @brief the border, a circle cleared in it and a polygon, testing every pixel center
+ */
+void draw_shapes_per_pixel(vector<unsigned char> & data, int width, int height, int border,
+    double cx, double cy, double r, const vector<vidi_utils::mask_point> & polygon)
+{
+    draw_border_per_pixel(data, width, height, border);
+    for (int y = 0; y < height; y++)
+    {
+        double py = y + 0.5;
+        for (int x = 0; x < width; x++)
+        {
+            double px = x + 0.5;
+            if (py >= cy - r && py < cy + r)
+            {
+                double half = sqrt(r * r - (py - cy) * (py - cy));
+                if (px >= cx - half && px < cx + half)
+                    data[y * width + x] = 0;
+            }
+
+            // even-odd: the number of edges crossing the row left of the pixel center
+            bool inside = false;
+            for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+            {
+                vidi_utils::mask_point top = polygon[i], bottom = polygon[j];
+                if (top.y > bottom.y)
+                    swap(top, bottom);
+                if (top.y <= py && py < bottom.y && px >= top.x + (py - top.y) * ((bottom.x - top.x) / (bottom.y - top.y)))
+                    inside = !inside;
+            }
+            if (inside)
+                data[y * width + x] = 2;
+        }
+    }
+}
+
+template<typename F>
+double time_ms(size_t n_runs, F f)
+{
+    auto start = chrono::steady_clock::now();
+    for (size_t k = 0; k < n_runs; ++k)
+        f();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_runs;
+}
+
+bool equal(const vector<unsigned char> & expected, const vidi_utils::mask_image & mask)
+{
+    vidi_utils::image_view view = mask.view();
+    return memcmp(expected.data(), view.data(), expected.size()) == 0;
+}
+
+/**
+ * @brief usage: example_cpp_mask_raster [width] [height] [runs]
+ */
+int main(int argc, char* argv[])
+{
+    int width = argc > 1 ? atoi(argv[1]) : 2048;
+    int height = argc > 2 ? atoi(argv[2]) : 1536;
+    size_t n_runs = argc > 3 ? atoi(argv[3]) : 20;
+    int border = 250;
+
+    vector<unsigned char> expected(static_cast<size_t>(width) * height);
+
+    // the border mask of Example.Runtime.Parameters
+    double per_pixel_ms = time_ms(n_runs, [&]() { draw_border_per_pixel(expected, width, height, border); });
+    vidi_utils::mask_description border_mask(width, height);
+    border_mask.border(border);
+    double spans_ms = time_ms(n_runs, [&]() { vidi_utils::mask_image mask(border_mask); });
+    vidi_utils::mask_cache cache;
+    double cached_ms = time_ms(n_runs, [&]() { cache.get(border_mask); });
+
+    cout << width << "x" << height << " border mask" << endl
+        << "per pixel: " << per_pixel_ms << " ms" << endl
+        << "spans    : " << spans_ms << " ms (" << per_pixel_ms / spans_ms << "x)"
+        << (equal(expected, vidi_utils::mask_image(border_mask)) ? "" : " (MISMATCH)") << endl
+        << "cached   : " << cached_ms * 1000 << " us (" << cache.hits() << " hits, " << cache.misses() << " misses)" << endl;
+
+    // a polygon and a hole, the mask a product variant would set
+    double cx = width / 2.0, cy = height / 2.0, r = height / 5.0;
+    vector<vidi_utils::mask_point> polygon;
+    for (int k = 0; k < 7; ++k)
+    {
+        double a = k * 2 * 3.14159265358979 * 3 / 7, pr = height / 2.5;
+        polygon.push_back(vidi_utils::mask_point(cx + pr * cos(a), cy + pr * sin(a)));
+    }
+    per_pixel_ms = time_ms(n_runs, [&]() { draw_shapes_per_pixel(expected, width, height, border, cx, cy, r, polygon); });
+    vidi_utils::mask_description shapes_mask(width, height);
+    shapes_mask.border(border).circle(cx, cy, r, 0).polygon(polygon, 2);
+    spans_ms = time_ms(n_runs, [&]() { vidi_utils::mask_image mask(shapes_mask); });
+
+    cout << "border, circle and star polygon" << endl
+        << "per pixel: " << per_pixel_ms << " ms" << endl
+        << "spans    : " << spans_ms << " ms (" << per_pixel_ms / spans_ms << "x)"
+        << (equal(expected, vidi_utils::mask_image(shapes_mask)) ? "" : " (MISMATCH)") << endl;
+
+    return 0;
+}
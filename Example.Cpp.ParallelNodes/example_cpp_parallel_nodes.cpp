@@ -0,0 +1,127 @@
+/**
+ * @file example_cpp_parallel_nodes.cpp
+ * @brief Example measuring how post-processing the views of a result scales with the number of threads
+ */
+
+#include "../include/rapidxml/rapidxml.hpp"
+#include "../include/rapidxml/rapidxml_iterators.hpp"
+#include "../include/vidi_utils/parallel_nodes.hpp"
+#include "../include/vidi_utils/thread_pool.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief builds a marking holding n_views views of n_features features each
+ */
+string make_marking_xml(size_t n_views, size_t n_features)
+{
+    ostringstream oss;
+    oss << "<marking>";
+    for (size_t v = 0; v < n_views; ++v)
+    {
+        oss << "<view index=\"" << v << "\">";
+        for (size_t f = 0; f < n_features; ++f)
+        {
+            oss << "<feature score=\"" << ((v * 31 + f * 17) % 1000) / 1000.0
+                << "\" x=\"" << (f * 13) % 512 << "\" y=\"" << (v * 7) % 512 << "\"/>";
+        }
+        oss << "</view><meta/>";
+    }
+    oss << "</marking>";
+    return oss.str();
+}
+
+/**
+ * @brief typical post-processing of one view: transform the coordinates of the features to the
+ * image frame and accumulate a distance-weighted score of the ones above the threshold
+ */
+double score_view(rapidxml::xml_node<> & view, double angle)
+{
+    const double threshold = 0.5;
+    const double c = cos(angle), s = sin(angle);
+    double score = 0;
+    for (auto & feature : rapidxml::children(&view, "feature"))
+    {
+        double p = atof(feature.first_attribute("score")->value());
+        if (p < threshold)
+            continue;
+        double x = atof(feature.first_attribute("x")->value());
+        double y = atof(feature.first_attribute("y")->value());
+        double u = c * x - s * y + 100.0, w = s * x + c * y - 50.0;
+        score += p * exp(-sqrt(u * u + w * w) / 512.0);
+    }
+    return score;
+}
+
+/**
+ * @brief usage: example_cpp_parallel_nodes [views] [features per view] [max threads] [iterations]
+ */
+int main(int argc, char* argv[])
+{
+    size_t n_views = argc > 1 ? atoi(argv[1]) : 4096;
+    size_t n_features = argc > 2 ? atoi(argv[2]) : 64;
+    size_t max_threads = argc > 3 ? max(1, atoi(argv[3])) : max(1u, thread::hardware_concurrency());
+    size_t n_iter = argc > 4 ? atoi(argv[4]) : 5;
+    double angle = 0.3;
+
+    string xml = make_marking_xml(n_views, n_features);
+    vector<char> text(xml.begin(), xml.end());
+    text.push_back(0);
+    rapidxml::xml_document<> doc;
+    doc.parse<0>(text.data());
+    rapidxml::xml_node<> * marking = doc.first_node("marking");
+
+    // the sibling list is walked once, the snapshot is reused by every run
+    vector<rapidxml::xml_node<> *> views;
+    auto start = chrono::steady_clock::now();
+    vidi_utils::snapshot_children(marking, "view", views);
+    double snapshot_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << views.size() << " views of " << n_features << " features, snapshot taken in " << snapshot_ms << " ms" << endl;
+
+    // single threaded reference
+    vector<double> reference(views.size());
+    start = chrono::steady_clock::now();
+    for (size_t iter = 0; iter < n_iter; ++iter)
+    {
+        for (size_t k = 0; k < views.size(); ++k)
+            reference[k] = score_view(*views[k], angle);
+    }
+    double sequential_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_iter;
+    cout << "sequential: " << sequential_ms << " ms" << endl;
+
+    // doubling the threads up to max_threads, which is run last whether or not it is a power of two
+    vector<size_t> thread_counts;
+    for (size_t n_threads = 1; n_threads < max_threads; n_threads *= 2)
+        thread_counts.push_back(n_threads);
+    thread_counts.push_back(max_threads);
+
+    for (size_t n_threads : thread_counts)
+    {
+        vidi_utils::thread_pool pool(n_threads);
+        vector<double> scores(views.size());
+
+        start = chrono::steady_clock::now();
+        for (size_t iter = 0; iter < n_iter; ++iter)
+        {
+            vidi_utils::parallel_for_each_node(pool, views, [&](size_t k, rapidxml::xml_node<> & view)
+            {
+                scores[k] = score_view(view, angle);
+            });
+        }
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_iter;
+
+        cout << n_threads << " thread(s): " << ms << " ms, speedup " << sequential_ms / ms
+            << (scores == reference ? "" : " (MISMATCH)") << endl;
+    }
+
+    return 0;
+}
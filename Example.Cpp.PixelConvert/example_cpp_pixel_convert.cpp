@@ -0,0 +1,212 @@
+/**
+ * @file example_cpp_pixel_convert.cpp
+ * @brief Example checking that the vectorized pixel conversions give the same bytes as the
+ * scalar ones, and measuring their throughput
+ */
+
+#include "vidi.h"
+#include "../include/vidi_utils/image_pool.hpp"
+#include "../include/vidi_utils/pixel_convert.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief fills the pixels of a view with random bytes
+ */
+void randomize(const vidi_utils::image_view & view, mt19937 & rng)
+{
+    for (VIDI_UINT y = 0; y < view.height(); ++y)
+    {
+        for (size_t k = 0; k < view.row_size(); ++k)
+            view.row(y)[k] = static_cast<unsigned char>(rng());
+    }
+}
+
+bool same_pixels(const vidi_utils::image_view & a, const vidi_utils::image_view & b)
+{
+    for (VIDI_UINT y = 0; y < a.height(); ++y)
+    {
+        if (memcmp(a.row(y), b.row(y), a.row_size()) != 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief runs a conversion at every level the processor supports, writing to out[level]
+ */
+void run(const char * name, double megapixels, size_t n_iter, const vector<vidi_utils::image_view> & out,
+    const function<bool(vidi_utils::simd_level)> & convert)
+{
+    cout << name << endl;
+    double scalar_ms = 0;
+    for (int level = vidi_utils::simd_scalar; level <= vidi_utils::best_simd_level(); ++level)
+    {
+        vidi_utils::simd_level l = static_cast<vidi_utils::simd_level>(level);
+        bool ok = convert(l);
+        auto start = chrono::steady_clock::now();
+        for (size_t iter = 0; iter < n_iter; ++iter)
+            convert(l);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_iter;
+        if (level == vidi_utils::simd_scalar)
+            scalar_ms = ms;
+
+        cout << "    " << vidi_utils::simd_level_name(l) << ": " << ms << " ms, " << megapixels / ms * 1e3 << " MP/s, "
+            << scalar_ms / ms << "x" << (!ok ? " (FAILED)" : same_pixels(out[level], out[0]) ? "" : " (MISMATCH)") << endl;
+    }
+}
+
+/**
+ * @brief splits and merges back images of 2 to 4 channels of 8 and 16 bits at every level,
+ * comparing the planes with the scalar ones and the merged image with the original
+ */
+void check_interleave(vidi_utils::image_pool & pool, VIDI_UINT width, VIDI_UINT height, mt19937 & rng)
+{
+    cout << "(de)interleave at every level:";
+    for (VIDI_UINT channels = 2; channels <= 4; ++channels)
+    {
+        for (VIDI_UINT depth : { VIDI_IMG_8U, VIDI_IMG_16U })
+        {
+            vidi_utils::pooled_image src = pool.acquire(width, height, channels, depth);
+            randomize(src.view(), rng);
+            vector<vidi_utils::pooled_image> images;
+            vector<vidi_utils::image_view> reference(channels);
+            bool ok = true;
+            for (int level = vidi_utils::simd_scalar; level <= vidi_utils::best_simd_level(); ++level)
+            {
+                vector<vidi_utils::image_view> planes(channels);
+                for (VIDI_UINT c = 0; c < channels; ++c)
+                {
+                    images.push_back(pool.acquire(width, height, 1, depth));
+                    planes[c] = images.back().view();
+                }
+                images.push_back(pool.acquire(width, height, channels, depth));
+                vidi_utils::image_view merged = images.back().view();
+
+                vidi_utils::simd_level l = static_cast<vidi_utils::simd_level>(level);
+                ok = ok && vidi_utils::deinterleave(src.view(), planes.data(), l) && vidi_utils::interleave(planes.data(), merged, l)
+                    && same_pixels(merged, src.view());
+                for (VIDI_UINT c = 0; c < channels; ++c)
+                {
+                    if (level == vidi_utils::simd_scalar)
+                        reference[c] = planes[c];
+                    ok = ok && same_pixels(planes[c], reference[c]);
+                }
+            }
+            cout << " " << channels << "x" << (depth == VIDI_IMG_8U ? "8U" : "16U") << (ok ? "" : " (MISMATCH)");
+        }
+    }
+    cout << endl;
+}
+
+/**
+ * @brief scales every 16-bit value with small and large max_value, checking that max_value
+ * gives 255, that the result never decreases and that every level agrees
+ */
+void check_scale(vidi_utils::image_pool & pool)
+{
+    vidi_utils::pooled_image all = pool.acquire(65536, 1, 1, VIDI_IMG_16U);
+    for (unsigned v = 0; v < 65536; ++v)
+        reinterpret_cast<uint16_t *>(all.view().row(0))[v] = static_cast<uint16_t>(v);
+
+    cout << "16U to 8U scale, max_value:";
+    for (unsigned max_value : { 1u, 2u, 3u, 100u, 254u, 255u, 256u, 257u, 1000u, 4095u, 65535u })
+    {
+        bool ok = true;
+        vector<vidi_utils::pooled_image> out;
+        for (int level = vidi_utils::simd_scalar; level <= vidi_utils::best_simd_level(); ++level)
+        {
+            out.push_back(pool.acquire(65536, 1, 1, VIDI_IMG_8U));
+            const unsigned char * d = out.back().view().row(0);
+            ok = ok && vidi_utils::convert_16u_to_8u_scale(all.view(), out.back().view(), max_value, static_cast<vidi_utils::simd_level>(level))
+                && d[0] == 0 && d[max_value] == 255 && same_pixels(out.back().view(), out.front().view());
+            for (unsigned v = 1; ok && v < 65536; ++v)
+                ok = d[v] >= d[v - 1];
+        }
+        cout << " " << max_value << (ok ? "" : " (MISMATCH)");
+    }
+    cout << endl;
+}
+
+/**
+ * @brief usage: example_cpp_pixel_convert [width] [height] [iterations]
+ */
+int main(int argc, char* argv[])
+{
+    // an odd width, so that every kernel also goes through its scalar tail
+    VIDI_UINT width = argc > 1 ? atoi(argv[1]) : 2447;
+    VIDI_UINT height = argc > 2 ? atoi(argv[2]) : 2048;
+    size_t n_iter = argc > 3 ? atoi(argv[3]) : 20;
+    double megapixels = width * double(height) / 1e6;
+
+    cout << "best instruction set: " << vidi_utils::simd_level_name(vidi_utils::best_simd_level()) << endl;
+
+    // the pool pads the rows, so the kernels work on steps larger than the rows
+    vidi_utils::image_pool pool;
+    mt19937 rng(42);
+    vidi_utils::pooled_image mono16 = pool.acquire(width, height, 1, VIDI_IMG_16U);
+    vidi_utils::pooled_image rgb = pool.acquire(width, height, 3, VIDI_IMG_8U);
+    randomize(mono16.view(), rng);
+    randomize(rgb.view(), rng);
+
+    vector<vidi_utils::pooled_image> gray, color, planes;
+    vector<vidi_utils::image_view> gray_views, color_views;
+    for (int level = vidi_utils::simd_scalar; level <= vidi_utils::simd_avx2; ++level)
+    {
+        gray.push_back(pool.acquire(width, height, 1, VIDI_IMG_8U));
+        color.push_back(pool.acquire(width, height, 3, VIDI_IMG_8U));
+        gray_views.push_back(gray.back().view());
+        color_views.push_back(color.back().view());
+    }
+    vidi_utils::image_view plane_views[3];
+    for (int c = 0; c < 3; ++c)
+    {
+        planes.push_back(pool.acquire(width, height, 1, VIDI_IMG_8U));
+        plane_views[c] = planes.back().view();
+    }
+
+    run("16U to 8U, shift 4", megapixels, n_iter, gray_views, [&](vidi_utils::simd_level l)
+    {
+        return vidi_utils::convert_16u_to_8u_shift(mono16.view(), gray_views[l], 4, l);
+    });
+    run("16U to 8U, scale [0, 4095]", megapixels, n_iter, gray_views, [&](vidi_utils::simd_level l)
+    {
+        return vidi_utils::convert_16u_to_8u_scale(mono16.view(), gray_views[l], 4095, l);
+    });
+    run("RGB to gray", megapixels, n_iter, gray_views, [&](vidi_utils::simd_level l)
+    {
+        return vidi_utils::rgb_to_gray(rgb.view(), gray_views[l], l);
+    });
+    run("BGR to gray", megapixels, n_iter, gray_views, [&](vidi_utils::simd_level l)
+    {
+        return vidi_utils::bgr_to_gray(rgb.view(), gray_views[l], l);
+    });
+    // the planes are the same for every level, the interleaved result is what is compared
+    run("deinterleave + interleave RGB", megapixels, n_iter, color_views, [&](vidi_utils::simd_level l)
+    {
+        return vidi_utils::deinterleave(rgb.view(), plane_views, l) && vidi_utils::interleave(plane_views, color_views[l], l);
+    });
+    cout << "round trip gives the original: " << (same_pixels(color_views[0], rgb.view()) ? "yes" : "NO") << endl;
+    check_interleave(pool, width, 16, rng);
+    check_scale(pool);
+
+    // copy between a padded view and a packed one
+    vector<unsigned char> packed(width * height * 3);
+    vidi_utils::image_view packed_view(packed.data(), width, height, 3, VIDI_IMG_8U);
+    auto start = chrono::steady_clock::now();
+    for (size_t iter = 0; iter < n_iter; ++iter)
+        vidi_utils::copy_pixels(rgb.view(), packed_view);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_iter;
+    cout << "step-padded copy: " << ms << " ms, " << megapixels / ms * 1e3 << " MP/s"
+        << (same_pixels(packed_view, rgb.view()) ? "" : " (MISMATCH)") << endl;
+
+    return 0;
+}
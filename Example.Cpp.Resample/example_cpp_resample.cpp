@@ -0,0 +1,177 @@
+/**
+ * @file example_cpp_resample.cpp
+ * @brief Example checking that the vectorized resampling kernels give the same bytes as the
+ * scalar ones, and measuring their throughput per megapixel of source, on one thread and on all
+ */
+
+#include "vidi.h"
+#include "../include/vidi_utils/image_pool.hpp"
+#include "../include/vidi_utils/resample.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief fills the pixels of a view with a smooth pattern plus noise, as a camera would
+ */
+void randomize(const vidi_utils::image_view & view, mt19937 & rng)
+{
+    for (VIDI_UINT y = 0; y < view.height(); ++y)
+    {
+        for (size_t k = 0; k < view.row_size(); ++k)
+            view.row(y)[k] = static_cast<unsigned char>(((k / 7 + y / 5) & 0xff) ^ (rng() & 0x0f));
+    }
+}
+
+bool same_pixels(const vidi_utils::image_view & a, const vidi_utils::image_view & b)
+{
+    for (VIDI_UINT y = 0; y < a.height(); ++y)
+    {
+        if (memcmp(a.row(y), b.row(y), a.row_size()) != 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief the straightforward loop: bilinear interpolation per pixel, in double, on 8-bit single channel images
+ */
+void naive_bilinear(const vidi_utils::image_view & src, const vidi_utils::image_view & dst)
+{
+    double sx = double(src.width()) / dst.width(), sy = double(src.height()) / dst.height();
+    for (VIDI_UINT y = 0; y < dst.height(); ++y)
+    {
+        double fy = min(max((y + 0.5) * sy - 0.5, 0.0), src.height() - 1.0);
+        VIDI_UINT y0 = VIDI_UINT(fy), y1 = min(y0 + 1, src.height() - 1);
+        for (VIDI_UINT x = 0; x < dst.width(); ++x)
+        {
+            double fx = min(max((x + 0.5) * sx - 0.5, 0.0), src.width() - 1.0);
+            VIDI_UINT x0 = VIDI_UINT(fx), x1 = min(x0 + 1, src.width() - 1);
+            double top = src.row(y0)[x0] * (1 - (fx - x0)) + src.row(y0)[x1] * (fx - x0);
+            double bottom = src.row(y1)[x0] * (1 - (fx - x0)) + src.row(y1)[x1] * (fx - x0);
+            dst.row(y)[x] = static_cast<unsigned char>(top * (1 - (fy - y0)) + bottom * (fy - y0) + 0.5);
+        }
+    }
+}
+
+double time_ms(size_t n_iter, const function<bool()> & f)
+{
+    f();
+    auto start = chrono::steady_clock::now();
+    for (size_t iter = 0; iter < n_iter; ++iter)
+        f();
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_iter;
+}
+
+/**
+ * @brief runs a kernel at every level the processor supports, then at the best one on all threads
+ */
+void run(const char * name, double megapixels, size_t n_iter, vidi_utils::thread_pool & pool,
+    const vector<vidi_utils::image_view> & out, const function<bool(vidi_utils::simd_level, vidi_utils::thread_pool *)> & kernel)
+{
+    cout << name << endl;
+    double scalar_ms = 0;
+    for (int level = vidi_utils::simd_scalar; level <= vidi_utils::best_simd_level(); ++level)
+    {
+        vidi_utils::simd_level l = static_cast<vidi_utils::simd_level>(level);
+        bool ok = true;
+        double ms = time_ms(n_iter, [&]() { return ok = kernel(l, 0) && ok; });
+        if (level == vidi_utils::simd_scalar)
+            scalar_ms = ms;
+        cout << "    " << vidi_utils::simd_level_name(l) << ": " << ms << " ms, " << megapixels / ms * 1e3 << " MP/s, "
+            << scalar_ms / ms << "x" << (!ok ? " (FAILED)" : same_pixels(out[level], out[0]) ? "" : " (MISMATCH)") << endl;
+    }
+    vidi_utils::simd_level best = vidi_utils::best_simd_level();
+    double ms = time_ms(n_iter, [&]() { return kernel(best, &pool); });
+    cout << "    " << vidi_utils::simd_level_name(best) << ", " << pool.size() << " threads: " << ms << " ms, "
+        << megapixels / ms * 1e3 << " MP/s" << (same_pixels(out[best], out[0]) ? "" : " (MISMATCH)") << endl;
+}
+
+/**
+ * @brief usage: example_cpp_resample [width] [height] [iterations]
+ */
+int main(int argc, char* argv[])
+{
+    // odd sizes, so that every kernel also goes through its scalar tail
+    VIDI_UINT width = argc > 1 ? atoi(argv[1]) : 4095;
+    VIDI_UINT height = argc > 2 ? atoi(argv[2]) : 3001;
+    size_t n_iter = argc > 3 ? atoi(argv[3]) : 10;
+    double megapixels = width * double(height) / 1e6;
+    // the canonical scale the frames are brought to
+    VIDI_UINT scaled_width = width * 3 / 8, scaled_height = height * 3 / 8;
+
+    cout << "best instruction set: " << vidi_utils::simd_level_name(vidi_utils::best_simd_level()) << endl
+        << width << "x" << height << " to " << scaled_width << "x" << scaled_height << endl;
+
+    vidi_utils::image_pool images;
+    vidi_utils::thread_pool pool;
+    mt19937 rng(42);
+    vidi_utils::pooled_image mono = images.acquire(width, height, 1, VIDI_IMG_8U);
+    vidi_utils::pooled_image mono16 = images.acquire(width, height, 1, VIDI_IMG_16U);
+    vidi_utils::pooled_image rgb = images.acquire(width, height, 3, VIDI_IMG_8U);
+    randomize(mono.view(), rng);
+    randomize(mono16.view(), rng);
+    randomize(rgb.view(), rng);
+
+    vector<vidi_utils::pooled_image> buffers;
+    vector<vidi_utils::image_view> scaled, scaled16, scaled_rgb, halves;
+    for (int level = vidi_utils::simd_scalar; level <= vidi_utils::simd_avx2; ++level)
+    {
+        buffers.push_back(images.acquire(scaled_width, scaled_height, 1, VIDI_IMG_8U));
+        scaled.push_back(buffers.back().view());
+        buffers.push_back(images.acquire(scaled_width, scaled_height, 1, VIDI_IMG_16U));
+        scaled16.push_back(buffers.back().view());
+        buffers.push_back(images.acquire(scaled_width, scaled_height, 3, VIDI_IMG_8U));
+        scaled_rgb.push_back(buffers.back().view());
+        buffers.push_back(images.acquire(width / 2, height / 2, 1, VIDI_IMG_8U));
+        halves.push_back(buffers.back().view());
+    }
+
+    vidi_utils::pooled_image naive = images.acquire(scaled_width, scaled_height, 1, VIDI_IMG_8U);
+    double naive_ms = time_ms(n_iter, [&]() { naive_bilinear(mono.view(), naive.view()); return true; });
+    cout << "naive bilinear, 8U: " << naive_ms << " ms, " << megapixels / naive_ms * 1e3 << " MP/s" << endl;
+
+    run("bilinear, 8U", megapixels, n_iter, pool, scaled, [&](vidi_utils::simd_level l, vidi_utils::thread_pool * p)
+    {
+        return vidi_utils::resize(mono.view(), scaled[l], vidi_utils::resample_bilinear, p, l);
+    });
+    run("area, 8U", megapixels, n_iter, pool, scaled, [&](vidi_utils::simd_level l, vidi_utils::thread_pool * p)
+    {
+        return vidi_utils::resize(mono.view(), scaled[l], vidi_utils::resample_area, p, l);
+    });
+    run("area, 16U", megapixels, n_iter, pool, scaled16, [&](vidi_utils::simd_level l, vidi_utils::thread_pool * p)
+    {
+        return vidi_utils::resize(mono16.view(), scaled16[l], vidi_utils::resample_area, p, l);
+    });
+    run("bilinear, 8U RGB", megapixels, n_iter, pool, scaled_rgb, [&](vidi_utils::simd_level l, vidi_utils::thread_pool * p)
+    {
+        return vidi_utils::resize(rgb.view(), scaled_rgb[l], vidi_utils::resample_bilinear, p, l);
+    });
+    run("2x2 average, 8U", megapixels, n_iter, pool, halves, [&](vidi_utils::simd_level l, vidi_utils::thread_pool * p)
+    {
+        return vidi_utils::downscale_2x(mono.view(), halves[l], p, l);
+    });
+
+    // area and 2x2 average agree on a factor of exactly 2
+    vidi_utils::image_view even = mono.view().crop(0, 0, width / 2 * 2, height / 2 * 2);
+    vidi_utils::resize(even, halves[0], vidi_utils::resample_area);
+    vidi_utils::downscale_2x(even, halves[1]);
+    cout << "area at 1/2 equals 2x2 average: " << (same_pixels(halves[0], halves[1]) ? "yes" : "NO") << endl;
+
+    vidi_utils::image_pyramid pyramid;
+    double ms = time_ms(n_iter, [&]() { return pyramid.build(mono.view(), 5, &pool); });
+    cout << "pyramid of " << pyramid.size() << " levels, down to " << pyramid.level(pyramid.size() - 1).width() << "x"
+        << pyramid.level(pyramid.size() - 1).height() << ": " << ms << " ms, " << megapixels / ms * 1e3 << " MP/s" << endl;
+
+    return 0;
+}
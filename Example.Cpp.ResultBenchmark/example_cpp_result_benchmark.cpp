@@ -0,0 +1,125 @@
+/**
+ * @file example_cpp_result_benchmark.cpp
+ * @brief Microbenchmark comparing raw status checks with vidi_utils::result chains on the success path
+ *
+ * The library is not called: each step is an out-of-line function returning a status read from
+ * a volatile variable, so that only the cost of the error handling itself is measured.
+ */
+
+#include "vidi.h"
+#include "../include/vidi_utils/result.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+using namespace std;
+
+volatile VIDI_UINT step_status = VIDI_SUCCESS;
+
+#if defined(_MSC_VER)
+    #define NOINLINE __declspec(noinline)
+#else
+    #define NOINLINE __attribute__((noinline))
+#endif
+
+NOINLINE VIDI_UINT step(int) { return step_status; }
+
+/**
+ * @brief five steps checked the way the examples used to do it
+ */
+NOINLINE int raw_sequence()
+{
+    VIDI_UINT status = step(0);
+    if (status != VIDI_SUCCESS)
+        return -1;
+    status = step(1);
+    if (status != VIDI_SUCCESS)
+        return -1;
+    status = step(2);
+    if (status != VIDI_SUCCESS)
+        return -1;
+    status = step(3);
+    if (status != VIDI_SUCCESS)
+        return -1;
+    status = step(4);
+    if (status != VIDI_SUCCESS)
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief the same five steps as a result chain
+ */
+NOINLINE int result_sequence()
+{
+    using vidi_utils::check;
+    auto r = check(step(0), "step 0")
+        .and_then([] { return check(step(1), "step 1"); })
+        .and_then([] { return check(step(2), "step 2"); })
+        .and_then([] { return check(step(3), "step 3"); })
+        .and_then([] { return check(step(4), "step 4"); });
+    return r ? 0 : -1;
+}
+
+/**
+ * @brief a chain carrying a value from step to step
+ */
+NOINLINE int value_sequence()
+{
+    using vidi_utils::check;
+    auto r = check(step(0), "step 0")
+        .map([] { return 1; })
+        .and_then([](int & v) { return check(step(1), "step 1").map([&] { return v + 1; }); })
+        .and_then([](int & v) { return check(step(2), "step 2").map([&] { return v + 1; }); })
+        .and_then([](int & v) { return check(step(3), "step 3").map([&] { return v + 1; }); })
+        .and_then([](int & v) { return check(step(4), "step 4").map([&] { return v + 1; }); });
+    return r ? r.value() - 5 : -1;
+}
+
+template<class F>
+double time_ns(F f, size_t n_iter)
+{
+    int sum = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t iter = 0; iter < n_iter; ++iter)
+    {
+        sum += f();
+    }
+    double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    if (sum != 0)
+        cerr << "unexpected failure" << endl;
+    return ns / n_iter;
+}
+
+/**
+ * @brief usage: example_cpp_result_benchmark [iterations]
+ */
+int main(int argc, char* argv[])
+{
+    size_t n_iter = argc > 1 ? atoi(argv[1]) : 20000000;
+
+    cout << "sizeof(result<void>) = " << sizeof(vidi_utils::result<void>)
+        << ", sizeof(result<int>) = " << sizeof(vidi_utils::result<int>) << endl;
+
+    // run each twice, the first round warms up
+    for (int round = 0; round < 2; ++round)
+    {
+        double raw = time_ns(raw_sequence, n_iter);
+        double chained = time_ns(result_sequence, n_iter);
+        double valued = time_ns(value_sequence, n_iter);
+        if (round == 1)
+        {
+            cout << "raw status checks : " << raw << " ns per 5 steps" << endl;
+            cout << "result<void> chain: " << chained << " ns per 5 steps" << endl;
+            cout << "result<int> chain : " << valued << " ns per 5 steps" << endl;
+        }
+    }
+
+    // the failure path: the chain stops at the first failing step and keeps its context
+    step_status = 3;
+    auto failed = vidi_utils::check(step(0), "step 0").and_then([] { return vidi_utils::check(step(1), "step 1"); });
+    cout << "failure carried to the end of the chain: status " << failed.error().status() << " from '" << failed.error().context() << "'" << endl;
+
+    return 0;
+}
@@ -0,0 +1,143 @@
+/**
+ * @file example_cpp_result_cache.cpp
+ * @brief Example processing a sequence of frames with repeats through vidi_utils::result_cache,
+ * and measuring the speed of the content hash
+ */
+
+#include "vidi_runtime.h"
+#include "../include/vidi_utils/image_pool.hpp"
+#include "../include/vidi_utils/result_cache.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+namespace runtime = vidi_utils::runtime;
+
+void randomize(const vidi_utils::image_view & view, mt19937 & rng)
+{
+    for (VIDI_UINT y = 0; y < view.height(); ++y)
+    {
+        for (size_t k = 0; k < view.row_size(); ++k)
+            view.row(y)[k] = static_cast<unsigned char>(rng());
+    }
+}
+
+/**
+ * @brief hashes a frame at every level the processor supports, and in pieces of odd sizes
+ */
+void bench_hash(const vidi_utils::image_view & frame, size_t n_iter)
+{
+    double mb = frame.row_size() * double(frame.height()) / (1 << 20);
+    uint64_t reference = vidi_utils::hash_pixels(frame, vidi_utils::simd_scalar);
+    cout << "content hash of a " << frame.width() << "x" << frame.height() << " frame" << endl;
+    for (int level = vidi_utils::simd_scalar; level <= vidi_utils::best_simd_level(); ++level)
+    {
+        vidi_utils::simd_level l = static_cast<vidi_utils::simd_level>(level);
+        uint64_t h = 0;
+        auto start = chrono::steady_clock::now();
+        for (size_t iter = 0; iter < n_iter; ++iter)
+            h = vidi_utils::hash_pixels(frame, l);
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_iter;
+        cout << "    " << vidi_utils::simd_level_name(l) << ": " << ms << " ms, " << mb / ms << " GB/s"
+            << (h == reference ? "" : " (MISMATCH)") << endl;
+    }
+
+    vidi_utils::content_hasher pieces;
+    VIDI_UINT header[4] = { frame.width(), frame.height(), frame.channels(), frame.channel_depth() };
+    pieces.update(header, sizeof(header));
+    for (VIDI_UINT y = 0; y < frame.height(); ++y)
+    {
+        pieces.update(frame.row(y), 37);
+        pieces.update(frame.row(y) + 37, frame.row_size() - 37);
+    }
+    cout << "    hashed in pieces: " << (pieces.digest() == reference ? "same" : "DIFFERENT") << endl;
+
+    frame.row(frame.height() / 2)[frame.row_size() / 2] ^= 1;
+    cout << "    one bit flipped: " << (vidi_utils::hash_pixels(frame) != reference ? "different" : "SAME") << endl;
+    frame.row(frame.height() / 2)[frame.row_size() / 2] ^= 1;
+}
+
+/**
+ * @brief usage: example_cpp_result_cache [frames] [distinct frames]
+ *
+ * the frames are drawn at random among the distinct ones, as re-sends and re-inspections would
+ */
+int main(int argc, char* argv[])
+{
+    size_t n_frames = argc > 1 ? atoi(argv[1]) : 500;
+    size_t n_distinct = argc > 2 ? atoi(argv[2]) : 50;
+
+    auto initialized = runtime::initialize(VIDI_GPU_SINGLE_DEVICE_PER_TOOL, "")
+        .and_then([] { return runtime::open_workspace_from_file("workspace", "..\\resources\\runtime\\Textile.vrws"); });
+    if (!initialized)
+    {
+        clog << initialized.error() << endl;
+        vidi_deinitialize();
+        return -1;
+    }
+
+    vidi_utils::image_pool pool;
+    mt19937 rng(42);
+    vector<vidi_utils::pooled_image> frames;
+    for (size_t k = 0; k < n_distinct; ++k)
+    {
+        frames.push_back(pool.acquire(2448, 2048, 1, VIDI_IMG_8U));
+        randomize(frames.back().view(), rng);
+    }
+    bench_hash(frames[0].view(), 20);
+
+    vector<size_t> sequence;
+    for (size_t k = 0; k < n_frames; ++k)
+        sequence.push_back(rng() % n_distinct);
+
+    // every frame processed
+    VIDI_BUFFER buffer;
+    vidi_init_buffer(&buffer);
+    auto start = chrono::steady_clock::now();
+    for (size_t k : sequence)
+    {
+        VIDI_IMAGE * image = frames[k].get();
+        auto processed = runtime::create_sample("workspace", "default", "my_sample")
+            .and_then([&] { return runtime::sample_add_image("workspace", "default", "my_sample", image); })
+            .and_then([] { return runtime::sample_process("workspace", "default", "analyze", "my_sample", ""); })
+            .and_then([&] { return runtime::get_sample("workspace", "default", "my_sample", &buffer); })
+            .and_then([] { return runtime::free_sample("workspace", "default", "my_sample"); });
+        if (!processed)
+        {
+            clog << processed.error() << endl;
+            break;
+        }
+    }
+    vidi_free_buffer(&buffer);
+    double uncached_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_frames;
+
+    // the same sequence through the cache
+    vidi_utils::result_cache cache;
+    string xml;
+    start = chrono::steady_clock::now();
+    for (size_t k : sequence)
+    {
+        VIDI_IMAGE * image = frames[k].get();
+        auto processed = cache.process("workspace", "default", "analyze", "my_sample", "", image, xml);
+        if (!processed)
+        {
+            clog << processed.error() << endl;
+            break;
+        }
+    }
+    double cached_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() / n_frames;
+
+    cout << n_frames << " frames, " << n_distinct << " distinct" << endl
+        << "processed: " << uncached_ms << " ms per frame" << endl
+        << "cached   : " << cached_ms << " ms per frame (" << uncached_ms / cached_ms << "x)" << endl;
+    cache.report(cout);
+
+    vidi_deinitialize();
+    return 0;
+}
@@ -1,107 +1,374 @@
 /**
  * @file example_runtime.cpp
- * @brief Example demonstrating how to process a sample
+ * @brief Example demonstrating how to process a sample, or a whole batch of images with several workers
  */
 
 #include "vidi_runtime.h"
+#include "../include/vidi_utils/buffer_view.hpp"
+#include "../include/vidi_utils/runtime.hpp"
+#include "../include/vidi_utils/sample_pool.hpp"
 
-#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+    #include <windows.h>
+#else
+    #include <dirent.h>
+    #include <sys/stat.h>
+#endif
 
 using namespace std;
 
+namespace runtime = vidi_utils::runtime;
+
+bool is_image_name(const string & name)
+{
+    string::size_type dot = name.rfind('.');
+    if (dot == string::npos)
+        return false;
+    string ext = name.substr(dot + 1);
+    transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return static_cast<char>(tolower(static_cast<unsigned char>(c))); });
+    return ext == "png" || ext == "bmp" || ext == "tif" || ext == "tiff" || ext == "jpg" || ext == "jpeg";
+}
+
 /**
- * @brief demonstrate the API for processing a sample in a given workspace
- *
- * this example uses the API that's new to 3.0.0. This breaks the process
- * step into many smaller steps. 
+ * @brief appends the images of a folder sorted by name, the lines of a .txt file list, or the path itself
  */
-int main()
+void list_images(const string & path, vector<string> & paths)
 {
-    // send debug info to a message file
-    VIDI_UINT status = vidi_debug_infos(VIDI_DEBUG_SINK_FILE, "vidi_messages.log");
-    if (status != VIDI_SUCCESS)
+    if (path.size() > 4 && path.compare(path.size() - 4, 4, ".txt") == 0)
     {
-        std::cerr << "failed to enable debug infos" << endl;
-        return -1;
+        ifstream list(path.c_str());
+        string line;
+        while (getline(list, line))
+        {
+            line.erase(line.find_last_not_of(" \t\r") + 1);
+            if (!line.empty())
+                paths.push_back(line);
+        }
+        return;
     }
 
-    // initialize the libary to run with one GPU per tool
-    status = vidi_initialize(VIDI_GPU_SINGLE_DEVICE_PER_TOOL, "");
-    if (status != VIDI_SUCCESS)
+    vector<string> names;
+#if defined(_WIN32)
+    DWORD attributes = GetFileAttributesA(path.c_str());
+    if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY))
     {
-        clog << "failed to initialize library" << endl;
-        return -1;
+        paths.push_back(path);
+        return;
+    }
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((path + "\\*").c_str(), &data);
+    if (find != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && is_image_name(data.cFileName))
+                names.push_back(path + "\\" + data.cFileName);
+        } while (FindNextFileA(find, &data));
+        FindClose(find);
+    }
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+    {
+        paths.push_back(path);
+        return;
+    }
+    if (DIR * dir = opendir(path.c_str()))
+    {
+        while (dirent * entry = readdir(dir))
+        {
+            if (is_image_name(entry->d_name))
+                names.push_back(path + "/" + entry->d_name);
+        }
+        closedir(dir);
     }
+#endif
+    sort(names.begin(), names.end());
+    paths.insert(paths.end(), names.begin(), names.end());
+}
 
-    // create and initialize a buffer to be used whenever data is returned from the library
-    VIDI_BUFFER buffer;
-    status = vidi_init_buffer(&buffer);
-    if (status != VIDI_SUCCESS)
+struct batch_options
+{
+    batch_options()
+        : n_workers(2)
     {
-        clog << "failed to initialize vidi buffer" << endl;
-        return -1;
     }
 
-    // open the given workspace
-    status = vidi_runtime_open_workspace_from_file("workspace", "..\\resources\\runtime\\Textile.vrws");
-    if (status != VIDI_SUCCESS)
+    string workspace_file;
+    string stream;
+    string tool;
+    vector<string> images;
+    size_t n_workers;
+    string combined;            ///< the file collecting every result, empty for one "<image>.xml" per image
+};
+
+/**
+ * @brief what a worker did with one image
+ */
+struct batch_item
+{
+    batch_item()
+        : ok(false)
+        , ms(0.0)
     {
-        vidi_get_error_message(status, &buffer);
-        // if you get this error, it's possible that the resources were not extracted in the path
-        clog << "failed to open workspace: " << buffer.data << endl;
+    }
+
+    bool ok;
+    double ms;                  ///< from loading the image to its results being written
+    string xml;                 ///< the results, kept only for the combined file
+};
+
+typedef chrono::steady_clock clock_type;
+
+/**
+ * @brief takes the next image of the list until there is none left, processing each in the sample of the worker
+ */
+void batch_worker(const batch_options & options, vidi_utils::sample_pool & samples, size_t worker,
+    atomic<size_t> & next, vector<batch_item> & items)
+{
+    VIDI_IMAGE image;
+    VIDI_BUFFER result_buffer;
+    vidi_init_image(&image);
+    vidi_init_buffer(&result_buffer);
+
+    for (size_t k = next++; k < options.images.size(); k = next++)
+    {
+        const string & path = options.images[k];
+        batch_item & item = items[k];
+        auto start = clock_type::now();
+
+        vidi_utils::sample_handle sample = samples.acquire(worker);
+        auto processed = runtime::load_image(path.c_str(), &image)
+            .and_then([&] { return sample.add_image(&image); })
+            .and_then([&] { return sample.process(options.tool.c_str()); })
+            .and_then([&] { return sample.get_sample(&result_buffer); });
+        sample.release();
+
+        if (!processed)
+        {
+            clog << path << ": " << processed.error() << endl;
+        }
+        else
+        {
+            vidi_utils::buffer_view view(result_buffer);
+            if (options.combined.empty())
+            {
+                string output = path + ".xml";
+                item.ok = view.write_file(output.c_str());
+                if (!item.ok)
+                    clog << "failed to write '" << output << "'" << endl;
+            }
+            else
+            {
+                item.xml.assign(view.data(), view.size());
+                item.ok = true;
+            }
+        }
+        item.ms = chrono::duration<double, milli>(clock_type::now() - start).count();
+    }
+
+    vidi_free_buffer(&result_buffer);
+    vidi_free_image(&image);
+}
+
+/**
+ * @brief the text with the characters that cannot appear in a quoted XML attribute replaced by entities
+ */
+string escape_attribute(const string & text)
+{
+    string escaped;
+    escaped.reserve(text.size());
+    for (char c : text)
+    {
+        switch (c)
+        {
+        case '&': escaped += "&amp;"; break;
+        case '<': escaped += "&lt;"; break;
+        case '>': escaped += "&gt;"; break;
+        case '"': escaped += "&quot;"; break;
+        default: escaped += c; break;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * @brief the result without its leading <?xml ...?> declaration, which may only start a document
+ */
+string without_declaration(const string & xml)
+{
+    string::size_type start = xml.find_first_not_of(" \t\r\n");
+    if (start == string::npos || xml.compare(start, 5, "<?xml") != 0)
+        return xml;
+    string::size_type end = xml.find("?>", start);
+    if (end == string::npos)
+        return xml;
+    start = xml.find_first_not_of(" \t\r\n", end + 2);
+    return start == string::npos ? string() : xml.substr(start);
+}
+
+/**
+ * @brief processes every image with n_workers threads against the one workspace, then prints throughput and latencies
+ */
+int run_batch(const batch_options & options)
+{
+    auto initialized = runtime::debug_infos(VIDI_DEBUG_SINK_FILE, "vidi_messages.log")
+        .and_then([] { return runtime::initialize(VIDI_GPU_SINGLE_DEVICE_PER_TOOL, ""); })
+        .and_then([&] { return runtime::open_workspace_from_file("workspace", options.workspace_file.c_str()); });
+    if (!initialized)
+    {
+        clog << initialized.error() << endl;
         vidi_deinitialize();
         return -1;
     }
 
+    vector<batch_item> items(options.images.size());
+    double seconds = 0;
     {
-        VIDI_IMAGE image;
-        status = vidi_init_image(&image);
-        if (status != VIDI_SUCCESS)
+        // one sample name per worker; the samples are created and freed for every image, see sample_pool.hpp
+        vidi_utils::sample_pool_options pool_options;
+        pool_options.slots_per_worker = 1;
+        vidi_utils::sample_pool samples("workspace", options.stream, options.n_workers, pool_options);
+        auto created = samples.create();
+        if (!created)
         {
-            vidi_get_error_message(status, &buffer);
-            clog << "failed to initialize image: " << buffer.data << endl;
+            clog << created.error() << endl;
             vidi_deinitialize();
             return -1;
         }
-        status = vidi_load_image("..\\resources\\images\\bad000001.png", &image);
-        if (status != VIDI_SUCCESS)
+
+        atomic<size_t> next(0);
+        auto start = clock_type::now();
+        vector<thread> workers;
+        for (size_t w = 0; w < options.n_workers; ++w)
+            workers.emplace_back(batch_worker, cref(options), ref(samples), w, ref(next), ref(items));
+        for (auto & worker : workers)
+            worker.join();
+        seconds = chrono::duration<double>(clock_type::now() - start).count();
+    }
+
+    if (!options.combined.empty())
+    {
+        // in the order of the list, whichever worker finished first
+        ofstream out(options.combined.c_str(), ios::binary);
+        out << "<results>\n";
+        for (size_t k = 0; k < items.size(); ++k)
         {
-            vidi_get_error_message(status, &buffer);
-            // if you get this error, it's possible that the resources were not extracted in the path
-            clog << "failed to read image: " << buffer.data << endl;
-            vidi_deinitialize();
-            return -1;
+            if (items[k].ok)
+                out << "<result image=\"" << escape_attribute(options.images[k]) << "\">\n" << without_declaration(items[k].xml) << "\n</result>\n";
         }
+        out << "</results>\n";
+        if (!out)
+            clog << "failed to write '" << options.combined << "'" << endl;
+    }
+
+    vector<double> latencies;
+    for (auto & item : items)
+    {
+        if (item.ok)
+            latencies.push_back(item.ms);
+    }
+    sort(latencies.begin(), latencies.end());
+    double mean = 0;
+    for (double ms : latencies)
+        mean += ms;
+    mean = latencies.empty() ? 0 : mean / latencies.size();
+    auto percentile = [&](double p) { return latencies.empty() ? 0 : latencies[static_cast<size_t>(p * (latencies.size() - 1))]; };
 
-        VIDI_BUFFER result_buffer;
-        status = vidi_init_buffer(&result_buffer);
-        if (status != VIDI_SUCCESS)
+    cout << items.size() << " images, " << items.size() - latencies.size() << " failed, with " << options.n_workers << " workers in "
+        << seconds << " s: " << (seconds > 0 ? latencies.size() / seconds : 0) << " images/s" << endl;
+    cout << "latency " << mean << " ms on average, " << percentile(0.5) << " ms median, " << percentile(0.95) << " ms at 95%, "
+        << percentile(0.99) << " ms at 99%, " << percentile(1.0) << " ms at worst" << endl;
+
+    vidi_deinitialize();
+    return latencies.size() == items.size() ? 0 : -1;
+}
+
+/**
+ * @brief demonstrate the API for processing a sample in a given workspace
+ *
+ * this example uses the API that's new to 3.0.0. This breaks the process
+ * step into many smaller steps.
+ *
+ * every step returns a vidi_utils::result; steps are chained with and_then() and the
+ * chain stops at the first one that fails, whose error is printed once at the end.
+ *
+ * usage: example_runtime
+ *        example_runtime <workspace file> <stream> <tool> <folder, image or .txt list>... [-w workers] [-o combined file]
+ *
+ * without arguments, processes the one example image; with them, processes every image given
+ * with several workers, writing the results of each image to "<image>.xml" or all of them to
+ * the combined file, one <result image="..."> element each, and prints the throughput and
+ * the latencies.
+ */
+int main(int argc, char* argv[])
+{
+    if (argc > 1)
+    {
+        batch_options options;
+        vector<string> positional;
+        for (int k = 1; k < argc; ++k)
         {
-            clog << "failed to initialize result buffer" << endl;
-            vidi_deinitialize();
+            if (strcmp(argv[k], "-w") == 0 && k + 1 < argc)
+                options.n_workers = max(1, atoi(argv[++k]));
+            else if (strcmp(argv[k], "-o") == 0 && k + 1 < argc)
+                options.combined = argv[++k];
+            else
+                positional.push_back(argv[k]);
+        }
+        if (positional.size() < 4)
+        {
+            clog << "usage: example_runtime <workspace file> <stream> <tool> <folder, image or .txt list>... [-w workers] [-o combined file]" << endl;
             return -1;
         }
-
-        // as of ViDi Suite 3.0.0, samples are processed in a few steps instead of just calling vidi_runtime_process
-        // the first step is to initialize the sample
-        status = vidi_runtime_create_sample("workspace", "default", "my_sample");
-        if (status != VIDI_SUCCESS)
+        options.workspace_file = positional[0];
+        options.stream = positional[1];
+        options.tool = positional[2];
+        for (size_t k = 3; k < positional.size(); ++k)
+            list_images(positional[k], options.images);
+        if (options.images.empty())
         {
-            clog << "failed to initialize sample" << endl;
-            vidi_deinitialize();
+            clog << "no images to process" << endl;
             return -1;
         }
+        return run_batch(options);
+    }
+
+    // send debug info to a message file and initialize the libary to run with one GPU per tool
+    auto initialized = runtime::debug_infos(VIDI_DEBUG_SINK_FILE, "vidi_messages.log")
+        .and_then([] { return runtime::initialize(VIDI_GPU_SINGLE_DEVICE_PER_TOOL, ""); });
+    if (!initialized)
+    {
+        clog << initialized.error() << endl;
+        return -1;
+    }
 
-		// then add the image to be processed
-		status = vidi_runtime_sample_add_image("workspace", "default", "my_sample", &image);
-		if (status != VIDI_SUCCESS)
-		{
-			clog << "failed to add image" << endl;
-			vidi_deinitialize();
-			return -1;
-		}
+    VIDI_IMAGE image;
+    VIDI_BUFFER result_buffer;
 
+    // if opening the workspace or reading the image fails, it's possible that the resources were not extracted in the path
+    auto processed = runtime::open_workspace_from_file("workspace", "..\\resources\\runtime\\Textile.vrws")
+        .and_then([&] { return runtime::init_image(&image); })
+        .and_then([&] { return runtime::load_image("..\\resources\\images\\bad000001.png", &image); })
+        // create a buffer to be used when the results are returned from the library
+        .and_then([&] { return runtime::init_buffer(&result_buffer); })
+        // as of ViDi Suite 3.0.0, samples are processed in a few steps instead of just calling vidi_runtime_process
+        // the first step is to initialize the sample
+        .and_then([] { return runtime::create_sample("workspace", "default", "my_sample"); })
+        // then add the image to be processed
+        .and_then([&] { return runtime::sample_add_image("workspace", "default", "my_sample", &image); })
         /**
          * subsequently process the sample for each tool
          * here, we know that the tool that's being processed is called "analyze". If you do not know the name of the
@@ -109,39 +376,33 @@ int main()
          * this is called only once. You can also trigger the whole chain to process by calling
          * vidi_runtime_process_sample for the last tool in the chain.
          */
-        status = vidi_runtime_sample_process("workspace", "default", "analyze", "my_sample", "");
-        if (status != VIDI_SUCCESS)
-        {
-            vidi_get_error_message(status, &buffer);
-            clog << "failed to process sample: " << buffer.data << endl;
-            vidi_deinitialize();
-            return -1;
-        }
-
+        .and_then([] { return runtime::sample_process("workspace", "default", "analyze", "my_sample", ""); })
         // the next step is to get the results
-        status = vidi_runtime_get_sample("workspace", "default", "my_sample", &result_buffer);
-        if (status != VIDI_SUCCESS)
-        {
-            clog << "failed to get results from sample" << endl;
-            vidi_deinitialize();
-            return -1;
-        }
+        .and_then([&] { return runtime::get_sample("workspace", "default", "my_sample", &result_buffer); });
+    if (!processed)
+    {
+        clog << processed.error() << endl;
+        vidi_deinitialize();
+        return -1;
+    }
 
-        clog << "writing result to 'result.xml'" << endl;
-        ofstream ofs("result.xml");
-        ofs << result_buffer.data;
-
-        vidi_free_buffer(&result_buffer);
-        vidi_free_image(&image);
-
-		// now that we've gotten the results, we can free the sample
-		status = vidi_runtime_free_sample("workspace", "default", "my_sample");
-		if (status != VIDI_SUCCESS)
-		{
-			clog << "failed to free sample" << endl;
-			vidi_deinitialize();
-			return -1;
-		}
+    clog << "writing result to 'result.xml'" << endl;
+    // the result is written straight from the buffer, without an intermediate copy
+    if (!vidi_utils::buffer_view(result_buffer).write_file("result.xml"))
+    {
+        clog << "failed to write 'result.xml'" << endl;
+    }
+
+    vidi_free_buffer(&result_buffer);
+    vidi_free_image(&image);
+
+    // now that we've gotten the results, we can free the sample
+    auto freed = runtime::free_sample("workspace", "default", "my_sample");
+    if (!freed)
+    {
+        clog << freed.error() << endl;
+        vidi_deinitialize();
+        return -1;
     }
 
     // this will free all images and buffers which have not yet been freed
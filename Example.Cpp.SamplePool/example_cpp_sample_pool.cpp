@@ -0,0 +1,228 @@
+/**
+ * @file example_cpp_sample_pool.cpp
+ * @brief Example measuring what creating and freeing a sample for every frame costs, against
+ * reusing the samples of a vidi_utils::sample_pool
+ */
+
+#include "vidi_runtime.h"
+#include "../include/vidi_utils/buffer_view.hpp"
+#include "../include/vidi_utils/runtime.hpp"
+#include "../include/vidi_utils/sample_pool.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace runtime = vidi_utils::runtime;
+
+/**
+ * @brief the time of a worker, as a whole and in the calls to sample_process alone
+ */
+struct timing
+{
+    timing()
+        : total(0.0)
+        , process(0.0)
+        , failed(0)
+    {
+    }
+
+    double total;
+    double process;
+    size_t failed;
+};
+
+typedef chrono::steady_clock clock_type;
+
+double seconds_since(clock_type::time_point start)
+{
+    return chrono::duration<double>(clock_type::now() - start).count();
+}
+
+/**
+ * @brief as the examples do: a sample named by concatenation, created and freed for every frame
+ */
+void worker_create_free(size_t worker, size_t n_frames, VIDI_IMAGE * image, timing & t)
+{
+    auto start = clock_type::now();
+    for (size_t k = 0; k < n_frames; ++k)
+    {
+        string sample = string("sample") + to_string(worker);
+        double process = 0;
+        auto processed = runtime::create_sample("workspace", "default", sample.c_str())
+            .and_then([&] { return runtime::sample_add_image("workspace", "default", sample.c_str(), image); })
+            .and_then([&]
+            {
+                auto begin = clock_type::now();
+                auto r = runtime::sample_process("workspace", "default", "analyze", sample.c_str(), "");
+                process = seconds_since(begin);
+                return r;
+            });
+        runtime::free_sample("workspace", "default", sample.c_str());
+        t.process += process;
+        t.failed += !processed;
+    }
+    t.total = seconds_since(start);
+}
+
+void worker_pool(vidi_utils::sample_pool & samples, size_t worker, size_t n_frames, VIDI_IMAGE * image, timing & t)
+{
+    auto start = clock_type::now();
+    for (size_t k = 0; k < n_frames; ++k)
+    {
+        double process = 0;
+        vidi_utils::sample_handle sample = samples.acquire(worker);
+        auto processed = sample.add_image(image)
+            .and_then([&]
+            {
+                auto begin = clock_type::now();
+                auto r = sample.process("analyze");
+                process = seconds_since(begin);
+                return r;
+            });
+        t.process += process;
+        t.failed += !processed;
+    }
+    t.total = seconds_since(start);
+}
+
+/**
+ * @brief processes image b in a sample that already processed image a, then in a fresh sample of the same name
+ *
+ * sample_keep is only safe if both give the same results, i.e. if adding an image to a sample
+ * replaces the previous one
+ */
+bool keep_matches_recreate(VIDI_IMAGE * a, VIDI_IMAGE * b)
+{
+    string results[2];
+    for (int recycling = vidi_utils::sample_keep; recycling <= vidi_utils::sample_recreate; ++recycling)
+    {
+        vidi_utils::sample_pool_options options;
+        options.slots_per_worker = 1;
+        options.recycling = static_cast<vidi_utils::sample_recycling>(recycling);
+        options.prefix = "check_";
+        vidi_utils::sample_pool samples("workspace", "default", 1, options);
+        if (recycling == vidi_utils::sample_keep)
+        {
+            vidi_utils::sample_handle sample = samples.acquire(0);
+            if (!sample.add_image(a).and_then([&] { return sample.process("analyze"); }))
+                return false;
+        }
+        VIDI_BUFFER buffer;
+        vidi_init_buffer(&buffer);
+        vidi_utils::sample_handle sample = samples.acquire(0);
+        auto processed = sample.add_image(b)
+            .and_then([&] { return sample.process("analyze"); })
+            .and_then([&] { return sample.get_sample(&buffer); });
+        if (processed)
+            results[recycling].assign(vidi_utils::buffer_view(buffer).data(), vidi_utils::buffer_view(buffer).size());
+        vidi_free_buffer(&buffer);
+        if (!processed)
+            return false;
+    }
+    return results[0] == results[1];
+}
+
+/**
+ * @brief runs n_workers threads and prints the time per frame spent outside of sample_process
+ *
+ * @return that time, in microseconds
+ */
+template<class F>
+double measure(const char * name, size_t n_workers, size_t n_frames, vector<VIDI_IMAGE> & images, F worker)
+{
+    vector<timing> timings(n_workers);
+    vector<thread> threads;
+    for (size_t k = 0; k < n_workers; ++k)
+        threads.emplace_back([&, k] { worker(k, n_frames, &images[k], timings[k]); });
+    for (auto & t : threads)
+        t.join();
+
+    double total = 0, process = 0;
+    size_t failed = 0;
+    for (auto & t : timings)
+    {
+        total += t.total;
+        process += t.process;
+        failed += t.failed;
+    }
+    double frames = double(n_workers) * n_frames;
+    double overhead_us = (total - process) / frames * 1e6;
+    cout << name << ": " << total / frames * 1e3 << " ms per frame and worker, of which " << overhead_us
+        << " us outside of sample_process" << (failed ? ", " + to_string(failed) + " failed" : string()) << endl;
+    return overhead_us;
+}
+
+/**
+ * @brief usage: example_cpp_sample_pool [frames per worker] [workers]
+ */
+int main(int argc, char* argv[])
+{
+    size_t n_frames = argc > 1 ? max(1, atoi(argv[1])) : 200;
+    size_t n_workers = argc > 2 ? max(1, atoi(argv[2])) : 2;
+
+    auto initialized = runtime::initialize(VIDI_GPU_SINGLE_DEVICE_PER_TOOL, "")
+        .and_then([] { return runtime::open_workspace_from_file("workspace", "..\\resources\\runtime\\Textile.vrws"); });
+    if (!initialized)
+    {
+        clog << initialized.error() << endl;
+        vidi_deinitialize();
+        return -1;
+    }
+
+    vector<VIDI_IMAGE> images(n_workers);
+    for (auto & image : images)
+    {
+        auto loaded = runtime::init_image(&image)
+            .and_then([&] { return runtime::load_image("..\\resources\\images\\bad000001.png", &image); });
+        if (!loaded)
+        {
+            clog << loaded.error() << endl;
+            vidi_deinitialize();
+            return -1;
+        }
+    }
+
+    VIDI_IMAGE other;
+    auto loaded = runtime::init_image(&other)
+        .and_then([&] { return runtime::load_image("..\\resources\\images\\000000.png", &other); });
+    if (loaded)
+    {
+        bool same = keep_matches_recreate(&other, &images[0]);
+        cout << "a kept sample gives the results of a fresh one: " << (same ? "yes" : "NO, keep the default sample_recreate") << endl;
+        vidi_free_image(&other);
+    }
+    else
+        clog << loaded.error() << endl;
+
+    double baseline = measure("create and free every frame", n_workers, n_frames, images, worker_create_free);
+
+    vidi_utils::sample_pool_options options;
+    options.slots_per_worker = 1;
+    for (int recycling = vidi_utils::sample_recreate; recycling >= vidi_utils::sample_keep; --recycling)
+    {
+        options.recycling = static_cast<vidi_utils::sample_recycling>(recycling);
+        vidi_utils::sample_pool samples("workspace", "default", n_workers, options);
+        auto created = samples.create();
+        if (!created)
+        {
+            clog << created.error() << endl;
+            continue;
+        }
+        double overhead = measure(options.recycling == vidi_utils::sample_keep ? "pool, samples kept" : "pool, samples recreated",
+            n_workers, n_frames, images, [&](size_t worker, size_t n, VIDI_IMAGE * image, timing & t) { worker_pool(samples, worker, n, image, t); });
+        cout << "    saved " << baseline - overhead << " us per frame; ";
+        samples.report(cout);
+    }
+
+    for (auto & image : images)
+        vidi_free_image(&image);
+    vidi_deinitialize();
+    return 0;
+}
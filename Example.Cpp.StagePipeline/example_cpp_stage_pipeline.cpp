@@ -0,0 +1,249 @@
+/**
+ * @file example_cpp_stage_pipeline.cpp
+ * @brief Example running the steps of example_runtime as the stages of a vidi_utils::stage_pipeline,
+ * against the same steps one after the other
+ */
+
+#include "vidi_runtime.h"
+#include "../include/vidi_utils/runtime.hpp"
+#include "../include/vidi_utils/buffer_view.hpp"
+#include "../include/vidi_utils/stage_pipeline.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+namespace runtime = vidi_utils::runtime;
+
+/**
+ * @brief one image on its way through the steps, owning the image and the results buffer
+ */
+struct inspection
+{
+    inspection()
+        : number(0)
+        , has_sample(false)
+        , score(-1.0)
+    {
+        vidi_init_image(&image);
+        vidi_init_buffer(&results);
+    }
+
+    inspection(size_t n, const string & p)
+        : number(n)
+        , path(p)
+        , has_sample(false)
+        , score(-1.0)
+    {
+        vidi_init_image(&image);
+        vidi_init_buffer(&results);
+    }
+
+    inspection(inspection && other)
+        : has_sample(false)
+    {
+        vidi_init_image(&image);
+        vidi_init_buffer(&results);
+        *this = move(other);
+    }
+
+    inspection & operator=(inspection && other)
+    {
+        if (this != &other)
+        {
+            clear();
+            number = other.number;
+            path = move(other.path);
+            sample = move(other.sample);
+            image = other.image;
+            results = other.results;
+            has_sample = other.has_sample;
+            score = other.score;
+            vidi_init_image(&other.image);
+            vidi_init_buffer(&other.results);
+            other.has_sample = false;
+        }
+        return *this;
+    }
+
+    ~inspection()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        if (has_sample)
+            runtime::free_sample("workspace", "default", sample.c_str());
+        has_sample = false;
+        if (image.data)
+            vidi_free_image(&image);
+        if (results.data)
+            vidi_free_buffer(&results);
+    }
+
+    size_t number;
+    string path;
+    string sample;
+    VIDI_IMAGE image;
+    VIDI_BUFFER results;
+    bool has_sample;
+    double score;               ///< of the first red feature, -1 without one
+
+private:
+    inspection(const inspection &);
+    inspection & operator=(const inspection &);
+};
+
+/**
+ * @brief logs the error of a failed step; the stage functions return whether the step succeeded
+ */
+bool succeeded(const vidi_utils::result<void> & r)
+{
+    if (!r)
+        clog << r.error() << endl;
+    return static_cast<bool>(r);
+}
+
+bool load(inspection & i)
+{
+    return succeeded(runtime::load_image(i.path.c_str(), &i.image));
+}
+
+bool setup(inspection & i)
+{
+    i.sample = "sample_" + to_string(i.number);
+    auto created = runtime::create_sample("workspace", "default", i.sample.c_str());
+    i.has_sample = static_cast<bool>(created);
+    return succeeded(created.and_then([&] { return runtime::sample_add_image("workspace", "default", i.sample.c_str(), &i.image); }));
+}
+
+bool process(inspection & i)
+{
+    return succeeded(runtime::sample_process("workspace", "default", "analyze", i.sample.c_str(), ""));
+}
+
+/**
+ * @brief fetches the results, then frees the sample and the image which the following steps do not need
+ */
+bool fetch(inspection & i)
+{
+    bool ok = succeeded(runtime::get_sample("workspace", "default", i.sample.c_str(), &i.results));
+    runtime::free_sample("workspace", "default", i.sample.c_str());
+    i.has_sample = false;
+    vidi_free_image(&i.image);
+    return ok;
+}
+
+bool parse(inspection & i)
+{
+    // non destructive, so that the text can still be saved as it came
+    rapidxml::xml_document<> doc;
+    try
+    {
+        if (!vidi_utils::parse_in_situ<rapidxml::parse_non_destructive>(doc, i.results))
+            return false;
+    }
+    catch (const rapidxml::parse_error & e)
+    {
+        clog << i.path << ": " << e.what() << endl;
+        return false;
+    }
+    rapidxml::xml_node<> * node = doc.first_node("sample");
+    node = node ? node->first_node("marking") : 0;
+    for (node = node ? node->first_node("view") : 0; node; node = node->next_sibling("view"))
+    {
+        rapidxml::xml_node<> * red = node->first_node("red");
+        rapidxml::xml_attribute<> * score = red ? red->first_attribute("score") : 0;
+        if (score)
+        {
+            i.score = atof(string(score->value(), score->value_size()).c_str());
+            break;
+        }
+    }
+    return true;
+}
+
+bool persist(ofstream & out, inspection & i)
+{
+    out << "<!-- " << i.number << ": " << i.path << ", score " << i.score << " -->\n";
+    return vidi_utils::buffer_view(i.results).write_to(out) && (out << "\n");
+}
+
+typedef chrono::steady_clock clock_type;
+
+double seconds_since(clock_type::time_point start)
+{
+    return chrono::duration<double>(clock_type::now() - start).count();
+}
+
+/**
+ * @brief usage: example_cpp_stage_pipeline [images] [process threads] [image path]
+ */
+int main(int argc, char* argv[])
+{
+    size_t n_images = argc > 1 ? max(1, atoi(argv[1])) : 100;
+    size_t n_process = argc > 2 ? max(1, atoi(argv[2])) : 2;
+    string path = argc > 3 ? argv[3] : "..\\resources\\images\\bad000001.png";
+
+    auto initialized = runtime::initialize(VIDI_GPU_SINGLE_DEVICE_PER_TOOL, "")
+        .and_then([] { return runtime::open_workspace_from_file("workspace", "..\\resources\\runtime\\Textile.vrws"); });
+    if (!initialized)
+    {
+        clog << initialized.error() << endl;
+        vidi_deinitialize();
+        return -1;
+    }
+
+    // as example_runtime does: every step waits for the one before
+    double sequential = 0;
+    {
+        ofstream out("results_sequential.xml", ios::binary);
+        size_t failed = 0;
+        auto start = clock_type::now();
+        for (size_t k = 0; k < n_images; ++k)
+        {
+            inspection i(k, path);
+            bool ok = load(i) && setup(i) && process(i) && fetch(i) && parse(i) && persist(out, i);
+            failed += !ok;
+        }
+        sequential = seconds_since(start);
+        cout << "sequential: " << n_images << " images in " << sequential * 1000 << " ms, "
+            << n_images / sequential << " images/s, " << failed << " failed" << endl;
+    }
+
+    // every step on its own threads; parsing passes the inspections on in order, so that the file lists the images
+    // as they were given, and persisting is the last step: nothing is popped, the pipeline discards the inspections once saved
+    {
+        ofstream out("results_pipeline.xml", ios::binary);
+        vidi_utils::stage_pipeline<inspection> pipeline(8, true);
+        pipeline.add_stage("load", 2, load);
+        pipeline.add_stage("setup", 1, setup);
+        pipeline.add_stage("process", n_process, process);
+        pipeline.add_stage("fetch", 1, fetch);
+        pipeline.add_stage("parse", 1, parse, true);
+        pipeline.add_stage("persist", 1, [&](inspection & i) { return persist(out, i); });
+
+        auto start = clock_type::now();
+        pipeline.start();
+        for (size_t k = 0; k < n_images; ++k)
+            pipeline.push(inspection(k, path));
+        pipeline.close();
+        pipeline.wait();
+        double elapsed = seconds_since(start);
+
+        cout << "pipeline: " << n_images << " images in " << elapsed * 1000 << " ms, " << n_images / elapsed
+            << " images/s, " << sequential / elapsed << "x the sequential throughput" << endl;
+        pipeline.report(cout);
+    }
+
+    vidi_deinitialize();
+    return 0;
+}
@@ -0,0 +1,154 @@
+/**
+ * @file example_cpp_synthetic_camera.cpp
+ * @brief Example driving the runtime with frames of vidi_utils::synthetic_camera handed over by a
+ * vidi_utils::frame_ring, blocking the camera or dropping the oldest frames when the tools fall behind
+ */
+
+#include "vidi_runtime.h"
+#include "../include/vidi_utils/runtime.hpp"
+#include "../include/vidi_utils/synthetic_camera.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace runtime = vidi_utils::runtime;
+
+struct run_result
+{
+    run_result()
+        : processed(0)
+        , defects(0)
+        , failed(0)
+    {
+    }
+
+    size_t processed;
+    size_t defects;
+    size_t failed;
+    vector<double> latencies;   ///< from the frame being ready to its results, in ms
+};
+
+/**
+ * @brief one inspection thread: pops frames until the camera stops, and processes each in its own sample
+ */
+void inspect(vidi_utils::frame_ring<vidi_utils::camera_frame> & ring, const string & sample, run_result & result, mutex & m)
+{
+    vidi_utils::camera_frame frame;
+    while (ring.pop(frame))
+    {
+        auto processed = runtime::create_sample("workspace", "default", sample.c_str())
+            .and_then([&] { return runtime::sample_add_image("workspace", "default", sample.c_str(), frame.image.get()); })
+            .and_then([&] { return runtime::sample_process("workspace", "default", "analyze", sample.c_str(), ""); });
+        runtime::free_sample("workspace", "default", sample.c_str());
+        double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - frame.timestamp).count();
+        // the image goes back to the pool before the next frame is popped
+        frame.image.release();
+
+        lock_guard<mutex> lock(m);
+        if (!processed)
+        {
+            ++result.failed;
+            clog << processed.error() << endl;
+            continue;
+        }
+        ++result.processed;
+        result.defects += frame.defect;
+        result.latencies.push_back(ms);
+    }
+}
+
+/**
+ * @param seconds how long the camera runs when options.frames is 0, since it would not stop by itself
+ */
+void run(vidi_utils::ring_policy policy, const vidi_utils::synthetic_camera_options & options, size_t n_workers, size_t ring_size, double seconds)
+{
+    vidi_utils::image_pool images;
+    vidi_utils::frame_ring<vidi_utils::camera_frame> ring(ring_size, policy);
+    vidi_utils::synthetic_camera camera(options, images, ring);
+
+    run_result result;
+    mutex m;
+    vector<thread> workers;
+    for (size_t k = 0; k < n_workers; ++k)
+        workers.emplace_back(inspect, ref(ring), "sample_" + to_string(k), ref(result), ref(m));
+    if (!camera.start())
+        clog << "failed to start the camera" << endl;
+    // the camera closes the ring once it stops, which is what ends the workers
+    if (!options.frames)
+    {
+        this_thread::sleep_for(chrono::duration<double>(seconds));
+        camera.stop();
+    }
+    for (auto & worker : workers)
+        worker.join();
+    camera.stop();
+
+    cout << vidi_utils::ring_policy_name(policy) << ", " << n_workers << " workers:" << endl << "    ";
+    camera.report(cout);
+    sort(result.latencies.begin(), result.latencies.end());
+    double mean = 0;
+    for (double ms : result.latencies)
+        mean += ms;
+    mean = result.latencies.empty() ? 0 : mean / result.latencies.size();
+    auto percentile = [&](double p) { return result.latencies.empty() ? 0 : result.latencies[static_cast<size_t>(p * (result.latencies.size() - 1))]; };
+    cout << "    " << result.processed << " frames processed, " << result.defects << " with defects, " << result.failed << " failed; latency "
+        << mean << " ms on average, " << percentile(0.5) << " ms median, " << percentile(0.99) << " ms at 99%, "
+        << percentile(1.0) << " ms at worst" << endl;
+}
+
+/**
+ * @brief usage: example_cpp_synthetic_camera [fps] [frames, 0 to run for the given seconds] [workers] [ring size] [seconds]
+ */
+int main(int argc, char* argv[])
+{
+    vidi_utils::synthetic_camera_options options;
+    options.fps = argc > 1 ? atof(argv[1]) : 25.0;
+    options.frames = argc > 2 ? atoi(argv[2]) : 250;
+    size_t n_workers = argc > 3 ? max(1, atoi(argv[3])) : 2;
+    size_t ring_size = argc > 4 ? max(1, atoi(argv[4])) : 8;
+    double seconds = argc > 5 ? atof(argv[5]) : 10.0;
+
+    auto initialized = runtime::initialize(VIDI_GPU_SINGLE_DEVICE_PER_TOOL, "")
+        .and_then([] { return runtime::open_workspace_from_file("workspace", "..\\resources\\runtime\\Textile.vrws"); });
+    if (!initialized)
+    {
+        clog << initialized.error() << endl;
+        vidi_deinitialize();
+        return -1;
+    }
+
+    // without waiting for a camera, how fast frames can be rendered and handed over
+    vidi_utils::synthetic_camera_options fastest = options;
+    fastest.fps = 0;
+    fastest.frames = 50;
+    {
+        vidi_utils::image_pool images;
+        vidi_utils::frame_ring<vidi_utils::camera_frame> ring(ring_size);
+        vidi_utils::synthetic_camera camera(fastest, images, ring);
+        camera.start();
+        vidi_utils::camera_frame frame;
+        while (ring.pop(frame))
+            frame.image.release();
+        cout << "free running: ";
+        camera.report(cout);
+    }
+
+    // at the rate of the camera: when the tools keep up, both policies process every frame;
+    // when they do not, ring_block slows the camera down and ring_drop_oldest loses frames but keeps the latency low
+    run(vidi_utils::ring_block, options, n_workers, ring_size, seconds);
+    run(vidi_utils::ring_drop_oldest, options, n_workers, ring_size, seconds);
+
+    options.channel_depth = VIDI_IMG_16U;
+    run(vidi_utils::ring_drop_oldest, options, n_workers, ring_size, seconds);
+
+    vidi_deinitialize();
+    return 0;
+}
@@ -7,6 +7,7 @@
 
 #include "vidi.h"
 #include "vidi_training.h"
+#include "../include/vidi_utils/error.hpp"
 #include<string>
 #include<iostream>
 
@@ -19,44 +20,18 @@
 #endif
 
 
-/**
- * @brief gets the error message from the status using VIDI_BUFFER
- *
- * @return a string containing the last error message or a string indicating that we couldn't get the last error message
- */
-std::string get_last_error_message(int status)
-{
-    VIDI_BUFFER buffer;
-    vidi_init_buffer(&buffer);
-
-    VIDI_UINT internal_status;
-
-    internal_status = vidi_get_error_message(status, &buffer);
-    if (internal_status != VIDI_SUCCESS)
-        return "failed to get last error message";
-
-#ifdef USE_RAPIDXML
-    rapidxml::xml_document<> doc;
-    doc.parse<0>(buffer.data);
-
-    std::string error_message(doc.first_node("error")->value());
-#else
-    std::string error_message = buffer.data;
-#endif
-
-    return error_message;
-}
-
 /**
 * @brief checks if the status passes, prints the last error message and returns the user defined error code
+*
+* the message is only retrieved from the library and decoded when the error is printed
 */
 #define CHECK_STATUS(f)                          \
 {                                                \
-    VIDI_UINT s = f;                             \
-    if (s != VIDI_SUCCESS)                       \
+    vidi_utils::error e(f);                      \
+    if (e)                                       \
     {                                            \
-        std::cerr << get_last_error_message(s)   \
-        << std::endl; vidi_deinitialize();       \
+        std::cerr << e << std::endl;             \
+        vidi_deinitialize();                     \
         return -1;                               \
     }                                            \
 }
@@ -0,0 +1,89 @@
+/**
+ * @file example_cpp_xml_batch.cpp
+ * @brief Example demonstrating how to load a large number of result files in parallel
+ */
+
+#include "../include/rapidxml/rapidxml.hpp"
+#include "../include/vidi_utils/xml_batch_loader.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief reads one path per line, skipping empty lines
+ */
+vector<string> read_file_list(const string & list_path)
+{
+    vector<string> paths;
+    ifstream ifs(list_path.c_str());
+    string line;
+    while (getline(ifs, line))
+    {
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        if (!line.empty())
+            paths.push_back(line);
+    }
+    return paths;
+}
+
+/**
+ * @brief loads every result.xml written by example_runtime-style processes and counts the views they contain
+ *
+ * usage: example_cpp_xml_batch <file list> [parser threads] [reader threads]
+ * where the file list contains the path of one result file per line.
+ */
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        cerr << "usage: " << argv[0] << " <file list> [parser threads] [reader threads]" << endl;
+        return -1;
+    }
+
+    vector<string> paths = read_file_list(argv[1]);
+    if (paths.empty())
+    {
+        cerr << "no file to load in '" << argv[1] << "'" << endl;
+        return -1;
+    }
+
+    vidi_utils::xml_batch_options options;
+    if (argc > 2)
+        options.n_parsers = atoi(argv[2]);
+    if (argc > 3)
+        options.n_readers = atoi(argv[3]);
+
+    // the visitor runs concurrently on all parser threads
+    atomic<size_t> n_views(0);
+    auto stats = vidi_utils::load_xml_batch(paths, [&](size_t, const string &, rapidxml::xml_document<> & doc)
+    {
+        size_t views = 0;
+        rapidxml::xml_node<> * sample = doc.first_node("sample");
+        for (rapidxml::xml_node<> * marking = sample ? sample->first_node("marking") : 0; marking; marking = marking->next_sibling("marking"))
+        {
+            for (rapidxml::xml_node<> * view = marking->first_node("view"); view; view = view->next_sibling("view"))
+            {
+                ++views;
+            }
+        }
+        n_views += views;
+    }, options);
+
+    for (const auto & failure : stats.failures)
+    {
+        clog << "skipped '" << failure.first << "': " << failure.second << endl;
+    }
+
+    cout << "loaded " << stats.files << " of " << paths.size() << " files (" << n_views << " views) in "
+        << stats.seconds << " s: " << stats.files_per_second() << " files/s, "
+        << stats.mb_per_second() << " MB/s" << endl;
+
+    return stats.failures.empty() ? 0 : -1;
+}
@@ -0,0 +1,144 @@
+/**
+ * @file example_cpp_xml_traversal.cpp
+ * @brief Benchmark comparing ways of visiting the children of large result trees
+ */
+
+#include "../include/rapidxml/rapidxml.hpp"
+#include "../include/rapidxml/rapidxml_iterators.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * @brief builds a result-like document with n_markings markings of n_views views each
+ *
+ * every view holds n_features features and, like real results, other nodes are interleaved
+ * with the ones we are looking for
+ */
+string make_result_xml(size_t n_markings, size_t n_views, size_t n_features)
+{
+    ostringstream oss;
+    oss << "<sample id=\"benchmark\">";
+    for (size_t m = 0; m < n_markings; ++m)
+    {
+        oss << "<marking mode=\"single\"><roi/>";
+        for (size_t v = 0; v < n_views; ++v)
+        {
+            oss << "<view index=\"" << v << "\" size=\"256x256\"><pose/><region/>";
+            for (size_t f = 0; f < n_features; ++f)
+            {
+                oss << "<feature score=\"" << (f % 100) / 100.0 << "\" x=\"" << f << "\" y=\"" << v << "\"/><meta/>";
+            }
+            oss << "</view><viewport/>";
+        }
+        oss << "</marking>";
+    }
+    oss << "</sample>";
+    return oss.str();
+}
+
+/**
+ * @brief the usual first_node(name) / next_sibling(name) loops; the name is measured at each step
+ */
+double sum_with_siblings(rapidxml::xml_node<> * sample)
+{
+    double sum = 0;
+    for (auto marking = sample->first_node("marking"); marking; marking = marking->next_sibling("marking"))
+        for (auto view = marking->first_node("view"); view; view = view->next_sibling("view"))
+            for (auto feature = view->first_node("feature"); feature; feature = feature->next_sibling("feature"))
+                sum += feature->first_attribute("score")->value_size();
+    return sum;
+}
+
+/**
+ * @brief unfiltered node_iterator, comparing names by hand
+ */
+double sum_with_node_iterator(rapidxml::xml_node<> * sample)
+{
+    typedef rapidxml::node_iterator<char> it;
+    double sum = 0;
+    for (it marking(sample); marking != it(); ++marking)
+    {
+        if (strcmp(marking->name(), "marking") != 0)
+            continue;
+        for (it view(&*marking); view != it(); ++view)
+        {
+            if (strcmp(view->name(), "view") != 0)
+                continue;
+            for (it feature(&*view); feature != it(); ++feature)
+            {
+                if (strcmp(feature->name(), "feature") == 0)
+                    sum += feature->first_attribute("score")->value_size();
+            }
+        }
+    }
+    return sum;
+}
+
+/**
+ * @brief name-filtered, prefetching ranges
+ */
+double sum_with_children(rapidxml::xml_node<> * sample)
+{
+    double sum = 0;
+    for (auto & marking : rapidxml::children(sample, "marking"))
+        for (auto & view : rapidxml::children(&marking, "view"))
+            for (auto & feature : rapidxml::children(&view, "feature"))
+                for (auto & score : rapidxml::attributes(&feature, "score"))
+                    sum += score.value_size();
+    return sum;
+}
+
+/**
+ * @brief runs f n_iter times and prints the time spent per visited node
+ *
+ * the traversals only add up the length of the score values so that the time is spent walking the tree
+ */
+template<class F>
+void run(const char* name, F f, rapidxml::xml_node<> * sample, size_t n_nodes, size_t n_iter)
+{
+    double check = 0;
+    auto start = chrono::steady_clock::now();
+    for (size_t iter = 0; iter < n_iter; ++iter)
+    {
+        check += f(sample);
+    }
+    auto elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    cout << name << ": " << elapsed / 1e6 << " ms (" << elapsed / (n_iter * n_nodes) << " ns/node, checksum " << check << ")" << endl;
+}
+
+/**
+ * @brief usage: example_cpp_xml_traversal [markings] [views per marking] [features per view] [iterations]
+ */
+int main(int argc, char* argv[])
+{
+    size_t n_markings = argc > 1 ? atoi(argv[1]) : 8;
+    size_t n_views = argc > 2 ? atoi(argv[2]) : 256;
+    size_t n_features = argc > 3 ? atoi(argv[3]) : 32;
+    size_t n_iter = argc > 4 ? atoi(argv[4]) : 20;
+
+    string xml = make_result_xml(n_markings, n_views, n_features);
+    vector<char> text(xml.begin(), xml.end());
+    text.push_back(0);
+
+    rapidxml::xml_document<> doc;
+    doc.parse<0>(text.data());
+    rapidxml::xml_node<> * sample = doc.first_node("sample");
+
+    // every child visited by the three traversals: markings, views and their siblings, features and their siblings
+    size_t n_nodes = n_markings * (1 + 3 * n_views + 2 * n_views * n_features);
+    cout << "result tree of " << xml.size() / 1024 << " kB, " << n_nodes << " nodes" << endl;
+
+    run("first_node/next_sibling", sum_with_siblings, sample, n_nodes, n_iter);
+    run("node_iterator + strcmp  ", sum_with_node_iterator, sample, n_nodes, n_iter);
+    run("children()/attributes() ", sum_with_children, sample, n_nodes, n_iter);
+
+    return 0;
+}
@@ -7,6 +7,17 @@
 //! \file rapidxml_iterators.hpp This file contains rapidxml iterators
 
 #include "rapidxml.hpp"
+#include <cstddef>
+#include <iterator>
+
+#if defined(_MSC_VER)
+    #include <xmmintrin.h>
+    #define RAPIDXML_PREFETCH(p) _mm_prefetch(reinterpret_cast<const char *>(p), _MM_HINT_T0)
+#elif defined(__GNUC__)
+    #define RAPIDXML_PREFETCH(p) __builtin_prefetch(p)
+#else
+    #define RAPIDXML_PREFETCH(p) ((void)(p))
+#endif
 
 namespace rapidxml
 {
@@ -18,9 +29,9 @@ namespace rapidxml
     
     public:
 
-        typedef typename xml_node<Ch> value_type;
-        typedef typename xml_node<Ch> &reference;
-        typedef typename xml_node<Ch> *pointer;
+        typedef xml_node<Ch> value_type;
+        typedef xml_node<Ch> &reference;
+        typedef xml_node<Ch> *pointer;
         typedef std::ptrdiff_t difference_type;
         typedef std::bidirectional_iterator_tag iterator_category;
         
@@ -56,7 +67,7 @@ namespace rapidxml
         node_iterator operator++(int)
         {
             node_iterator tmp = *this;
-            ++this;
+            ++*this;
             return tmp;
         }
 
@@ -70,7 +81,7 @@ namespace rapidxml
         node_iterator operator--(int)
         {
             node_iterator tmp = *this;
-            ++this;
+            --*this;
             return tmp;
         }
 
@@ -97,9 +108,9 @@ namespace rapidxml
     
     public:
 
-        typedef typename xml_attribute<Ch> value_type;
-        typedef typename xml_attribute<Ch> &reference;
-        typedef typename xml_attribute<Ch> *pointer;
+        typedef xml_attribute<Ch> value_type;
+        typedef xml_attribute<Ch> &reference;
+        typedef xml_attribute<Ch> *pointer;
         typedef std::ptrdiff_t difference_type;
         typedef std::bidirectional_iterator_tag iterator_category;
         
@@ -135,7 +146,7 @@ namespace rapidxml
         attribute_iterator operator++(int)
         {
             attribute_iterator tmp = *this;
-            ++this;
+            ++*this;
             return tmp;
         }
 
@@ -149,7 +160,7 @@ namespace rapidxml
         attribute_iterator operator--(int)
         {
             attribute_iterator tmp = *this;
-            ++this;
+            --*this;
             return tmp;
         }
 
@@ -169,6 +180,268 @@ namespace rapidxml
 
     };
 
+    //! Name used to filter children and attributes.
+    //! Its length and a fingerprint made of its first and last characters are computed once,
+    //! so that most non-matching names are rejected without touching their characters.
+    //! A null name matches everything.
+    template<class Ch>
+    class name_filter
+    {
+
+    public:
+
+        name_filter(const Ch *name = 0, std::size_t size = 0)
+            : m_name(name)
+            , m_size(name && !size ? internal::measure(name) : size)
+            , m_fingerprint(fingerprint(name, m_size))
+        {
+        }
+
+        //! Checks if the given name matches the filter
+        bool matches(const Ch *name, std::size_t size) const
+        {
+            if (!m_name)
+                return true;
+            if (size != m_size || fingerprint(name, size) != m_fingerprint)
+                return false;
+            return internal::compare(name, size, m_name, m_size, true);
+        }
+
+    private:
+
+        static std::size_t fingerprint(const Ch *name, std::size_t size)
+        {
+            if (!name || !size)
+                return 0;
+            return static_cast<std::size_t>(name[0]) ^ (static_cast<std::size_t>(name[size - 1]) << 8);
+        }
+
+        const Ch *m_name;
+        std::size_t m_size;
+        std::size_t m_fingerprint;
+
+    };
+
+    //! Forward iterator over the children of a node matching a name_filter.
+    //! The sibling after the current one is prefetched while the current one is being used.
+    template<class Ch>
+    class filtered_node_iterator
+    {
+
+    public:
+
+        typedef xml_node<Ch> value_type;
+        typedef xml_node<Ch> &reference;
+        typedef xml_node<Ch> *pointer;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::forward_iterator_tag iterator_category;
+
+        filtered_node_iterator()
+            : m_node(0)
+        {
+        }
+
+        filtered_node_iterator(xml_node<Ch> *first, const name_filter<Ch> &filter)
+            : m_node(first)
+            , m_filter(filter)
+        {
+            skip();
+        }
+
+        reference operator *() const
+        {
+            assert(m_node);
+            return *m_node;
+        }
+
+        pointer operator->() const
+        {
+            assert(m_node);
+            return m_node;
+        }
+
+        filtered_node_iterator& operator++()
+        {
+            assert(m_node);
+            m_node = m_node->next_sibling();
+            skip();
+            return *this;
+        }
+
+        filtered_node_iterator operator++(int)
+        {
+            filtered_node_iterator tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        bool operator ==(const filtered_node_iterator<Ch> &rhs) const
+        {
+            return m_node == rhs.m_node;
+        }
+
+        bool operator !=(const filtered_node_iterator<Ch> &rhs) const
+        {
+            return m_node != rhs.m_node;
+        }
+
+    private:
+
+        void skip()
+        {
+            while (m_node && !m_filter.matches(m_node->name(), m_node->name_size()))
+                m_node = m_node->next_sibling();
+            if (m_node && m_node->next_sibling())
+                RAPIDXML_PREFETCH(m_node->next_sibling());
+        }
+
+        xml_node<Ch> *m_node;
+        name_filter<Ch> m_filter;
+
+    };
+
+    //! Forward iterator over the attributes of a node matching a name_filter
+    template<class Ch>
+    class filtered_attribute_iterator
+    {
+
+    public:
+
+        typedef xml_attribute<Ch> value_type;
+        typedef xml_attribute<Ch> &reference;
+        typedef xml_attribute<Ch> *pointer;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::forward_iterator_tag iterator_category;
+
+        filtered_attribute_iterator()
+            : m_attribute(0)
+        {
+        }
+
+        filtered_attribute_iterator(xml_attribute<Ch> *first, const name_filter<Ch> &filter)
+            : m_attribute(first)
+            , m_filter(filter)
+        {
+            skip();
+        }
+
+        reference operator *() const
+        {
+            assert(m_attribute);
+            return *m_attribute;
+        }
+
+        pointer operator->() const
+        {
+            assert(m_attribute);
+            return m_attribute;
+        }
+
+        filtered_attribute_iterator& operator++()
+        {
+            assert(m_attribute);
+            m_attribute = m_attribute->next_attribute();
+            skip();
+            return *this;
+        }
+
+        filtered_attribute_iterator operator++(int)
+        {
+            filtered_attribute_iterator tmp = *this;
+            ++*this;
+            return tmp;
+        }
+
+        bool operator ==(const filtered_attribute_iterator<Ch> &rhs) const
+        {
+            return m_attribute == rhs.m_attribute;
+        }
+
+        bool operator !=(const filtered_attribute_iterator<Ch> &rhs) const
+        {
+            return m_attribute != rhs.m_attribute;
+        }
+
+    private:
+
+        void skip()
+        {
+            while (m_attribute && !m_filter.matches(m_attribute->name(), m_attribute->name_size()))
+                m_attribute = m_attribute->next_attribute();
+            if (m_attribute && m_attribute->next_attribute())
+                RAPIDXML_PREFETCH(m_attribute->next_attribute());
+        }
+
+        xml_attribute<Ch> *m_attribute;
+        name_filter<Ch> m_filter;
+
+    };
+
+    //! Pair of iterators usable in a range-based for loop
+    template<class Iterator>
+    class xml_range
+    {
+
+    public:
+
+        xml_range(Iterator first, Iterator last)
+            : m_first(first)
+            , m_last(last)
+        {
+        }
+
+        Iterator begin() const
+        {
+            return m_first;
+        }
+
+        Iterator end() const
+        {
+            return m_last;
+        }
+
+        bool empty() const
+        {
+            return m_first == m_last;
+        }
+
+    private:
+
+        Iterator m_first;
+        Iterator m_last;
+
+    };
+
+    //! Returns the children of node, optionally only the ones with the given name.
+    //! <pre>
+    //! for (xml_node<> &view : children(marking, "view"))
+    //!     ...
+    //! </pre>
+    //! \param node Node whose children are visited.
+    //! \param name Name of the children to visit, or 0 to visit all of them.
+    //! \param name_size Size of name, in characters, or 0 to have the size calculated automatically.
+    template<class Ch>
+    inline xml_range<filtered_node_iterator<Ch> > children(xml_node<Ch> *node, const Ch *name = 0, std::size_t name_size = 0)
+    {
+        assert(node);
+        return xml_range<filtered_node_iterator<Ch> >(
+            filtered_node_iterator<Ch>(node->first_node(), name_filter<Ch>(name, name_size)),
+            filtered_node_iterator<Ch>());
+    }
+
+    //! Returns the attributes of node, optionally only the ones with the given name.
+    //! \param node Node whose attributes are visited.
+    //! \param name Name of the attributes to visit, or 0 to visit all of them.
+    //! \param name_size Size of name, in characters, or 0 to have the size calculated automatically.
+    template<class Ch>
+    inline xml_range<filtered_attribute_iterator<Ch> > attributes(xml_node<Ch> *node, const Ch *name = 0, std::size_t name_size = 0)
+    {
+        assert(node);
+        return xml_range<filtered_attribute_iterator<Ch> >(
+            filtered_attribute_iterator<Ch>(node->first_attribute(), name_filter<Ch>(name, name_size)),
+            filtered_attribute_iterator<Ch>());
+    }
+
 }
 
 #endif
@@ -0,0 +1,131 @@
+/**
+ * @file bounded_queue.hpp
+ * @brief Blocking multi-producer / multi-consumer queue with a fixed capacity
+ *
+ * Used to connect the stages of the batch helpers in this directory. push() blocks while
+ * the queue is full, which is what bounds the amount of work (and memory) in flight.
+ */
+
+#ifndef VIDI_UTILS_BOUNDED_QUEUE_HPP_INCLUDED
+#define VIDI_UTILS_BOUNDED_QUEUE_HPP_INCLUDED
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <utility>
+
+namespace vidi_utils
+{
+    template<class T>
+    class bounded_queue
+    {
+    public:
+        explicit bounded_queue(std::size_t capacity)
+            : m_capacity(capacity ? capacity : 1)
+            , m_closed(false)
+        {
+        }
+
+        /**
+         * @brief waits for a free slot and enqueues the value
+         *
+         * @return false if the queue was closed, in which case the value is dropped
+         */
+        bool push(T value)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_not_full.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+            if (m_closed)
+                return false;
+            m_items.push_back(std::move(value));
+            lock.unlock();
+            m_not_empty.notify_one();
+            return true;
+        }
+
+        /**
+         * @brief enqueues the value only if there is a free slot
+         */
+        bool try_push(T value)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_closed || m_items.size() >= m_capacity)
+                return false;
+            m_items.push_back(std::move(value));
+            lock.unlock();
+            m_not_empty.notify_one();
+            return true;
+        }
+
+        /**
+         * @brief waits for a value
+         *
+         * @return false once the queue is closed and drained
+         */
+        bool pop(T & value)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_not_empty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+            if (m_items.empty())
+                return false;
+            value = std::move(m_items.front());
+            m_items.pop_front();
+            lock.unlock();
+            m_not_full.notify_one();
+            return true;
+        }
+
+        /**
+         * @brief dequeues a value only if one is immediately available
+         */
+        bool try_pop(T & value)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_items.empty())
+                return false;
+            value = std::move(m_items.front());
+            m_items.pop_front();
+            lock.unlock();
+            m_not_full.notify_one();
+            return true;
+        }
+
+        /**
+         * @brief wakes up all waiters; pending values can still be popped, new pushes fail
+         */
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_closed = true;
+            }
+            m_not_empty.notify_all();
+            m_not_full.notify_all();
+        }
+
+        std::size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_items.size();
+        }
+
+        std::size_t capacity() const
+        {
+            return m_capacity;
+        }
+
+    private:
+        bounded_queue(const bounded_queue &);
+        bounded_queue & operator=(const bounded_queue &);
+
+        const std::size_t m_capacity;
+        bool m_closed;
+        std::deque<T> m_items;
+        mutable std::mutex m_mutex;
+        std::condition_variable m_not_empty;
+        std::condition_variable m_not_full;
+    };
+}
+
+#endif
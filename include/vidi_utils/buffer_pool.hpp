@@ -0,0 +1,307 @@
+/**
+ * @file buffer_pool.hpp
+ * @brief Move-only VIDI_BUFFER handle reusing the buffers already grown by the library
+ *
+ * Calling vidi_init_buffer() / vidi_free_buffer() around every call means the library has to
+ * grow a fresh buffer each time. pooled_buffer instead takes its VIDI_BUFFER from a small
+ * per-thread free list and gives it back when it goes out of scope, so the memory grown for
+ * the previous sample is reused for the next one.
+ *
+ * The library frees every buffer in vidi_deinitialize(), so call buffer_pool::shutdown()
+ * right before it; the cached buffers are then released and handles destroyed later on just
+ * drop theirs.
+ *
+ * Each handle is attributed to a buffer_site which counts how many allocations were avoided
+ * and the largest size seen there; buffer_pool::report() prints them.
+ */
+
+#ifndef VIDI_UTILS_BUFFER_POOL_HPP_INCLUDED
+#define VIDI_UTILS_BUFFER_POOL_HPP_INCLUDED
+
+#include "vidi.h"
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+namespace vidi_utils
+{
+    /**
+     * @brief statistics of the handles created at one place in the code
+     *
+     * Sites register themselves once and must outlive the pool, which is why they are meant to
+     * be declared static: static vidi_utils::buffer_site site("get_sample");
+     */
+    class buffer_site
+    {
+    public:
+        explicit buffer_site(const char * name)
+            : m_name(name)
+            , m_acquired(0)
+            , m_allocated(0)
+            , m_high_water(0)
+        {
+            std::lock_guard<std::mutex> lock(registry_mutex());
+            registry().push_back(this);
+        }
+
+        const char * name() const { return m_name; }
+        size_t acquired() const { return m_acquired; }
+        size_t allocated() const { return m_allocated; }
+        size_t allocations_avoided() const { return m_acquired - m_allocated; }
+        size_t high_water() const { return m_high_water; }
+
+        void on_acquire(bool allocated)
+        {
+            ++m_acquired;
+            if (allocated)
+                ++m_allocated;
+        }
+
+        void on_release(size_t size)
+        {
+            size_t current = m_high_water.load(std::memory_order_relaxed);
+            while (size > current && !m_high_water.compare_exchange_weak(current, size, std::memory_order_relaxed))
+            {
+            }
+        }
+
+        static std::vector<buffer_site *> & registry()
+        {
+            static std::vector<buffer_site *> sites;
+            return sites;
+        }
+
+        static std::mutex & registry_mutex()
+        {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        static buffer_site & unnamed()
+        {
+            static buffer_site site("unnamed");
+            return site;
+        }
+
+    private:
+        buffer_site(const buffer_site &);
+        buffer_site & operator=(const buffer_site &);
+
+        const char * m_name;
+        std::atomic<size_t> m_acquired;
+        std::atomic<size_t> m_allocated;
+        std::atomic<size_t> m_high_water;
+    };
+
+    class buffer_pool
+    {
+    public:
+        /// number of idle buffers kept per thread, the others are freed
+        static const size_t max_cached = 16;
+
+        /**
+         * @brief frees the buffers cached by every thread and stops freeing buffers afterwards
+         *
+         * To be called right before vidi_deinitialize(), which frees all the remaining buffers.
+         */
+        static void shutdown()
+        {
+            std::vector<VIDI_BUFFER> idle;
+            {
+                std::lock_guard<std::mutex> lock(cache_mutex());
+                shut_down() = true;
+                for (auto & c : caches())
+                    idle.insert(idle.end(), c.second.begin(), c.second.end());
+                caches().clear();
+            }
+            free_all(idle);
+        }
+
+        /**
+         * @brief frees the buffers cached by the calling thread
+         */
+        static void trim()
+        {
+            std::vector<VIDI_BUFFER> idle;
+            {
+                std::lock_guard<std::mutex> lock(cache_mutex());
+                cache_map::iterator it = caches().find(std::this_thread::get_id());
+                if (it == caches().end())
+                    return;
+                idle.swap(it->second);
+                caches().erase(it);
+            }
+            free_all(idle);
+        }
+
+        /**
+         * @brief prints, for every site, how many buffers were requested, allocated and the largest size seen
+         */
+        static void report(std::ostream & os)
+        {
+            std::lock_guard<std::mutex> lock(buffer_site::registry_mutex());
+            for (auto site : buffer_site::registry())
+            {
+                os << site->name() << ": " << site->acquired() << " acquired, " << site->allocated()
+                    << " allocated (" << site->allocations_avoided() << " avoided), high-water "
+                    << site->high_water() << " bytes" << std::endl;
+            }
+        }
+
+        /**
+         * @brief hands out a cached buffer, or initializes a new one
+         *
+         * @return false if a new buffer was needed, true if a cached one was reused
+         */
+        static bool take(VIDI_BUFFER & buffer, VIDI_UINT & status)
+        {
+            status = VIDI_SUCCESS;
+            {
+                std::lock_guard<std::mutex> lock(cache_mutex());
+                cache_map::iterator it = caches().find(std::this_thread::get_id());
+                if (it != caches().end() && !it->second.empty())
+                {
+                    buffer = it->second.back();
+                    it->second.pop_back();
+                    return true;
+                }
+            }
+            status = vidi_init_buffer(&buffer);
+            return false;
+        }
+
+        /**
+         * @brief keeps the buffer for later, or frees it if the cache is full
+         */
+        static void give_back(VIDI_BUFFER & buffer)
+        {
+            {
+                std::lock_guard<std::mutex> lock(cache_mutex());
+                if (shut_down())
+                    return;
+                std::vector<VIDI_BUFFER> & buffers = caches()[std::this_thread::get_id()];
+                if (buffers.size() < max_cached)
+                {
+                    buffers.push_back(buffer);
+                    return;
+                }
+            }
+            vidi_free_buffer(&buffer);
+        }
+
+    private:
+        // the free lists are keyed by thread rather than thread_local, which Visual Studio 2013 does not support;
+        // the list of a thread that ended is reused by the next thread given its id, or freed by shutdown()
+        typedef std::map<std::thread::id, std::vector<VIDI_BUFFER> > cache_map;
+
+        static cache_map & caches()
+        {
+            static cache_map c;
+            return c;
+        }
+
+        static std::mutex & cache_mutex()
+        {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        static void free_all(std::vector<VIDI_BUFFER> & buffers)
+        {
+            for (auto & buffer : buffers)
+                vidi_free_buffer(&buffer);
+            buffers.clear();
+        }
+
+        static std::atomic<bool> & shut_down()
+        {
+            static std::atomic<bool> flag(false);
+            return flag;
+        }
+    };
+
+    /**
+     * @brief VIDI_BUFFER taken from the calling thread's pool and given back on destruction
+     *
+     * The handle must be destroyed on the thread that created it.
+     */
+    class pooled_buffer
+    {
+    public:
+        explicit pooled_buffer(buffer_site & site = buffer_site::unnamed())
+            : m_site(&site)
+            , m_owned(true)
+        {
+            bool reused = buffer_pool::take(m_buffer, m_status);
+            m_site->on_acquire(!reused);
+            m_owned = m_status == VIDI_SUCCESS;
+        }
+
+        pooled_buffer(pooled_buffer && other)
+            : m_buffer(other.m_buffer)
+            , m_status(other.m_status)
+            , m_site(other.m_site)
+            , m_owned(other.m_owned)
+        {
+            other.m_owned = false;
+        }
+
+        pooled_buffer & operator=(pooled_buffer && other)
+        {
+            if (this != &other)
+            {
+                release();
+                m_buffer = other.m_buffer;
+                m_status = other.m_status;
+                m_site = other.m_site;
+                m_owned = other.m_owned;
+                other.m_owned = false;
+            }
+            return *this;
+        }
+
+        ~pooled_buffer()
+        {
+            release();
+        }
+
+        /**
+         * @brief status of the vidi_init_buffer() call, VIDI_SUCCESS when a cached buffer was reused
+         */
+        VIDI_UINT status() const { return m_status; }
+
+        /**
+         * @brief the buffer to pass to the library
+         */
+        VIDI_BUFFER * get() { return &m_buffer; }
+        const VIDI_BUFFER * get() const { return &m_buffer; }
+
+        const char * data() const { return m_buffer.data; }
+        size_t size() const { return m_buffer.size; }
+
+    private:
+        pooled_buffer(const pooled_buffer &);
+        pooled_buffer & operator=(const pooled_buffer &);
+
+        void release()
+        {
+            if (!m_owned)
+                return;
+            m_site->on_release(m_buffer.size);
+            buffer_pool::give_back(m_buffer);
+            m_owned = false;
+        }
+
+        VIDI_BUFFER m_buffer;
+        VIDI_UINT m_status;
+        buffer_site * m_site;
+        bool m_owned;
+    };
+}
+
+#endif
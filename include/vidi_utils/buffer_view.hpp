@@ -0,0 +1,128 @@
+/**
+ * @file buffer_view.hpp
+ * @brief Non-owning views over the data returned in a VIDI_BUFFER
+ *
+ * The results returned by the library are already in memory; buffer_view lets them be
+ * parsed or written out without first copying them into a std::string or a stream.
+ */
+
+#ifndef VIDI_UTILS_BUFFER_VIEW_HPP_INCLUDED
+#define VIDI_UTILS_BUFFER_VIEW_HPP_INCLUDED
+
+#include "vidi.h"
+#include "../rapidxml/rapidxml.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+
+#if __cplusplus >= 201703L || (defined(_MSVC_LANG) && _MSVC_LANG >= 201703L)
+    #define VIDI_UTILS_HAS_STRING_VIEW
+    #include <string_view>
+#endif
+
+namespace vidi_utils
+{
+    /**
+     * @brief view over the bytes of a VIDI_BUFFER; the buffer must outlive the view
+     *
+     * Text returned by the library is zero terminated, possibly before the end of the buffer:
+     * size() is the length of that text, capacity() the size reported by the buffer.
+     */
+    class buffer_view
+    {
+    public:
+        buffer_view()
+            : m_data(0)
+            , m_size(0)
+            , m_capacity(0)
+        {
+        }
+
+        explicit buffer_view(const VIDI_BUFFER & buffer)
+            : m_data(buffer.data)
+            , m_size(0)
+            , m_capacity(buffer.data ? static_cast<size_t>(buffer.size) : 0)
+        {
+            if (m_data)
+            {
+                const void * end = std::memchr(m_data, 0, m_capacity);
+                m_size = end ? static_cast<const char *>(end) - m_data : m_capacity;
+            }
+        }
+
+        const char * data() const { return m_data; }
+        size_t size() const { return m_size; }
+        size_t capacity() const { return m_capacity; }
+        bool empty() const { return m_size == 0; }
+
+        const char * begin() const { return m_data; }
+        const char * end() const { return m_data + m_size; }
+
+        /**
+         * @brief true when the text is followed by its terminating zero, as in-situ parsing requires
+         */
+        bool zero_terminated() const { return m_data && m_size < m_capacity; }
+
+#ifdef VIDI_UTILS_HAS_STRING_VIEW
+        std::string_view str() const { return std::string_view(m_data ? m_data : "", m_size); }
+#endif
+
+        /**
+         * @brief writes the text with a single write() call
+         */
+        bool write_to(std::ostream & os) const
+        {
+            return static_cast<bool>(os.write(m_data, static_cast<std::streamsize>(m_size)));
+        }
+
+        /**
+         * @brief writes the text to a file with a single fwrite() call
+         */
+        bool write_file(const char * path) const
+        {
+            std::FILE * f = std::fopen(path, "wb");
+            if (!f)
+                return false;
+            bool ok = std::fwrite(m_data, 1, m_size, f) == m_size;
+            return std::fclose(f) == 0 && ok;
+        }
+
+    private:
+        const char * m_data;
+        size_t m_size;
+        size_t m_capacity;
+    };
+
+    inline std::ostream & operator<<(std::ostream & os, const buffer_view & view)
+    {
+        view.write_to(os);
+        return os;
+    }
+
+    /**
+     * @brief parses the xml text held by the buffer in place
+     *
+     * rapidxml writes into the text and the document points into it, so the buffer must not be
+     * reused, e.g. passed to another library call, as long as the document is in use.
+     *
+     * @return false if the buffer holds no zero terminated text; parse errors throw rapidxml::parse_error
+     */
+    template<int Flags>
+    bool parse_in_situ(rapidxml::xml_document<> & doc, VIDI_BUFFER & buffer)
+    {
+        buffer_view view(buffer);
+        if (!view.zero_terminated())
+            return false;
+        doc.parse<Flags>(buffer.data);
+        return true;
+    }
+
+    inline bool parse_in_situ(rapidxml::xml_document<> & doc, VIDI_BUFFER & buffer)
+    {
+        return parse_in_situ<0>(doc, buffer);
+    }
+}
+
+#endif
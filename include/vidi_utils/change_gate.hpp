@@ -0,0 +1,418 @@
+/**
+ * @file change_gate.hpp
+ * @brief Skips processing frames that differ from the last processed one only by sensor noise
+ *
+ * The frame is cut into blocks and the mean absolute difference of each block to the same
+ * block of the reference frame, the last one processed on the stream, is computed with SSE2 or
+ * AVX2 sums of absolute differences. When no more than max_changed_blocks blocks differ by more
+ * than block_threshold, the result of the reference is returned instead of processing again:
+ *
+ *     vidi_utils::change_gate gate;
+ *     std::string xml;
+ *     auto processed = gate.process("workspace", "default", "analyze", "my_sample", "", &image, xml);
+ *
+ * Blocks catch a small defect appearing on an otherwise still scene, which the mean difference
+ * over the whole frame would dilute. Frames are always compared with the last processed frame,
+ * not with the previous one, so a slow drift eventually gets processed. The gate is
+ * thread-safe; frames of the same stream are compared one at a time.
+ */
+
+#ifndef VIDI_UTILS_CHANGE_GATE_HPP_INCLUDED
+#define VIDI_UTILS_CHANGE_GATE_HPP_INCLUDED
+
+#include "vidi_runtime.h"
+#include "buffer_view.hpp"
+#include "image_view.hpp"
+#include "pixel_convert.hpp"
+#include "runtime.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace vidi_utils
+{
+    namespace detail
+    {
+        // sums[k] += sum of |a[i] - b[i]| over segment k, segments being n_segment values long except the last one
+
+        template<class T>
+        void sad_segments_scalar(const T * a, const T * b, size_t n, size_t n_segment, uint64_t * sums)
+        {
+            for (size_t begin = 0, k = 0; begin < n; begin += n_segment, ++k)
+            {
+                size_t end = std::min(n, begin + n_segment);
+                uint64_t sum = 0;
+                for (size_t i = begin; i < end; ++i)
+                    sum += a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+                sums[k] += sum;
+            }
+        }
+
+#if defined(VIDI_UTILS_X86_SIMD)
+        VIDI_UTILS_TARGET("sse2")
+        inline void sad_segments_sse(const uint8_t * a, const uint8_t * b, size_t n, size_t n_segment, uint64_t * sums)
+        {
+            for (size_t begin = 0, k = 0; begin < n; begin += n_segment, ++k)
+            {
+                size_t end = std::min(n, begin + n_segment), i = begin;
+                __m128i acc = _mm_setzero_si128();
+                for (; i + 16 <= end; i += 16)
+                    acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i)),
+                        _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i))));
+                uint64_t lanes[2];
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+                sums[k] += lanes[0] + lanes[1];
+                sad_segments_scalar(a + i, b + i, end - i, end - i, sums + k);
+            }
+        }
+
+        /// |a - b| of unsigned 16-bit values is the larger of the two saturated differences, widened to 32 bits to be summed
+        VIDI_UTILS_TARGET("sse2")
+        inline void sad_segments_sse(const uint16_t * a, const uint16_t * b, size_t n, size_t n_segment, uint64_t * sums)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            for (size_t begin = 0, k = 0; begin < n; begin += n_segment, ++k)
+            {
+                size_t end = std::min(n, begin + n_segment), i = begin;
+                __m128i acc = _mm_setzero_si128();
+                for (; i + 8 <= end; i += 8)
+                {
+                    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+                    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + i));
+                    __m128i d = _mm_or_si128(_mm_subs_epu16(x, y), _mm_subs_epu16(y, x));
+                    acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_unpacklo_epi16(d, zero), _mm_unpackhi_epi16(d, zero)));
+                }
+                uint32_t lanes[4];
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+                sums[k] += static_cast<uint64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+                sad_segments_scalar(a + i, b + i, end - i, end - i, sums + k);
+            }
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline void sad_segments_avx2(const uint8_t * a, const uint8_t * b, size_t n, size_t n_segment, uint64_t * sums)
+        {
+            for (size_t begin = 0, k = 0; begin < n; begin += n_segment, ++k)
+            {
+                size_t end = std::min(n, begin + n_segment), i = begin;
+                __m256i acc = _mm256_setzero_si256();
+                for (; i + 32 <= end; i += 32)
+                    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i)),
+                        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i))));
+                uint64_t lanes[4];
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+                sums[k] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+                sad_segments_sse(a + i, b + i, end - i, end - i, sums + k);
+            }
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline void sad_segments_avx2(const uint16_t * a, const uint16_t * b, size_t n, size_t n_segment, uint64_t * sums)
+        {
+            const __m256i zero = _mm256_setzero_si256();
+            for (size_t begin = 0, k = 0; begin < n; begin += n_segment, ++k)
+            {
+                size_t end = std::min(n, begin + n_segment), i = begin;
+                __m256i acc = _mm256_setzero_si256();
+                for (; i + 16 <= end; i += 16)
+                {
+                    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+                    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+                    __m256i d = _mm256_or_si256(_mm256_subs_epu16(x, y), _mm256_subs_epu16(y, x));
+                    acc = _mm256_add_epi32(acc, _mm256_add_epi32(_mm256_unpacklo_epi16(d, zero), _mm256_unpackhi_epi16(d, zero)));
+                }
+                uint32_t lanes[8];
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+                uint64_t sum = 0;
+                for (size_t l = 0; l < 8; ++l)
+                    sum += lanes[l];
+                sums[k] += sum;
+                sad_segments_sse(a + i, b + i, end - i, end - i, sums + k);
+            }
+        }
+#endif
+
+        template<class T>
+        void sad_segments(const T * a, const T * b, size_t n, size_t n_segment, uint64_t * sums, simd_level level)
+        {
+#if defined(VIDI_UTILS_X86_SIMD)
+            if (level == simd_avx2)
+                return sad_segments_avx2(a, b, n, n_segment, sums);
+            if (level == simd_sse)
+                return sad_segments_sse(a, b, n, n_segment, sums);
+#endif
+            (void)level;
+            sad_segments_scalar(a, b, n, n_segment, sums);
+        }
+    }
+
+    /**
+     * @brief mean absolute difference of each block of two images, in the units of their channels
+     */
+    struct change_map
+    {
+        change_map()
+            : blocks_x(0)
+            , blocks_y(0)
+            , mean_difference(0)
+        {
+        }
+
+        VIDI_UINT blocks_x;
+        VIDI_UINT blocks_y;
+        std::vector<float> blocks;  ///< blocks[by * blocks_x + bx], over all the channels of the block
+        double mean_difference;     ///< over the whole image
+
+        size_t count_above(double threshold) const
+        {
+            size_t n = 0;
+            for (size_t k = 0; k < blocks.size(); ++k)
+                n += blocks[k] > threshold;
+            return n;
+        }
+    };
+
+    /**
+     * @brief compares two images of the same size and format block by block
+     *
+     * @param block_size side of the blocks in pixels; those of the last row and column may be smaller
+     */
+    inline bool compute_change_map(const image_view & a, const image_view & b, VIDI_UINT block_size, change_map & map,
+        simd_level level = best_simd_level())
+    {
+        if (a.empty() || !block_size || a.width() != b.width() || a.height() != b.height() || a.channels() != b.channels()
+            || a.channel_depth() != b.channel_depth())
+            return false;
+
+        map.blocks_x = (a.width() + block_size - 1) / block_size;
+        map.blocks_y = (a.height() + block_size - 1) / block_size;
+        map.blocks.assign(static_cast<size_t>(map.blocks_x) * map.blocks_y, 0.f);
+
+        size_t n = static_cast<size_t>(a.width()) * a.channels(), n_segment = static_cast<size_t>(block_size) * a.channels();
+        std::vector<uint64_t> sums(map.blocks_x);
+        uint64_t total = 0;
+        for (VIDI_UINT by = 0; by < map.blocks_y; ++by)
+        {
+            std::fill(sums.begin(), sums.end(), 0);
+            VIDI_UINT y0 = by * block_size, y1 = std::min(a.height(), y0 + block_size);
+            for (VIDI_UINT y = y0; y < y1; ++y)
+            {
+                if (a.channel_depth() == VIDI_IMG_8U)
+                    detail::sad_segments(a.row(y), b.row(y), n, n_segment, &sums[0], level);
+                else
+                    detail::sad_segments(reinterpret_cast<const uint16_t *>(a.row(y)), reinterpret_cast<const uint16_t *>(b.row(y)),
+                        n, n_segment, &sums[0], level);
+            }
+            for (VIDI_UINT bx = 0; bx < map.blocks_x; ++bx)
+            {
+                size_t values = static_cast<size_t>(std::min(block_size, a.width() - bx * block_size)) * a.channels() * (y1 - y0);
+                map.blocks[by * map.blocks_x + bx] = static_cast<float>(double(sums[bx]) / values);
+                total += sums[bx];
+            }
+        }
+        map.mean_difference = double(total) / (n * a.height());
+        return true;
+    }
+
+    struct change_gate_options
+    {
+        change_gate_options()
+            : block_size(32)
+            , block_threshold(4.0)
+            , max_changed_blocks(0)
+            , max_reuses(0)
+        {
+        }
+
+        VIDI_UINT block_size;           ///< side of the blocks in pixels
+        double block_threshold;         ///< mean absolute difference above which a block has changed, in the units of the channels
+        size_t max_changed_blocks;      ///< number of changed blocks still taken as the same scene
+        size_t max_reuses;              ///< consecutive frames that may reuse a result before one is processed anyway, 0 for no limit
+    };
+
+    struct change_gate_stats
+    {
+        change_gate_stats()
+            : frames(0)
+            , reused(0)
+            , processed(0)
+        {
+        }
+
+        size_t frames;
+        size_t reused;      ///< processing avoided
+        size_t processed;
+    };
+
+    class change_gate
+    {
+    public:
+        explicit change_gate(const change_gate_options & options = change_gate_options(), simd_level level = best_simd_level())
+            : m_options(options)
+            , m_level(level)
+        {
+        }
+
+        /**
+         * @brief copies the result of the last processed frame of the stream to xml if the frame looks the same
+         *
+         * @param map if not null, receives the comparison with the last processed frame
+         */
+        bool reuse(const std::string & stream, const image_view & frame, std::string & xml, change_map * map = 0)
+        {
+            stream_state & s = state(stream);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            change_map local;
+            change_map & m = map ? *map : local;
+            bool same = s.has_result && (!m_options.max_reuses || s.reuses < m_options.max_reuses)
+                && compute_change_map(frame, s.reference.view(), m_options.block_size, m, m_level)
+                && m.count_above(m_options.block_threshold) <= m_options.max_changed_blocks;
+            if (same)
+            {
+                xml = s.xml;
+                ++s.reuses;
+            }
+
+            std::lock_guard<std::mutex> stats_lock(m_mutex);
+            ++m_stats.frames;
+            ++(same ? m_stats.reused : m_stats.processed);
+            return same;
+        }
+
+        /**
+         * @brief makes the frame and its result the reference of the stream
+         */
+        void update(const std::string & stream, const image_view & frame, const std::string & xml)
+        {
+            stream_state & s = state(stream);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.reference.assign(frame);
+            s.xml = xml;
+            s.reuses = 0;
+            s.has_result = true;
+        }
+
+        /**
+         * @brief returns the result of processing the image with the tool, or the last one of the stream if the image looks the same
+         *
+         * The gate keeps one reference per stream argument, so the tool and parameters should
+         * not change between calls on the same stream; call forget() when they do.
+         *
+         * @return whether the previous result was reused, or the error of the first step that failed
+         */
+        result<bool> process(const char * workspace, const char * stream, const char * tool, const char * sample,
+            const char * parameters, VIDI_IMAGE * image, std::string & xml)
+        {
+            image_view frame(*image);
+            if (reuse(stream, frame, xml))
+                return true;
+
+            VIDI_BUFFER buffer;
+            vidi_init_buffer(&buffer);
+            auto created = runtime::create_sample(workspace, stream, sample);
+            auto processed = created
+                .and_then([&] { return runtime::sample_add_image(workspace, stream, sample, image); })
+                .and_then([&] { return runtime::sample_process(workspace, stream, tool, sample, parameters); })
+                .and_then([&] { return runtime::get_sample(workspace, stream, sample, &buffer); });
+            if (processed)
+            {
+                buffer_view view(buffer);
+                xml.assign(view.data(), view.size());
+                update(stream, frame, xml);
+            }
+            vidi_free_buffer(&buffer);
+
+            if (created)
+            {
+                auto freed = runtime::free_sample(workspace, stream, sample);
+                if (processed && !freed)
+                    return freed.error();
+            }
+            if (!processed)
+                return processed.error();
+            return false;
+        }
+
+        /**
+         * @brief drops the reference of a stream, so that its next frame is processed
+         */
+        void forget(const std::string & stream)
+        {
+            stream_state & s = state(stream);
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.has_result = false;
+        }
+
+        change_gate_stats stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_stats;
+        }
+
+    private:
+        change_gate(const change_gate &);
+        change_gate & operator=(const change_gate &);
+
+        /// packed copy of a frame
+        struct frame_copy
+        {
+            frame_copy() : width(0), height(0), channels(0), depth(VIDI_IMG_8U) {}
+
+            void assign(const image_view & frame)
+            {
+                width = frame.width();
+                height = frame.height();
+                channels = frame.channels();
+                depth = frame.channel_depth();
+                pixels.resize(frame.row_size() * frame.height());
+                if (!pixels.empty())
+                    frame.copy_to(&pixels[0]);
+            }
+
+            image_view view() const
+            {
+                return image_view(pixels.empty() ? 0 : const_cast<unsigned char *>(&pixels[0]), width, height, channels, depth);
+            }
+
+            std::vector<unsigned char> pixels;
+            VIDI_UINT width;
+            VIDI_UINT height;
+            VIDI_UINT channels;
+            VIDI_UINT depth;
+        };
+
+        struct stream_state
+        {
+            stream_state() : reuses(0), has_result(false) {}
+
+            std::mutex mutex;
+            frame_copy reference;
+            std::string xml;
+            size_t reuses;
+            bool has_result;
+        };
+
+        stream_state & state(const std::string & stream)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::unique_ptr<stream_state> & s = m_streams[stream];
+            if (!s)
+                s.reset(new stream_state());
+            return *s;
+        }
+
+        change_gate_options m_options;
+        simd_level m_level;
+        std::map<std::string, std::unique_ptr<stream_state> > m_streams;
+        change_gate_stats m_stats;
+        mutable std::mutex m_mutex;
+    };
+}
+
+#endif
@@ -0,0 +1,264 @@
+/**
+ * @file content_hash.hpp
+ * @brief Fast 64-bit hash of pixel data, with SSE2/AVX2 and scalar paths
+ *
+ * The construction follows XXH3: the input is read in stripes of 64 bytes, each 64-bit lane
+ * of a stripe is combined with a secret and multiplied 32 by 32 bits into one accumulator,
+ * while the raw lane is added to the neighbouring one; every 16 stripes the accumulators are
+ * scrambled, and at the end they are folded and avalanched. It is meant to recognize identical
+ * frames, not to resist an adversary, and is not compatible with the reference XXH3 values.
+ *
+ *     vidi_utils::content_hasher hasher;
+ *     vidi_utils::hash_pixels(hasher, vidi_utils::image_view(image));
+ *     uint64_t h = hasher.digest();
+ *
+ * Every instruction set gives the same value, and feeding the same bytes in different pieces
+ * gives the same value as feeding them at once.
+ */
+
+#ifndef VIDI_UTILS_CONTENT_HASH_HPP_INCLUDED
+#define VIDI_UTILS_CONTENT_HASH_HPP_INCLUDED
+
+#include "vidi.h"
+#include "image_view.hpp"
+#include "pixel_convert.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace vidi_utils
+{
+    namespace detail
+    {
+        static const uint64_t hash_prime32_1 = 0x9E3779B1ULL;
+        static const uint64_t hash_prime64_1 = 0x9E3779B185EBCA87ULL;
+        static const uint64_t hash_prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+        static const size_t hash_stripes_per_block = 16;
+
+        /// the secret mixed into the lanes, then into the accumulators when scrambling
+        inline const uint64_t * hash_secret()
+        {
+            static const uint64_t secret[16] = {
+                0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+                0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL, 0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL,
+                0xcb00c391bb52283cULL, 0xa32e531b8b65d088ULL, 0x4ef90da297486471ULL, 0xd8acdea946ef1938ULL,
+                0x3f349ce33f76faa8ULL, 0x1d4f0bc7c7bbdcf9ULL, 0x3159b4cd4be0518aULL, 0x647378d9c97e9fc8ULL };
+            return secret;
+        }
+
+        inline uint64_t read64(const unsigned char * p)
+        {
+            uint64_t v;
+            std::memcpy(&v, p, 8);
+            return v;
+        }
+
+        inline uint64_t hash_avalanche(uint64_t h)
+        {
+            h ^= h >> 37;
+            h *= 0x165667919E3779F9ULL;
+            return h ^ (h >> 32);
+        }
+
+        inline void hash_stripes_scalar(uint64_t * acc, const unsigned char * p, size_t n_stripes)
+        {
+            const uint64_t * secret = hash_secret();
+            for (size_t s = 0; s < n_stripes; ++s, p += 64)
+            {
+                for (size_t i = 0; i < 8; ++i)
+                {
+                    uint64_t data = read64(p + 8 * i);
+                    uint64_t key = data ^ secret[i];
+                    acc[i ^ 1] += data;
+                    acc[i] += (key & 0xFFFFFFFFULL) * (key >> 32);
+                }
+            }
+        }
+
+        inline void hash_scramble_scalar(uint64_t * acc)
+        {
+            const uint64_t * secret = hash_secret();
+            for (size_t i = 0; i < 8; ++i)
+                acc[i] = ((acc[i] ^ (acc[i] >> 47)) ^ secret[8 + i]) * hash_prime32_1;
+        }
+
+#if defined(VIDI_UTILS_X86_SIMD)
+        VIDI_UTILS_TARGET("sse2")
+        inline void hash_stripes_sse(uint64_t * acc, const unsigned char * p, size_t n_stripes)
+        {
+            const uint64_t * secret = hash_secret();
+            __m128i a[4], k[4];
+            for (size_t i = 0; i < 4; ++i)
+            {
+                a[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(acc + 2 * i));
+                k[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(secret + 2 * i));
+            }
+            for (size_t s = 0; s < n_stripes; ++s, p += 64)
+            {
+                for (size_t i = 0; i < 4; ++i)
+                {
+                    __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * i));
+                    __m128i key = _mm_xor_si128(data, k[i]);
+                    __m128i product = _mm_mul_epu32(key, _mm_srli_epi64(key, 32));
+                    // the lanes of a pair exchanged: acc[i ^ 1] += data
+                    a[i] = _mm_add_epi64(a[i], _mm_add_epi64(product, _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2))));
+                }
+            }
+            for (size_t i = 0; i < 4; ++i)
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(acc + 2 * i), a[i]);
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline void hash_stripes_avx2(uint64_t * acc, const unsigned char * p, size_t n_stripes)
+        {
+            const uint64_t * secret = hash_secret();
+            __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc));
+            __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(acc + 4));
+            const __m256i k0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(secret));
+            const __m256i k1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(secret + 4));
+            for (size_t s = 0; s < n_stripes; ++s, p += 64)
+            {
+                __m256i d0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+                __m256i d1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 32));
+                __m256i x0 = _mm256_xor_si256(d0, k0), x1 = _mm256_xor_si256(d1, k1);
+                a0 = _mm256_add_epi64(a0, _mm256_add_epi64(_mm256_mul_epu32(x0, _mm256_srli_epi64(x0, 32)), _mm256_shuffle_epi32(d0, _MM_SHUFFLE(1, 0, 3, 2))));
+                a1 = _mm256_add_epi64(a1, _mm256_add_epi64(_mm256_mul_epu32(x1, _mm256_srli_epi64(x1, 32)), _mm256_shuffle_epi32(d1, _MM_SHUFFLE(1, 0, 3, 2))));
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc), a0);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(acc + 4), a1);
+        }
+#endif
+    }
+
+    /**
+     * @brief incremental hash of a sequence of bytes
+     */
+    class content_hasher
+    {
+    public:
+        explicit content_hasher(simd_level level = best_simd_level())
+            : m_level(level)
+        {
+            reset();
+        }
+
+        void reset()
+        {
+            static const uint64_t init[8] = {
+                detail::hash_prime32_1, detail::hash_prime64_1, detail::hash_prime64_2, 0x165667B19E3779F9ULL,
+                0x85EBCA77C2B2AE63ULL, 0x27D4EB2F165667C5ULL, detail::hash_prime64_2, detail::hash_prime32_1 };
+            std::memcpy(m_acc, init, sizeof(m_acc));
+            m_length = 0;
+            m_buffered = 0;
+            m_stripes = 0;
+        }
+
+        void update(const void * data, size_t size)
+        {
+            if (!size)
+                return;
+            const unsigned char * p = static_cast<const unsigned char *>(data);
+            m_length += size;
+            if (m_buffered)
+            {
+                size_t n = size < 64 - m_buffered ? size : 64 - m_buffered;
+                std::memcpy(m_buffer + m_buffered, p, n);
+                m_buffered += n;
+                p += n;
+                size -= n;
+                if (m_buffered < 64)
+                    return;
+                stripes(m_buffer, 1);
+                m_buffered = 0;
+            }
+            size_t n_stripes = size / 64;
+            stripes(p, n_stripes);
+            p += 64 * n_stripes;
+            size -= 64 * n_stripes;
+            std::memcpy(m_buffer, p, size);
+            m_buffered = size;
+        }
+
+        /**
+         * @brief the hash of the bytes given so far; more can be added afterwards
+         */
+        uint64_t digest() const
+        {
+            uint64_t acc[8];
+            std::memcpy(acc, m_acc, sizeof(acc));
+            if (m_buffered)
+            {
+                // the last, partial stripe is padded with zeros; the length tells the paddings apart
+                unsigned char last[64] = { 0 };
+                std::memcpy(last, m_buffer, m_buffered);
+                detail::hash_stripes_scalar(acc, last, 1);
+            }
+
+            uint64_t h = m_length * detail::hash_prime64_1;
+            for (size_t i = 0; i < 8; ++i)
+                h = (h ^ detail::hash_avalanche(acc[i] + detail::hash_secret()[i])) * detail::hash_prime64_2;
+            return detail::hash_avalanche(h ^ (h >> 29));
+        }
+
+    private:
+        /// processes full stripes, scrambling the accumulators at the end of each block
+        void stripes(const unsigned char * p, size_t n)
+        {
+            while (n)
+            {
+                size_t k = detail::hash_stripes_per_block - m_stripes;
+                if (k > n)
+                    k = n;
+#if defined(VIDI_UTILS_X86_SIMD)
+                if (m_level == simd_avx2)
+                    detail::hash_stripes_avx2(m_acc, p, k);
+                else if (m_level == simd_sse)
+                    detail::hash_stripes_sse(m_acc, p, k);
+                else
+#endif
+                    detail::hash_stripes_scalar(m_acc, p, k);
+                p += 64 * k;
+                n -= k;
+                m_stripes += k;
+                if (m_stripes == detail::hash_stripes_per_block)
+                {
+                    detail::hash_scramble_scalar(m_acc);
+                    m_stripes = 0;
+                }
+            }
+        }
+
+        simd_level m_level;
+        uint64_t m_acc[8];
+        uint64_t m_length;
+        unsigned char m_buffer[64];
+        size_t m_buffered;
+        size_t m_stripes;
+    };
+
+    /**
+     * @brief adds the size, format and pixels of an image to a hash, leaving out the padding of the rows
+     */
+    inline void hash_pixels(content_hasher & hasher, const image_view & image)
+    {
+        VIDI_UINT header[4] = { image.width(), image.height(), image.channels(), image.channel_depth() };
+        hasher.update(header, sizeof(header));
+        if (image.contiguous())
+        {
+            hasher.update(image.data(), image.row_size() * image.height());
+            return;
+        }
+        for (VIDI_UINT y = 0; y < image.height(); ++y)
+            hasher.update(image.row(y), image.row_size());
+    }
+
+    inline uint64_t hash_pixels(const image_view & image, simd_level level = best_simd_level())
+    {
+        content_hasher hasher(level);
+        hash_pixels(hasher, image);
+        return hasher.digest();
+    }
+}
+
+#endif
@@ -0,0 +1,381 @@
+/**
+ * @file decode_pipeline.hpp
+ * @brief Decodes encoded images (PNG, BMP, TIFF) on worker threads and delivers them in order
+ *
+ * Decoding a received image with vidi_load_image_from_memory() on the thread that processes
+ * the samples stalls the processing for the duration of the decode. decode_pipeline moves the
+ * decoding to worker threads:
+ *
+ *     vidi_utils::decode_pipeline decoder;
+ *     // producer, e.g. a network receiver
+ *     decoder.submit(std::move(png_bytes), VIDI_IMAGE_FORMAT_PNG);
+ *     ...
+ *     decoder.close();
+ *     // consumer
+ *     vidi_utils::decoded_image image;
+ *     while (decoder.next(image))
+ *         if (image) vidi_runtime_sample_add_image("workspace", "default", "my_sample", image.get());
+ *
+ * Images come out in the order they were submitted, whatever the order the decodes finish in.
+ * They are decoded into a fixed set of library managed VIDI_IMAGEs which are reused once the
+ * decoded_image holding them is destroyed: this bounds the memory in flight, and a consumer
+ * holding on to decoded images eventually stalls the workers. Every decoded_image must be
+ * destroyed before the pipeline, which must itself be destroyed before vidi_deinitialize().
+ */
+
+#ifndef VIDI_UTILS_DECODE_PIPELINE_HPP_INCLUDED
+#define VIDI_UTILS_DECODE_PIPELINE_HPP_INCLUDED
+
+#include "vidi.h"
+#include "bounded_queue.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace vidi_utils
+{
+    /**
+     * @brief the VIDI_IMAGE_FORMAT_ matching the extension of the path, PNG for unknown extensions
+     */
+    inline VIDI_UINT image_format_of(const std::string & path)
+    {
+        std::string::size_type dot = path.rfind('.');
+        std::string ext = dot == std::string::npos ? std::string() : path.substr(dot + 1);
+        for (size_t k = 0; k < ext.size(); ++k)
+            ext[k] = static_cast<char>(std::tolower(static_cast<unsigned char>(ext[k])));
+        if (ext == "bmp")
+            return VIDI_IMAGE_FORMAT_BMP;
+        if (ext == "tif" || ext == "tiff")
+            return VIDI_IMAGE_FORMAT_TIFF;
+        return VIDI_IMAGE_FORMAT_PNG;
+    }
+
+    struct decode_options
+    {
+        decode_options()
+            : n_workers(0)
+            , queue_capacity(8)
+            , max_images(0)
+        {
+        }
+
+        size_t n_workers;       ///< decoding threads, 0 uses std::thread::hardware_concurrency()
+        size_t queue_capacity;  ///< encoded images waiting for a worker, and decoded ones waiting for the consumer
+        size_t max_images;      ///< VIDI_IMAGEs decoded into, 0 uses n_workers + 2 * queue_capacity
+    };
+
+    struct decode_stats
+    {
+        decode_stats()
+            : submitted(0)
+            , decoded(0)
+            , failed(0)
+            , bytes(0)
+            , decode_seconds(0.0)
+        {
+        }
+
+        size_t submitted;
+        size_t decoded;
+        size_t failed;
+        size_t bytes;           ///< encoded bytes decoded
+        double decode_seconds;  ///< time spent decoding, summed over the workers
+    };
+
+    /**
+     * @brief an image out of the pipeline, or the status of its failed decode
+     *
+     * Move-only; its VIDI_IMAGE goes back to the pipeline when it is destroyed.
+     */
+    class decoded_image
+    {
+    public:
+        decoded_image()
+            : m_index(0)
+            , m_status(VIDI_SUCCESS)
+            , m_owned(false)
+            , m_free(0)
+        {
+        }
+
+        decoded_image(decoded_image && other)
+            : m_index(other.m_index)
+            , m_status(other.m_status)
+            , m_image(other.m_image)
+            , m_owned(other.m_owned)
+            , m_free(other.m_free)
+        {
+            other.m_owned = false;
+        }
+
+        decoded_image & operator=(decoded_image && other)
+        {
+            if (this != &other)
+            {
+                release();
+                m_index = other.m_index;
+                m_status = other.m_status;
+                m_image = other.m_image;
+                m_owned = other.m_owned;
+                m_free = other.m_free;
+                other.m_owned = false;
+            }
+            return *this;
+        }
+
+        ~decoded_image()
+        {
+            release();
+        }
+
+        /**
+         * @brief position of the image in the order of submission
+         */
+        size_t index() const { return m_index; }
+
+        /**
+         * @brief status of vidi_load_image_from_memory()
+         */
+        VIDI_UINT status() const { return m_status; }
+
+        explicit operator bool() const { return m_owned && m_status == VIDI_SUCCESS; }
+
+        VIDI_IMAGE * get() { return &m_image; }
+        const VIDI_IMAGE * get() const { return &m_image; }
+
+        /**
+         * @brief gives the image back to the pipeline before the handle is destroyed
+         */
+        void release()
+        {
+            if (!m_owned)
+                return;
+            // the pipeline is shutting down: nobody will reuse the image
+            if (!m_free->push(m_image))
+                vidi_free_image(&m_image);
+            m_owned = false;
+        }
+
+    private:
+        friend class decode_pipeline;
+
+        decoded_image(const decoded_image &);
+        decoded_image & operator=(const decoded_image &);
+
+        size_t m_index;
+        VIDI_UINT m_status;
+        VIDI_IMAGE m_image;
+        bool m_owned;
+        bounded_queue<VIDI_IMAGE> * m_free;
+    };
+
+    class decode_pipeline
+    {
+    public:
+        explicit decode_pipeline(const decode_options & options = decode_options())
+            : m_n_workers(options.n_workers ? options.n_workers : std::max<size_t>(1, std::thread::hardware_concurrency()))
+            , m_free(options.max_images ? options.max_images : m_n_workers + 2 * options.queue_capacity)
+            , m_input(options.queue_capacity)
+            , m_output(options.queue_capacity)
+            , m_recycled(options.queue_capacity + m_n_workers)
+            , m_next_submitted(0)
+            , m_next_delivered(0)
+            , m_running(m_n_workers)
+        {
+            for (size_t k = 0; k < m_free.capacity(); ++k)
+            {
+                VIDI_IMAGE image;
+                if (vidi_init_image(&image) != VIDI_SUCCESS)
+                    break;
+                m_free.push(image);
+            }
+
+            for (size_t k = 0; k < m_n_workers; ++k)
+                m_workers.push_back(std::thread([this]() { worker_loop(); }));
+        }
+
+        /**
+         * @brief stops the workers, dropping the images not delivered yet, and frees the images
+         */
+        ~decode_pipeline()
+        {
+            m_input.close();
+            m_output.close();
+            m_free.close();
+            for (auto & th : m_workers)
+                th.join();
+
+            decoded_image undelivered;
+            while (m_output.try_pop(undelivered))
+                undelivered.release();
+            VIDI_IMAGE image;
+            while (m_free.try_pop(image))
+                vidi_free_image(&image);
+        }
+
+        /**
+         * @brief a buffer to fill with the next encoded image, reusing the capacity of a decoded one
+         */
+        std::vector<char> buffer()
+        {
+            std::vector<char> data;
+            m_recycled.try_pop(data);
+            data.clear();
+            return data;
+        }
+
+        /**
+         * @brief queues an encoded image, waiting while the workers are busy
+         *
+         * @param format VIDI_IMAGE_FORMAT_PNG, VIDI_IMAGE_FORMAT_BMP or VIDI_IMAGE_FORMAT_TIFF
+         * @return false once close() has been called
+         */
+        bool submit(std::vector<char> && data, VIDI_UINT format)
+        {
+            // the index and the position in the queue must be given together for the order to hold
+            std::lock_guard<std::mutex> lock(m_submit_mutex);
+            encoded e;
+            e.index = m_next_submitted;
+            e.format = format;
+            e.data = std::move(data);
+            if (!m_input.push(std::move(e)))
+                return false;
+            ++m_next_submitted;
+            return true;
+        }
+
+        /**
+         * @brief no more submissions; next() returns false once the queued images are delivered
+         */
+        void close()
+        {
+            m_input.close();
+        }
+
+        /**
+         * @brief waits for the next image in the order of submission
+         *
+         * @return false once the pipeline is closed and every image was delivered
+         */
+        bool next(decoded_image & image)
+        {
+            return m_output.pop(image);
+        }
+
+        size_t n_workers() const { return m_n_workers; }
+
+        decode_stats stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_order_mutex);
+            decode_stats s = m_stats;
+            s.submitted = m_next_submitted;
+            return s;
+        }
+
+    private:
+        decode_pipeline(const decode_pipeline &);
+        decode_pipeline & operator=(const decode_pipeline &);
+
+        struct encoded
+        {
+            encoded() : index(0), format(VIDI_IMAGE_FORMAT_PNG) {}
+
+            size_t index;
+            VIDI_UINT format;
+            std::vector<char> data;
+        };
+
+        void worker_loop()
+        {
+            encoded e;
+            VIDI_IMAGE image;
+            // the image is taken before the input, so the worker holding the oldest input always has one
+            while (m_free.pop(image))
+            {
+                if (!m_input.pop(e))
+                {
+                    if (!m_free.push(image))
+                        vidi_free_image(&image);
+                    break;
+                }
+
+                VIDI_BUFFER buffer;
+                buffer.data = e.data.empty() ? 0 : &e.data.front();
+                buffer.size = static_cast<VIDI_UINT>(e.data.size());
+
+                auto start = std::chrono::steady_clock::now();
+                decoded_image out;
+                out.m_index = e.index;
+                out.m_status = vidi_load_image_from_memory(&buffer, e.format, &image);
+                out.m_image = image;
+                out.m_owned = true;
+                out.m_free = &m_free;
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                size_t bytes = e.data.size();
+                m_recycled.try_push(std::move(e.data));
+                e.data = std::vector<char>();
+
+                // a failed decode does not keep its image
+                if (out.m_status != VIDI_SUCCESS)
+                    out.release();
+                deliver(std::move(out), bytes, seconds);
+            }
+
+            std::lock_guard<std::mutex> lock(m_order_mutex);
+            if (--m_running == 0)
+                m_output.close();
+        }
+
+        /**
+         * @brief passes the image and every following one already decoded to the consumer
+         */
+        void deliver(decoded_image && image, size_t bytes, double seconds)
+        {
+            std::lock_guard<std::mutex> lock(m_order_mutex);
+            if (image.status() == VIDI_SUCCESS)
+                ++m_stats.decoded;
+            else
+                ++m_stats.failed;
+            m_stats.bytes += bytes;
+            m_stats.decode_seconds += seconds;
+
+            m_pending.insert(std::make_pair(image.index(), std::move(image)));
+            // pushing under the lock keeps the order; a full output queue holds the other workers back
+            for (auto it = m_pending.find(m_next_delivered); it != m_pending.end(); it = m_pending.find(m_next_delivered))
+            {
+                m_output.push(std::move(it->second));
+                m_pending.erase(it);
+                ++m_next_delivered;
+            }
+        }
+
+        size_t m_n_workers;
+        // declared first so that it outlives the decoded images held by the other members
+        bounded_queue<VIDI_IMAGE> m_free;
+        bounded_queue<encoded> m_input;
+        bounded_queue<decoded_image> m_output;
+        bounded_queue<std::vector<char> > m_recycled;
+
+        std::mutex m_submit_mutex;
+        std::atomic<size_t> m_next_submitted;
+
+        mutable std::mutex m_order_mutex;
+        std::map<size_t, decoded_image> m_pending;
+        size_t m_next_delivered;
+        size_t m_running;
+        decode_stats m_stats;
+
+        std::vector<std::thread> m_workers;
+    };
+}
+
+#endif
@@ -0,0 +1,192 @@
+/**
+ * @file error.hpp
+ * @brief Status code carrying error with its message looked up only when it is printed
+ *
+ * A vidi_utils::error is just the status code returned by the library plus an optional static
+ * context string, so creating, copying and testing it costs nothing. Retrieving the message
+ * means allocating a VIDI_BUFFER, calling vidi_get_error_message() and decoding the returned
+ * xml; this is only done when message() is called or the error is printed, and the decoded
+ * message is then kept in a small cache keyed by status code.
+ */
+
+#ifndef VIDI_UTILS_ERROR_HPP_INCLUDED
+#define VIDI_UTILS_ERROR_HPP_INCLUDED
+
+#include "vidi.h"
+#include "../rapidxml/rapidxml.hpp"
+#include "buffer_view.hpp"
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+namespace vidi_utils
+{
+    /**
+     * @brief bounded cache of decoded error messages, safe to use from several threads
+     *
+     * Entries are spread over independently locked shards so that threads printing different
+     * errors do not contend. Each shard forgets its oldest entry once full.
+     *
+     * The message of a status code is assumed not to change; call clear() if the library
+     * is reinitialized.
+     */
+    class error_message_cache
+    {
+    public:
+        static const size_t n_shards = 8;
+        static const size_t entries_per_shard = 16;
+
+        /**
+         * @brief returns the message of status, fetching and decoding it on the first request
+         */
+        static std::string get(VIDI_UINT status)
+        {
+            shard & s = shard_of(status);
+            {
+                std::lock_guard<std::mutex> lock(s.mutex);
+                std::map<VIDI_UINT, std::string>::const_iterator it = s.messages.find(status);
+                if (it != s.messages.end())
+                    return it->second;
+            }
+
+            // fetched outside of the lock, two threads may decode the same message once
+            std::string message;
+            if (!fetch(status, message))
+                return message;
+
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (s.messages.insert(std::make_pair(status, message)).second)
+            {
+                s.order.push_back(status);
+                if (s.order.size() > entries_per_shard)
+                {
+                    s.messages.erase(s.order.front());
+                    s.order.pop_front();
+                }
+            }
+            return message;
+        }
+
+        static void clear()
+        {
+            for (size_t k = 0; k < n_shards; ++k)
+            {
+                std::lock_guard<std::mutex> lock(shards()[k].mutex);
+                shards()[k].messages.clear();
+                shards()[k].order.clear();
+            }
+        }
+
+        /**
+         * @brief asks the library for the message of status and extracts the text of its <error> node
+         *
+         * @return false if the message could not be retrieved, message then says so and must not be cached
+         */
+        static bool fetch(VIDI_UINT status, std::string & message)
+        {
+            VIDI_BUFFER buffer;
+            if (vidi_init_buffer(&buffer) != VIDI_SUCCESS)
+            {
+                message = "failed to get last error message";
+                return false;
+            }
+
+            bool ok = vidi_get_error_message(status, &buffer) == VIDI_SUCCESS;
+            if (!ok)
+            {
+                message = "failed to get last error message";
+            }
+            else
+            {
+                buffer_view text(buffer);
+                message.assign(text.data() ? text.data() : "", text.size());
+                try
+                {
+                    rapidxml::xml_document<> doc;
+                    rapidxml::xml_node<> * node = parse_in_situ(doc, buffer) ? doc.first_node("error") : 0;
+                    if (node)
+                        message.assign(node->value(), node->value_size());
+                }
+                catch (const rapidxml::parse_error &)
+                {
+                    // not xml, keep the raw text
+                }
+            }
+
+            vidi_free_buffer(&buffer);
+            return ok;
+        }
+
+    private:
+        struct shard
+        {
+            std::mutex mutex;
+            std::map<VIDI_UINT, std::string> messages;
+            std::deque<VIDI_UINT> order;
+        };
+
+        static shard * shards()
+        {
+            static shard s[n_shards];
+            return s;
+        }
+
+        static shard & shard_of(VIDI_UINT status)
+        {
+            return shards()[status % n_shards];
+        }
+    };
+
+    /**
+     * @brief status code returned by the library, with the name of the call that failed
+     */
+    class error
+    {
+    public:
+        /**
+         * @param context static string describing what failed, e.g. "failed to open workspace"; it is not copied
+         */
+        error(VIDI_UINT status = VIDI_SUCCESS, const char * context = 0)
+            : m_status(status)
+            , m_context(context)
+        {
+        }
+
+        VIDI_UINT status() const { return m_status; }
+        const char * context() const { return m_context; }
+
+        bool failed() const { return m_status != VIDI_SUCCESS; }
+
+        /**
+         * @brief true on failure, like std::error_code
+         */
+        explicit operator bool() const { return failed(); }
+
+        /**
+         * @brief the decoded message of the library, retrieved on first use
+         */
+        std::string message() const
+        {
+            return failed() ? error_message_cache::get(m_status) : std::string();
+        }
+
+    private:
+        VIDI_UINT m_status;
+        const char * m_context;
+    };
+
+    /**
+     * @brief prints "context: message (status)"; this is where the message gets retrieved
+     */
+    inline std::ostream & operator<<(std::ostream & os, const error & e)
+    {
+        if (e.context())
+            os << e.context() << ": ";
+        return os << e.message() << " (status " << e.status() << ")";
+    }
+}
+
+#endif
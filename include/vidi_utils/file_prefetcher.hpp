@@ -0,0 +1,580 @@
+/**
+ * @file file_prefetcher.hpp
+ * @brief Reads a list of files ahead of their use, keeping several reads in flight
+ *
+ * Loading images one after the other with vidi_load_image() puts the latency of every disk
+ * access on the critical path. file_prefetcher reads the files of a list in the background,
+ * up to `depth` of them at once, and hands their content out in the order of the list:
+ *
+ *     vidi_utils::file_prefetcher files(paths);
+ *     vidi_utils::prefetched_file file;
+ *     while (files.next(file))
+ *         if (file.ok) decoder.submit(std::move(file.data), vidi_utils::image_format_of(paths[file.index]));
+ *
+ * On Linux the reads are queued with io_uring, through the raw system calls so that no
+ * library is needed; where io_uring is not available (older kernels, containers forbidding
+ * it, other systems, or VIDI_UTILS_NO_IO_URING defined) a few threads read the files with
+ * pread() (fread() on Windows) instead. backend() tells which one is used.
+ */
+
+#ifndef VIDI_UTILS_FILE_PREFETCHER_HPP_INCLUDED
+#define VIDI_UTILS_FILE_PREFETCHER_HPP_INCLUDED
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__) && !defined(VIDI_UTILS_NO_IO_URING) && defined(__has_include)
+    #if __has_include(<linux/io_uring.h>)
+        #define VIDI_UTILS_HAS_IO_URING
+    #endif
+#endif
+
+#if defined(_WIN32)
+    #include <cstdio>
+#else
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#if defined(VIDI_UTILS_HAS_IO_URING)
+    #include <linux/io_uring.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <sys/uio.h>
+    #include <cerrno>
+#endif
+
+namespace vidi_utils
+{
+    struct prefetch_options
+    {
+        prefetch_options()
+            : depth(16)
+            , n_threads(4)
+            , use_io_uring(true)
+        {
+        }
+
+        size_t depth;       ///< files read ahead of the consumer, hence at most in flight
+        size_t n_threads;   ///< reading threads when io_uring is not used
+        bool use_io_uring;  ///< false forces the threads
+    };
+
+    struct prefetch_stats
+    {
+        prefetch_stats()
+            : files(0)
+            , bytes(0)
+            , failures(0)
+            , seconds(0.0)
+            , max_in_flight(0)
+            , in_flight_sum(0)
+        {
+        }
+
+        double mb_per_second() const { return seconds > 0.0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0; }
+        double files_per_second() const { return seconds > 0.0 ? files / seconds : 0.0; }
+
+        /**
+         * @brief average number of reads in flight when one completed
+         */
+        double average_in_flight() const { return files + failures ? double(in_flight_sum) / (files + failures) : 0.0; }
+
+        size_t files;           ///< files read completely
+        size_t bytes;
+        size_t failures;        ///< files which could not be opened or read
+        double seconds;         ///< from the construction to the last completed read
+        size_t max_in_flight;
+        size_t in_flight_sum;
+    };
+
+    struct prefetched_file
+    {
+        prefetched_file() : index(0), ok(false) {}
+
+        size_t index;           ///< position in the list of paths
+        bool ok;                ///< false if the file could not be read, data is then empty
+        std::vector<char> data;
+    };
+
+    namespace detail
+    {
+        /**
+         * @brief reads the whole file into data, reusing its capacity
+         */
+        inline bool read_whole_file(const std::string & path, std::vector<char> & data)
+        {
+            data.clear();
+#if defined(_WIN32)
+            std::FILE * f = std::fopen(path.c_str(), "rb");
+            if (!f)
+                return false;
+            bool ok = std::fseek(f, 0, SEEK_END) == 0;
+            long size = ok ? std::ftell(f) : -1;
+            ok = size >= 0 && std::fseek(f, 0, SEEK_SET) == 0;
+            if (ok)
+            {
+                data.resize(static_cast<size_t>(size));
+                ok = std::fread(data.data(), 1, data.size(), f) == data.size();
+            }
+            std::fclose(f);
+            return ok;
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            bool ok = ::fstat(fd, &st) == 0;
+            if (ok)
+            {
+                data.resize(static_cast<size_t>(st.st_size));
+                size_t done = 0;
+                while (ok && done < data.size())
+                {
+                    ssize_t n = ::pread(fd, data.data() + done, data.size() - done, static_cast<off_t>(done));
+                    ok = n > 0;
+                    if (ok)
+                        done += static_cast<size_t>(n);
+                }
+            }
+            ::close(fd);
+            return ok;
+#endif
+        }
+
+#if defined(VIDI_UTILS_HAS_IO_URING)
+        /**
+         * @brief minimal io_uring submission and completion queues, driven by a single thread
+         */
+        class io_uring_queue
+        {
+        public:
+            io_uring_queue()
+                : m_fd(-1), m_sq_ptr(MAP_FAILED), m_cq_ptr(MAP_FAILED), m_sqes(0), m_sq_size(0), m_cq_size(0), m_sqes_size(0)
+            {
+            }
+
+            ~io_uring_queue()
+            {
+                if (m_sqes)
+                    ::munmap(m_sqes, m_sqes_size);
+                if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr)
+                    ::munmap(m_cq_ptr, m_cq_size);
+                if (m_sq_ptr != MAP_FAILED)
+                    ::munmap(m_sq_ptr, m_sq_size);
+                if (m_fd >= 0)
+                    ::close(m_fd);
+            }
+
+            /**
+             * @return false if the kernel does not offer io_uring or forbids it
+             */
+            bool init(unsigned entries)
+            {
+                io_uring_params p;
+                std::memset(&p, 0, sizeof(p));
+                m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+                if (m_fd < 0)
+                    return false;
+
+                m_sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+                m_cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+                bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+                if (single)
+                    m_sq_size = m_cq_size = std::max(m_sq_size, m_cq_size);
+
+                m_sq_ptr = ::mmap(0, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+                if (m_sq_ptr == MAP_FAILED)
+                    return false;
+                m_cq_ptr = single ? m_sq_ptr : ::mmap(0, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+                if (m_cq_ptr == MAP_FAILED)
+                    return false;
+                m_sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+                void * sqes = ::mmap(0, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+                if (sqes == MAP_FAILED)
+                    return false;
+                m_sqes = static_cast<io_uring_sqe *>(sqes);
+
+                char * sq = static_cast<char *>(m_sq_ptr);
+                m_sq_tail = reinterpret_cast<unsigned *>(sq + p.sq_off.tail);
+                m_sq_mask = *reinterpret_cast<unsigned *>(sq + p.sq_off.ring_mask);
+                m_sq_array = reinterpret_cast<unsigned *>(sq + p.sq_off.array);
+                char * cq = static_cast<char *>(m_cq_ptr);
+                m_cq_head = reinterpret_cast<unsigned *>(cq + p.cq_off.head);
+                m_cq_tail = reinterpret_cast<unsigned *>(cq + p.cq_off.tail);
+                m_cq_mask = *reinterpret_cast<unsigned *>(cq + p.cq_off.ring_mask);
+                m_cqes = reinterpret_cast<io_uring_cqe *>(cq + p.cq_off.cqes);
+                return true;
+            }
+
+            /**
+             * @brief queues a read of iov; it is sent to the kernel by the next enter()
+             */
+            void queue_read(int fd, const iovec * iov, size_t offset, unsigned long long user_data)
+            {
+                unsigned tail = *m_sq_tail;
+                unsigned index = tail & m_sq_mask;
+                io_uring_sqe * sqe = m_sqes + index;
+                std::memset(sqe, 0, sizeof(*sqe));
+                // READV rather than READ: it is available since the first kernels offering io_uring
+                sqe->opcode = IORING_OP_READV;
+                sqe->fd = fd;
+                sqe->addr = reinterpret_cast<unsigned long long>(iov);
+                sqe->len = 1;
+                sqe->off = offset;
+                sqe->user_data = user_data;
+                m_sq_array[index] = index;
+                __atomic_store_n(m_sq_tail, tail + 1, __ATOMIC_RELEASE);
+            }
+
+            /**
+             * @brief submits the queued reads and waits for at least min_complete completions
+             */
+            bool enter(unsigned to_submit, unsigned min_complete)
+            {
+                for (;;)
+                {
+                    long r = ::syscall(__NR_io_uring_enter, m_fd, to_submit, min_complete, min_complete ? IORING_ENTER_GETEVENTS : 0, 0, 0);
+                    if (r >= 0)
+                        return true;
+                    if (errno != EINTR)
+                        return false;
+                }
+            }
+
+            bool pop_completion(unsigned long long & user_data, int & res)
+            {
+                unsigned head = *m_cq_head;
+                if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE))
+                    return false;
+                const io_uring_cqe & cqe = m_cqes[head & m_cq_mask];
+                user_data = cqe.user_data;
+                res = cqe.res;
+                __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+                return true;
+            }
+
+        private:
+            io_uring_queue(const io_uring_queue &);
+            io_uring_queue & operator=(const io_uring_queue &);
+
+            int m_fd;
+            void * m_sq_ptr;
+            void * m_cq_ptr;
+            io_uring_sqe * m_sqes;
+            size_t m_sq_size;
+            size_t m_cq_size;
+            size_t m_sqes_size;
+            unsigned * m_sq_tail;
+            unsigned m_sq_mask;
+            unsigned * m_sq_array;
+            unsigned * m_cq_head;
+            unsigned * m_cq_tail;
+            unsigned m_cq_mask;
+            io_uring_cqe * m_cqes;
+        };
+#endif
+    }
+
+    class file_prefetcher
+    {
+    public:
+        /**
+         * @brief starts reading the first files of the list; the list must outlive the prefetcher
+         */
+        explicit file_prefetcher(const std::vector<std::string> & paths, const prefetch_options & options = prefetch_options())
+            : m_paths(paths)
+            , m_depth(std::max<size_t>(1, options.depth))
+            , m_slots(m_depth)
+            , m_ready(m_depth, false)
+            , m_consumed(0)
+            , m_next_issue(0)
+            , m_in_flight(0)
+            , m_stop(false)
+            , m_backend("threads")
+            , m_start(std::chrono::steady_clock::now())
+        {
+#if defined(VIDI_UTILS_HAS_IO_URING)
+            if (options.use_io_uring && m_ring.init(static_cast<unsigned>(m_depth)))
+            {
+                m_backend = "io_uring";
+                m_threads.push_back(std::thread([this]() { io_uring_loop(); }));
+                return;
+            }
+#endif
+            size_t n_threads = std::max<size_t>(1, std::min(options.n_threads, m_depth));
+            for (size_t k = 0; k < n_threads; ++k)
+                m_threads.push_back(std::thread([this]() { thread_loop(); }));
+        }
+
+        /**
+         * @brief stops reading; the reads in flight are waited for
+         */
+        ~file_prefetcher()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_slot_freed.notify_all();
+            for (auto & th : m_threads)
+                th.join();
+        }
+
+        /**
+         * @brief waits for the next file of the list
+         *
+         * @return false once every file was handed out
+         */
+        bool next(prefetched_file & file)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_consumed == m_paths.size())
+                return false;
+            size_t slot = m_consumed % m_depth;
+            m_file_ready.wait(lock, [&] { return m_ready[slot]; });
+            // the previous content of file goes back to the readers
+            std::swap(file, m_slots[slot]);
+            m_slots[slot].data.clear();
+            m_ready[slot] = false;
+            ++m_consumed;
+            lock.unlock();
+            m_slot_freed.notify_all();
+            return true;
+        }
+
+        /**
+         * @brief "io_uring" or "threads"
+         */
+        const char * backend() const { return m_backend; }
+
+        prefetch_stats stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_stats;
+        }
+
+    private:
+        file_prefetcher(const file_prefetcher &);
+        file_prefetcher & operator=(const file_prefetcher &);
+
+        /**
+         * @brief whether the file at m_next_issue may be read: its slot has been consumed
+         */
+        bool can_issue() const
+        {
+            return m_next_issue < m_paths.size() && m_next_issue < m_consumed + m_depth;
+        }
+
+        /**
+         * @brief takes the buffer left in the slot by the consumer, to reuse its capacity
+         */
+        std::vector<char> take_buffer(size_t index)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::vector<char> data;
+            data.swap(m_slots[index % m_depth].data);
+            return data;
+        }
+
+        void complete(size_t index, bool ok, std::vector<char> && data)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                prefetched_file & file = m_slots[index % m_depth];
+                file.index = index;
+                file.ok = ok;
+                file.data = std::move(data);
+                if (!ok)
+                    file.data.clear();
+                m_ready[index % m_depth] = true;
+
+                if (ok)
+                {
+                    ++m_stats.files;
+                    m_stats.bytes += file.data.size();
+                }
+                else
+                {
+                    ++m_stats.failures;
+                }
+                m_stats.in_flight_sum += m_in_flight;
+                --m_in_flight;
+                m_stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+            }
+            m_file_ready.notify_all();
+        }
+
+        /**
+         * @brief claims the next file to read, waiting for a free slot
+         *
+         * @return false when there is nothing left to read or the prefetcher is stopping
+         */
+        bool claim(size_t & index, bool wait)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (wait)
+                m_slot_freed.wait(lock, [this] { return m_stop || m_next_issue == m_paths.size() || can_issue(); });
+            if (m_stop || !can_issue())
+                return false;
+            index = m_next_issue++;
+            ++m_in_flight;
+            m_stats.max_in_flight = std::max(m_stats.max_in_flight, m_in_flight);
+            return true;
+        }
+
+        void thread_loop()
+        {
+            size_t index;
+            while (claim(index, true))
+            {
+                std::vector<char> data = take_buffer(index);
+                bool ok = detail::read_whole_file(m_paths[index], data);
+                complete(index, ok, std::move(data));
+            }
+        }
+
+#if defined(VIDI_UTILS_HAS_IO_URING)
+        struct request
+        {
+            request() : index(0), fd(-1), done(0) {}
+
+            size_t index;
+            int fd;
+            size_t done;
+            iovec iov;
+            std::vector<char> data;
+        };
+
+        void finish(request & r, bool ok)
+        {
+            if (r.fd >= 0)
+                ::close(r.fd);
+            r.fd = -1;
+            complete(r.index, ok, std::move(r.data));
+            r.data = std::vector<char>();
+        }
+
+        void queue_rest(request & r)
+        {
+            r.iov.iov_base = r.data.data() + r.done;
+            r.iov.iov_len = r.data.size() - r.done;
+            m_ring.queue_read(r.fd, &r.iov, r.done, r.index);
+        }
+
+        void io_uring_loop()
+        {
+            std::vector<request> requests(m_depth);
+            size_t in_flight = 0;
+            unsigned resubmit = 0;
+            for (;;)
+            {
+                bool more = true;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    if (!in_flight)
+                        m_slot_freed.wait(lock, [this] { return m_stop || m_next_issue == m_paths.size() || can_issue(); });
+                    if (!in_flight && (m_stop || m_next_issue == m_paths.size()))
+                        return;
+                    more = !m_stop;
+                }
+
+                // open the files whose slots are free and queue their reads, after the rest of the short reads
+                unsigned to_submit = resubmit;
+                resubmit = 0;
+                size_t index;
+                while (more && claim(index, false))
+                {
+                    request & r = requests[index % m_depth];
+                    r.index = index;
+                    r.data = take_buffer(index);
+                    r.done = 0;
+                    r.fd = ::open(m_paths[index].c_str(), O_RDONLY);
+                    struct stat st;
+                    if (r.fd < 0 || ::fstat(r.fd, &st) != 0)
+                    {
+                        finish(r, false);
+                        continue;
+                    }
+                    r.data.resize(static_cast<size_t>(st.st_size));
+                    if (r.data.empty())
+                    {
+                        finish(r, true);
+                        continue;
+                    }
+                    queue_rest(r);
+                    ++to_submit;
+                    ++in_flight;
+                }
+                if (!in_flight)
+                    continue;
+
+                if (!m_ring.enter(to_submit, 1))
+                {
+                    // the ring became unusable: fail what is in flight and read the rest with pread()
+                    for (size_t k = 0; k < requests.size(); ++k)
+                    {
+                        if (requests[k].fd >= 0)
+                            finish(requests[k], false);
+                    }
+                    thread_loop();
+                    return;
+                }
+
+                unsigned long long user_data;
+                int res;
+                while (m_ring.pop_completion(user_data, res))
+                {
+                    size_t index = static_cast<size_t>(user_data);
+                    request & r = requests[index % m_depth];
+                    if (res > 0)
+                        r.done += static_cast<size_t>(res);
+                    if (res <= 0 || r.done == r.data.size())
+                    {
+                        finish(r, res > 0);
+                        --in_flight;
+                    }
+                    else
+                    {
+                        // short read, queue the rest; it is submitted with the next reads, so that a ring failing
+                        // then fails it with the others rather than leaving its reader waiting
+                        queue_rest(r);
+                        ++resubmit;
+                    }
+                }
+            }
+        }
+
+        detail::io_uring_queue m_ring;
+#endif
+
+        const std::vector<std::string> & m_paths;
+        const size_t m_depth;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_file_ready;
+        std::condition_variable m_slot_freed;
+        std::vector<prefetched_file> m_slots;
+        std::vector<bool> m_ready;
+        size_t m_consumed;
+        size_t m_next_issue;
+        size_t m_in_flight;
+        bool m_stop;
+        prefetch_stats m_stats;
+
+        const char * m_backend;
+        std::chrono::steady_clock::time_point m_start;
+        std::vector<std::thread> m_threads;
+    };
+}
+
+#endif
@@ -0,0 +1,513 @@
+/**
+ * @file frame_file.hpp
+ * @brief Container of raw frames which is memory-mapped and read without decoding or copying
+ *
+ * Reprocessing a regression set stored as PNG files decodes every image at every pass. A frame
+ * file stores the decoded pixels once, and reading a frame is then only a matter of pointing a
+ * VIDI_IMAGE into the mapping of the file:
+ *
+ *     vidi_utils::frame_file frames;
+ *     if (!frames.open("regression.vraw")) std::cerr << frames.error_message() << std::endl;
+ *     for (size_t k = 0; k < frames.size(); ++k)
+ *     {
+ *         VIDI_IMAGE image = frames.image(k);
+ *         vidi_runtime_sample_add_image("workspace", "default", "my_sample", &image);
+ *         ...
+ *     }
+ *
+ * Layout, all integers little-endian:
+ *
+ *     header     frame_file_header, 64 bytes
+ *     index      frame_count x frame_file_entry, 48 bytes each
+ *     names      the names of the frames, one after the other, not zero terminated
+ *     data       the pixels of each frame, rows `step` bytes apart, starting on a multiple of alignment
+ *
+ * The file is mapped copy-on-write: writing to the pixels changes the memory of the process
+ * and never the file. The images point into the mapping and are invalid once the frame_file
+ * is closed or destroyed; they must never be given to vidi_free_image().
+ */
+
+#ifndef VIDI_UTILS_FRAME_FILE_HPP_INCLUDED
+#define VIDI_UTILS_FRAME_FILE_HPP_INCLUDED
+
+#include "vidi.h"
+#include "image_view.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace vidi_utils
+{
+#pragma pack(push, 1)
+    struct frame_file_header
+    {
+        char magic[8];              ///< "VIDIRAW" followed by a zero
+        uint32_t version;           ///< 1
+        uint32_t frame_count;
+        uint64_t index_offset;
+        uint64_t names_offset;
+        uint64_t data_offset;
+        uint32_t alignment;
+        uint8_t reserved[20];
+    };
+
+    struct frame_file_entry
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t channels;
+        uint32_t channel_depth;     ///< VIDI_IMG_8U or VIDI_IMG_16U
+        uint32_t step;              ///< bytes between the starts of two rows
+        uint32_t name_length;
+        uint64_t name_offset;       ///< from the start of the names
+        uint64_t data_offset;       ///< from the start of the file
+        uint64_t data_size;
+    };
+#pragma pack(pop)
+
+    static_assert(sizeof(frame_file_header) == 64, "the header is 64 bytes");
+    static_assert(sizeof(frame_file_entry) == 48, "an index entry is 48 bytes");
+
+    namespace detail
+    {
+        static const char frame_file_magic[8] = { 'V', 'I', 'D', 'I', 'R', 'A', 'W', 0 };
+
+        inline bool write_zeros(std::FILE * f, size_t n)
+        {
+            static const char zeros[4096] = { 0 };
+            while (n)
+            {
+                size_t chunk = std::min(n, sizeof(zeros));
+                if (std::fwrite(zeros, 1, chunk, f) != chunk)
+                    return false;
+                n -= chunk;
+            }
+            return true;
+        }
+
+        /**
+         * @brief renames the completely written "<path>.part" to path, or removes it if writing failed
+         *
+         * a failed write leaves the previous file as it was
+         */
+        inline bool replace_with_part(const std::string & part, const std::string & path, bool ok)
+        {
+            if (!ok)
+            {
+                std::remove(part.c_str());
+                return false;
+            }
+            // rename() does not replace an existing file on Windows
+            std::remove(path.c_str());
+            if (std::rename(part.c_str(), path.c_str()) != 0)
+            {
+                std::remove(part.c_str());
+                return false;
+            }
+            return true;
+        }
+    }
+
+    /**
+     * @brief writes a frame file, frame after frame
+     *
+     * The pixels are first written to "<path>.data", and moved behind the index by close(),
+     * once the number of frames and the size of their names are known. The file is written as
+     * "<path>.part" and renamed once complete.
+     */
+    class frame_file_writer
+    {
+    public:
+        /**
+         * @param alignment of the start of every frame, a power of two; 4096 aligns frames on pages
+         */
+        explicit frame_file_writer(const std::string & path, uint32_t alignment = 64)
+            : m_path(path)
+            , m_alignment(alignment ? alignment : 1)
+            , m_data(std::fopen((path + ".data").c_str(), "wb"))
+            , m_data_size(0)
+        {
+        }
+
+        ~frame_file_writer()
+        {
+            if (m_data)
+            {
+                std::fclose(m_data);
+                std::remove((m_path + ".data").c_str());
+            }
+        }
+
+        bool is_open() const { return m_data != 0; }
+
+        /**
+         * @brief appends the pixels of the image, its rows stored without the padding of its step
+         */
+        bool add(const std::string & name, const VIDI_IMAGE & image)
+        {
+            if (!m_data || (image.channel_depth != VIDI_IMG_8U && image.channel_depth != VIDI_IMG_16U))
+                return false;
+
+            image_view view(image);
+            frame_file_entry entry;
+            std::memset(&entry, 0, sizeof(entry));
+            entry.width = image.width;
+            entry.height = image.height;
+            entry.channels = image.channels;
+            entry.channel_depth = image.channel_depth;
+            entry.step = static_cast<uint32_t>(view.row_size());
+            entry.name_length = static_cast<uint32_t>(name.size());
+            entry.name_offset = m_names.size();
+            // offset from the start of the data for now, made absolute by close()
+            entry.data_offset = align(m_data_size);
+            entry.data_size = static_cast<uint64_t>(entry.step) * entry.height;
+
+            if (!detail::write_zeros(m_data, static_cast<size_t>(entry.data_offset - m_data_size)))
+                return false;
+            for (VIDI_UINT y = 0; y < view.height(); ++y)
+            {
+                if (std::fwrite(view.row(y), 1, view.row_size(), m_data) != view.row_size())
+                    return false;
+            }
+
+            m_data_size = entry.data_offset + entry.data_size;
+            m_names += name;
+            m_entries.push_back(entry);
+            return true;
+        }
+
+        size_t size() const { return m_entries.size(); }
+
+        /**
+         * @brief writes the header and the index, then the pixels
+         */
+        bool close()
+        {
+            if (!m_data)
+                return false;
+            std::fclose(m_data);
+            m_data = 0;
+            std::string data_path = m_path + ".data";
+
+            frame_file_header header;
+            std::memset(&header, 0, sizeof(header));
+            std::memcpy(header.magic, detail::frame_file_magic, sizeof(header.magic));
+            header.version = 1;
+            header.frame_count = static_cast<uint32_t>(m_entries.size());
+            header.index_offset = sizeof(frame_file_header);
+            header.names_offset = header.index_offset + m_entries.size() * sizeof(frame_file_entry);
+            header.data_offset = align(header.names_offset + m_names.size());
+            header.alignment = m_alignment;
+            for (size_t k = 0; k < m_entries.size(); ++k)
+                m_entries[k].data_offset += header.data_offset;
+
+            std::string part = m_path + ".part";
+            std::FILE * out = std::fopen(part.c_str(), "wb");
+            std::FILE * in = std::fopen(data_path.c_str(), "rb");
+            bool ok = out && in
+                && std::fwrite(&header, sizeof(header), 1, out) == 1
+                && (m_entries.empty() || std::fwrite(m_entries.data(), sizeof(frame_file_entry), m_entries.size(), out) == m_entries.size())
+                && std::fwrite(m_names.data(), 1, m_names.size(), out) == m_names.size();
+            if (ok)
+            {
+                std::vector<char> chunk(size_t(1) << 20);
+                ok = detail::write_zeros(out, static_cast<size_t>(header.data_offset - header.names_offset - m_names.size()));
+                size_t n;
+                while (ok && (n = std::fread(chunk.data(), 1, chunk.size(), in)) > 0)
+                    ok = std::fwrite(chunk.data(), 1, n, out) == n;
+            }
+            if (in)
+                std::fclose(in);
+            if (out && std::fclose(out) != 0)
+                ok = false;
+            std::remove(data_path.c_str());
+            return detail::replace_with_part(part, m_path, ok);
+        }
+
+    private:
+        frame_file_writer(const frame_file_writer &);
+        frame_file_writer & operator=(const frame_file_writer &);
+
+        uint64_t align(uint64_t offset) const
+        {
+            return (offset + m_alignment - 1) / m_alignment * m_alignment;
+        }
+
+        std::string m_path;
+        uint32_t m_alignment;
+        std::FILE * m_data;
+        uint64_t m_data_size;
+        std::vector<frame_file_entry> m_entries;
+        std::string m_names;
+    };
+
+    /**
+     * @brief writes a frame file holding a single frame, in one pass
+     *
+     * The size of the index and of the name are known upfront, so unlike frame_file_writer the
+     * pixels are written once. The file is written as "<path>.part" and renamed once complete.
+     */
+    inline bool save_frame(const std::string & path, const std::string & name, const VIDI_IMAGE & image, uint32_t alignment = 64)
+    {
+        if (image.channel_depth != VIDI_IMG_8U && image.channel_depth != VIDI_IMG_16U)
+            return false;
+        if (!alignment)
+            alignment = 1;
+
+        image_view view(image);
+        frame_file_header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, detail::frame_file_magic, sizeof(header.magic));
+        header.version = 1;
+        header.frame_count = 1;
+        header.index_offset = sizeof(frame_file_header);
+        header.names_offset = header.index_offset + sizeof(frame_file_entry);
+        header.data_offset = (header.names_offset + name.size() + alignment - 1) / alignment * alignment;
+        header.alignment = alignment;
+
+        frame_file_entry entry;
+        std::memset(&entry, 0, sizeof(entry));
+        entry.width = image.width;
+        entry.height = image.height;
+        entry.channels = image.channels;
+        entry.channel_depth = image.channel_depth;
+        entry.step = static_cast<uint32_t>(view.row_size());
+        entry.name_length = static_cast<uint32_t>(name.size());
+        entry.data_offset = header.data_offset;
+        entry.data_size = static_cast<uint64_t>(entry.step) * entry.height;
+
+        std::string part = path + ".part";
+        std::FILE * out = std::fopen(part.c_str(), "wb");
+        if (!out)
+            return false;
+        bool ok = std::fwrite(&header, sizeof(header), 1, out) == 1
+            && std::fwrite(&entry, sizeof(entry), 1, out) == 1
+            && std::fwrite(name.data(), 1, name.size(), out) == name.size()
+            && detail::write_zeros(out, static_cast<size_t>(header.data_offset - header.names_offset - name.size()));
+        if (ok && view.contiguous())
+            ok = std::fwrite(view.data(), 1, static_cast<size_t>(entry.data_size), out) == entry.data_size;
+        for (VIDI_UINT y = 0; ok && !view.contiguous() && y < view.height(); ++y)
+            ok = std::fwrite(view.row(y), 1, view.row_size(), out) == view.row_size();
+        if (std::fclose(out) != 0)
+            ok = false;
+        return detail::replace_with_part(part, path, ok);
+    }
+
+    /**
+     * @brief read access to the frames of a memory-mapped frame file
+     */
+    class frame_file
+    {
+    public:
+        frame_file()
+            : m_base(0)
+            , m_size(0)
+            , m_entries(0)
+            , m_names(0)
+            , m_count(0)
+#if defined(_WIN32)
+            , m_file(INVALID_HANDLE_VALUE)
+            , m_mapping(0)
+#endif
+        {
+        }
+
+        ~frame_file()
+        {
+            close();
+        }
+
+        /**
+         * @brief maps the file and checks that its index is consistent with its size
+         *
+         * @return false on failure, error_message() then tells why
+         */
+        bool open(const std::string & path)
+        {
+            close();
+            m_error.clear();
+            if (!map(path))
+                return fail("cannot map '" + path + "'");
+
+            const frame_file_header * header = reinterpret_cast<const frame_file_header *>(m_base);
+            if (m_size < sizeof(frame_file_header) || std::memcmp(header->magic, detail::frame_file_magic, sizeof(header->magic)) != 0)
+                return fail("'" + path + "' is not a frame file");
+            if (header->version != 1)
+                return fail("'" + path + "' has an unsupported version");
+            if (header->index_offset > m_size || (m_size - header->index_offset) / sizeof(frame_file_entry) < header->frame_count
+                || header->names_offset > m_size)
+                return fail("'" + path + "' is truncated");
+
+            m_entries = reinterpret_cast<const frame_file_entry *>(m_base + header->index_offset);
+            m_names = reinterpret_cast<const char *>(m_base + header->names_offset);
+            m_count = header->frame_count;
+            for (size_t k = 0; k < m_count; ++k)
+            {
+                const frame_file_entry & e = m_entries[k];
+                bool valid = (e.channel_depth == VIDI_IMG_8U || e.channel_depth == VIDI_IMG_16U)
+                    && e.step >= static_cast<uint64_t>(e.width) * e.channels * channel_size(e.channel_depth)
+                    && e.data_size >= static_cast<uint64_t>(e.step) * e.height
+                    && e.data_offset <= m_size && e.data_size <= m_size - e.data_offset
+                    // subtractions rather than sums, which a corrupt index could make wrap around
+                    && e.name_offset <= m_size - header->names_offset
+                    && e.name_length <= m_size - header->names_offset - e.name_offset;
+                if (!valid)
+                    return fail("'" + path + "' has an invalid index");
+            }
+            return true;
+        }
+
+        void close()
+        {
+            unmap();
+            m_entries = 0;
+            m_names = 0;
+            m_count = 0;
+        }
+
+        bool is_open() const { return m_base != 0; }
+        const std::string & error_message() const { return m_error; }
+
+        /**
+         * @brief number of frames
+         */
+        size_t size() const { return m_count; }
+
+        std::string name(size_t k) const
+        {
+            return std::string(m_names + m_entries[k].name_offset, m_entries[k].name_length);
+        }
+
+        /**
+         * @brief VIDI_IMAGE pointing into the mapping, to be passed to the library as is
+         */
+        VIDI_IMAGE image(size_t k) const
+        {
+            const frame_file_entry & e = m_entries[k];
+            VIDI_IMAGE image;
+            image.width = e.width;
+            image.height = e.height;
+            image.channels = e.channels;
+            image.channel_depth = e.channel_depth;
+            image.step = e.step;
+            image.data = m_base + e.data_offset;
+            return image;
+        }
+
+        image_view view(size_t k) const
+        {
+            return image_view(image(k));
+        }
+
+        /**
+         * @brief asks the system to start reading the frame from the disk, e.g. one frame ahead of its use
+         */
+        void will_need(size_t k) const
+        {
+#if defined(_WIN32)
+            (void)k;
+#else
+            const frame_file_entry & e = m_entries[k];
+            size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            size_t begin = static_cast<size_t>(e.data_offset) / page * page;
+            madvise(m_base + begin, static_cast<size_t>(e.data_offset + e.data_size) - begin, MADV_WILLNEED);
+#endif
+        }
+
+    private:
+        frame_file(const frame_file &);
+        frame_file & operator=(const frame_file &);
+
+        bool fail(const std::string & message)
+        {
+            close();
+            m_error = message;
+            return false;
+        }
+
+        bool map(const std::string & path)
+        {
+#if defined(_WIN32)
+            m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+            if (m_file == INVALID_HANDLE_VALUE)
+                return false;
+            LARGE_INTEGER size;
+            if (!GetFileSizeEx(m_file, &size) || !size.QuadPart)
+                return false;
+            m_size = static_cast<size_t>(size.QuadPart);
+            m_mapping = CreateFileMappingA(m_file, 0, PAGE_WRITECOPY, 0, 0, 0);
+            if (!m_mapping)
+                return false;
+            m_base = static_cast<unsigned char *>(MapViewOfFile(m_mapping, FILE_MAP_COPY, 0, 0, 0));
+            return m_base != 0;
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (::fstat(fd, &st) != 0 || !st.st_size)
+            {
+                ::close(fd);
+                return false;
+            }
+            m_size = static_cast<size_t>(st.st_size);
+            void * base = ::mmap(0, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            // the mapping keeps the file alive
+            ::close(fd);
+            if (base == MAP_FAILED)
+                return false;
+            m_base = static_cast<unsigned char *>(base);
+            return true;
+#endif
+        }
+
+        void unmap()
+        {
+#if defined(_WIN32)
+            if (m_base)
+                UnmapViewOfFile(m_base);
+            if (m_mapping)
+                CloseHandle(m_mapping);
+            if (m_file != INVALID_HANDLE_VALUE)
+                CloseHandle(m_file);
+            m_mapping = 0;
+            m_file = INVALID_HANDLE_VALUE;
+#else
+            if (m_base)
+                ::munmap(m_base, m_size);
+#endif
+            m_base = 0;
+            m_size = 0;
+        }
+
+        unsigned char * m_base;
+        size_t m_size;
+        const frame_file_entry * m_entries;
+        const char * m_names;
+        size_t m_count;
+        std::string m_error;
+#if defined(_WIN32)
+        HANDLE m_file;
+        HANDLE m_mapping;
+#endif
+    };
+}
+
+#endif
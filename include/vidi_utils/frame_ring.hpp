@@ -0,0 +1,284 @@
+/**
+ * @file frame_ring.hpp
+ * @brief Lock-free bounded ring buffer, typically from a camera to the inspection threads
+ *
+ * A camera cannot wait for a mutex held by a consumer: its driver has the next frame ready at
+ * a fixed rate whatever happens downstream. frame_ring hands the frames over without locks,
+ * and decides what happens when the consumers fall behind:
+ *
+ *     vidi_utils::frame_ring<vidi_utils::camera_frame> ring(8, vidi_utils::ring_drop_oldest);
+ *     // camera thread
+ *     ring.push(std::move(frame));
+ *     // inspection threads
+ *     vidi_utils::camera_frame frame;
+ *     while (ring.pop(frame))
+ *         ...
+ *
+ * ring_block makes push() wait for a free slot, as bounded_queue does: no frame is lost and
+ * the camera slows down to the pace of the inspection. ring_drop_oldest makes push() discard
+ * the oldest frame instead: the camera keeps its rate and the inspection always works on the
+ * most recent frames, like a camera overwriting its own buffers.
+ *
+ * Any number of threads may push and pop; the stages of stage_pipeline use it with several on
+ * each side. Every slot carries a sequence number telling whether it is free or holds a value,
+ * after Dmitry Vyukov's bounded queue, and a thread claims a slot with a single compare and
+ * swap of the head or the tail.
+ * A thread that finds the ring full or empty spins briefly, then yields, then sleeps for
+ * short periods, since there is no condition variable to wait on.
+ */
+
+#ifndef VIDI_UTILS_FRAME_RING_HPP_INCLUDED
+#define VIDI_UTILS_FRAME_RING_HPP_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace vidi_utils
+{
+    enum ring_policy
+    {
+        ring_block,         ///< push() waits for a free slot
+        ring_drop_oldest    ///< push() discards the oldest value to make room
+    };
+
+    inline const char * ring_policy_name(ring_policy policy)
+    {
+        return policy == ring_block ? "block" : "drop oldest";
+    }
+
+    namespace detail
+    {
+        inline size_t ring_mask(size_t capacity)
+        {
+            size_t n = 2;
+            while (n < capacity)
+                n *= 2;
+            return n - 1;
+        }
+
+        /**
+         * @brief waiting without a condition variable: spinning, then yielding, then sleeping
+         */
+        class ring_backoff
+        {
+        public:
+            ring_backoff()
+                : m_count(0)
+            {
+            }
+
+            void wait()
+            {
+                if (m_count < 64)
+                    ++m_count;
+                else if (m_count < 128)
+                {
+                    ++m_count;
+                    std::this_thread::yield();
+                }
+                else
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+
+        private:
+            unsigned m_count;
+        };
+    }
+
+    template<class T>
+    class frame_ring
+    {
+    public:
+        /**
+         * @param capacity rounded up to a power of two
+         */
+        explicit frame_ring(size_t capacity, ring_policy policy = ring_block)
+            : m_policy(policy)
+            , m_mask(detail::ring_mask(capacity))
+            , m_slots(m_mask + 1)
+            , m_closed(false)
+            , m_pushed(0)
+            , m_dropped(0)
+            , m_full_waits(0)
+        {
+            for (size_t k = 0; k < m_slots.size(); ++k)
+                m_slots[k].sequence.store(k, std::memory_order_relaxed);
+            m_head.store(0, std::memory_order_relaxed);
+            m_tail.store(0, std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief enqueues the value
+         *
+         * With ring_block, waits while the ring is full. With ring_drop_oldest, discards the
+         * oldest values instead, on the calling thread.
+         *
+         * @return false if the ring was closed, in which case the value is dropped
+         */
+        bool push(T value)
+        {
+            detail::ring_backoff backoff;
+            bool waited = false;
+            for (;;)
+            {
+                if (m_closed.load(std::memory_order_acquire))
+                    return false;
+                if (try_push(value))
+                    break;
+                if (m_policy == ring_drop_oldest)
+                {
+                    T oldest;
+                    if (try_pop(oldest))
+                    {
+                        m_dropped.fetch_add(1, std::memory_order_relaxed);
+                        continue;
+                    }
+                }
+                else if (!waited)
+                {
+                    waited = true;
+                    m_full_waits.fetch_add(1, std::memory_order_relaxed);
+                }
+                // a consumer took the oldest slot and has not freed it yet
+                backoff.wait();
+            }
+            return true;
+        }
+
+        /**
+         * @brief enqueues the value only if there is a free slot, leaving it untouched otherwise
+         */
+        bool try_push(T & value)
+        {
+            if (m_closed.load(std::memory_order_acquire))
+                return false;
+            size_t head = m_head.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                slot & s = m_slots[head & m_mask];
+                size_t sequence = s.sequence.load(std::memory_order_acquire);
+                if (sequence != head)
+                {
+                    // full, or another producer took the slot and head has moved on
+                    if (static_cast<std::ptrdiff_t>(sequence - head) < 0)
+                        return false;
+                    head = m_head.load(std::memory_order_relaxed);
+                }
+                else if (m_head.compare_exchange_weak(head, head + 1, std::memory_order_relaxed))
+                {
+                    s.value = std::move(value);
+                    s.sequence.store(head + 1, std::memory_order_release);
+                    m_pushed.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            }
+        }
+
+        /**
+         * @brief dequeues the oldest value if there is one
+         */
+        bool try_pop(T & value)
+        {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            for (;;)
+            {
+                slot & s = m_slots[tail & m_mask];
+                size_t sequence = s.sequence.load(std::memory_order_acquire);
+                if (sequence != tail + 1)
+                {
+                    // empty, or another consumer took the slot and tail has moved on
+                    if (static_cast<std::ptrdiff_t>(sequence - (tail + 1)) < 0)
+                        return false;
+                    tail = m_tail.load(std::memory_order_relaxed);
+                }
+                else if (m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+                {
+                    value = std::move(s.value);
+                    s.value = T();
+                    s.sequence.store(tail + m_mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+        }
+
+        /**
+         * @brief waits for a value
+         *
+         * @return false once the ring is closed and drained
+         */
+        bool pop(T & value)
+        {
+            detail::ring_backoff backoff;
+            for (;;)
+            {
+                if (try_pop(value))
+                    return true;
+                if (m_closed.load(std::memory_order_acquire))
+                    return try_pop(value);
+                backoff.wait();
+            }
+        }
+
+        /**
+         * @brief makes push() fail from now on and pop() return false once the ring is drained
+         */
+        void close()
+        {
+            m_closed.store(true, std::memory_order_release);
+        }
+
+        bool closed() const { return m_closed.load(std::memory_order_acquire); }
+
+        /**
+         * @brief the values waiting, exact only while nobody pushes or pops
+         */
+        size_t size() const
+        {
+            size_t head = m_head.load(std::memory_order_acquire), tail = m_tail.load(std::memory_order_acquire);
+            return head > tail ? head - tail : 0;
+        }
+
+        size_t capacity() const { return m_mask + 1; }
+        ring_policy policy() const { return m_policy; }
+
+        size_t pushed() const { return m_pushed.load(std::memory_order_relaxed); }                  ///< values enqueued
+        size_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }                ///< discarded by ring_drop_oldest
+        size_t full_waits() const { return m_full_waits.load(std::memory_order_relaxed); }          ///< push() calls that found the ring full with ring_block
+
+    private:
+        frame_ring(const frame_ring &);
+        frame_ring & operator=(const frame_ring &);
+
+        struct slot
+        {
+            slot()
+                : sequence(0)
+            {
+            }
+
+            std::atomic<size_t> sequence;   ///< the position it can be pushed at, or that position + 1 once it holds a value
+            T value;
+        };
+
+        const ring_policy m_policy;
+        const size_t m_mask;
+        std::vector<slot> m_slots;
+        std::atomic<bool> m_closed;
+        std::atomic<size_t> m_pushed;
+        std::atomic<size_t> m_dropped;
+        std::atomic<size_t> m_full_waits;
+
+        // the producers and the consumers each write their own index: keep them on separate cache lines
+        char m_pad0[64];
+        std::atomic<size_t> m_head;
+        char m_pad1[64];
+        std::atomic<size_t> m_tail;
+        char m_pad2[64];
+    };
+}
+
+#endif
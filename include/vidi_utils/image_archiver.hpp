@@ -0,0 +1,430 @@
+/**
+ * @file image_archiver.hpp
+ * @brief Saves images on background threads, with a bound on the memory they hold meanwhile
+ *
+ * Saving a rejected frame with vidi_save_image() on the inspection thread stalls the inspection
+ * for the duration of the encode, which on a bad batch means for every frame. image_archiver
+ * takes the image and encodes and writes it on worker threads:
+ *
+ *     vidi_utils::image_archiver_options options;
+ *     options.format = vidi_utils::archive_png;
+ *     options.level = vidi_utils::png_fastest;
+ *     vidi_utils::image_archiver archiver(options);
+ *     ...
+ *     if (rejected)
+ *         archiver.save("rejects/frame_000042.png", image);   // image is now empty, the archiver frees it
+ *
+ * save() takes ownership of a library managed image, loaded or decoded by ViDi, and resets the
+ * caller's VIDI_IMAGE so that the next load allocates a new one; the archiver calls
+ * vidi_free_image() once the file is written. save_copy() copies any other image, for instance a
+ * camera buffer, into pooled memory first.
+ *
+ * The images waiting or being written are limited in number and in bytes. Beyond that, save()
+ * waits for the workers, or gives up and counts the image as dropped if drop_when_full is set:
+ * a flood of rejects then costs some of the rejects rather than all of the memory.
+ */
+
+#ifndef VIDI_UTILS_IMAGE_ARCHIVER_HPP_INCLUDED
+#define VIDI_UTILS_IMAGE_ARCHIVER_HPP_INCLUDED
+
+#include "vidi.h"
+#include "frame_file.hpp"
+#include "image_pool.hpp"
+#include "image_view.hpp"
+#include "lossless_codec.hpp"
+#include "png_encoder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace vidi_utils
+{
+    enum archive_format
+    {
+        archive_png,        ///< PNG written by png_encoder, at the level of the options
+        archive_raw,        ///< the pixels as they are, in a single-frame frame file
+        archive_vidi,       ///< vidi_save_image(), the format given by the extension of the path
+        archive_lossless    ///< encode_lossless(), several times faster than PNG for a slightly larger file
+    };
+
+    inline const char * archive_format_name(archive_format format)
+    {
+        switch (format)
+        {
+        case archive_png: return "png";
+        case archive_raw: return "raw";
+        case archive_vidi: return "vidi";
+        case archive_lossless: return "lossless";
+        }
+        return "unknown";
+    }
+
+    /**
+     * @brief the extension matching the files written in the format, for archive_vidi the one of PNG
+     */
+    inline const char * archive_extension(archive_format format)
+    {
+        return format == archive_raw ? ".vraw" : format == archive_lossless ? ".vll" : ".png";
+    }
+
+    struct image_archiver_options
+    {
+        image_archiver_options()
+            : n_workers(2)
+            , max_pending(32)
+            , max_pending_bytes(size_t(256) << 20)
+            , format(archive_png)
+            , level(png_fastest)
+            , drop_when_full(false)
+        {
+        }
+
+        size_t n_workers;           ///< encoding threads, 0 uses std::thread::hardware_concurrency()
+        size_t max_pending;         ///< images waiting or being written
+        size_t max_pending_bytes;   ///< pixels of those images; a single larger image is still accepted alone
+        archive_format format;
+        png_level level;            ///< compression of archive_png
+        bool drop_when_full;        ///< whether save() drops the image instead of waiting
+    };
+
+    struct image_archiver_stats
+    {
+        image_archiver_stats()
+            : submitted(0)
+            , written(0)
+            , failed(0)
+            , dropped(0)
+            , pixel_bytes(0)
+            , file_bytes(0)
+            , peak_pending(0)
+            , peak_pending_bytes(0)
+            , wait_seconds(0.0)
+            , encode_seconds(0.0)
+        {
+        }
+
+        size_t submitted;           ///< images accepted by save() and save_copy()
+        size_t written;
+        size_t failed;              ///< images that could not be encoded or written
+        size_t dropped;             ///< images refused because the archiver was full or closed
+        size_t pixel_bytes;         ///< of the images written
+        size_t file_bytes;          ///< of the files written, 0 for archive_vidi which does not tell
+        size_t peak_pending;
+        size_t peak_pending_bytes;
+        double wait_seconds;        ///< time save() and save_copy() waited for room, summed over the callers
+        double encode_seconds;      ///< time spent encoding and writing, summed over the workers
+
+        double ratio() const { return file_bytes ? double(pixel_bytes) / file_bytes : 0.0; }
+    };
+
+    class image_archiver
+    {
+    public:
+        explicit image_archiver(const image_archiver_options & options = image_archiver_options())
+            : m_options(options)
+            , m_pending(0)
+            , m_pending_bytes(0)
+            , m_closed(false)
+        {
+            if (!m_options.max_pending)
+                m_options.max_pending = 1;
+            size_t n_workers = options.n_workers ? options.n_workers : std::max<size_t>(1, std::thread::hardware_concurrency());
+            for (size_t k = 0; k < n_workers; ++k)
+                m_workers.push_back(std::thread([this]() { worker_loop(); }));
+        }
+
+        /**
+         * @brief writes the images still queued, then stops the workers
+         */
+        ~image_archiver()
+        {
+            close();
+        }
+
+        /**
+         * @brief queues a library managed image, taking ownership of it
+         *
+         * On success the caller's image is reset with vidi_init_image(). When the image is
+         * dropped, because the archiver is full and drop_when_full is set or because it is
+         * closed, the caller keeps it and remains responsible for freeing it.
+         *
+         * @return whether the image was queued
+         */
+        bool save(const std::string & path, VIDI_IMAGE & image)
+        {
+            size_t bytes = image_bytes(image_view(image));
+            if (!admit(bytes))
+                return false;
+            job j;
+            j.path = path;
+            j.image = image;
+            j.owned = true;
+            j.bytes = bytes;
+            vidi_init_image(&image);
+            enqueue(std::move(j));
+            return true;
+        }
+
+        /**
+         * @brief queues a copy of the image, which the caller keeps
+         *
+         * Room is made before copying, so a full archiver waits or drops without copying anything.
+         */
+        bool save_copy(const std::string & path, const image_view & image)
+        {
+            size_t bytes = image_bytes(image);
+            if (!admit(bytes))
+                return false;
+            job j;
+            j.path = path;
+            j.bytes = bytes;
+            j.copy = m_pool.acquire(image.width(), image.height(), image.channels(), image.channel_depth());
+            if (!j.copy)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                release(bytes);
+                --m_stats.submitted;
+                ++m_stats.failed;
+                return false;
+            }
+            image.copy_to(j.copy.get()->data, j.copy.get()->step);
+            j.image = *j.copy.get();
+            enqueue(std::move(j));
+            return true;
+        }
+
+        /**
+         * @brief waits until every image queued so far is written
+         */
+        void flush()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_room.wait(lock, [this] { return m_pending == 0; });
+        }
+
+        /**
+         * @brief refuses further images, writes the ones queued and stops the workers
+         */
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_closed = true;
+            }
+            m_work.notify_all();
+            m_room.notify_all();
+            for (auto & th : m_workers)
+                th.join();
+            m_workers.clear();
+        }
+
+        size_t pending() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_pending;
+        }
+
+        image_archiver_stats stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_stats;
+        }
+
+        void report(std::ostream & os) const
+        {
+            image_archiver_stats s = stats();
+            os << "image archiver (" << archive_format_name(m_options.format);
+            if (m_options.format == archive_png)
+                os << ", " << png_level_name(m_options.level);
+            os << "): " << s.written << " written, " << s.failed << " failed, " << s.dropped << " dropped, "
+                << s.pixel_bytes / (1 << 20) << " MB of pixels";
+            if (s.file_bytes)
+                os << " in " << s.file_bytes / (1 << 20) << " MB (ratio " << s.ratio() << ")";
+            os << ", peak " << s.peak_pending << " images / " << s.peak_pending_bytes / (1 << 20) << " MB pending, "
+                << s.wait_seconds * 1000 << " ms waiting, " << s.encode_seconds * 1000 << " ms encoding" << std::endl;
+        }
+
+    private:
+        image_archiver(const image_archiver &);
+        image_archiver & operator=(const image_archiver &);
+
+        struct job
+        {
+            job() : owned(false), bytes(0) { vidi_init_image(&image); }
+
+            // written out: Visual Studio 2013 does not generate move constructors and assignments
+            job(job && other)
+                : path(std::move(other.path))
+                , image(other.image)
+                , owned(other.owned)
+                , copy(std::move(other.copy))
+                , bytes(other.bytes)
+            {
+                vidi_init_image(&other.image);
+                other.owned = false;
+            }
+
+            job & operator=(job && other)
+            {
+                if (this != &other)
+                {
+                    path = std::move(other.path);
+                    image = other.image;
+                    owned = other.owned;
+                    copy = std::move(other.copy);
+                    bytes = other.bytes;
+                    vidi_init_image(&other.image);
+                    other.owned = false;
+                }
+                return *this;
+            }
+
+            std::string path;
+            VIDI_IMAGE image;
+            bool owned;             ///< image to be freed with vidi_free_image()
+            pooled_image copy;      ///< or the pooled copy image points into
+            size_t bytes;
+
+        private:
+            job(const job &);
+            job & operator=(const job &);
+        };
+
+        static size_t image_bytes(const image_view & image)
+        {
+            return image.row_size() * image.height();
+        }
+
+        /// reserves room for an image, waiting for it unless drop_when_full is set
+        bool admit(size_t bytes)
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            auto full = [&] {
+                return m_pending >= m_options.max_pending || (m_pending && m_pending_bytes + bytes > m_options.max_pending_bytes);
+            };
+            if (!m_closed && full() && !m_options.drop_when_full)
+            {
+                auto start = std::chrono::steady_clock::now();
+                m_room.wait(lock, [&] { return m_closed || !full(); });
+                m_stats.wait_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            }
+            if (m_closed || full())
+            {
+                ++m_stats.dropped;
+                return false;
+            }
+            ++m_pending;
+            m_pending_bytes += bytes;
+            ++m_stats.submitted;
+            m_stats.peak_pending = std::max(m_stats.peak_pending, m_pending);
+            m_stats.peak_pending_bytes = std::max(m_stats.peak_pending_bytes, m_pending_bytes);
+            return true;
+        }
+
+        void enqueue(job && j)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_queue.push_back(std::move(j));
+            }
+            m_work.notify_one();
+        }
+
+        /// called with the mutex held
+        void release(size_t bytes)
+        {
+            --m_pending;
+            m_pending_bytes -= bytes;
+            m_room.notify_all();
+        }
+
+        bool write(const job & j, std::vector<unsigned char> & encoded, size_t & file_bytes)
+        {
+            file_bytes = 0;
+            switch (m_options.format)
+            {
+            case archive_png:
+                if (!encode_png(image_view(j.image), m_options.level, encoded) || !write_file(j.path, encoded))
+                    return false;
+                file_bytes = encoded.size();
+                return true;
+            case archive_raw:
+                if (!save_frame(j.path, j.path, j.image))
+                    return false;
+                file_bytes = (sizeof(frame_file_header) + sizeof(frame_file_entry) + j.path.size() + 63) / 64 * 64 + j.bytes;
+                return true;
+            case archive_vidi:
+                return vidi_save_image(j.path.c_str(), &j.image) == VIDI_SUCCESS;
+            case archive_lossless:
+                if (!encode_lossless(image_view(j.image), encoded) || !write_file(j.path, encoded))
+                    return false;
+                file_bytes = encoded.size();
+                return true;
+            }
+            return false;
+        }
+
+        void worker_loop()
+        {
+            std::vector<unsigned char> encoded;
+            for (;;)
+            {
+                job j;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_work.wait(lock, [this] { return m_closed || !m_queue.empty(); });
+                    if (m_queue.empty())
+                        return;
+                    j = std::move(m_queue.front());
+                    m_queue.pop_front();
+                }
+
+                auto start = std::chrono::steady_clock::now();
+                size_t file_bytes = 0;
+                bool ok = write(j, encoded, file_bytes);
+                if (j.owned)
+                    vidi_free_image(&j.image);
+                j.copy = pooled_image();
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (ok)
+                {
+                    ++m_stats.written;
+                    m_stats.pixel_bytes += j.bytes;
+                    m_stats.file_bytes += file_bytes;
+                }
+                else
+                    ++m_stats.failed;
+                m_stats.encode_seconds += seconds;
+                release(j.bytes);
+            }
+        }
+
+        image_archiver_options m_options;
+        // declared before the workers, which give the copies back to it
+        image_pool m_pool;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_work;     ///< signalled when an image is queued or the archiver closed
+        std::condition_variable m_room;     ///< signalled when an image is written or the archiver closed
+        std::deque<job> m_queue;
+        size_t m_pending;
+        size_t m_pending_bytes;
+        bool m_closed;
+        image_archiver_stats m_stats;
+
+        std::vector<std::thread> m_workers;
+    };
+}
+
+#endif
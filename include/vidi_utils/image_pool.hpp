@@ -0,0 +1,403 @@
+/**
+ * @file image_pool.hpp
+ * @brief Pool of pre-faulted, aligned pixel buffers handed out as RAII VIDI_IMAGE handles
+ *
+ * Allocating every camera frame with new[] and deleting it afterwards means that, for
+ * multi-megapixel frames, the allocator returns the memory to the system and the next frame
+ * page-faults fresh memory again. image_pool keeps the released buffers, by shape (width,
+ * height, channels, channel depth), and hands them out again to the next frame of that shape:
+ *
+ *     vidi_utils::image_pool pool;
+ *     vidi_utils::pooled_image frame = pool.acquire(2448, 2048, 1, VIDI_IMG_8U);
+ *     camera.grab(frame.data(), frame.get()->step);
+ *     vidi_runtime_sample_add_image("workspace", "default", "my_sample", frame.get());
+ *
+ * Buffers are 64-byte aligned, rows are padded to a multiple of 64 bytes so that every row is
+ * aligned too, and every page is touched once when a buffer is allocated. The pool is safe to
+ * use from several threads, a frame can be released on another thread than the one which
+ * acquired it, and the pool must outlive its handles.
+ */
+
+#ifndef VIDI_UTILS_IMAGE_POOL_HPP_INCLUDED
+#define VIDI_UTILS_IMAGE_POOL_HPP_INCLUDED
+
+#include "vidi.h"
+#include "image_view.hpp"
+
+#include <cstddef>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#if defined(_MSC_VER)
+    #include <malloc.h>
+#endif
+
+namespace vidi_utils
+{
+    namespace detail
+    {
+        inline void * aligned_malloc(size_t size, size_t alignment)
+        {
+#if defined(_MSC_VER)
+            return _aligned_malloc(size, alignment);
+#else
+            void * p = 0;
+            return posix_memalign(&p, alignment, size) == 0 ? p : 0;
+#endif
+        }
+
+        inline void aligned_free(void * p)
+        {
+#if defined(_MSC_VER)
+            _aligned_free(p);
+#else
+            free(p);
+#endif
+        }
+    }
+
+    /**
+     * @brief width, height, channels and channel depth of the images sharing a free list
+     */
+    struct image_shape
+    {
+        image_shape(VIDI_UINT w = 0, VIDI_UINT h = 0, VIDI_UINT c = 1, VIDI_UINT d = VIDI_IMG_8U)
+            : width(w), height(h), channels(c), channel_depth(d)
+        {
+        }
+
+        bool operator<(const image_shape & other) const
+        {
+            if (width != other.width) return width < other.width;
+            if (height != other.height) return height < other.height;
+            if (channels != other.channels) return channels < other.channels;
+            return channel_depth < other.channel_depth;
+        }
+
+        VIDI_UINT width;
+        VIDI_UINT height;
+        VIDI_UINT channels;
+        VIDI_UINT channel_depth;
+    };
+
+    struct image_pool_options
+    {
+        image_pool_options()
+            : alignment(64)
+            , max_idle_per_shape(8)
+            , max_idle_bytes(size_t(1) << 30)
+            , max_live_bytes(0)
+            , prefault(true)
+        {
+        }
+
+        size_t alignment;           ///< of the buffers and of the steps, a power of two
+        size_t max_idle_per_shape;  ///< released buffers kept per shape, the others are freed
+        size_t max_idle_bytes;      ///< released buffers kept overall
+        size_t max_live_bytes;      ///< acquire() fails beyond this many bytes in use, 0 for no limit
+        bool prefault;              ///< touch every page of a new buffer
+    };
+
+    struct image_pool_stats
+    {
+        image_pool_stats()
+            : acquired(0), allocated(0), refused(0), freed(0)
+            , live_images(0), live_bytes(0), idle_images(0), idle_bytes(0), high_water_bytes(0)
+        {
+        }
+
+        size_t acquired;            ///< successful acquire() calls
+        size_t allocated;           ///< of which needed a new buffer
+        size_t refused;             ///< acquire() calls failing because of max_live_bytes
+        size_t freed;               ///< buffers released beyond the idle caps
+        size_t live_images;
+        size_t live_bytes;
+        size_t idle_images;
+        size_t idle_bytes;
+        size_t high_water_bytes;    ///< of live and idle bytes together
+
+        size_t reused() const { return acquired - allocated; }
+    };
+
+    class image_pool;
+
+    /**
+     * @brief move-only VIDI_IMAGE whose pixels go back to their pool on destruction
+     *
+     * The image is not managed by the library: never give it to vidi_free_image(). The buffer goes
+     * back under the shape it was acquired with, whatever the image says by then.
+     */
+    class pooled_image
+    {
+    public:
+        pooled_image()
+            : m_pool(0)
+            , m_data(0)
+            , m_step(0)
+        {
+            m_image.width = m_image.height = m_image.channels = m_image.step = 0;
+            m_image.channel_depth = VIDI_IMG_8U;
+            m_image.data = 0;
+        }
+
+        pooled_image(pooled_image && other)
+            : m_image(other.m_image)
+            , m_pool(other.m_pool)
+            , m_shape(other.m_shape)
+            , m_data(other.m_data)
+            , m_step(other.m_step)
+        {
+            other.m_pool = 0;
+            other.m_data = 0;
+            other.m_image.data = 0;
+        }
+
+        pooled_image & operator=(pooled_image && other)
+        {
+            if (this != &other)
+            {
+                release();
+                m_image = other.m_image;
+                m_pool = other.m_pool;
+                m_shape = other.m_shape;
+                m_data = other.m_data;
+                m_step = other.m_step;
+                other.m_pool = 0;
+                other.m_data = 0;
+                other.m_image.data = 0;
+            }
+            return *this;
+        }
+
+        ~pooled_image()
+        {
+            release();
+        }
+
+        /**
+         * @brief false if the pool refused or failed to allocate the image
+         */
+        explicit operator bool() const { return m_image.data != 0; }
+
+        /**
+         * @brief the image to pass to the library
+         */
+        VIDI_IMAGE * get() { return &m_image; }
+        const VIDI_IMAGE * get() const { return &m_image; }
+
+        unsigned char * data() const { return static_cast<unsigned char *>(m_image.data); }
+        image_view view() const { return image_view(m_image); }
+
+        /**
+         * @brief gives the pixels back to the pool before the handle is destroyed
+         */
+        void release();
+
+    private:
+        friend class image_pool;
+
+        pooled_image(const pooled_image &);
+        pooled_image & operator=(const pooled_image &);
+
+        VIDI_IMAGE m_image;
+        image_pool * m_pool;
+        // as acquired: get() hands out m_image, which the caller or the library may change
+        image_shape m_shape;
+        void * m_data;
+        size_t m_step;
+    };
+
+    class image_pool
+    {
+    public:
+        explicit image_pool(const image_pool_options & options = image_pool_options())
+            : m_options(options)
+        {
+        }
+
+        ~image_pool()
+        {
+            trim();
+        }
+
+        /**
+         * @brief step in bytes of the images of that shape, rows padded to the alignment
+         */
+        size_t step_of(const image_shape & shape) const
+        {
+            size_t row = shape.width * shape.channels * channel_size(shape.channel_depth);
+            return (row + m_options.alignment - 1) & ~(m_options.alignment - 1);
+        }
+
+        /**
+         * @brief an image of that shape, reusing a released buffer when there is one
+         *
+         * The pixels are left as the previous frame wrote them. The handle is empty if
+         * max_live_bytes would be exceeded or the allocation failed.
+         */
+        pooled_image acquire(VIDI_UINT width, VIDI_UINT height, VIDI_UINT channels, VIDI_UINT channel_depth)
+        {
+            image_shape shape(width, height, channels, channel_depth);
+            size_t step = step_of(shape);
+            size_t bytes = step * height;
+
+            void * data = 0;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_options.max_live_bytes && m_stats.live_bytes + bytes > m_options.max_live_bytes)
+                {
+                    ++m_stats.refused;
+                    return pooled_image();
+                }
+                std::vector<void *> & idle = m_idle[shape];
+                if (!idle.empty())
+                {
+                    data = idle.back();
+                    idle.pop_back();
+                    --m_stats.idle_images;
+                    m_stats.idle_bytes -= bytes;
+                }
+                else
+                {
+                    ++m_stats.allocated;
+                }
+                ++m_stats.acquired;
+                ++m_stats.live_images;
+                m_stats.live_bytes += bytes;
+                if (m_stats.live_bytes + m_stats.idle_bytes > m_stats.high_water_bytes)
+                    m_stats.high_water_bytes = m_stats.live_bytes + m_stats.idle_bytes;
+            }
+
+            if (!data)
+            {
+                data = allocate(bytes);
+                if (!data)
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    --m_stats.acquired;
+                    --m_stats.allocated;
+                    --m_stats.live_images;
+                    m_stats.live_bytes -= bytes;
+                    return pooled_image();
+                }
+            }
+
+            pooled_image image;
+            image.m_image.width = width;
+            image.m_image.height = height;
+            image.m_image.channels = channels;
+            image.m_image.channel_depth = channel_depth;
+            image.m_image.step = static_cast<VIDI_UINT>(step);
+            image.m_image.data = data;
+            image.m_pool = this;
+            image.m_shape = shape;
+            image.m_data = data;
+            image.m_step = step;
+            return image;
+        }
+
+        /**
+         * @brief allocates buffers ahead of time so that the first frames do not page-fault
+         */
+        void reserve(VIDI_UINT width, VIDI_UINT height, VIDI_UINT channels, VIDI_UINT channel_depth, size_t count)
+        {
+            std::vector<pooled_image> images;
+            for (size_t k = 0; k < count; ++k)
+                images.push_back(acquire(width, height, channels, channel_depth));
+        }
+
+        /**
+         * @brief frees every idle buffer
+         */
+        void trim()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (std::map<image_shape, std::vector<void *> >::iterator it = m_idle.begin(); it != m_idle.end(); ++it)
+            {
+                for (size_t k = 0; k < it->second.size(); ++k)
+                    detail::aligned_free(it->second[k]);
+            }
+            m_idle.clear();
+            m_stats.idle_images = 0;
+            m_stats.idle_bytes = 0;
+        }
+
+        image_pool_stats stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_stats;
+        }
+
+        void report(std::ostream & os) const
+        {
+            image_pool_stats s = stats();
+            os << s.acquired << " images acquired, " << s.allocated << " allocated (" << s.reused() << " reused), "
+                << s.refused << " refused, " << s.freed << " freed over the caps; " << s.live_images << " live ("
+                << s.live_bytes << " bytes), " << s.idle_images << " idle (" << s.idle_bytes << " bytes), high-water "
+                << s.high_water_bytes << " bytes" << std::endl;
+        }
+
+    private:
+        friend class pooled_image;
+
+        image_pool(const image_pool &);
+        image_pool & operator=(const image_pool &);
+
+        void * allocate(size_t bytes) const
+        {
+            unsigned char * data = static_cast<unsigned char *>(detail::aligned_malloc(bytes ? bytes : 1, m_options.alignment));
+            if (data && m_options.prefault)
+            {
+                // one write per page is enough for the system to map it
+                for (size_t k = 0; k < bytes; k += 4096)
+                    data[k] = 0;
+            }
+            return data;
+        }
+
+        void give_back(const image_shape & shape, void * data, size_t step)
+        {
+            size_t bytes = step * shape.height;
+            bool keep = false;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                --m_stats.live_images;
+                m_stats.live_bytes -= bytes;
+                std::vector<void *> & idle = m_idle[shape];
+                if (idle.size() < m_options.max_idle_per_shape && m_stats.idle_bytes + bytes <= m_options.max_idle_bytes)
+                {
+                    idle.push_back(data);
+                    ++m_stats.idle_images;
+                    m_stats.idle_bytes += bytes;
+                    keep = true;
+                }
+                else
+                {
+                    ++m_stats.freed;
+                }
+            }
+            if (!keep)
+                detail::aligned_free(data);
+        }
+
+        image_pool_options m_options;
+        std::map<image_shape, std::vector<void *> > m_idle;
+        image_pool_stats m_stats;
+        mutable std::mutex m_mutex;
+    };
+
+    inline void pooled_image::release()
+    {
+        if (!m_pool || !m_data)
+            return;
+        m_pool->give_back(m_shape, m_data, m_step);
+        m_pool = 0;
+        m_data = 0;
+        m_image.data = 0;
+    }
+}
+
+#endif
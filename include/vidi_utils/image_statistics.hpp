@@ -0,0 +1,546 @@
+/**
+ * @file image_statistics.hpp
+ * @brief Histogram, min/max, mean/variance and saturation of images, and a pre-filter rejecting
+ * blank or saturated frames before they are added to a sample
+ *
+ * Lighting faults produce frames that are black, saturated or flat, and processing them only
+ * wastes the time of the tools. compute_statistics() gets everything needed to recognize them
+ * in one pass over the pixels, vectorized with SSE2/AVX2 and split over the rows with a
+ * thread_pool; frame_prefilter applies rules to those statistics:
+ *
+ *     vidi_utils::frame_prefilter filter;
+ *     filter.add_rule("dark", vidi_utils::reject_dark(10));
+ *     filter.add_rule("saturated", vidi_utils::reject_saturated(0.25));
+ *     auto added = filter.sample_add_image("workspace", "default", "my_sample", &image);
+ *
+ * Values are in the units of the channels, 0-255 or 0-65535, all channels together. The
+ * histogram has 256 bins, a 16U value v falling in bin v >> 8.
+ */
+
+#ifndef VIDI_UTILS_IMAGE_STATISTICS_HPP_INCLUDED
+#define VIDI_UTILS_IMAGE_STATISTICS_HPP_INCLUDED
+
+#include "vidi_runtime.h"
+#include "image_view.hpp"
+#include "pixel_convert.hpp"
+#include "runtime.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace vidi_utils
+{
+    struct image_statistics
+    {
+        image_statistics()
+            : count(0)
+            , min(0)
+            , max(0)
+            , mean(0)
+            , variance(0)
+            , saturated(0)
+        {
+        }
+
+        uint64_t count;                     ///< number of values, pixels times channels
+        unsigned min;
+        unsigned max;
+        double mean;
+        double variance;
+        double saturated;                   ///< fraction of the values at or above the saturation level
+        std::vector<uint64_t> histogram;    ///< 256 bins, empty if not requested
+
+        double stddev() const { return std::sqrt(variance); }
+    };
+
+    namespace detail
+    {
+        /// partial sums of a band of rows
+        struct statistics_sums
+        {
+            statistics_sums() : min(~0u), max(0), sum(0), squares(0), saturated(0) {}
+
+            void merge(const statistics_sums & other)
+            {
+                min = std::min(min, other.min);
+                max = std::max(max, other.max);
+                sum += other.sum;
+                squares += other.squares;
+                saturated += other.saturated;
+            }
+
+            unsigned min;
+            unsigned max;
+            uint64_t sum;
+            uint64_t squares;
+            uint64_t saturated;
+        };
+
+        template<class T>
+        void statistics_row_scalar(const T * p, size_t n, unsigned level, statistics_sums & s)
+        {
+            for (size_t k = 0; k < n; ++k)
+            {
+                unsigned v = p[k];
+                s.min = std::min(s.min, v);
+                s.max = std::max(s.max, v);
+                s.sum += v;
+                s.squares += static_cast<uint64_t>(v) * v;
+                s.saturated += v >= level;
+            }
+        }
+
+        /// the 32-bit lane accumulators are flushed to 64 bits every this many vectors, well before they can overflow
+        static const size_t statistics_flush = 4096;
+
+        inline uint64_t sum_epi64(const uint64_t * lanes, size_t n)
+        {
+            uint64_t s = 0;
+            for (size_t k = 0; k < n; ++k)
+                s += lanes[k];
+            return s;
+        }
+
+#if defined(VIDI_UTILS_X86_SIMD)
+        VIDI_UTILS_TARGET("sse2")
+        inline uint64_t hsum_epi32_sse(__m128i v)
+        {
+            uint32_t lanes[4];
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), v);
+            return static_cast<uint64_t>(lanes[0]) + lanes[1] + lanes[2] + lanes[3];
+        }
+
+        VIDI_UTILS_TARGET("sse2")
+        inline void statistics_row_sse(const uint8_t * p, size_t n, unsigned level, statistics_sums & s)
+        {
+            const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi8(1), l = _mm_set1_epi8(static_cast<char>(level));
+            __m128i vmin = _mm_set1_epi8(-1), vmax = zero, sum = zero, saturated = zero;
+            uint64_t squares = 0;
+            size_t k = 0;
+            while (k + 16 <= n)
+            {
+                __m128i sq = zero;
+                for (size_t i = 0; i < statistics_flush && k + 16 <= n; ++i, k += 16)
+                {
+                    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + k));
+                    vmin = _mm_min_epu8(vmin, x);
+                    vmax = _mm_max_epu8(vmax, x);
+                    sum = _mm_add_epi64(sum, _mm_sad_epu8(x, zero));
+                    // x >= level where level - x saturates to 0
+                    __m128i at_level = _mm_and_si128(_mm_cmpeq_epi8(_mm_subs_epu8(l, x), zero), one);
+                    saturated = _mm_add_epi64(saturated, _mm_sad_epu8(at_level, zero));
+                    __m128i lo = _mm_unpacklo_epi8(x, zero), hi = _mm_unpackhi_epi8(x, zero);
+                    sq = _mm_add_epi32(sq, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+                }
+                squares += hsum_epi32_sse(sq);
+            }
+            uint8_t mins[16], maxs[16];
+            uint64_t sums[2], sats[2];
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(mins), vmin);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(maxs), vmax);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(sums), sum);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(sats), saturated);
+            if (k)
+            {
+                s.min = std::min<unsigned>(s.min, *std::min_element(mins, mins + 16));
+                s.max = std::max<unsigned>(s.max, *std::max_element(maxs, maxs + 16));
+            }
+            s.sum += sum_epi64(sums, 2);
+            s.saturated += sum_epi64(sats, 2);
+            s.squares += squares;
+            statistics_row_scalar(p + k, n - k, level, s);
+        }
+
+        /// SSE2 only compares signed 16-bit values: flipping the sign bit maps the unsigned order to the signed one
+        VIDI_UTILS_TARGET("sse2")
+        inline void statistics_row_sse(const uint16_t * p, size_t n, unsigned level, statistics_sums & s)
+        {
+            const __m128i zero = _mm_setzero_si128(), sign = _mm_set1_epi16(-32768), one = _mm_set1_epi16(1);
+            const __m128i l = _mm_set1_epi16(static_cast<short>(level));
+            __m128i vmin = _mm_set1_epi16(32767), vmax = _mm_set1_epi16(-32768);
+            uint64_t sum = 0, squares = 0, saturated = 0;
+            size_t k = 0;
+            while (k + 8 <= n)
+            {
+                __m128i acc = zero, sat = zero, sq = zero;
+                for (size_t i = 0; i < statistics_flush && k + 8 <= n; ++i, k += 8)
+                {
+                    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + k));
+                    __m128i xs = _mm_xor_si128(x, sign);
+                    vmin = _mm_min_epi16(vmin, xs);
+                    vmax = _mm_max_epi16(vmax, xs);
+                    __m128i lo = _mm_unpacklo_epi16(x, zero), hi = _mm_unpackhi_epi16(x, zero);
+                    acc = _mm_add_epi32(acc, _mm_add_epi32(lo, hi));
+                    sat = _mm_add_epi32(sat, _mm_madd_epi16(_mm_and_si128(_mm_cmpeq_epi16(_mm_subs_epu16(l, x), zero), one), one));
+                    sq = _mm_add_epi64(sq, _mm_add_epi64(
+                        _mm_add_epi64(_mm_mul_epu32(lo, lo), _mm_mul_epu32(_mm_srli_epi64(lo, 32), _mm_srli_epi64(lo, 32))),
+                        _mm_add_epi64(_mm_mul_epu32(hi, hi), _mm_mul_epu32(_mm_srli_epi64(hi, 32), _mm_srli_epi64(hi, 32)))));
+                }
+                uint64_t sq_lanes[2];
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(sq_lanes), sq);
+                sum += hsum_epi32_sse(acc);
+                saturated += hsum_epi32_sse(sat);
+                squares += sum_epi64(sq_lanes, 2);
+            }
+            int16_t mins[8], maxs[8];
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(mins), _mm_xor_si128(vmin, sign));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(maxs), _mm_xor_si128(vmax, sign));
+            if (k)
+            {
+                for (size_t i = 0; i < 8; ++i)
+                {
+                    s.min = std::min<unsigned>(s.min, static_cast<uint16_t>(mins[i]));
+                    s.max = std::max<unsigned>(s.max, static_cast<uint16_t>(maxs[i]));
+                }
+            }
+            s.sum += sum;
+            s.squares += squares;
+            s.saturated += saturated;
+            statistics_row_scalar(p + k, n - k, level, s);
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline void statistics_row_avx2(const uint8_t * p, size_t n, unsigned level, statistics_sums & s)
+        {
+            const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi8(1), l = _mm256_set1_epi8(static_cast<char>(level));
+            __m256i vmin = _mm256_set1_epi8(-1), vmax = zero, sum = zero, saturated = zero;
+            uint64_t squares = 0;
+            size_t k = 0;
+            while (k + 32 <= n)
+            {
+                __m256i sq = zero;
+                for (size_t i = 0; i < statistics_flush && k + 32 <= n; ++i, k += 32)
+                {
+                    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + k));
+                    vmin = _mm256_min_epu8(vmin, x);
+                    vmax = _mm256_max_epu8(vmax, x);
+                    sum = _mm256_add_epi64(sum, _mm256_sad_epu8(x, zero));
+                    __m256i at_level = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_subs_epu8(l, x), zero), one);
+                    saturated = _mm256_add_epi64(saturated, _mm256_sad_epu8(at_level, zero));
+                    __m256i lo = _mm256_unpacklo_epi8(x, zero), hi = _mm256_unpackhi_epi8(x, zero);
+                    sq = _mm256_add_epi32(sq, _mm256_add_epi32(_mm256_madd_epi16(lo, lo), _mm256_madd_epi16(hi, hi)));
+                }
+                squares += hsum_epi32_sse(_mm_add_epi32(_mm256_castsi256_si128(sq), _mm256_extracti128_si256(sq, 1)));
+            }
+            uint8_t mins[32], maxs[32];
+            uint64_t sums[4], sats[4];
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(mins), vmin);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(maxs), vmax);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(sums), sum);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(sats), saturated);
+            if (k)
+            {
+                s.min = std::min<unsigned>(s.min, *std::min_element(mins, mins + 32));
+                s.max = std::max<unsigned>(s.max, *std::max_element(maxs, maxs + 32));
+            }
+            s.sum += sum_epi64(sums, 4);
+            s.saturated += sum_epi64(sats, 4);
+            s.squares += squares;
+            statistics_row_sse(p + k, n - k, level, s);
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline void statistics_row_avx2(const uint16_t * p, size_t n, unsigned level, statistics_sums & s)
+        {
+            const __m256i zero = _mm256_setzero_si256(), one = _mm256_set1_epi16(1);
+            const __m256i l = _mm256_set1_epi16(static_cast<short>(level));
+            __m256i vmin = _mm256_set1_epi16(-1), vmax = zero;
+            uint64_t sum = 0, squares = 0, saturated = 0;
+            size_t k = 0;
+            while (k + 16 <= n)
+            {
+                __m256i acc = zero, sat = zero, sq = zero;
+                for (size_t i = 0; i < statistics_flush && k + 16 <= n; ++i, k += 16)
+                {
+                    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + k));
+                    vmin = _mm256_min_epu16(vmin, x);
+                    vmax = _mm256_max_epu16(vmax, x);
+                    __m256i lo = _mm256_unpacklo_epi16(x, zero), hi = _mm256_unpackhi_epi16(x, zero);
+                    acc = _mm256_add_epi32(acc, _mm256_add_epi32(lo, hi));
+                    sat = _mm256_add_epi32(sat, _mm256_madd_epi16(_mm256_and_si256(_mm256_cmpeq_epi16(_mm256_subs_epu16(l, x), zero), one), one));
+                    sq = _mm256_add_epi64(sq, _mm256_add_epi64(
+                        _mm256_add_epi64(_mm256_mul_epu32(lo, lo), _mm256_mul_epu32(_mm256_srli_epi64(lo, 32), _mm256_srli_epi64(lo, 32))),
+                        _mm256_add_epi64(_mm256_mul_epu32(hi, hi), _mm256_mul_epu32(_mm256_srli_epi64(hi, 32), _mm256_srli_epi64(hi, 32)))));
+                }
+                uint64_t sq_lanes[4];
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(sq_lanes), sq);
+                sum += hsum_epi32_sse(_mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1)));
+                saturated += hsum_epi32_sse(_mm_add_epi32(_mm256_castsi256_si128(sat), _mm256_extracti128_si256(sat, 1)));
+                squares += sum_epi64(sq_lanes, 4);
+            }
+            uint16_t mins[16], maxs[16];
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(mins), vmin);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(maxs), vmax);
+            if (k)
+            {
+                s.min = std::min<unsigned>(s.min, *std::min_element(mins, mins + 16));
+                s.max = std::max<unsigned>(s.max, *std::max_element(maxs, maxs + 16));
+            }
+            s.sum += sum;
+            s.squares += squares;
+            s.saturated += saturated;
+            statistics_row_sse(p + k, n - k, level, s);
+        }
+#endif
+
+        /// four interleaved sub-histograms, so that runs of equal values do not wait on the same counter
+        template<class T>
+        void histogram_row(const T * p, size_t n, uint32_t * bins)
+        {
+            const int shift = sizeof(T) == 1 ? 0 : 8;
+            size_t k = 0;
+            for (; k + 4 <= n; k += 4)
+            {
+                ++bins[p[k] >> shift];
+                ++bins[256 + (p[k + 1] >> shift)];
+                ++bins[512 + (p[k + 2] >> shift)];
+                ++bins[768 + (p[k + 3] >> shift)];
+            }
+            for (; k < n; ++k)
+                ++bins[p[k] >> shift];
+        }
+
+        template<class T>
+        void statistics_rows(const image_view & image, VIDI_UINT y0, VIDI_UINT y1, unsigned level, bool histogram,
+            statistics_sums & s, std::vector<uint64_t> & bins, simd_level simd)
+        {
+            size_t n = static_cast<size_t>(image.width()) * image.channels();
+            size_t rows_per_flush = std::max<size_t>(1, 0x7fffffff / n);
+            std::vector<uint32_t> sub_bins(histogram ? 4 * 256 : 0);
+            for (VIDI_UINT y = y0; y < y1; ++y)
+            {
+                const T * p = reinterpret_cast<const T *>(image.row(y));
+#if defined(VIDI_UTILS_X86_SIMD)
+                if (simd == simd_avx2)
+                    statistics_row_avx2(p, n, level, s);
+                else if (simd == simd_sse)
+                    statistics_row_sse(p, n, level, s);
+                else
+#endif
+                    statistics_row_scalar(p, n, level, s);
+                if (histogram)
+                    histogram_row(p, n, &sub_bins[0]);
+                // the 32-bit counters are emptied before they can overflow
+                if (histogram && (y + 1 == y1 || (y - y0 + 1) % rows_per_flush == 0))
+                {
+                    for (size_t b = 0; b < 256; ++b)
+                        bins[b] += sub_bins[b] + sub_bins[256 + b] + sub_bins[512 + b] + sub_bins[768 + b];
+                    std::fill(sub_bins.begin(), sub_bins.end(), 0);
+                }
+            }
+            (void)simd;
+        }
+    }
+
+    /**
+     * @param saturation_level values at or above it count as saturated, 0 for the largest value of the depth
+     * @param histogram false to skip the histogram, the slowest part of the statistics
+     */
+    inline bool compute_statistics(const image_view & image, image_statistics & stats, thread_pool * pool = 0,
+        unsigned saturation_level = 0, bool histogram = true, simd_level level = best_simd_level())
+    {
+        if (image.empty() || (image.channel_depth() != VIDI_IMG_8U && image.channel_depth() != VIDI_IMG_16U))
+            return false;
+        bool is_8u = image.channel_depth() == VIDI_IMG_8U;
+        unsigned max_value = is_8u ? 255 : 65535;
+        if (!saturation_level || saturation_level > max_value)
+            saturation_level = max_value;
+
+        detail::statistics_sums total;
+        std::vector<uint64_t> bins(histogram ? 256 : 0);
+        std::mutex mutex;
+        auto band = [&](size_t y0, size_t y1)
+        {
+            detail::statistics_sums s;
+            std::vector<uint64_t> b(bins.size());
+            if (is_8u)
+                detail::statistics_rows<uint8_t>(image, static_cast<VIDI_UINT>(y0), static_cast<VIDI_UINT>(y1), saturation_level, histogram, s, b, level);
+            else
+                detail::statistics_rows<uint16_t>(image, static_cast<VIDI_UINT>(y0), static_cast<VIDI_UINT>(y1), saturation_level, histogram, s, b, level);
+            std::lock_guard<std::mutex> lock(mutex);
+            total.merge(s);
+            for (size_t k = 0; k < b.size(); ++k)
+                bins[k] += b[k];
+        };
+        if (pool && pool->size() > 1)
+            pool->parallel_for(image.height(), std::max<size_t>(16, image.height() / (4 * pool->size())), band);
+        else
+            band(0, image.height());
+
+        stats.count = static_cast<uint64_t>(image.width()) * image.height() * image.channels();
+        stats.min = total.min;
+        stats.max = total.max;
+        stats.mean = double(total.sum) / stats.count;
+        stats.variance = std::max(0.0, double(total.squares) / stats.count - stats.mean * stats.mean);
+        stats.saturated = double(total.saturated) / stats.count;
+        stats.histogram.swap(bins);
+        return true;
+    }
+
+    /**
+     * @brief a check on the statistics of a frame: returns true to reject it, with the reason
+     */
+    typedef std::function<bool(const image_statistics &, std::string &)> frame_rule;
+
+    /**
+     * @brief rejects frames whose mean is below max_mean
+     */
+    inline frame_rule reject_dark(double max_mean)
+    {
+        return [max_mean](const image_statistics & s, std::string & reason)
+        {
+            if (s.mean >= max_mean)
+                return false;
+            reason = "mean " + std::to_string(s.mean) + " below " + std::to_string(max_mean);
+            return true;
+        };
+    }
+
+    /**
+     * @brief rejects frames with more than max_fraction of their values saturated
+     */
+    inline frame_rule reject_saturated(double max_fraction)
+    {
+        return [max_fraction](const image_statistics & s, std::string & reason)
+        {
+            if (s.saturated <= max_fraction)
+                return false;
+            reason = std::to_string(100 * s.saturated) + "% of the values saturated";
+            return true;
+        };
+    }
+
+    /**
+     * @brief rejects frames without contrast, an empty field of view or a covered lens, whose standard deviation is below min_stddev
+     */
+    inline frame_rule reject_flat(double min_stddev)
+    {
+        return [min_stddev](const image_statistics & s, std::string & reason)
+        {
+            if (s.stddev() >= min_stddev)
+                return false;
+            reason = "standard deviation " + std::to_string(s.stddev()) + " below " + std::to_string(min_stddev);
+            return true;
+        };
+    }
+
+    struct prefilter_stats
+    {
+        prefilter_stats()
+            : accepted(0)
+        {
+        }
+
+        size_t accepted;
+        std::vector<std::pair<std::string, size_t> > rejected;    ///< frames rejected by each rule, in the order of the rules
+    };
+
+    /**
+     * @brief rules applied to the statistics of each frame, rejecting it at the first one that fails
+     *
+     * Rules are added before the filter is used; checking frames is then thread-safe.
+     */
+    class frame_prefilter
+    {
+    public:
+        /**
+         * @param histogram whether the rules need the histogram of the frames
+         * @param pool threads computing the statistics, none for the calling thread alone
+         */
+        explicit frame_prefilter(bool histogram = false, thread_pool * pool = 0, unsigned saturation_level = 0)
+            : m_histogram(histogram)
+            , m_pool(pool)
+            , m_saturation_level(saturation_level)
+        {
+        }
+
+        void add_rule(const std::string & name, const frame_rule & rule)
+        {
+            m_rules.push_back(std::make_pair(name, rule));
+            m_stats.rejected.push_back(std::make_pair(name, size_t(0)));
+        }
+
+        /**
+         * @brief true if the frame passes every rule; otherwise reason tells which rule rejected it and why
+         */
+        bool accept(const image_view & frame, std::string & reason, image_statistics * statistics = 0)
+        {
+            image_statistics local;
+            image_statistics & s = statistics ? *statistics : local;
+            if (!compute_statistics(frame, s, m_pool, m_saturation_level, m_histogram))
+            {
+                reason = "unsupported image";
+                return false;
+            }
+            for (size_t k = 0; k < m_rules.size(); ++k)
+            {
+                std::string why;
+                if (m_rules[k].second(s, why))
+                {
+                    reason = m_rules[k].first + ": " + why;
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    ++m_stats.rejected[k].second;
+                    return false;
+                }
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            ++m_stats.accepted;
+            return true;
+        }
+
+        /**
+         * @brief adds the image to the sample if it passes the rules
+         *
+         * @return whether the image was added, or the error of vidi_runtime_sample_add_image()
+         */
+        result<bool> sample_add_image(const char * workspace, const char * stream, const char * sample, VIDI_IMAGE * image,
+            std::string * reason = 0)
+        {
+            std::string why;
+            if (!accept(image_view(*image), why))
+            {
+                if (reason)
+                    *reason = why;
+                return false;
+            }
+            return runtime::sample_add_image(workspace, stream, sample, image).map([] { return true; });
+        }
+
+        prefilter_stats stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_stats;
+        }
+
+        void report(std::ostream & os) const
+        {
+            prefilter_stats s = stats();
+            os << "prefilter: " << s.accepted << " accepted";
+            for (size_t k = 0; k < s.rejected.size(); ++k)
+                os << ", " << s.rejected[k].second << " rejected as " << s.rejected[k].first;
+            os << std::endl;
+        }
+
+    private:
+        frame_prefilter(const frame_prefilter &);
+        frame_prefilter & operator=(const frame_prefilter &);
+
+        bool m_histogram;
+        thread_pool * m_pool;
+        unsigned m_saturation_level;
+        std::vector<std::pair<std::string, frame_rule> > m_rules;
+        prefilter_stats m_stats;
+        mutable std::mutex m_mutex;
+    };
+}
+
+#endif
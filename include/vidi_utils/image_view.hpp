@@ -0,0 +1,233 @@
+/**
+ * @file image_view.hpp
+ * @brief Non-owning, stride-aware views into the pixels of a VIDI_IMAGE
+ *
+ * A VIDI_IMAGE has a step separate from its width, so a rectangle of a larger image can be
+ * described by pointing data at its first pixel and keeping the step of the parent. image_view
+ * builds such rectangles (crops, regions of interest, the tiles of a splitting grid) and turns
+ * them back into a VIDI_IMAGE that can be passed to the library without copying any pixel:
+ *
+ *     vidi_utils::image_view roi = vidi_utils::image_view(frame).crop(x, y, w, h);
+ *     VIDI_IMAGE roi_image = roi.image();
+ *     vidi_runtime_sample_add_image("workspace", "default", "my_sample", &roi_image);
+ *
+ * The step is a number of bytes, for every channel depth and number of channels. The parent
+ * image must outlive its views, and the VIDI_IMAGE returned by image() must never be given to
+ * vidi_free_image(). Bounds are checked with assert(), i.e. in debug builds only.
+ */
+
+#ifndef VIDI_UTILS_IMAGE_VIEW_HPP_INCLUDED
+#define VIDI_UTILS_IMAGE_VIEW_HPP_INCLUDED
+
+#include "vidi.h"
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+namespace vidi_utils
+{
+    /**
+     * @brief size in bytes of one channel of a pixel of the given depth
+     */
+    inline size_t channel_size(VIDI_UINT channel_depth)
+    {
+        assert(channel_depth == VIDI_IMG_8U || channel_depth == VIDI_IMG_16U);
+        return channel_depth == VIDI_IMG_16U ? 2 : 1;
+    }
+
+    /**
+     * @brief size in bytes of one (possibly multi-channel) pixel of the image
+     */
+    inline size_t pixel_size(const VIDI_IMAGE & image)
+    {
+        return image.channels * channel_size(image.channel_depth);
+    }
+
+    /**
+     * @brief rectangle of pixels sharing the memory and the step of an existing image
+     */
+    class image_view
+    {
+    public:
+        image_view()
+            : m_data(0)
+            , m_width(0)
+            , m_height(0)
+            , m_channels(0)
+            , m_channel_depth(VIDI_IMG_8U)
+            , m_step(0)
+        {
+        }
+
+        /**
+         * @brief view of the whole image
+         */
+        explicit image_view(const VIDI_IMAGE & image)
+            : m_data(static_cast<unsigned char *>(image.data))
+            , m_width(image.width)
+            , m_height(image.height)
+            , m_channels(image.channels)
+            , m_channel_depth(image.channel_depth)
+            , m_step(image.step)
+        {
+            assert(!m_height || m_step >= m_width * pixel_size());
+        }
+
+        /**
+         * @brief view of pixels owned by the caller, e.g. a camera frame
+         *
+         * @param step size of a row in bytes, 0 for tightly packed rows
+         */
+        image_view(void * data, VIDI_UINT width, VIDI_UINT height, VIDI_UINT channels, VIDI_UINT channel_depth, VIDI_UINT step = 0)
+            : m_data(static_cast<unsigned char *>(data))
+            , m_width(width)
+            , m_height(height)
+            , m_channels(channels)
+            , m_channel_depth(channel_depth)
+            , m_step(step ? step : static_cast<VIDI_UINT>(width * channels * channel_size(channel_depth)))
+        {
+            assert(!m_height || m_step >= m_width * pixel_size());
+        }
+
+        unsigned char * data() const { return m_data; }
+        VIDI_UINT width() const { return m_width; }
+        VIDI_UINT height() const { return m_height; }
+        VIDI_UINT channels() const { return m_channels; }
+        VIDI_UINT channel_depth() const { return m_channel_depth; }
+        VIDI_UINT step() const { return m_step; }
+        bool empty() const { return !m_data || !m_width || !m_height; }
+
+        size_t pixel_size() const { return m_channels * channel_size(m_channel_depth); }
+
+        /**
+         * @brief bytes of pixel data in a row, without the padding up to the step
+         */
+        size_t row_size() const { return m_width * pixel_size(); }
+
+        /**
+         * @brief true when the rows follow each other without padding, as in a single block
+         */
+        bool contiguous() const { return m_step == row_size() || m_height <= 1; }
+
+        /**
+         * @brief true if the rectangle lies inside the view, for checks in release builds
+         */
+        bool contains(VIDI_UINT x, VIDI_UINT y, VIDI_UINT width, VIDI_UINT height) const
+        {
+            return x <= m_width && width <= m_width - x && y <= m_height && height <= m_height - y;
+        }
+
+        /**
+         * @brief view of a rectangle of this view, no pixel is copied
+         */
+        image_view crop(VIDI_UINT x, VIDI_UINT y, VIDI_UINT width, VIDI_UINT height) const
+        {
+            assert(contains(x, y, width, height));
+            image_view view(*this);
+            view.m_data = m_data + static_cast<size_t>(y) * m_step + x * pixel_size();
+            view.m_width = width;
+            view.m_height = height;
+            return view;
+        }
+
+        /**
+         * @brief first byte of row y
+         */
+        unsigned char * row(VIDI_UINT y) const
+        {
+            assert(y < m_height);
+            return m_data + static_cast<size_t>(y) * m_step;
+        }
+
+        /**
+         * @brief first channel of the pixel (x, y), T being unsigned char for 8U and unsigned short for 16U images
+         */
+        template<class T>
+        T * pixel(VIDI_UINT x, VIDI_UINT y) const
+        {
+            assert(sizeof(T) == channel_size(m_channel_depth));
+            assert(x < m_width);
+            return reinterpret_cast<T *>(row(y)) + static_cast<size_t>(x) * m_channels;
+        }
+
+        /**
+         * @brief VIDI_IMAGE aliasing the pixels of the view, to be passed to the library
+         *
+         * it is not managed by the library and must not be freed with vidi_free_image()
+         */
+        VIDI_IMAGE image() const
+        {
+            VIDI_IMAGE image;
+            image.width = m_width;
+            image.height = m_height;
+            image.channels = m_channels;
+            image.channel_depth = m_channel_depth;
+            image.step = m_step;
+            image.data = m_data;
+            return image;
+        }
+
+        /**
+         * @brief copies the pixels to dst, whose rows are dst_step bytes apart (0 for tightly packed)
+         */
+        void copy_to(void * dst, size_t dst_step = 0) const
+        {
+            size_t n = row_size();
+            if (!dst_step)
+                dst_step = n;
+            unsigned char * out = static_cast<unsigned char *>(dst);
+            if (contiguous() && dst_step == n)
+            {
+                std::memcpy(out, m_data, n * m_height);
+                return;
+            }
+            for (VIDI_UINT y = 0; y < m_height; ++y)
+                std::memcpy(out + y * dst_step, row(y), n);
+        }
+
+    private:
+        unsigned char * m_data;
+        VIDI_UINT m_width;
+        VIDI_UINT m_height;
+        VIDI_UINT m_channels;
+        VIDI_UINT m_channel_depth;
+        VIDI_UINT m_step;
+    };
+
+    /**
+     * @brief views of the cells of a splitting grid covering the view
+     *
+     * cells are tile_width x tile_height, overlap pixels are shared with the neighbouring cells and
+     * the last cell of a row or column is shifted back inside the view rather than cut, unless the
+     * view is smaller than a cell. Cells are returned row by row, none when the view is empty or the
+     * overlap is not smaller than the cells.
+     */
+    inline std::vector<image_view> grid_tiles(const image_view & view, VIDI_UINT tile_width, VIDI_UINT tile_height, VIDI_UINT overlap = 0)
+    {
+        std::vector<image_view> tiles;
+        // checked in release builds too: the grid would not advance
+        if (view.empty() || tile_width <= overlap || tile_height <= overlap)
+            return tiles;
+
+        VIDI_UINT w = tile_width < view.width() ? tile_width : view.width();
+        VIDI_UINT h = tile_height < view.height() ? tile_height : view.height();
+        for (VIDI_UINT y = 0;; y += tile_height - overlap)
+        {
+            VIDI_UINT ty = y + h > view.height() ? view.height() - h : y;
+            for (VIDI_UINT x = 0;; x += tile_width - overlap)
+            {
+                VIDI_UINT tx = x + w > view.width() ? view.width() - w : x;
+                tiles.push_back(view.crop(tx, ty, w, h));
+                if (tx + w >= view.width())
+                    break;
+            }
+            if (ty + h >= view.height())
+                break;
+        }
+        return tiles;
+    }
+}
+
+#endif
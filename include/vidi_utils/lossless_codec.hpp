@@ -0,0 +1,713 @@
+/**
+ * @file lossless_codec.hpp
+ * @brief Fast lossless compression of 8-bit and 16-bit images, by tiles of rows on a thread pool
+ *
+ * Keeping every inspected frame for traceability needs something between PNG, too slow to keep
+ * up with the line, and raw pixels, too large. This codec predicts every sample from its
+ * neighbours and packs the prediction errors with as few bits as they need:
+ *
+ *     std::vector<unsigned char> encoded;
+ *     vidi_utils::encode_lossless(vidi_utils::image_view(image), encoded, &pool);
+ *     ...
+ *     vidi_utils::pooled_image frame = vidi_utils::decode_lossless(encoded.data(), encoded.size(), images, &pool);
+ *
+ * Prediction is the median edge detector of LOCO-I: the left sample, the one above or their
+ * gradient, whichever does not overshoot an edge. Each channel is predicted from the same
+ * channel of its neighbours. The errors, wrapped to the depth of the image and zigzag mapped
+ * so that small errors of either sign give small numbers, go in groups of 16, each stored as
+ * a byte giving the bit width w of its largest error followed by w bit planes of 2 bytes, bit
+ * k of plane b being bit b of the k-th error, and a run of up to 128 groups of zeros takes a
+ * single byte: flat backgrounds cost next to nothing, a 12-bit camera in a 16-bit image never
+ * takes more than 12 bits per sample, and SSSE3 packs and unpacks a plane in a couple of
+ * instructions. Prediction runs with SSSE3 or AVX2 when the
+ * processor has them; reconstruction is serial, each sample needing the one on its left.
+ *
+ * Layout, all integers little-endian:
+ *
+ *     header     lossless_header, 32 bytes
+ *     index      tile_count x lossless_tile, 16 bytes each
+ *     tiles      the tiles, one after the other
+ *
+ * A tile is a band of tile_rows rows, the last one possibly shorter, and does not depend on
+ * the others: the tiles are encoded and decoded in parallel, and a tile where packing does not
+ * pay is stored as raw rows.
+ */
+
+#ifndef VIDI_UTILS_LOSSLESS_CODEC_HPP_INCLUDED
+#define VIDI_UTILS_LOSSLESS_CODEC_HPP_INCLUDED
+
+#include "vidi.h"
+#include "image_pool.hpp"
+#include "image_view.hpp"
+#include "pixel_convert.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace vidi_utils
+{
+#pragma pack(push, 1)
+    struct lossless_header
+    {
+        char magic[4];              ///< "VLL1"
+        uint16_t version;           ///< 1
+        uint16_t tile_rows;
+        uint32_t width;
+        uint32_t height;
+        uint32_t channels;
+        uint32_t channel_depth;     ///< VIDI_IMG_8U or VIDI_IMG_16U
+        uint32_t tile_count;
+        uint32_t reserved;
+    };
+
+    struct lossless_tile
+    {
+        uint64_t offset;            ///< from the start of the data
+        uint32_t size;
+        uint8_t mode;               ///< lossless_raw or lossless_packed
+        uint8_t reserved[3];
+    };
+#pragma pack(pop)
+
+    static_assert(sizeof(lossless_header) == 32, "the header is 32 bytes");
+    static_assert(sizeof(lossless_tile) == 16, "an index entry is 16 bytes");
+
+    enum lossless_tile_mode
+    {
+        lossless_raw = 0,
+        lossless_packed = 1
+    };
+
+    namespace detail
+    {
+        static const char lossless_magic[4] = { 'V', 'L', 'L', '1' };
+        static const size_t lossless_group = 16;
+
+        /**
+         * @brief the median edge detector: a on the left, b above, c above left
+         *
+         * The median of a, b and a + b - c is the gradient clamped between a and b.
+         */
+        inline int med_predict(int a, int b, int c)
+        {
+            int lo = a < b ? a : b, hi = a < b ? b : a, g = a + b - c;
+            return g < lo ? lo : g > hi ? hi : g;
+        }
+
+        template<class T>
+        struct lossless_traits;
+
+        template<>
+        struct lossless_traits<uint8_t>
+        {
+            typedef int8_t signed_type;
+            static const unsigned bits = 8;
+        };
+
+        template<>
+        struct lossless_traits<uint16_t>
+        {
+            typedef int16_t signed_type;
+            static const unsigned bits = 16;
+        };
+
+        /// the error of the prediction, wrapped to the depth then zigzag mapped: 0, -1, 1, -2... give 0, 1, 2, 3...
+        template<class T>
+        inline T zigzag(T value, int predicted)
+        {
+            typedef typename lossless_traits<T>::signed_type S;
+            S d = static_cast<S>(static_cast<T>(value - predicted));
+            return static_cast<T>((static_cast<T>(d) << 1) ^ static_cast<T>(d >> (lossless_traits<T>::bits - 1)));
+        }
+
+        template<class T>
+        inline T unzigzag(T z, int predicted)
+        {
+            T d = static_cast<T>((z >> 1) ^ static_cast<T>(0 - (z & 1)));
+            return static_cast<T>(predicted + d);
+        }
+
+        inline unsigned bit_width(uint32_t v)
+        {
+#if defined(_MSC_VER)
+            unsigned long index;
+            return _BitScanReverse(&index, v) ? index + 1 : 0;
+#else
+            return v ? 32 - __builtin_clz(v) : 0;
+#endif
+        }
+
+        /// errors of out[x] for x in [x, n), with the rows of the sample on the left ch samples back; returns n
+        template<class T>
+        inline size_t med_residuals_scalar(const T * row, const T * above, size_t ch, size_t x, size_t n, T * out)
+        {
+            for (; x < n; ++x)
+                out[x] = zigzag<T>(row[x], med_predict(row[x - ch], above[x], above[x - ch]));
+            return n;
+        }
+
+        /// one group of 16 values: its width, then bit b of the k-th value as bit k of the 16-bit plane b
+        template<class T>
+        inline unsigned char * pack_group_scalar(const T * v, unsigned char * p)
+        {
+            uint32_t any = 0;
+            for (size_t k = 0; k < lossless_group; ++k)
+                any |= v[k];
+            const unsigned w = bit_width(any);
+            *p++ = static_cast<unsigned char>(w);
+            for (unsigned b = 0; b < w; ++b)
+            {
+                unsigned plane = 0;
+                for (size_t k = 0; k < lossless_group; ++k)
+                    plane |= ((v[k] >> b) & 1u) << k;
+                *p++ = static_cast<unsigned char>(plane);
+                *p++ = static_cast<unsigned char>(plane >> 8);
+            }
+            return p;
+        }
+
+        template<class T>
+        inline void unpack_group_scalar(const unsigned char * p, unsigned w, T * v)
+        {
+            for (size_t k = 0; k < lossless_group; ++k)
+                v[k] = 0;
+            for (unsigned b = 0; b < w; ++b, p += 2)
+            {
+                unsigned plane = p[0] | unsigned(p[1]) << 8;
+                for (size_t k = 0; k < lossless_group; ++k)
+                    v[k] = static_cast<T>(v[k] | (((plane >> k) & 1u) << b));
+            }
+        }
+
+#if defined(VIDI_UTILS_X86_SIMD)
+        VIDI_UTILS_TARGET("ssse3")
+        inline __m128i med_epi16_sse(__m128i a, __m128i b, __m128i c)
+        {
+            __m128i lo = _mm_min_epi16(a, b), hi = _mm_max_epi16(a, b);
+            return _mm_min_epi16(_mm_max_epi16(_mm_sub_epi16(_mm_add_epi16(a, b), c), lo), hi);
+        }
+
+        VIDI_UTILS_TARGET("ssse3")
+        inline size_t med_residuals_sse(const uint8_t * row, const uint8_t * above, size_t ch, size_t x, size_t n, uint8_t * out)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            for (; x + 16 <= n; x += 16)
+            {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x - ch));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(above + x));
+                __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(above + x - ch));
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x));
+                __m128i p = _mm_packus_epi16(
+                    med_epi16_sse(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(c, zero)),
+                    med_epi16_sse(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(c, zero)));
+                __m128i d = _mm_sub_epi8(v, p);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x), _mm_xor_si128(_mm_add_epi8(d, d), _mm_cmpgt_epi8(zero, d)));
+            }
+            return x;
+        }
+
+        /// 16-bit samples compared as signed after flipping their top bit; the gradient wraps but is only kept when between a and b
+        VIDI_UTILS_TARGET("ssse3")
+        inline size_t med_residuals_sse(const uint16_t * row, const uint16_t * above, size_t ch, size_t x, size_t n, uint16_t * out)
+        {
+            const __m128i flip = _mm_set1_epi16(static_cast<short>(0x8000)), ones = _mm_set1_epi16(-1);
+            for (; x + 8 <= n; x += 8)
+            {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x - ch));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(above + x));
+                __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(above + x - ch));
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + x));
+                __m128i sa = _mm_xor_si128(a, flip), sb = _mm_xor_si128(b, flip), sc = _mm_xor_si128(c, flip);
+                __m128i lo = _mm_min_epi16(sa, sb), hi = _mm_max_epi16(sa, sb);
+                __m128i below = _mm_xor_si128(_mm_cmpgt_epi16(hi, sc), ones);       // c >= hi: the gradient is under lo
+                __m128i over = _mm_xor_si128(_mm_cmpgt_epi16(sc, lo), ones);        // c <= lo: the gradient is over hi
+                __m128i g = _mm_sub_epi16(_mm_add_epi16(a, b), c);
+                g = _mm_or_si128(_mm_and_si128(over, _mm_xor_si128(hi, flip)), _mm_andnot_si128(over, g));
+                g = _mm_or_si128(_mm_and_si128(below, _mm_xor_si128(lo, flip)), _mm_andnot_si128(below, g));
+                __m128i d = _mm_sub_epi16(v, g);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + x), _mm_xor_si128(_mm_add_epi16(d, d), _mm_srai_epi16(d, 15)));
+            }
+            return x;
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline __m256i med_epi16_avx2(__m256i a, __m256i b, __m256i c)
+        {
+            __m256i lo = _mm256_min_epi16(a, b), hi = _mm256_max_epi16(a, b);
+            return _mm256_min_epi16(_mm256_max_epi16(_mm256_sub_epi16(_mm256_add_epi16(a, b), c), lo), hi);
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline size_t med_residuals_avx2(const uint8_t * row, const uint8_t * above, size_t ch, size_t x, size_t n, uint8_t * out)
+        {
+            const __m256i zero = _mm256_setzero_si256();
+            for (; x + 32 <= n; x += 32)
+            {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x - ch));
+                __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(above + x));
+                __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(above + x - ch));
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x));
+                // unpacking and packing both work within 128-bit lanes, so the order is kept
+                __m256i p = _mm256_packus_epi16(
+                    med_epi16_avx2(_mm256_unpacklo_epi8(a, zero), _mm256_unpacklo_epi8(b, zero), _mm256_unpacklo_epi8(c, zero)),
+                    med_epi16_avx2(_mm256_unpackhi_epi8(a, zero), _mm256_unpackhi_epi8(b, zero), _mm256_unpackhi_epi8(c, zero)));
+                __m256i d = _mm256_sub_epi8(v, p);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x), _mm256_xor_si256(_mm256_add_epi8(d, d), _mm256_cmpgt_epi8(zero, d)));
+            }
+            return med_residuals_sse(row, above, ch, x, n, out);
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline size_t med_residuals_avx2(const uint16_t * row, const uint16_t * above, size_t ch, size_t x, size_t n, uint16_t * out)
+        {
+            // unsigned minimum and maximum are available here, and the clamp needs no flipping
+            for (; x + 16 <= n; x += 16)
+            {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x - ch));
+                __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(above + x));
+                __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(above + x - ch));
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row + x));
+                __m256i lo = _mm256_min_epu16(a, b), hi = _mm256_max_epu16(a, b);
+                __m256i below = _mm256_cmpeq_epi16(_mm256_max_epu16(c, hi), c);     // c >= hi
+                __m256i over = _mm256_cmpeq_epi16(_mm256_min_epu16(c, lo), c);      // c <= lo
+                __m256i g = _mm256_sub_epi16(_mm256_add_epi16(a, b), c);
+                g = _mm256_blendv_epi8(g, hi, over);
+                g = _mm256_blendv_epi8(g, lo, below);
+                __m256i d = _mm256_sub_epi16(v, g);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + x), _mm256_xor_si256(_mm256_add_epi16(d, d), _mm256_srai_epi16(d, 15)));
+            }
+            return med_residuals_sse(row, above, ch, x, n, out);
+        }
+
+        /// the lowest count planes of 16 bytes: shifting bit b to the top of every byte and gathering the tops
+        VIDI_UTILS_TARGET("ssse3")
+        inline unsigned char * pack_planes_sse(__m128i bytes, unsigned count, unsigned char * p)
+        {
+            for (unsigned b = 0; b < count; ++b, p += 2)
+            {
+                int plane = _mm_movemask_epi8(_mm_sll_epi16(bytes, _mm_cvtsi32_si128(7 - b)));
+                p[0] = static_cast<unsigned char>(plane);
+                p[1] = static_cast<unsigned char>(plane >> 8);
+            }
+            return p;
+        }
+
+        VIDI_UTILS_TARGET("ssse3")
+        inline unsigned max_byte_sse(__m128i v)
+        {
+            v = _mm_max_epu8(v, _mm_srli_si128(v, 8));
+            v = _mm_max_epu8(v, _mm_srli_si128(v, 4));
+            v = _mm_max_epu8(v, _mm_srli_si128(v, 2));
+            v = _mm_max_epu8(v, _mm_srli_si128(v, 1));
+            return static_cast<unsigned>(_mm_cvtsi128_si32(v) & 0xFF);
+        }
+
+        VIDI_UTILS_TARGET("ssse3")
+        inline unsigned char * pack_group_sse(const uint8_t * v, unsigned char * p)
+        {
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(v));
+            const unsigned w = bit_width(max_byte_sse(bytes));
+            *p++ = static_cast<unsigned char>(w);
+            return pack_planes_sse(bytes, w, p);
+        }
+
+        VIDI_UTILS_TARGET("ssse3")
+        inline unsigned char * pack_group_sse(const uint16_t * v, unsigned char * p)
+        {
+            __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(v));
+            __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(v + 8));
+            const __m128i low = _mm_set1_epi16(0xFF);
+            __m128i lo = _mm_packus_epi16(_mm_and_si128(v0, low), _mm_and_si128(v1, low));
+            __m128i hi = _mm_packus_epi16(_mm_srli_epi16(v0, 8), _mm_srli_epi16(v1, 8));
+            unsigned top = max_byte_sse(hi);
+            const unsigned w = top ? 8 + bit_width(top) : bit_width(max_byte_sse(lo));
+            *p++ = static_cast<unsigned char>(w);
+            p = pack_planes_sse(lo, std::min(w, 8u), p);
+            return w > 8 ? pack_planes_sse(hi, w - 8, p) : p;
+        }
+
+        /// 16 bytes from count planes: plane b spread over the bytes, one bit each, and kept as bit b where set
+        VIDI_UTILS_TARGET("ssse3")
+        inline __m128i unpack_planes_sse(const unsigned char * p, unsigned count)
+        {
+            const __m128i spread = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+            const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+            __m128i v = _mm_setzero_si128();
+            for (unsigned b = 0; b < count; ++b, p += 2)
+            {
+                __m128i plane = _mm_shuffle_epi8(_mm_cvtsi32_si128(p[0] | p[1] << 8), spread);
+                __m128i set = _mm_cmpeq_epi8(_mm_and_si128(plane, bits), bits);
+                v = _mm_or_si128(v, _mm_and_si128(set, _mm_set1_epi8(static_cast<char>(1 << b))));
+            }
+            return v;
+        }
+
+        VIDI_UTILS_TARGET("ssse3")
+        inline void unpack_group_sse(const unsigned char * p, unsigned w, uint8_t * v)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(v), unpack_planes_sse(p, w));
+        }
+
+        VIDI_UTILS_TARGET("ssse3")
+        inline void unpack_group_sse(const unsigned char * p, unsigned w, uint16_t * v)
+        {
+            __m128i lo = unpack_planes_sse(p, std::min(w, 8u));
+            __m128i hi = w > 8 ? unpack_planes_sse(p + 16, w - 8) : _mm_setzero_si128();
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(v), _mm_unpacklo_epi8(lo, hi));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(v + 8), _mm_unpackhi_epi8(lo, hi));
+        }
+#endif
+
+        template<class T>
+        inline size_t med_residuals(const T * row, const T * above, size_t ch, size_t x, size_t n, T * out, simd_level level)
+        {
+#if defined(VIDI_UTILS_X86_SIMD)
+            if (level == simd_avx2)
+                x = med_residuals_avx2(row, above, ch, x, n, out);
+            else if (level == simd_sse)
+                x = med_residuals_sse(row, above, ch, x, n, out);
+#else
+            (void)level;
+#endif
+            return med_residuals_scalar(row, above, ch, x, n, out);
+        }
+
+        /// zigzagged errors of rows [y0, y1), which are predicted as if there were nothing above y0
+        template<class T>
+        inline void lossless_residuals(const image_view & image, VIDI_UINT y0, VIDI_UINT y1, T * out, simd_level level)
+        {
+            const size_t ch = image.channels(), n = image.width() * ch;
+            for (VIDI_UINT y = y0; y < y1; ++y, out += n)
+            {
+                const T * row = reinterpret_cast<const T *>(image.row(y));
+                size_t head = std::min(ch, n);
+                if (y == y0)
+                {
+                    for (size_t x = 0; x < head; ++x)
+                        out[x] = zigzag<T>(row[x], 0);
+                    for (size_t x = ch; x < n; ++x)
+                        out[x] = zigzag<T>(row[x], row[x - ch]);
+                    continue;
+                }
+                const T * above = reinterpret_cast<const T *>(image.row(y - 1));
+                for (size_t x = 0; x < head; ++x)
+                    out[x] = zigzag<T>(row[x], above[x]);
+                med_residuals(row, above, ch, head, n, out, level);
+            }
+        }
+
+        /// the inverse of lossless_residuals(), serial since every sample needs the one on its left
+        template<class T>
+        inline void lossless_reconstruct(const image_view & image, VIDI_UINT y0, VIDI_UINT y1, const T * in)
+        {
+            const size_t ch = image.channels(), n = image.width() * ch;
+            for (VIDI_UINT y = y0; y < y1; ++y, in += n)
+            {
+                T * row = reinterpret_cast<T *>(image.row(y));
+                size_t head = std::min(ch, n);
+                if (y == y0)
+                {
+                    for (size_t x = 0; x < head; ++x)
+                        row[x] = unzigzag<T>(in[x], 0);
+                    for (size_t x = ch; x < n; ++x)
+                        row[x] = unzigzag<T>(in[x], row[x - ch]);
+                    continue;
+                }
+                const T * above = reinterpret_cast<const T *>(image.row(y - 1));
+                // channel by channel, so the sample on the left stays in a register rather than going through memory
+                for (size_t c = 0; c < head; ++c)
+                {
+                    int a = row[c] = unzigzag<T>(in[c], above[c]);
+                    for (size_t x = c + ch; x < n; x += ch)
+                        a = row[x] = unzigzag<T>(in[x], med_predict(a, above[x], above[x - ch]));
+                }
+            }
+        }
+
+        template<class T>
+        inline unsigned char * pack_group(const T * v, unsigned char * p, simd_level level)
+        {
+#if defined(VIDI_UTILS_X86_SIMD)
+            if (level != simd_scalar)
+                return pack_group_sse(v, p);
+#else
+            (void)level;
+#endif
+            return pack_group_scalar(v, p);
+        }
+
+        template<class T>
+        inline void unpack_group(const unsigned char * p, unsigned w, T * v, simd_level level)
+        {
+#if defined(VIDI_UTILS_X86_SIMD)
+            if (level != simd_scalar)
+            {
+                unpack_group_sse(p, w, v);
+                return;
+            }
+#else
+            (void)level;
+#endif
+            unpack_group_scalar(p, w, v);
+        }
+
+        /**
+         * @brief appends the values in groups of 16, each its width w then w planes of 2 bytes; n is a multiple of 16
+         *
+         * Consecutive groups of zeros share a single byte, 0x80 + k for k + 1 groups, up to 128 of them.
+         */
+        template<class T>
+        inline void lossless_pack(const T * values, size_t n, std::vector<unsigned char> & out, simd_level level)
+        {
+            size_t size = out.size();
+            out.resize(size + n / lossless_group * (1 + 2 * lossless_traits<T>::bits));
+            unsigned char * p = &out[size];
+            unsigned char * run = 0;
+            for (size_t g = 0; g < n; g += lossless_group)
+            {
+                unsigned char * next = pack_group(values + g, p, level);
+                if (next != p + 1 || *p != 0)
+                    run = 0;
+                else if (run && *run != 0xFF)
+                {
+                    *run = static_cast<unsigned char>(*run ? *run + 1 : 0x81);
+                    continue;
+                }
+                else
+                    run = p;
+                p = next;
+            }
+            out.resize(p - &out[0]);
+        }
+
+        /**
+         * @brief the inverse of lossless_pack(); false if the data ends early, has bytes left or a width is out of range
+         */
+        template<class T>
+        inline bool lossless_unpack(const unsigned char * p, size_t size, T * values, size_t n, simd_level level)
+        {
+            const unsigned char * end = p + size;
+            for (size_t g = 0; g < n; g += lossless_group)
+            {
+                if (p == end)
+                    return false;
+                if (*p & 0x80)
+                {
+                    size_t zeros = ((*p++ & 0x7F) + 1) * lossless_group;
+                    if (zeros > n - g)
+                        return false;
+                    std::fill(values + g, values + g + zeros, T(0));
+                    g += zeros - lossless_group;
+                    continue;
+                }
+                if (*p > lossless_traits<T>::bits)
+                    return false;
+                const unsigned w = *p++;
+                if (static_cast<size_t>(end - p) < 2 * w)
+                    return false;
+                unpack_group(p, w, values + g, level);
+                p += 2 * w;
+            }
+            return p == end;
+        }
+
+        template<class T>
+        inline void lossless_encode_tile(const image_view & image, VIDI_UINT y0, VIDI_UINT y1, lossless_tile & tile,
+            std::vector<unsigned char> & out, simd_level level)
+        {
+            const size_t n = image.width() * image.channels() * (y1 - y0);
+            std::vector<T> residuals((n + lossless_group - 1) / lossless_group * lossless_group, T(0));
+            lossless_residuals<T>(image, y0, y1, residuals.data(), level);
+            out.clear();
+            lossless_pack<T>(residuals.data(), residuals.size(), out, level);
+
+            tile.mode = lossless_packed;
+            if (out.size() >= n * sizeof(T))
+            {
+                out.resize(n * sizeof(T));
+                for (VIDI_UINT y = y0; y < y1; ++y)
+                    std::memcpy(&out[(y - y0) * image.row_size()], image.row(y), image.row_size());
+                tile.mode = lossless_raw;
+            }
+            tile.size = static_cast<uint32_t>(out.size());
+        }
+
+        template<class T>
+        inline bool lossless_decode_tile(const unsigned char * data, const lossless_tile & tile, const image_view & image,
+            VIDI_UINT y0, VIDI_UINT y1, simd_level level)
+        {
+            const size_t n = image.width() * image.channels() * (y1 - y0);
+            if (tile.mode == lossless_raw)
+            {
+                if (tile.size != n * sizeof(T))
+                    return false;
+                for (VIDI_UINT y = y0; y < y1; ++y)
+                    std::memcpy(image.row(y), data + (y - y0) * image.row_size(), image.row_size());
+                return true;
+            }
+            if (tile.mode != lossless_packed)
+                return false;
+            std::vector<T> residuals((n + lossless_group - 1) / lossless_group * lossless_group);
+            if (!lossless_unpack<T>(data, tile.size, residuals.data(), residuals.size(), level))
+                return false;
+            lossless_reconstruct<T>(image, y0, y1, residuals.data());
+            return true;
+        }
+
+        /// checks that the header, the index and the tiles fit in the data
+        inline bool lossless_parse(const void * data, size_t size, lossless_header & header, const lossless_tile *& tiles)
+        {
+            if (!data || size < sizeof(lossless_header))
+                return false;
+            std::memcpy(&header, data, sizeof(header));
+            if (std::memcmp(header.magic, lossless_magic, 4) != 0 || header.version != 1 || !header.tile_rows
+                || header.channels < 1 || header.channels > 4
+                || (header.channel_depth != VIDI_IMG_8U && header.channel_depth != VIDI_IMG_16U)
+                || header.tile_count != (uint64_t(header.height) + header.tile_rows - 1) / header.tile_rows)
+                return false;
+            uint64_t index_end = sizeof(lossless_header) + uint64_t(header.tile_count) * sizeof(lossless_tile);
+            if (index_end > size)
+                return false;
+            tiles = reinterpret_cast<const lossless_tile *>(static_cast<const unsigned char *>(data) + sizeof(lossless_header));
+            for (uint32_t k = 0; k < header.tile_count; ++k)
+            {
+                if (tiles[k].offset < index_end || tiles[k].offset > size || tiles[k].size > size - tiles[k].offset)
+                    return false;
+            }
+            return true;
+        }
+    }
+
+    /**
+     * @brief the size and format of an encoded image, without decoding it
+     */
+    inline bool lossless_shape(const void * data, size_t size, image_shape & shape)
+    {
+        lossless_header header;
+        const lossless_tile * tiles;
+        if (!detail::lossless_parse(data, size, header, tiles))
+            return false;
+        shape = image_shape(header.width, header.height, header.channels, header.channel_depth);
+        return true;
+    }
+
+    /**
+     * @brief encodes an 8-bit or 16-bit image with 1 to 4 channels
+     *
+     * @param pool encodes the tiles in parallel, 0 encodes them on the calling thread
+     * @param tile_rows rows per tile; smaller tiles spread better over threads and compress slightly worse
+     * @param level every level gives the same bytes
+     */
+    inline bool encode_lossless(const image_view & image, std::vector<unsigned char> & out, thread_pool * pool = 0,
+        VIDI_UINT tile_rows = 64, simd_level level = best_simd_level())
+    {
+        if (image.empty() || image.channels() < 1 || image.channels() > 4 || !tile_rows || tile_rows > 65535
+            || (image.channel_depth() != VIDI_IMG_8U && image.channel_depth() != VIDI_IMG_16U))
+            return false;
+
+        lossless_header header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, detail::lossless_magic, 4);
+        header.version = 1;
+        header.tile_rows = static_cast<uint16_t>(tile_rows);
+        header.width = image.width();
+        header.height = image.height();
+        header.channels = image.channels();
+        header.channel_depth = image.channel_depth();
+        header.tile_count = (image.height() + tile_rows - 1) / tile_rows;
+
+        std::vector<lossless_tile> tiles(header.tile_count);
+        std::vector<std::vector<unsigned char> > encoded(header.tile_count);
+        auto encode = [&](size_t begin, size_t end)
+        {
+            for (size_t k = begin; k < end; ++k)
+            {
+                std::memset(&tiles[k], 0, sizeof(lossless_tile));
+                VIDI_UINT y0 = static_cast<VIDI_UINT>(k * tile_rows), y1 = std::min(image.height(), y0 + tile_rows);
+                if (image.channel_depth() == VIDI_IMG_8U)
+                    detail::lossless_encode_tile<uint8_t>(image, y0, y1, tiles[k], encoded[k], level);
+                else
+                    detail::lossless_encode_tile<uint16_t>(image, y0, y1, tiles[k], encoded[k], level);
+            }
+        };
+        if (pool && pool->size() > 1)
+            pool->parallel_for(tiles.size(), 1, encode);
+        else
+            encode(0, tiles.size());
+
+        uint64_t offset = sizeof(lossless_header) + tiles.size() * sizeof(lossless_tile);
+        for (size_t k = 0; k < tiles.size(); ++k)
+        {
+            tiles[k].offset = offset;
+            offset += tiles[k].size;
+        }
+        out.resize(static_cast<size_t>(offset));
+        std::memcpy(&out[0], &header, sizeof(header));
+        std::memcpy(&out[sizeof(header)], tiles.data(), tiles.size() * sizeof(lossless_tile));
+        for (size_t k = 0; k < tiles.size(); ++k)
+        {
+            if (tiles[k].size)
+                std::memcpy(&out[static_cast<size_t>(tiles[k].offset)], encoded[k].data(), tiles[k].size);
+        }
+        return true;
+    }
+
+    /**
+     * @brief decodes into an image of the size and format that was encoded, of any step
+     *
+     * @return false if the data is not a valid encoding, or does not match the image
+     */
+    inline bool decode_lossless(const void * data, size_t size, const image_view & image, thread_pool * pool = 0,
+        simd_level level = best_simd_level())
+    {
+        lossless_header header;
+        const lossless_tile * tiles;
+        if (!detail::lossless_parse(data, size, header, tiles) || image.width() != header.width || image.height() != header.height
+            || image.channels() != header.channels || image.channel_depth() != header.channel_depth)
+            return false;
+
+        const unsigned char * bytes = static_cast<const unsigned char *>(data);
+        std::vector<char> ok(header.tile_count, 0);
+        auto decode = [&](size_t begin, size_t end)
+        {
+            for (size_t k = begin; k < end; ++k)
+            {
+                lossless_tile tile;
+                std::memcpy(&tile, &tiles[k], sizeof(tile));
+                VIDI_UINT y0 = static_cast<VIDI_UINT>(k * header.tile_rows), y1 = std::min<VIDI_UINT>(header.height, y0 + header.tile_rows);
+                const unsigned char * p = bytes + tile.offset;
+                ok[k] = header.channel_depth == VIDI_IMG_8U
+                    ? detail::lossless_decode_tile<uint8_t>(p, tile, image, y0, y1, level)
+                    : detail::lossless_decode_tile<uint16_t>(p, tile, image, y0, y1, level);
+            }
+        };
+        if (pool && pool->size() > 1)
+            pool->parallel_for(header.tile_count, 1, decode);
+        else
+            decode(0, header.tile_count);
+        return std::find(ok.begin(), ok.end(), 0) == ok.end();
+    }
+
+    /**
+     * @brief decodes into an image acquired from the pool
+     *
+     * @return the image, empty if the data is not a valid encoding or the pool refused the image
+     */
+    inline pooled_image decode_lossless(const void * data, size_t size, image_pool & images, thread_pool * pool = 0,
+        simd_level level = best_simd_level())
+    {
+        image_shape shape;
+        if (!lossless_shape(data, size, shape))
+            return pooled_image();
+        pooled_image image = images.acquire(shape.width, shape.height, shape.channels, shape.channel_depth);
+        if (image && !decode_lossless(data, size, image.view(), pool, level))
+            return pooled_image();
+        return image;
+    }
+}
+
+#endif
@@ -0,0 +1,71 @@
+/**
+ * @file parallel_nodes.hpp
+ * @brief Runs per-node work on the children of an xml node from several threads
+ *
+ * Siblings are chained in a linked list which cannot be split between threads. The children
+ * are therefore snapshot once into a contiguous vector of pointers, which thread_pool can
+ * then cut into chunks.
+ *
+ * The callback may read the nodes and modify values in place but must not allocate from the
+ * document (allocate_node(), allocate_string(), append_node(), ...) since its memory pool is
+ * not thread-safe.
+ */
+
+#ifndef VIDI_UTILS_PARALLEL_NODES_HPP_INCLUDED
+#define VIDI_UTILS_PARALLEL_NODES_HPP_INCLUDED
+
+#include "../rapidxml/rapidxml.hpp"
+#include "../rapidxml/rapidxml_iterators.hpp"
+#include "thread_pool.hpp"
+
+#include <vector>
+
+namespace vidi_utils
+{
+    /**
+     * @brief stores pointers to the children of node named name (all of them if name is 0) into nodes
+     *
+     * nodes is cleared first; passing the same vector again avoids reallocating it.
+     */
+    template<class Ch>
+    void snapshot_children(rapidxml::xml_node<Ch> * node, const Ch * name, std::vector<rapidxml::xml_node<Ch> *> & nodes)
+    {
+        nodes.clear();
+        for (auto & child : rapidxml::children(node, name))
+        {
+            nodes.push_back(&child);
+        }
+    }
+
+    /**
+     * @brief calls f(index, node) for every entry of nodes from all the threads of the pool
+     *
+     * @param chunk number of nodes per task, 0 lets the pool choose
+     */
+    template<class Ch, class F>
+    void parallel_for_each_node(thread_pool & pool, const std::vector<rapidxml::xml_node<Ch> *> & nodes, F f, size_t chunk = 0)
+    {
+        pool.parallel_for(nodes.size(), chunk, [&](size_t begin, size_t end)
+        {
+            for (size_t k = begin; k < end; ++k)
+            {
+                f(k, *nodes[k]);
+            }
+        });
+    }
+
+    /**
+     * @brief calls f(index, child) for every child of node named name from all the threads of the pool
+     *
+     * index is the position of the child among the matching ones.
+     */
+    template<class Ch, class F>
+    void parallel_for_each_child(thread_pool & pool, rapidxml::xml_node<Ch> * node, const Ch * name, F f, size_t chunk = 0)
+    {
+        std::vector<rapidxml::xml_node<Ch> *> nodes;
+        snapshot_children(node, name, nodes);
+        parallel_for_each_node(pool, nodes, f, chunk);
+    }
+}
+
+#endif
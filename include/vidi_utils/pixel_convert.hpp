@@ -0,0 +1,784 @@
+/**
+ * @file pixel_convert.hpp
+ * @brief Pixel format conversions between image views, with SSE/AVX2 and scalar paths
+ *
+ * Frames coming from cameras are often 16-bit, RGB or BGR, while workspaces expect 8-bit
+ * grayscale or 3-channel images. The functions below convert between image_view rectangles,
+ * so they work on any step and on crops of larger images:
+ *
+ *     vidi_utils::image_view gray(gray_data, width, height, 1, VIDI_IMG_8U);
+ *     vidi_utils::rgb_to_gray(vidi_utils::image_view(frame), gray);
+ *
+ * The instruction set is picked at run time (AVX2, else SSSE3, else scalar) unless a level is
+ * passed explicitly; defining VIDI_UTILS_NO_SIMD keeps only the scalar code. Every path gives
+ * the same bytes as the scalar one: the arithmetic is integer only. The functions return false,
+ * without writing anything, when the views do not have matching sizes, channels or depths.
+ */
+
+#ifndef VIDI_UTILS_PIXEL_CONVERT_HPP_INCLUDED
+#define VIDI_UTILS_PIXEL_CONVERT_HPP_INCLUDED
+
+#include "vidi.h"
+#include "image_view.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if !defined(VIDI_UTILS_NO_SIMD) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+    #define VIDI_UTILS_X86_SIMD
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #endif
+#endif
+
+// GCC and clang only generate the instructions of the functions enabling them
+#if defined(VIDI_UTILS_X86_SIMD) && defined(__GNUC__)
+    #define VIDI_UTILS_TARGET(isa) __attribute__((target(isa)))
+#else
+    #define VIDI_UTILS_TARGET(isa)
+#endif
+
+namespace vidi_utils
+{
+    enum simd_level
+    {
+        simd_scalar,
+        simd_sse,       ///< SSE2 and SSSE3
+        simd_avx2
+    };
+
+    inline simd_level detect_simd_level()
+    {
+#if defined(VIDI_UTILS_X86_SIMD) && defined(__GNUC__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return simd_avx2;
+        if (__builtin_cpu_supports("ssse3"))
+            return simd_sse;
+#elif defined(VIDI_UTILS_X86_SIMD) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        bool ssse3 = (info[2] & (1 << 9)) != 0;
+        bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+        __cpuidex(info, 7, 0);
+        if (avx && (info[1] & (1 << 5)))
+            return simd_avx2;
+        if (ssse3)
+            return simd_sse;
+#endif
+        return simd_scalar;
+    }
+
+    /**
+     * @brief the widest instruction set supported by the processor
+     */
+    inline simd_level best_simd_level()
+    {
+        static const simd_level level = detect_simd_level();
+        return level;
+    }
+
+    inline const char * simd_level_name(simd_level level)
+    {
+        return level == simd_avx2 ? "avx2" : level == simd_sse ? "sse" : "scalar";
+    }
+
+    namespace detail
+    {
+        // scalar kernels, the reference for the vectorized ones
+
+        inline void shift_16u_to_8u_scalar(const uint16_t * src, uint8_t * dst, size_t n, int shift)
+        {
+            for (size_t k = 0; k < n; ++k)
+            {
+                unsigned v = src[k] >> shift;
+                dst[k] = static_cast<uint8_t>(v > 255 ? 255 : v);
+            }
+        }
+
+        /// with pre 8, the values are first saturated to 255 and shifted left by 8, for max_value below 256
+        inline void scale_16u_to_8u_scalar(const uint16_t * src, uint8_t * dst, size_t n, unsigned mul, int pre)
+        {
+            for (size_t k = 0; k < n; ++k)
+            {
+                unsigned v = src[k];
+                if (pre)
+                    v = (v > 255 ? 255 : v) << 8;
+                v = (v * mul) >> 16;
+                dst[k] = static_cast<uint8_t>(v > 255 ? 255 : v);
+            }
+        }
+
+        /// w0 and w2 are the weights of the first and third channels, the second one weighs 150
+        inline void gray_scalar(const uint8_t * src, uint8_t * dst, size_t n, unsigned w0, unsigned w2)
+        {
+            for (size_t k = 0; k < n; ++k, src += 3)
+                dst[k] = static_cast<uint8_t>((src[0] * w0 + src[1] * 150 + src[2] * w2 + 128) >> 8);
+        }
+
+        template<class T>
+        void deinterleave_scalar(const T * src, T * const * planes, size_t n, size_t channels)
+        {
+            for (size_t k = 0; k < n; ++k)
+                for (size_t c = 0; c < channels; ++c)
+                    planes[c][k] = *src++;
+        }
+
+        template<class T>
+        void interleave_scalar(const T * const * planes, T * dst, size_t n, size_t channels)
+        {
+            for (size_t k = 0; k < n; ++k)
+                for (size_t c = 0; c < channels; ++c)
+                    *dst++ = planes[c][k];
+        }
+
+        /**
+         * @brief byte shuffles between interleaved pixels of 2 to 4 channels of 1 or 2 bytes and planes
+         *
+         * The kernels move 16 bytes of every plane at a time. With 3 channels, split[c][chunk] picks
+         * the bytes of channel c out of each of the 3 chunks of 16 interleaved bytes, -1 for none, and
+         * merge[chunk][c] the bytes of each chunk out of the 16 bytes of channel c. With 2 and 4
+         * channels, split[0][0] gathers the bytes of every channel of a chunk next to each other,
+         * which a transpose of 8 or 4 byte lanes then turns into planes, and merge[0][0] undoes it.
+         */
+        struct shuffle_masks
+        {
+            shuffle_masks(size_t channels, size_t bytes)
+            {
+                std::memset(split, -1, sizeof(split));
+                std::memset(merge, -1, sizeof(merge));
+                for (size_t i = 0; i < 16 * (channels == 3 ? 3 : 1); ++i)
+                {
+                    // interleaved byte i is byte b of channel c of pixel p
+                    size_t sample = i / bytes, b = i % bytes, c = sample % channels, p = sample / channels;
+                    if (channels == 3)
+                    {
+                        split[c][i / 16][p * bytes + b] = static_cast<signed char>(i % 16);
+                        merge[i / 16][c][i % 16] = static_cast<signed char>(p * bytes + b);
+                    }
+                    else
+                    {
+                        size_t gathered = c * (16 / channels) + p * bytes + b;
+                        split[0][0][gathered] = static_cast<signed char>(i);
+                        merge[0][0][i] = static_cast<signed char>(gathered);
+                    }
+                }
+            }
+
+            signed char split[3][3][16];
+            signed char merge[3][3][16];
+        };
+
+        inline const shuffle_masks & masks_for(size_t channels, size_t bytes)
+        {
+            static const shuffle_masks masks[3][2] = {
+                { shuffle_masks(2, 1), shuffle_masks(2, 2) },
+                { shuffle_masks(3, 1), shuffle_masks(3, 2) },
+                { shuffle_masks(4, 1), shuffle_masks(4, 2) } };
+            return masks[channels - 2][bytes - 1];
+        }
+
+#if defined(VIDI_UTILS_X86_SIMD)
+        VIDI_UTILS_TARGET("ssse3")
+        inline __m128i load_mask(const signed char * mask)
+        {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i *>(mask));
+        }
+
+        /**
+         * @brief splits 48 interleaved bytes of 3 channels into the 16 bytes of each channel
+         */
+        VIDI_UTILS_TARGET("ssse3")
+        inline void split3(const uint8_t * src, const shuffle_masks & m, __m128i & c0, __m128i & c1, __m128i & c2)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16));
+            __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 32));
+            __m128i * out[3] = { &c0, &c1, &c2 };
+            for (int ch = 0; ch < 3; ++ch)
+            {
+                *out[ch] = _mm_or_si128(_mm_or_si128(
+                    _mm_shuffle_epi8(a, load_mask(m.split[ch][0])),
+                    _mm_shuffle_epi8(b, load_mask(m.split[ch][1]))),
+                    _mm_shuffle_epi8(c, load_mask(m.split[ch][2])));
+            }
+        }
+
+        /**
+         * @brief the inverse of split3()
+         */
+        VIDI_UTILS_TARGET("ssse3")
+        inline void merge3(__m128i c0, __m128i c1, __m128i c2, const shuffle_masks & m, uint8_t * dst)
+        {
+            for (int chunk = 0; chunk < 3; ++chunk)
+            {
+                __m128i v = _mm_or_si128(_mm_or_si128(
+                    _mm_shuffle_epi8(c0, load_mask(m.merge[chunk][0])),
+                    _mm_shuffle_epi8(c1, load_mask(m.merge[chunk][1]))),
+                    _mm_shuffle_epi8(c2, load_mask(m.merge[chunk][2])));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16 * chunk), v);
+            }
+        }
+
+        /**
+         * @brief transposes the 8-byte lanes of 2 vectors or the 4-byte lanes of 4, its own inverse
+         */
+        VIDI_UTILS_TARGET("ssse3")
+        inline void transpose_lanes(__m128i * v, size_t channels)
+        {
+            if (channels == 2)
+            {
+                __m128i t = _mm_unpacklo_epi64(v[0], v[1]);
+                v[1] = _mm_unpackhi_epi64(v[0], v[1]);
+                v[0] = t;
+                return;
+            }
+            __m128i t0 = _mm_unpacklo_epi32(v[0], v[1]);
+            __m128i t1 = _mm_unpacklo_epi32(v[2], v[3]);
+            __m128i t2 = _mm_unpackhi_epi32(v[0], v[1]);
+            __m128i t3 = _mm_unpackhi_epi32(v[2], v[3]);
+            v[0] = _mm_unpacklo_epi64(t0, t1);
+            v[1] = _mm_unpackhi_epi64(t0, t1);
+            v[2] = _mm_unpacklo_epi64(t2, t3);
+            v[3] = _mm_unpackhi_epi64(t2, t3);
+        }
+
+        /// min(v, 255) for unsigned 16-bit lanes, SSE2 having no unsigned minimum
+        VIDI_UTILS_TARGET("ssse3")
+        inline __m128i min255_epu16(__m128i v)
+        {
+            return _mm_subs_epu16(v, _mm_subs_epu16(v, _mm_set1_epi16(255)));
+        }
+
+        VIDI_UTILS_TARGET("ssse3")
+        inline void shift_16u_to_8u_sse(const uint16_t * src, uint8_t * dst, size_t n, int shift)
+        {
+            __m128i count = _mm_cvtsi32_si128(shift);
+            size_t k = 0;
+            for (; k + 16 <= n; k += 16)
+            {
+                __m128i a = _mm_srl_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + k)), count);
+                __m128i b = _mm_srl_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + k + 8)), count);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + k), _mm_packus_epi16(min255_epu16(a), min255_epu16(b)));
+            }
+            shift_16u_to_8u_scalar(src + k, dst + k, n - k, shift);
+        }
+
+        VIDI_UTILS_TARGET("ssse3")
+        inline __m128i prescale_epu16(__m128i v, int pre)
+        {
+            return pre ? _mm_slli_epi16(min255_epu16(v), 8) : v;
+        }
+
+        VIDI_UTILS_TARGET("ssse3")
+        inline void scale_16u_to_8u_sse(const uint16_t * src, uint8_t * dst, size_t n, unsigned mul, int pre)
+        {
+            __m128i m = _mm_set1_epi16(static_cast<short>(mul));
+            size_t k = 0;
+            for (; k + 16 <= n; k += 16)
+            {
+                __m128i a = _mm_mulhi_epu16(prescale_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + k)), pre), m);
+                __m128i b = _mm_mulhi_epu16(prescale_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + k + 8)), pre), m);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + k), _mm_packus_epi16(min255_epu16(a), min255_epu16(b)));
+            }
+            scale_16u_to_8u_scalar(src + k, dst + k, n - k, mul, pre);
+        }
+
+        VIDI_UTILS_TARGET("ssse3")
+        inline void gray_sse(const uint8_t * src, uint8_t * dst, size_t n, unsigned w0, unsigned w2)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i m0 = _mm_set1_epi16(static_cast<short>(w0));
+            const __m128i m1 = _mm_set1_epi16(150);
+            const __m128i m2 = _mm_set1_epi16(static_cast<short>(w2));
+            const __m128i half = _mm_set1_epi16(128);
+            const shuffle_masks & masks = masks_for(3, 1);
+            size_t k = 0;
+            for (; k + 16 <= n; k += 16)
+            {
+                __m128i c0, c1, c2;
+                split3(src + 3 * k, masks, c0, c1, c2);
+                // the weights add up to 256, so the sums fit in 16 bits
+                __m128i lo = _mm_add_epi16(_mm_add_epi16(
+                    _mm_mullo_epi16(_mm_unpacklo_epi8(c0, zero), m0),
+                    _mm_mullo_epi16(_mm_unpacklo_epi8(c1, zero), m1)),
+                    _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(c2, zero), m2), half));
+                __m128i hi = _mm_add_epi16(_mm_add_epi16(
+                    _mm_mullo_epi16(_mm_unpackhi_epi8(c0, zero), m0),
+                    _mm_mullo_epi16(_mm_unpackhi_epi8(c1, zero), m1)),
+                    _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(c2, zero), m2), half));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + k), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+            }
+            gray_scalar(src + 3 * k, dst + k, n - k, w0, w2);
+        }
+
+        /**
+         * @brief splits groups of 16 * channels interleaved bytes into 16 bytes of each plane
+         */
+        VIDI_UTILS_TARGET("ssse3")
+        inline void deinterleave_sse(const uint8_t * src, uint8_t * const * planes, size_t channels, size_t groups, const shuffle_masks & m)
+        {
+            const __m128i gather = load_mask(m.split[0][0]);
+            for (size_t g = 0; g < groups; ++g, src += 16 * channels)
+            {
+                __m128i v[4];
+                if (channels == 3)
+                    split3(src, m, v[0], v[1], v[2]);
+                else
+                {
+                    for (size_t c = 0; c < channels; ++c)
+                        v[c] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + 16 * c)), gather);
+                    transpose_lanes(v, channels);
+                }
+                for (size_t c = 0; c < channels; ++c)
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(planes[c] + 16 * g), v[c]);
+            }
+        }
+
+        VIDI_UTILS_TARGET("ssse3")
+        inline void interleave_sse(const uint8_t * const * planes, uint8_t * dst, size_t channels, size_t groups, const shuffle_masks & m)
+        {
+            const __m128i scatter = load_mask(m.merge[0][0]);
+            for (size_t g = 0; g < groups; ++g, dst += 16 * channels)
+            {
+                __m128i v[4];
+                for (size_t c = 0; c < channels; ++c)
+                    v[c] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(planes[c] + 16 * g));
+                if (channels == 3)
+                {
+                    merge3(v[0], v[1], v[2], m, dst);
+                    continue;
+                }
+                transpose_lanes(v, channels);
+                for (size_t c = 0; c < channels; ++c)
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 16 * c), _mm_shuffle_epi8(v[c], scatter));
+            }
+        }
+
+        /// packs 16-bit lanes of a and b to bytes in their original order, packus working per 128-bit lane
+        VIDI_UTILS_TARGET("avx2")
+        inline __m256i pack_ordered(__m256i a, __m256i b)
+        {
+            return _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline void shift_16u_to_8u_avx2(const uint16_t * src, uint8_t * dst, size_t n, int shift)
+        {
+            __m128i count = _mm_cvtsi32_si128(shift);
+            __m256i c255 = _mm256_set1_epi16(255);
+            size_t k = 0;
+            for (; k + 32 <= n; k += 32)
+            {
+                __m256i a = _mm256_srl_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + k)), count);
+                __m256i b = _mm256_srl_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + k + 16)), count);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + k), pack_ordered(_mm256_min_epu16(a, c255), _mm256_min_epu16(b, c255)));
+            }
+            shift_16u_to_8u_sse(src + k, dst + k, n - k, shift);
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline void scale_16u_to_8u_avx2(const uint16_t * src, uint8_t * dst, size_t n, unsigned mul, int pre)
+        {
+            __m256i m = _mm256_set1_epi16(static_cast<short>(mul));
+            __m256i c255 = _mm256_set1_epi16(255);
+            size_t k = 0;
+            for (; k + 32 <= n; k += 32)
+            {
+                __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + k));
+                __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + k + 16));
+                if (pre)
+                {
+                    a = _mm256_slli_epi16(_mm256_min_epu16(a, c255), 8);
+                    b = _mm256_slli_epi16(_mm256_min_epu16(b, c255), 8);
+                }
+                a = _mm256_mulhi_epu16(a, m);
+                b = _mm256_mulhi_epu16(b, m);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + k), pack_ordered(_mm256_min_epu16(a, c255), _mm256_min_epu16(b, c255)));
+            }
+            scale_16u_to_8u_sse(src + k, dst + k, n - k, mul, pre);
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline void gray_avx2(const uint8_t * src, uint8_t * dst, size_t n, unsigned w0, unsigned w2)
+        {
+            const __m256i m0 = _mm256_set1_epi16(static_cast<short>(w0));
+            const __m256i m1 = _mm256_set1_epi16(150);
+            const __m256i m2 = _mm256_set1_epi16(static_cast<short>(w2));
+            const __m256i half = _mm256_set1_epi16(128);
+            const shuffle_masks & masks = masks_for(3, 1);
+            size_t k = 0;
+            for (; k + 32 <= n; k += 32)
+            {
+                // the shuffles stay 128 bits wide, the arithmetic of two groups of 16 pixels is done at once
+                __m128i a0, a1, a2, b0, b1, b2;
+                split3(src + 3 * k, masks, a0, a1, a2);
+                split3(src + 3 * k + 48, masks, b0, b1, b2);
+                __m256i lo = _mm256_add_epi16(_mm256_add_epi16(
+                    _mm256_mullo_epi16(_mm256_cvtepu8_epi16(a0), m0),
+                    _mm256_mullo_epi16(_mm256_cvtepu8_epi16(a1), m1)),
+                    _mm256_add_epi16(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(a2), m2), half));
+                __m256i hi = _mm256_add_epi16(_mm256_add_epi16(
+                    _mm256_mullo_epi16(_mm256_cvtepu8_epi16(b0), m0),
+                    _mm256_mullo_epi16(_mm256_cvtepu8_epi16(b1), m1)),
+                    _mm256_add_epi16(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(b2), m2), half));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + k), pack_ordered(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)));
+            }
+            gray_sse(src + 3 * k, dst + k, n - k, w0, w2);
+        }
+
+        /// two groups of 16 interleaved bytes, 'stride' apart, in the two 128-bit lanes
+        VIDI_UTILS_TARGET("avx2")
+        inline __m256i load_lanes(const uint8_t * src, size_t stride)
+        {
+            return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src))),
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + stride)), 1);
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline void store_lanes(uint8_t * dst, size_t stride, __m256i v)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm256_castsi256_si128(v));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + stride), _mm256_extracti128_si256(v, 1));
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline __m256i load_mask_lanes(const signed char * mask)
+        {
+            return _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(mask)));
+        }
+
+        /// transpose_lanes() within each 128-bit lane
+        VIDI_UTILS_TARGET("avx2")
+        inline void transpose_lanes(__m256i * v, size_t channels)
+        {
+            if (channels == 2)
+            {
+                __m256i t = _mm256_unpacklo_epi64(v[0], v[1]);
+                v[1] = _mm256_unpackhi_epi64(v[0], v[1]);
+                v[0] = t;
+                return;
+            }
+            __m256i t0 = _mm256_unpacklo_epi32(v[0], v[1]);
+            __m256i t1 = _mm256_unpacklo_epi32(v[2], v[3]);
+            __m256i t2 = _mm256_unpackhi_epi32(v[0], v[1]);
+            __m256i t3 = _mm256_unpackhi_epi32(v[2], v[3]);
+            v[0] = _mm256_unpacklo_epi64(t0, t1);
+            v[1] = _mm256_unpackhi_epi64(t0, t1);
+            v[2] = _mm256_unpacklo_epi64(t2, t3);
+            v[3] = _mm256_unpackhi_epi64(t2, t3);
+        }
+
+        /**
+         * @brief deinterleave_sse() two groups at a time, one per 128-bit lane, so that the planes get 32 bytes per store
+         */
+        VIDI_UTILS_TARGET("avx2")
+        inline void deinterleave_avx2(const uint8_t * src, uint8_t * const * planes, size_t channels, size_t groups, const shuffle_masks & m)
+        {
+            const size_t group_size = 16 * channels;
+            size_t g = 0;
+            for (; g + 2 <= groups; g += 2, src += 2 * group_size)
+            {
+                __m256i v[4];
+                if (channels == 3)
+                {
+                    __m256i chunks[3];
+                    for (int k = 0; k < 3; ++k)
+                        chunks[k] = load_lanes(src + 16 * k, group_size);
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        v[c] = _mm256_or_si256(_mm256_or_si256(
+                            _mm256_shuffle_epi8(chunks[0], load_mask_lanes(m.split[c][0])),
+                            _mm256_shuffle_epi8(chunks[1], load_mask_lanes(m.split[c][1]))),
+                            _mm256_shuffle_epi8(chunks[2], load_mask_lanes(m.split[c][2])));
+                    }
+                }
+                else
+                {
+                    const __m256i gather = load_mask_lanes(m.split[0][0]);
+                    for (size_t c = 0; c < channels; ++c)
+                        v[c] = _mm256_shuffle_epi8(load_lanes(src + 16 * c, group_size), gather);
+                    transpose_lanes(v, channels);
+                }
+                for (size_t c = 0; c < channels; ++c)
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(planes[c] + 16 * g), v[c]);
+            }
+            uint8_t * rest[4];
+            for (size_t c = 0; c < channels; ++c)
+                rest[c] = planes[c] + 16 * g;
+            deinterleave_sse(src, rest, channels, groups - g, m);
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline void interleave_avx2(const uint8_t * const * planes, uint8_t * dst, size_t channels, size_t groups, const shuffle_masks & m)
+        {
+            const size_t group_size = 16 * channels;
+            size_t g = 0;
+            for (; g + 2 <= groups; g += 2, dst += 2 * group_size)
+            {
+                __m256i v[4];
+                for (size_t c = 0; c < channels; ++c)
+                    v[c] = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(planes[c] + 16 * g));
+                if (channels == 3)
+                {
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        __m256i chunk = _mm256_or_si256(_mm256_or_si256(
+                            _mm256_shuffle_epi8(v[0], load_mask_lanes(m.merge[k][0])),
+                            _mm256_shuffle_epi8(v[1], load_mask_lanes(m.merge[k][1]))),
+                            _mm256_shuffle_epi8(v[2], load_mask_lanes(m.merge[k][2])));
+                        store_lanes(dst + 16 * k, group_size, chunk);
+                    }
+                    continue;
+                }
+                const __m256i scatter = load_mask_lanes(m.merge[0][0]);
+                transpose_lanes(v, channels);
+                for (size_t c = 0; c < channels; ++c)
+                    store_lanes(dst + 16 * c, group_size, _mm256_shuffle_epi8(v[c], scatter));
+            }
+            const uint8_t * rest[4];
+            for (size_t c = 0; c < channels; ++c)
+                rest[c] = planes[c] + 16 * g;
+            interleave_sse(rest, dst, channels, groups - g, m);
+        }
+#endif
+
+        inline bool same_size(const image_view & a, const image_view & b)
+        {
+            return a.width() == b.width() && a.height() == b.height();
+        }
+
+        /// shift >= 0 keeps bits [shift, shift + 8), shift < 0 scales by mul, after saturating and shifting by pre
+        inline bool convert_16u_to_8u(const image_view & src, const image_view & dst, int shift, unsigned mul, int pre, simd_level level)
+        {
+            if (!same_size(src, dst) || src.channels() != dst.channels()
+                || src.channel_depth() != VIDI_IMG_16U || dst.channel_depth() != VIDI_IMG_8U)
+                return false;
+
+            size_t n = static_cast<size_t>(src.width()) * src.channels();
+            for (VIDI_UINT y = 0; y < src.height(); ++y)
+            {
+                const uint16_t * s = reinterpret_cast<const uint16_t *>(src.row(y));
+                uint8_t * d = dst.row(y);
+#if defined(VIDI_UTILS_X86_SIMD)
+                if (level == simd_avx2)
+                {
+                    if (shift >= 0) shift_16u_to_8u_avx2(s, d, n, shift); else scale_16u_to_8u_avx2(s, d, n, mul, pre);
+                    continue;
+                }
+                if (level == simd_sse)
+                {
+                    if (shift >= 0) shift_16u_to_8u_sse(s, d, n, shift); else scale_16u_to_8u_sse(s, d, n, mul, pre);
+                    continue;
+                }
+#endif
+                (void)level;
+                if (shift >= 0) shift_16u_to_8u_scalar(s, d, n, shift); else scale_16u_to_8u_scalar(s, d, n, mul, pre);
+            }
+            return true;
+        }
+
+        inline bool to_gray(const image_view & src, const image_view & dst, unsigned w0, unsigned w2, simd_level level)
+        {
+            if (!same_size(src, dst) || src.channels() != 3 || dst.channels() != 1
+                || src.channel_depth() != VIDI_IMG_8U || dst.channel_depth() != VIDI_IMG_8U)
+                return false;
+
+            for (VIDI_UINT y = 0; y < src.height(); ++y)
+            {
+#if defined(VIDI_UTILS_X86_SIMD)
+                if (level == simd_avx2)
+                {
+                    gray_avx2(src.row(y), dst.row(y), src.width(), w0, w2);
+                    continue;
+                }
+                if (level == simd_sse)
+                {
+                    gray_sse(src.row(y), dst.row(y), src.width(), w0, w2);
+                    continue;
+                }
+#endif
+                (void)level;
+                gray_scalar(src.row(y), dst.row(y), src.width(), w0, w2);
+            }
+            return true;
+        }
+
+        inline bool planes_match(const image_view & image, const image_view * planes)
+        {
+            // checked before reading the planes: there are as many as channels, and the kernels only handle these
+            if (image.channels() < 1 || image.channels() > 4)
+                return false;
+            if (image.channel_depth() != VIDI_IMG_8U && image.channel_depth() != VIDI_IMG_16U)
+                return false;
+            for (VIDI_UINT c = 0; c < image.channels(); ++c)
+            {
+                if (!same_size(image, planes[c]) || planes[c].channels() != 1 || planes[c].channel_depth() != image.channel_depth())
+                    return false;
+            }
+            return true;
+        }
+    }
+
+    /**
+     * @brief 16-bit to 8-bit by keeping bits [shift, shift + 8), larger values saturating to 255
+     *
+     * e.g. shift 4 for 12-bit sensors, 8 for the high byte of 16-bit data
+     */
+    inline bool convert_16u_to_8u_shift(const image_view & src, const image_view & dst, int shift, simd_level level = best_simd_level())
+    {
+        if (shift < 0 || shift > 15)
+            return false;
+        return detail::convert_16u_to_8u(src, dst, shift, 0, 0, level);
+    }
+
+    /**
+     * @brief 16-bit to 8-bit by mapping [0, max_value] to [0, 255], larger values saturating to 255
+     *
+     * computed as min(255, (v * m) >> 16) with m = ceil(255 * 65536 / max_value), which fits in
+     * 16 bits from max_value 256 up and maps max_value to exactly 255. Below 256, m would not fit:
+     * v is saturated to 255 first and the result is min(255, ((v << 8) * m) >> 16) with
+     * m = ceil(255 * 256 / max_value), so that max_value still maps to 255.
+     */
+    inline bool convert_16u_to_8u_scale(const image_view & src, const image_view & dst, unsigned max_value, simd_level level = best_simd_level())
+    {
+        if (!max_value)
+            return false;
+        int pre = max_value < 256 ? 8 : 0;
+        unsigned m = ((255u << (16 - pre)) + max_value - 1) / max_value;
+        return detail::convert_16u_to_8u(src, dst, -1, m, pre, level);
+    }
+
+    /**
+     * @brief 8-bit RGB to 8-bit gray, (77 R + 150 G + 29 B + 128) >> 8
+     */
+    inline bool rgb_to_gray(const image_view & src, const image_view & dst, simd_level level = best_simd_level())
+    {
+        return detail::to_gray(src, dst, 77, 29, level);
+    }
+
+    /**
+     * @brief 8-bit BGR to 8-bit gray, with the same weights as rgb_to_gray()
+     */
+    inline bool bgr_to_gray(const image_view & src, const image_view & dst, simd_level level = best_simd_level())
+    {
+        return detail::to_gray(src, dst, 29, 77, level);
+    }
+
+    /**
+     * @brief splits an image of up to 4 channels into single channel planes, one per channel
+     *
+     * 8 and 16-bit images of 2 to 4 channels have vectorized paths; a single channel is copied
+     */
+    inline bool deinterleave(const image_view & src, const image_view * planes, simd_level level = best_simd_level())
+    {
+        if (!detail::planes_match(src, planes))
+            return false;
+
+        const size_t channels = src.channels();
+        const size_t bytes = src.channel_depth() == VIDI_IMG_16U ? 2 : 1;
+        for (VIDI_UINT y = 0; y < src.height(); ++y)
+        {
+            if (channels == 1)
+            {
+                std::memcpy(planes[0].row(y), src.row(y), src.row_size());
+                continue;
+            }
+            unsigned char * rows[4];
+            for (size_t c = 0; c < channels; ++c)
+                rows[c] = planes[c].row(y);
+            size_t done = 0;
+#if defined(VIDI_UTILS_X86_SIMD)
+            if (level != simd_scalar)
+            {
+                size_t groups = src.width() * bytes / 16;
+                if (level == simd_avx2)
+                    detail::deinterleave_avx2(src.row(y), rows, channels, groups, detail::masks_for(channels, bytes));
+                else
+                    detail::deinterleave_sse(src.row(y), rows, channels, groups, detail::masks_for(channels, bytes));
+                done = groups * 16 / bytes;
+            }
+#endif
+            (void)level;
+            const unsigned char * rest = src.row(y) + done * channels * bytes;
+            for (size_t c = 0; c < channels; ++c)
+                rows[c] += done * bytes;
+            if (bytes == 1)
+                detail::deinterleave_scalar(rest, rows, src.width() - done, channels);
+            else
+            {
+                uint16_t * rows16[4];
+                for (size_t c = 0; c < channels; ++c)
+                    rows16[c] = reinterpret_cast<uint16_t *>(rows[c]);
+                detail::deinterleave_scalar(reinterpret_cast<const uint16_t *>(rest), rows16, src.width() - done, channels);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief merges single channel planes, one per channel of dst, into dst
+     */
+    inline bool interleave(const image_view * planes, const image_view & dst, simd_level level = best_simd_level())
+    {
+        if (!detail::planes_match(dst, planes))
+            return false;
+
+        const size_t channels = dst.channels();
+        const size_t bytes = dst.channel_depth() == VIDI_IMG_16U ? 2 : 1;
+        for (VIDI_UINT y = 0; y < dst.height(); ++y)
+        {
+            if (channels == 1)
+            {
+                std::memcpy(dst.row(y), planes[0].row(y), dst.row_size());
+                continue;
+            }
+            const unsigned char * rows[4];
+            for (size_t c = 0; c < channels; ++c)
+                rows[c] = planes[c].row(y);
+            size_t done = 0;
+#if defined(VIDI_UTILS_X86_SIMD)
+            if (level != simd_scalar)
+            {
+                size_t groups = dst.width() * bytes / 16;
+                if (level == simd_avx2)
+                    detail::interleave_avx2(rows, dst.row(y), channels, groups, detail::masks_for(channels, bytes));
+                else
+                    detail::interleave_sse(rows, dst.row(y), channels, groups, detail::masks_for(channels, bytes));
+                done = groups * 16 / bytes;
+            }
+#endif
+            (void)level;
+            unsigned char * rest = dst.row(y) + done * channels * bytes;
+            for (size_t c = 0; c < channels; ++c)
+                rows[c] += done * bytes;
+            if (bytes == 1)
+                detail::interleave_scalar(rows, rest, dst.width() - done, channels);
+            else
+            {
+                const uint16_t * rows16[4];
+                for (size_t c = 0; c < channels; ++c)
+                    rows16[c] = reinterpret_cast<const uint16_t *>(rows[c]);
+                detail::interleave_scalar(rows16, reinterpret_cast<uint16_t *>(rest), dst.width() - done, channels);
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief copies pixels between views of any step, in one block when both are contiguous
+     *
+     * memcpy() is already vectorized, there is no point in a hand written path
+     */
+    inline bool copy_pixels(const image_view & src, const image_view & dst)
+    {
+        if (!detail::same_size(src, dst) || src.pixel_size() != dst.pixel_size())
+            return false;
+        src.copy_to(dst.data(), dst.step());
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,912 @@
+/**
+ * @file png_encoder.hpp
+ * @brief Self-contained PNG encoder with selectable compression, from store-only to small files
+ *
+ * vidi_save_image() compresses with one fixed setting. When frames are saved in bulk, the time
+ * spent compressing matters more than the last percent of size, so this encoder lets the caller
+ * choose:
+ *
+ *     std::vector<unsigned char> png;
+ *     vidi_utils::encode_png(vidi_utils::image_view(image), vidi_utils::png_fastest, png);
+ *     vidi_utils::write_file("frame.png", png);
+ *
+ *     png_store      no filtering, deflate blocks stored as they are; as fast as copying
+ *     png_fastest    the Sub filter, Huffman codes and runs only: no search for earlier matches
+ *     png_balanced   the filter of each row chosen by the smallest sum of residuals, and
+ *                    LZ77 comparing up to 4 earlier positions
+ *     png_smallest   as png_balanced, comparing up to 64 earlier positions
+ *
+ * Every block of 32768 symbols gets its own Huffman codes, and falls back to the fixed codes or
+ * to storing when that is smaller. Channels are written in the order they are stored in memory:
+ * 1 channel as gray, 2 as gray and alpha, 3 as RGB and 4 as RGBA. 16-bit channels are written
+ * big-endian as PNG requires.
+ */
+
+#ifndef VIDI_UTILS_PNG_ENCODER_HPP_INCLUDED
+#define VIDI_UTILS_PNG_ENCODER_HPP_INCLUDED
+
+#include "vidi.h"
+#include "image_view.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace vidi_utils
+{
+    enum png_level
+    {
+        png_store = 0,
+        png_fastest = 1,
+        png_balanced = 2,
+        png_smallest = 3
+    };
+
+    inline const char * png_level_name(png_level level)
+    {
+        switch (level)
+        {
+        case png_store: return "store";
+        case png_fastest: return "fastest";
+        case png_balanced: return "balanced";
+        case png_smallest: return "smallest";
+        }
+        return "unknown";
+    }
+
+    namespace detail
+    {
+        /// CRC-32 tables for four bytes at a time: table[k][b] is the CRC of b followed by k zero bytes
+        inline const uint32_t (*crc32_tables())[256]
+        {
+            struct tables
+            {
+                tables()
+                {
+                    for (uint32_t n = 0; n < 256; ++n)
+                    {
+                        uint32_t c = n;
+                        for (int k = 0; k < 8; ++k)
+                            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                        values[0][n] = c;
+                    }
+                    for (int k = 1; k < 4; ++k)
+                    {
+                        for (uint32_t n = 0; n < 256; ++n)
+                            values[k][n] = values[0][values[k - 1][n] & 0xFF] ^ (values[k - 1][n] >> 8);
+                    }
+                }
+                uint32_t values[4][256];
+            };
+            static const tables t;
+            return t.values;
+        }
+
+        /// continues a CRC-32 as used by PNG; start with crc = 0
+        inline uint32_t crc32(uint32_t crc, const unsigned char * p, size_t n)
+        {
+            const uint32_t (*table)[256] = crc32_tables();
+            crc = ~crc;
+            for (; n >= 4; n -= 4, p += 4)
+            {
+                crc ^= uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+                crc = table[3][crc & 0xFF] ^ table[2][(crc >> 8) & 0xFF] ^ table[1][(crc >> 16) & 0xFF] ^ table[0][crc >> 24];
+            }
+            for (; n; --n, ++p)
+                crc = table[0][(crc ^ *p) & 0xFF] ^ (crc >> 8);
+            return ~crc;
+        }
+
+        /// continues an Adler-32 as used by zlib; start with adler = 1
+        inline uint32_t adler32(uint32_t adler, const unsigned char * p, size_t n)
+        {
+            // 5552 bytes is the most that can be summed before the 32-bit sums could overflow
+            uint32_t a = adler & 0xFFFF, b = adler >> 16;
+            while (n)
+            {
+                size_t k = n < 5552 ? n : 5552;
+                n -= k;
+                for (size_t i = 0; i < k; ++i)
+                {
+                    a += p[i];
+                    b += a;
+                }
+                p += k;
+                a %= 65521;
+                b %= 65521;
+            }
+            return (b << 16) | a;
+        }
+
+        inline void put_be32(std::vector<unsigned char> & out, uint32_t v)
+        {
+            out.push_back(static_cast<unsigned char>(v >> 24));
+            out.push_back(static_cast<unsigned char>(v >> 16));
+            out.push_back(static_cast<unsigned char>(v >> 8));
+            out.push_back(static_cast<unsigned char>(v));
+        }
+
+        /// deflate writes its codes starting with the least significant bit
+        class bit_writer
+        {
+        public:
+            explicit bit_writer(std::vector<unsigned char> & out)
+                : m_out(out)
+                , m_bits(0)
+                , m_count(0)
+            {
+            }
+
+            /// n is at most 32
+            void put(uint32_t bits, unsigned n)
+            {
+                m_bits |= static_cast<uint64_t>(bits) << m_count;
+                m_count += n;
+                if (m_count >= 32)
+                {
+                    size_t size = m_out.size();
+                    m_out.resize(size + 4);
+                    for (int k = 0; k < 4; ++k)
+                        m_out[size + k] = static_cast<unsigned char>(m_bits >> (8 * k));
+                    m_bits >>= 32;
+                    m_count -= 32;
+                }
+            }
+
+            /// pads with zeros to the next byte and writes out the pending bits
+            void align()
+            {
+                for (; m_count > 0; m_count = m_count > 8 ? m_count - 8 : 0)
+                {
+                    m_out.push_back(static_cast<unsigned char>(m_bits));
+                    m_bits >>= 8;
+                }
+            }
+
+            std::vector<unsigned char> & bytes() { return m_out; }
+
+        private:
+            std::vector<unsigned char> & m_out;
+            uint64_t m_bits;
+            unsigned m_count;
+        };
+
+        inline uint32_t reverse_bits(uint32_t code, unsigned length)
+        {
+            uint32_t r = 0;
+            for (unsigned k = 0; k < length; ++k)
+                r |= ((code >> k) & 1) << (length - 1 - k);
+            return r;
+        }
+
+        /// the symbols of the lengths and distances of deflate, and the fixed code lengths
+        struct deflate_tables
+        {
+            deflate_tables()
+            {
+                for (unsigned v = 0; v < 288; ++v)
+                    fixed_length[v] = static_cast<uint8_t>(v < 144 ? 8 : v < 256 ? 9 : v < 280 ? 7 : 8);
+
+                static const uint16_t length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+                static const uint8_t length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+                for (unsigned c = 0; c < 29; ++c)
+                {
+                    unsigned last = c + 1 < 29 ? length_base[c + 1] : 259;
+                    for (unsigned len = length_base[c]; len < last; ++len)
+                    {
+                        length_symbol[len] = static_cast<uint16_t>(257 + c);
+                        length_bits[len] = length_extra[c];
+                        length_value[len] = static_cast<uint16_t>(len - length_base[c]);
+                    }
+                }
+
+                static const uint16_t distance_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+                for (unsigned c = 0; c < 30; ++c)
+                {
+                    distance_start[c] = distance_base[c];
+                    distance_bits[c] = static_cast<uint8_t>(c < 4 ? 0 : c / 2 - 1);
+                }
+                // distances up to 256 are looked up directly, longer ones by (distance - 1) / 128
+                for (unsigned c = 0, d = 1; d <= 256; ++d)
+                {
+                    while (c + 1 < 30 && distance_base[c + 1] <= d)
+                        ++c;
+                    distance_small[d - 1] = static_cast<uint8_t>(c);
+                }
+                for (unsigned c = 0, k = 2; k < 256; ++k)
+                {
+                    unsigned d = (k << 7) + 1;
+                    while (c + 1 < 30 && distance_base[c + 1] <= d)
+                        ++c;
+                    distance_large[k] = static_cast<uint8_t>(c);
+                }
+            }
+
+            unsigned distance_symbol(unsigned d) const
+            {
+                return d <= 256 ? distance_small[d - 1] : distance_large[(d - 1) >> 7];
+            }
+
+            uint8_t fixed_length[288];
+            uint16_t length_symbol[259];
+            uint8_t length_bits[259];
+            uint16_t length_value[259];
+            uint16_t distance_start[30];
+            uint8_t distance_bits[30];
+            uint8_t distance_small[256];
+            uint8_t distance_large[256];
+        };
+
+        inline const deflate_tables & deflate_codes()
+        {
+            static const deflate_tables tables;
+            return tables;
+        }
+
+        /**
+         * @brief lengths of a Huffman code limited to max_length bits, 0 for the symbols which never occur
+         *
+         * The tree is built with the two-queue method over the symbols sorted by frequency. Lengths
+         * beyond the limit are then cut and the counts per length rebalanced so the code stays
+         * complete, and the lengths handed back out, shortest to the most frequent symbols.
+         */
+        inline void huffman_lengths(const uint32_t * frequencies, size_t n, unsigned max_length, uint8_t * lengths)
+        {
+            std::vector<std::pair<uint32_t, uint16_t> > leaves;
+            for (size_t i = 0; i < n; ++i)
+            {
+                lengths[i] = 0;
+                if (frequencies[i])
+                    leaves.push_back(std::make_pair(frequencies[i], static_cast<uint16_t>(i)));
+            }
+            const size_t m = leaves.size();
+            if (m == 0)
+                return;
+            if (m == 1)
+            {
+                lengths[leaves[0].second] = 1;
+                return;
+            }
+            std::sort(leaves.begin(), leaves.end());
+
+            // nodes 0 to m - 1 are the leaves, the internal nodes follow in the order they are made
+            std::vector<uint64_t> weight(2 * m - 1);
+            std::vector<uint32_t> parent(2 * m - 1);
+            for (size_t i = 0; i < m; ++i)
+                weight[i] = leaves[i].first;
+            size_t leaf = 0, node = m;
+            for (size_t next = m; next < 2 * m - 1; ++next)
+            {
+                size_t pick[2];
+                for (int k = 0; k < 2; ++k)
+                    pick[k] = leaf < m && (node >= next || weight[leaf] <= weight[node]) ? leaf++ : node++;
+                weight[next] = weight[pick[0]] + weight[pick[1]];
+                parent[pick[0]] = parent[pick[1]] = static_cast<uint32_t>(next);
+            }
+
+            // depths from the root down, parents come after their children
+            std::vector<unsigned> depth(2 * m - 1, 0);
+            unsigned counts[33] = { 0 };
+            for (size_t i = 2 * m - 1; i-- > 0;)
+            {
+                if (i != 2 * m - 2)
+                    depth[i] = depth[parent[i]] + 1;
+                if (i < m)
+                    ++counts[std::min(depth[i], 32u)];
+            }
+
+            for (unsigned len = max_length + 1; len <= 32; ++len)
+            {
+                counts[max_length] += counts[len];
+                counts[len] = 0;
+            }
+            uint64_t total = 0;
+            for (unsigned len = 1; len <= max_length; ++len)
+                total += static_cast<uint64_t>(counts[len]) << (max_length - len);
+            while (total > (uint64_t(1) << max_length))
+            {
+                // a leaf at the limit moves under a shorter leaf, which moves one level down
+                --counts[max_length];
+                for (unsigned len = max_length - 1; len > 0; --len)
+                {
+                    if (counts[len])
+                    {
+                        --counts[len];
+                        counts[len + 1] += 2;
+                        break;
+                    }
+                }
+                --total;
+            }
+
+            size_t i = 0;
+            for (unsigned len = max_length; len > 0; --len)
+            {
+                for (unsigned k = 0; k < counts[len]; ++k)
+                    lengths[leaves[i++].second] = static_cast<uint8_t>(len);
+            }
+        }
+
+        /// the canonical codes of the lengths, bit-reversed so they can be written least significant bit first
+        inline void huffman_codes(const uint8_t * lengths, size_t n, uint16_t * codes)
+        {
+            unsigned counts[16] = { 0 }, next[16] = { 0 };
+            for (size_t i = 0; i < n; ++i)
+                ++counts[lengths[i]];
+            counts[0] = 0;
+            for (unsigned len = 1, code = 0; len < 16; ++len)
+            {
+                code = (code + counts[len - 1]) << 1;
+                next[len] = code;
+            }
+            for (size_t i = 0; i < n; ++i)
+                codes[i] = lengths[i] ? static_cast<uint16_t>(reverse_bits(next[lengths[i]]++, lengths[i])) : 0;
+        }
+
+        /// a literal, or a match of `value` bytes `distance` bytes back
+        struct lz_symbol
+        {
+            uint16_t value;
+            uint16_t distance;      ///< 0 for a literal
+        };
+
+        inline size_t match_length(const unsigned char * a, const unsigned char * b, size_t max)
+        {
+            size_t n = 0;
+            while (n + 8 <= max)
+            {
+                uint64_t x, y;
+                std::memcpy(&x, a + n, 8);
+                std::memcpy(&y, b + n, 8);
+                if (x != y)
+                    break;
+                n += 8;
+            }
+            while (n < max && a[n] == b[n])
+                ++n;
+            return n;
+        }
+
+        inline void deflate_stored(const unsigned char * data, size_t size, bool final, bit_writer & bits)
+        {
+            do
+            {
+                size_t n = size < 65535 ? size : 65535;
+                bits.put(final && n == size ? 1 : 0, 3);
+                bits.align();
+                unsigned char header[4] = { static_cast<unsigned char>(n), static_cast<unsigned char>(n >> 8),
+                    static_cast<unsigned char>(~n), static_cast<unsigned char>(~n >> 8) };
+                bits.bytes().insert(bits.bytes().end(), header, header + 4);
+                bits.bytes().insert(bits.bytes().end(), data, data + n);
+                data += n;
+                size -= n;
+            } while (size);
+        }
+
+        inline void deflate_symbols(const std::vector<lz_symbol> & symbols, const uint16_t * literal_codes, const uint8_t * literal_lengths,
+            const uint16_t * distance_codes, const uint8_t * distance_lengths, bit_writer & bits)
+        {
+            const deflate_tables & t = deflate_codes();
+            for (size_t k = 0; k < symbols.size(); ++k)
+            {
+                const lz_symbol & s = symbols[k];
+                if (!s.distance)
+                {
+                    bits.put(literal_codes[s.value], literal_lengths[s.value]);
+                    continue;
+                }
+                unsigned l = t.length_symbol[s.value], d = t.distance_symbol(s.distance);
+                bits.put(literal_codes[l], literal_lengths[l]);
+                bits.put(t.length_value[s.value], t.length_bits[s.value]);
+                bits.put(distance_codes[d], distance_lengths[d]);
+                bits.put(s.distance - t.distance_start[d], t.distance_bits[d]);
+            }
+            bits.put(literal_codes[256], literal_lengths[256]);
+        }
+
+        /**
+         * @brief estimate of the bits each symbol will take, to decide whether a match pays off
+         *
+         * Literals are costed with a Huffman code of the bytes coming next, matches with the codes
+         * of the previous block. Costing literals with the codes of the previous block instead
+         * feeds back on itself: once short matches took many literals, literals look expensive.
+         */
+        struct deflate_costs
+        {
+            deflate_costs()
+            {
+                std::fill(literal, literal + 256, uint8_t(8));
+                set(deflate_codes().fixed_length, 0);
+            }
+
+            void estimate_literals(const unsigned char * data, size_t size)
+            {
+                uint32_t frequencies[256] = { 0 };
+                for (size_t i = 0; i < size; ++i)
+                    ++frequencies[data[i]];
+                uint8_t lengths[256];
+                huffman_lengths(frequencies, 256, 15, lengths);
+                for (unsigned v = 0; v < 256; ++v)
+                    literal[v] = lengths[v] ? lengths[v] : 15;
+            }
+
+            /// the lengths and distances as coded; symbols without a code are taken as rare, not as free
+            void set(const uint8_t * literal_lengths, const uint8_t * distance_lengths)
+            {
+                for (unsigned v = 257; v < 286; ++v)
+                    literal[v] = literal_lengths[v] ? literal_lengths[v] : 15;
+                for (unsigned d = 0; d < 30; ++d)
+                    distance[d] = distance_lengths && distance_lengths[d] ? distance_lengths[d] : distance_lengths ? 15 : 5;
+            }
+
+            uint8_t literal[286];
+            uint8_t distance[30];
+        };
+
+        /**
+         * @brief writes the symbols as one block, with the smallest of dynamic codes, fixed codes or the raw bytes
+         *
+         * @param costs set to the bits each symbol took
+         */
+        inline void deflate_block(const std::vector<lz_symbol> & symbols, const unsigned char * raw, size_t raw_size, bool final,
+            bit_writer & bits, deflate_costs & costs)
+        {
+            const deflate_tables & t = deflate_codes();
+            uint32_t literal_frequencies[286] = { 0 }, distance_frequencies[30] = { 0 };
+            uint64_t extra_bits = 0;
+            for (size_t k = 0; k < symbols.size(); ++k)
+            {
+                const lz_symbol & s = symbols[k];
+                if (!s.distance)
+                {
+                    ++literal_frequencies[s.value];
+                    continue;
+                }
+                unsigned d = t.distance_symbol(s.distance);
+                ++literal_frequencies[t.length_symbol[s.value]];
+                ++distance_frequencies[d];
+                extra_bits += t.length_bits[s.value] + t.distance_bits[d];
+            }
+            literal_frequencies[256] = 1;
+
+            uint8_t literal_lengths[288] = { 0 }, distance_lengths[30] = { 0 };
+            huffman_lengths(literal_frequencies, 286, 15, literal_lengths);
+            huffman_lengths(distance_frequencies, 30, 15, distance_lengths);
+            // a block without matches still declares one distance code
+            if (std::find_if(distance_lengths, distance_lengths + 30, [](uint8_t l) { return l != 0; }) == distance_lengths + 30)
+                distance_lengths[0] = 1;
+
+            size_t n_literals = 286, n_distances = 30;
+            while (n_literals > 257 && !literal_lengths[n_literals - 1])
+                --n_literals;
+            while (n_distances > 1 && !distance_lengths[n_distances - 1])
+                --n_distances;
+
+            // the code lengths, run-length encoded with the symbols 16 (repeat), 17 and 18 (zeros)
+            uint8_t all[286 + 30];
+            std::memcpy(all, literal_lengths, n_literals);
+            std::memcpy(all + n_literals, distance_lengths, n_distances);
+            const size_t n_all = n_literals + n_distances;
+            std::vector<std::pair<uint8_t, uint8_t> > runs;     // symbol, extra value
+            for (size_t i = 0; i < n_all;)
+            {
+                size_t run = 1;
+                while (i + run < n_all && all[i + run] == all[i])
+                    ++run;
+                if (!all[i] && run >= 3)
+                {
+                    run = std::min<size_t>(run, 138);
+                    runs.push_back(std::make_pair(run >= 11 ? 18 : 17, static_cast<uint8_t>(run >= 11 ? run - 11 : run - 3)));
+                    i += run;
+                }
+                else if (all[i] && run >= 4)
+                {
+                    runs.push_back(std::make_pair(all[i], 0));
+                    run = std::min<size_t>(run - 1, 6);
+                    runs.push_back(std::make_pair(16, static_cast<uint8_t>(run - 3)));
+                    i += run + 1;
+                }
+                else
+                {
+                    runs.push_back(std::make_pair(all[i], 0));
+                    ++i;
+                }
+            }
+            uint32_t length_frequencies[19] = { 0 };
+            for (size_t k = 0; k < runs.size(); ++k)
+                ++length_frequencies[runs[k].first];
+            uint8_t length_lengths[19];
+            huffman_lengths(length_frequencies, 19, 7, length_lengths);
+            static const uint8_t order[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+            size_t n_lengths = 19;
+            while (n_lengths > 4 && !length_lengths[order[n_lengths - 1]])
+                --n_lengths;
+
+            uint64_t dynamic_bits = 3 + 14 + 3 * n_lengths + extra_bits, fixed_bits = 3 + extra_bits;
+            static const uint8_t run_extra[19] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7 };
+            for (size_t k = 0; k < runs.size(); ++k)
+                dynamic_bits += length_lengths[runs[k].first] + run_extra[runs[k].first];
+            for (unsigned v = 0; v < 286; ++v)
+            {
+                dynamic_bits += uint64_t(literal_frequencies[v]) * literal_lengths[v];
+                fixed_bits += uint64_t(literal_frequencies[v]) * t.fixed_length[v];
+            }
+            for (unsigned d = 0; d < 30; ++d)
+            {
+                dynamic_bits += uint64_t(distance_frequencies[d]) * distance_lengths[d];
+                fixed_bits += uint64_t(distance_frequencies[d]) * 5;
+            }
+            uint64_t stored_bits = (raw_size + (raw_size / 65535 + 1) * 5) * 8 + 7;
+
+            if (stored_bits < dynamic_bits && stored_bits < fixed_bits)
+            {
+                deflate_stored(raw, raw_size, final, bits);
+                costs.set(literal_lengths, distance_lengths);
+                return;
+            }
+
+            uint16_t literal_codes[288], distance_codes[30];
+            if (fixed_bits <= dynamic_bits)
+            {
+                uint8_t fixed_distances[30];
+                std::fill(fixed_distances, fixed_distances + 30, uint8_t(5));
+                huffman_codes(t.fixed_length, 288, literal_codes);
+                huffman_codes(fixed_distances, 30, distance_codes);
+                bits.put(final ? 1 : 0, 1);
+                bits.put(1, 2);
+                deflate_symbols(symbols, literal_codes, t.fixed_length, distance_codes, fixed_distances, bits);
+                costs.set(t.fixed_length, fixed_distances);
+                return;
+            }
+
+            uint16_t length_codes[19];
+            huffman_codes(literal_lengths, 286, literal_codes);
+            huffman_codes(distance_lengths, 30, distance_codes);
+            huffman_codes(length_lengths, 19, length_codes);
+            bits.put(final ? 1 : 0, 1);
+            bits.put(2, 2);
+            bits.put(static_cast<uint32_t>(n_literals - 257), 5);
+            bits.put(static_cast<uint32_t>(n_distances - 1), 5);
+            bits.put(static_cast<uint32_t>(n_lengths - 4), 4);
+            for (size_t k = 0; k < n_lengths; ++k)
+                bits.put(length_lengths[order[k]], 3);
+            for (size_t k = 0; k < runs.size(); ++k)
+            {
+                bits.put(length_codes[runs[k].first], length_lengths[runs[k].first]);
+                bits.put(runs[k].second, run_extra[runs[k].first]);
+            }
+            deflate_symbols(symbols, literal_codes, literal_lengths, distance_codes, distance_lengths, bits);
+            costs.set(literal_lengths, distance_lengths);
+        }
+
+        /**
+         * @brief compresses data as a raw deflate stream, in blocks of at most block_symbols symbols
+         *
+         * With max_chain 0 the only matches looked for are runs, repeats of the previous byte;
+         * otherwise a hash of 4 bytes finds earlier positions in the 32 KB window, and up to
+         * max_chain of them are compared, keeping the longest match. A match is only taken when
+         * it costs fewer bits than the literals it replaces, with the codes of the previous block;
+         * on noisy images short matches far back otherwise cost more than they save.
+         */
+        inline void deflate(const unsigned char * data, size_t size, unsigned max_chain, std::vector<unsigned char> & out)
+        {
+            static const unsigned hash_bits = 15;
+            struct
+            {
+                uint32_t operator()(const unsigned char * p) const
+                {
+                    uint32_t v;
+                    std::memcpy(&v, p, 4);
+                    return (v * 2654435761u) >> (32 - hash_bits);
+                }
+            } hash4;
+            static const size_t window = 32768;
+            static const size_t block_symbols = 1 << 15;
+            bit_writer bits(out);
+            std::vector<int32_t> head, previous;
+            if (max_chain)
+            {
+                head.assign(size_t(1) << hash_bits, -1);
+                previous.assign(window, -1);
+            }
+            std::vector<lz_symbol> symbols;
+            symbols.reserve(block_symbols);
+            const deflate_tables & t = deflate_codes();
+            deflate_costs costs;
+            costs.estimate_literals(data, std::min(size, block_symbols));
+
+            size_t i = 0, block_start = 0;
+            while (i < size)
+            {
+                size_t best_length = 0, best_distance = 0;
+                size_t max = size - i < 258 ? size - i : 258;
+                if (!max_chain)
+                {
+                    if (i && max >= 3 && data[i] == data[i - 1])
+                    {
+                        best_length = match_length(data + i - 1, data + i, max);
+                        best_distance = 1;
+                    }
+                }
+                else if (max >= 4)
+                {
+                    uint32_t h = hash4(data + i);
+                    int32_t candidate = head[h];
+                    for (unsigned chain = max_chain; candidate >= 0 && i - candidate <= window && chain; --chain)
+                    {
+                        // a longer match has to match the byte after the best one so far
+                        if (best_length < max && data[candidate + best_length] != data[i + best_length])
+                        {
+                            int32_t next = previous[candidate & (window - 1)];
+                            if (next >= candidate)
+                                break;
+                            candidate = next;
+                            continue;
+                        }
+                        size_t length = match_length(data + candidate, data + i, max);
+                        if (length > best_length)
+                        {
+                            best_length = length;
+                            best_distance = i - candidate;
+                            if (length == max)
+                                break;
+                        }
+                        int32_t next = previous[candidate & (window - 1)];
+                        // the slot may have been reused by a later position: the chain ends there
+                        if (next >= candidate)
+                            break;
+                        candidate = next;
+                    }
+                    previous[i & (window - 1)] = head[h];
+                    head[h] = static_cast<int32_t>(i);
+                }
+
+                if (best_length >= 3)
+                {
+                    unsigned l = t.length_symbol[best_length], d = t.distance_symbol(static_cast<unsigned>(best_distance));
+                    size_t match_bits = costs.literal[l] + t.length_bits[best_length] + costs.distance[d] + t.distance_bits[d];
+                    size_t literal_bits = 0;
+                    for (size_t k = 0; k < best_length && literal_bits <= match_bits; ++k)
+                        literal_bits += costs.literal[data[i + k]];
+                    if (literal_bits <= match_bits)
+                        best_length = 0;
+                }
+
+                lz_symbol s;
+                if (best_length < 3)
+                {
+                    s.value = data[i];
+                    s.distance = 0;
+                    ++i;
+                }
+                else
+                {
+                    s.value = static_cast<uint16_t>(best_length);
+                    s.distance = static_cast<uint16_t>(best_distance);
+                    size_t end = i + best_length;
+                    // the positions inside the match are hashed too, for the matches that follow
+                    for (++i; max_chain && i < end && i + 4 <= size; ++i)
+                    {
+                        uint32_t h = hash4(data + i);
+                        previous[i & (window - 1)] = head[h];
+                        head[h] = static_cast<int32_t>(i);
+                    }
+                    i = end;
+                }
+                symbols.push_back(s);
+
+                if (symbols.size() == block_symbols && i < size)
+                {
+                    deflate_block(symbols, data + block_start, i - block_start, false, bits, costs);
+                    symbols.clear();
+                    block_start = i;
+                    costs.estimate_literals(data + i, std::min(size - i, block_symbols));
+                }
+            }
+            deflate_block(symbols, data + block_start, size - block_start, true, bits, costs);
+            bits.align();
+        }
+
+        inline unsigned char paeth(int a, int b, int c)
+        {
+            int p = a + b - c;
+            int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+            if (pa <= pb && pa <= pc)
+                return static_cast<unsigned char>(a);
+            return static_cast<unsigned char>(pb <= pc ? b : c);
+        }
+
+        /**
+         * @brief writes the filter type then the filtered row
+         *
+         * @param above the previous row, 0 for the first one
+         * @param bpp bytes per pixel, the distance to the byte on the left
+         */
+        inline void png_filter_row(int type, const unsigned char * row, const unsigned char * above, size_t n, size_t bpp, unsigned char * out)
+        {
+            *out++ = static_cast<unsigned char>(type);
+            size_t head = std::min(bpp, n);
+            switch (type)
+            {
+            case 0:
+                std::memcpy(out, row, n);
+                break;
+            case 1:
+                std::memcpy(out, row, head);
+                for (size_t i = bpp; i < n; ++i)
+                    out[i] = static_cast<unsigned char>(row[i] - row[i - bpp]);
+                break;
+            case 2:
+                for (size_t i = 0; i < n; ++i)
+                    out[i] = static_cast<unsigned char>(row[i] - (above ? above[i] : 0));
+                break;
+            case 3:
+                for (size_t i = 0; i < head; ++i)
+                    out[i] = static_cast<unsigned char>(row[i] - ((above ? above[i] : 0) >> 1));
+                for (size_t i = bpp; i < n; ++i)
+                    out[i] = static_cast<unsigned char>(row[i] - ((row[i - bpp] + (above ? above[i] : 0)) >> 1));
+                break;
+            case 4:
+                for (size_t i = 0; i < head; ++i)
+                    out[i] = static_cast<unsigned char>(row[i] - (above ? above[i] : 0));
+                for (size_t i = bpp; i < n; ++i)
+                    out[i] = static_cast<unsigned char>(row[i] - (above ? paeth(row[i - bpp], above[i], above[i - bpp]) : row[i - bpp]));
+                break;
+            }
+        }
+
+        /// sum of the residuals taken as signed bytes, the usual estimate of how well a filtered row compresses
+        inline size_t png_filter_cost(const unsigned char * filtered, size_t n)
+        {
+            size_t cost = 0;
+            for (size_t i = 0; i < n; ++i)
+                cost += filtered[i] < 128 ? filtered[i] : 256 - filtered[i];
+            return cost;
+        }
+
+        inline void png_chunk(std::vector<unsigned char> & out, const char * type, const unsigned char * data, size_t size)
+        {
+            put_be32(out, static_cast<uint32_t>(size));
+            size_t start = out.size();
+            out.insert(out.end(), type, type + 4);
+            if (size)
+                out.insert(out.end(), data, data + size);
+            put_be32(out, crc32(0, &out[start], out.size() - start));
+        }
+    }
+
+    /**
+     * @brief encodes an 8-bit or 16-bit image with 1 to 4 channels as a PNG file in memory
+     *
+     * @return false if the format of the image cannot be written as PNG
+     */
+    inline bool encode_png(const image_view & image, png_level level, std::vector<unsigned char> & png)
+    {
+        static const unsigned char color_types[5] = { 0, 0, 4, 2, 6 };
+        if (image.empty() || image.channels() < 1 || image.channels() > 4
+            || (image.channel_depth() != VIDI_IMG_8U && image.channel_depth() != VIDI_IMG_16U))
+            return false;
+
+        const bool wide = image.channel_depth() == VIDI_IMG_16U;
+        const size_t n = image.row_size(), bpp = image.pixel_size();
+
+        // the filtered rows, each preceded by its filter type, are what deflate compresses
+        std::vector<unsigned char> filtered((n + 1) * image.height());
+        std::vector<unsigned char> swapped(wide ? 2 * n : 0), candidates(level >= png_balanced ? 5 * (n + 1) : 0);
+        const unsigned char * above = 0;
+        for (VIDI_UINT y = 0; y < image.height(); ++y)
+        {
+            const unsigned char * row = image.row(y);
+            if (wide)
+            {
+                // big-endian, alternating between the two halves so the row above stays available
+                unsigned char * be = &swapped[(y & 1) * n];
+                for (size_t i = 0; i < n; i += 2)
+                {
+                    be[i] = row[i + 1];
+                    be[i + 1] = row[i];
+                }
+                row = be;
+            }
+
+            unsigned char * out = &filtered[y * (n + 1)];
+            if (level == png_store)
+                detail::png_filter_row(0, row, above, n, bpp, out);
+            else if (level == png_fastest)
+                detail::png_filter_row(1, row, above, n, bpp, out);
+            else
+            {
+                size_t best = 0, best_cost = size_t(-1);
+                for (int type = 0; type < 5; ++type)
+                {
+                    unsigned char * candidate = &candidates[type * (n + 1)];
+                    detail::png_filter_row(type, row, above, n, bpp, candidate);
+                    size_t cost = detail::png_filter_cost(candidate + 1, n);
+                    if (cost < best_cost)
+                    {
+                        best = type;
+                        best_cost = cost;
+                    }
+                }
+                std::memcpy(out, &candidates[best * (n + 1)], n + 1);
+            }
+            above = row;
+        }
+
+        std::vector<unsigned char> zlib;
+        zlib.reserve(filtered.size() + filtered.size() / 65535 * 5 + 16);
+        // compression method 8 with a 32 KB window; the check bits make the header a multiple of 31
+        zlib.push_back(0x78);
+        zlib.push_back(0x01);
+        if (level == png_store)
+        {
+            detail::bit_writer bits(zlib);
+            detail::deflate_stored(filtered.data(), filtered.size(), true, bits);
+        }
+        else
+        {
+            static const unsigned chains[4] = { 0, 0, 4, 64 };
+            detail::deflate(filtered.data(), filtered.size(), chains[level], zlib);
+        }
+        detail::put_be32(zlib, detail::adler32(1, filtered.data(), filtered.size()));
+
+        static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        png.assign(signature, signature + 8);
+        std::vector<unsigned char> header;
+        detail::put_be32(header, image.width());
+        detail::put_be32(header, image.height());
+        header.push_back(wide ? 16 : 8);
+        header.push_back(color_types[image.channels()]);
+        header.push_back(0);    // deflate
+        header.push_back(0);    // adaptive filtering
+        header.push_back(0);    // not interlaced
+        detail::png_chunk(png, "IHDR", header.data(), header.size());
+        detail::png_chunk(png, "IDAT", zlib.data(), zlib.size());
+        detail::png_chunk(png, "IEND", 0, 0);
+        return true;
+    }
+
+    /**
+     * @brief writes the bytes to a file, first as "<path>.part" then renamed, so a reader never sees half a file
+     */
+    inline bool write_file(const std::string & path, const void * data, size_t size)
+    {
+        std::string part = path + ".part";
+        std::FILE * f = std::fopen(part.c_str(), "wb");
+        if (!f)
+            return false;
+        bool ok = (!size || std::fwrite(data, 1, size, f) == size);
+        if (std::fclose(f) != 0)
+            ok = false;
+        // a failed write leaves the previous file as it was
+        if (!ok)
+        {
+            std::remove(part.c_str());
+            return false;
+        }
+        // rename() does not replace an existing file on Windows
+        std::remove(path.c_str());
+        if (std::rename(part.c_str(), path.c_str()) != 0)
+        {
+            std::remove(part.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    inline bool write_file(const std::string & path, const std::vector<unsigned char> & data)
+    {
+        return write_file(path, data.data(), data.size());
+    }
+}
+
+#endif
@@ -0,0 +1,481 @@
+/**
+ * @file resample.hpp
+ * @brief Bilinear and area resizing, 2x downscaling and image pyramids, with SSE/AVX2 and scalar paths
+ *
+ * Example.Runtime.BlueReadChangeFeatureSize changes the feature size of a tool; the same effect
+ * is obtained on the images by bringing them to a canonical scale before processing:
+ *
+ *     vidi_utils::thread_pool pool;
+ *     vidi_utils::resize(vidi_utils::image_view(frame), scaled, vidi_utils::resample_area, &pool);
+ *
+ * Resizing is separable. Each destination row is first the weighted sum of a few source rows, in
+ * floats, which is vectorized; that row is then resampled horizontally and rounded back to 8 or
+ * 16 bits, with AVX2 gathers for single channel images. downscale_2x() averages blocks of 2x2
+ * pixels with integer arithmetic and is what image_pyramid uses for its levels.
+ *
+ * Images are 8U or 16U with any number of channels and any step. With a thread_pool, bands of
+ * destination rows are processed in parallel. Every instruction set gives the same bytes as the
+ * scalar code, as long as the compiler does not fuse float multiply-adds (-ffp-contract=off when
+ * compiling for FMA). The functions return false, without writing anything, when the views do
+ * not match.
+ */
+
+#ifndef VIDI_UTILS_RESAMPLE_HPP_INCLUDED
+#define VIDI_UTILS_RESAMPLE_HPP_INCLUDED
+
+#include "vidi.h"
+#include "image_view.hpp"
+#include "pixel_convert.hpp"
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace vidi_utils
+{
+    enum resample_method
+    {
+        resample_bilinear,  ///< interpolates between the 2x2 nearest source pixels
+        resample_area       ///< averages the source pixels covered by each destination pixel, for downscaling
+    };
+
+    namespace detail
+    {
+        /**
+         * @brief for each destination column (or row), the source ones it is computed from and their weights
+         *
+         * Every destination index has max_count taps, those past the source pixels it needs having
+         * a weight of 0, so that the kernels have no varying loop bounds.
+         */
+        struct resample_taps
+        {
+            std::vector<int32_t> first;     ///< source index of the first tap
+            std::vector<float> weights;     ///< weights[i * max_count + t], tap t of destination i
+            std::vector<float> by_tap;      ///< the same weights ordered by tap, by_tap[t * first.size() + i]
+            VIDI_UINT max_count;
+        };
+
+        inline resample_taps make_taps(VIDI_UINT src_n, VIDI_UINT dst_n, resample_method method)
+        {
+            std::vector<std::vector<float> > w(dst_n);
+            resample_taps taps;
+            taps.max_count = 0;
+            for (VIDI_UINT i = 0; i < dst_n; ++i)
+            {
+                if (method == resample_bilinear)
+                {
+                    // pixel centers line up: destination i is at source (i + 0.5) * src_n / dst_n - 0.5
+                    double c = std::min(std::max((i + 0.5) * src_n / dst_n - 0.5, 0.0), src_n - 1.0);
+                    VIDI_UINT i0 = static_cast<VIDI_UINT>(c);
+                    float f = static_cast<float>(c - i0);
+                    taps.first.push_back(i0);
+                    w[i].push_back(1 - f);
+                    if (i0 + 1 < src_n)
+                        w[i].push_back(f);
+                }
+                else
+                {
+                    // destination i covers [a, b) in source pixels; the products are exact, so are integer bounds
+                    double a = static_cast<double>(i) * src_n / dst_n, b = static_cast<double>(i + 1) * src_n / dst_n;
+                    double scale = static_cast<double>(src_n) / dst_n;
+                    VIDI_UINT i0 = static_cast<VIDI_UINT>(a);
+                    VIDI_UINT i1 = std::min(src_n, static_cast<VIDI_UINT>(std::ceil(b)));
+                    taps.first.push_back(i0);
+                    for (VIDI_UINT j = i0; j < i1; ++j)
+                        w[i].push_back(static_cast<float>((std::min(b, j + 1.0) - std::max(a, static_cast<double>(j))) / scale));
+                }
+                taps.max_count = std::max(taps.max_count, static_cast<VIDI_UINT>(w[i].size()));
+            }
+
+            taps.weights.assign(static_cast<size_t>(dst_n) * taps.max_count, 0.f);
+            taps.by_tap.assign(taps.weights.size(), 0.f);
+            for (VIDI_UINT i = 0; i < dst_n; ++i)
+            {
+                for (size_t t = 0; t < w[i].size(); ++t)
+                {
+                    taps.weights[i * taps.max_count + t] = w[i][t];
+                    taps.by_tap[t * dst_n + i] = w[i][t];
+                }
+            }
+            return taps;
+        }
+
+        template<class T>
+        T round_to(float v)
+        {
+            return static_cast<T>(std::min(v + 0.5f, sizeof(T) == 1 ? 255.f : 65535.f));
+        }
+
+        // vertical pass: line[k] = rows[0][k] * weights[0] + ... + rows[n_rows - 1][k] * weights[n_rows - 1], for k in [begin, n)
+
+        template<class T>
+        void vertical_scalar(const T * const * rows, const float * weights, VIDI_UINT n_rows, float * line, size_t begin, size_t n)
+        {
+            for (size_t k = begin; k < n; ++k)
+            {
+                float v = rows[0][k] * weights[0];
+                for (VIDI_UINT t = 1; t < n_rows; ++t)
+                    v = v + rows[t][k] * weights[t];
+                line[k] = v;
+            }
+        }
+
+        // horizontal pass: dst[x] = line[first[x]] * w[x][0] + ... + line[first[x] + max_count - 1] * w[x][max_count - 1], rounded, for x in [begin, n)
+
+        template<class T>
+        void horizontal_scalar(const float * line, T * dst, const resample_taps & taps, VIDI_UINT channels, size_t begin)
+        {
+            for (size_t x = begin; x < taps.first.size(); ++x)
+            {
+                const float * s = line + static_cast<size_t>(taps.first[x]) * channels;
+                const float * w = &taps.weights[x * taps.max_count];
+                for (VIDI_UINT c = 0; c < channels; ++c)
+                {
+                    float v = s[c] * w[0];
+                    for (VIDI_UINT t = 1; t < taps.max_count; ++t)
+                        v = v + s[t * channels + c] * w[t];
+                    dst[x * channels + c] = round_to<T>(v);
+                }
+            }
+        }
+
+        inline void box_2x_8u_c1_scalar(const uint8_t * r0, const uint8_t * r1, uint8_t * dst, size_t n)
+        {
+            for (size_t k = 0; k < n; ++k)
+                dst[k] = static_cast<uint8_t>((r0[2 * k] + r0[2 * k + 1] + r1[2 * k] + r1[2 * k + 1] + 2) >> 2);
+        }
+
+#if defined(VIDI_UTILS_X86_SIMD)
+        VIDI_UTILS_TARGET("ssse3")
+        inline __m128 load4_ps(const uint8_t * p)
+        {
+            int32_t bytes;
+            std::memcpy(&bytes, p, 4);
+            __m128i zero = _mm_setzero_si128();
+            return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(bytes), zero), zero));
+        }
+
+        VIDI_UTILS_TARGET("ssse3")
+        inline __m128 load4_ps(const uint16_t * p)
+        {
+            return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), _mm_setzero_si128()));
+        }
+
+        template<class T>
+        VIDI_UTILS_TARGET("ssse3")
+        void vertical_sse(const T * const * rows, const float * weights, VIDI_UINT n_rows, float * line, size_t n)
+        {
+            size_t k = 0;
+            for (; k + 4 <= n; k += 4)
+            {
+                __m128 v = _mm_mul_ps(load4_ps(rows[0] + k), _mm_set1_ps(weights[0]));
+                for (VIDI_UINT t = 1; t < n_rows; ++t)
+                    v = _mm_add_ps(v, _mm_mul_ps(load4_ps(rows[t] + k), _mm_set1_ps(weights[t])));
+                _mm_storeu_ps(line + k, v);
+            }
+            vertical_scalar(rows, weights, n_rows, line, k, n);
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline __m256 load8_ps(const uint8_t * p)
+        {
+            return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(p))));
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline __m256 load8_ps(const uint16_t * p)
+        {
+            return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p))));
+        }
+
+        template<class T>
+        VIDI_UTILS_TARGET("avx2")
+        void vertical_avx2(const T * const * rows, const float * weights, VIDI_UINT n_rows, float * line, size_t n)
+        {
+            size_t k = 0;
+            for (; k + 8 <= n; k += 8)
+            {
+                __m256 v = _mm256_mul_ps(load8_ps(rows[0] + k), _mm256_set1_ps(weights[0]));
+                for (VIDI_UINT t = 1; t < n_rows; ++t)
+                    v = _mm256_add_ps(v, _mm256_mul_ps(load8_ps(rows[t] + k), _mm256_set1_ps(weights[t])));
+                _mm256_storeu_ps(line + k, v);
+            }
+            vertical_scalar(rows, weights, n_rows, line, k, n);
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline void store8_rounded(__m256 v, uint8_t * dst)
+        {
+            __m256i i = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_add_ps(v, _mm256_set1_ps(0.5f)), _mm256_set1_ps(255.f)));
+            __m128i w = _mm_packs_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+            _mm_storel_epi64(reinterpret_cast<__m128i *>(dst), _mm_packus_epi16(w, w));
+        }
+
+        /// 16-bit values go through signed saturation shifted by 32768, there being no unsigned 32 to 16-bit pack before SSE4.1
+        VIDI_UTILS_TARGET("avx2")
+        inline void store8_rounded(__m256 v, uint16_t * dst)
+        {
+            __m256i i = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_add_ps(v, _mm256_set1_ps(0.5f)), _mm256_set1_ps(65535.f)));
+            i = _mm256_sub_epi32(i, _mm256_set1_epi32(32768));
+            __m128i w = _mm_packs_epi32(_mm256_castsi256_si128(i), _mm256_extracti128_si256(i, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), _mm_xor_si128(w, _mm_set1_epi16(-32768)));
+        }
+
+        /**
+         * @brief the horizontal pass of single channel images, gathering the taps of 8 destination pixels at once
+         */
+        template<class T>
+        VIDI_UTILS_TARGET("avx2")
+        void horizontal_avx2(const float * line, T * dst, const resample_taps & taps)
+        {
+            size_t n = taps.first.size(), x = 0;
+            const __m256i one = _mm256_set1_epi32(1);
+            for (; x + 8 <= n; x += 8)
+            {
+                __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(&taps.first[x]));
+                __m256 v = _mm256_mul_ps(_mm256_i32gather_ps(line, index, 4), _mm256_loadu_ps(&taps.by_tap[x]));
+                for (VIDI_UINT t = 1; t < taps.max_count; ++t)
+                {
+                    index = _mm256_add_epi32(index, one);
+                    v = _mm256_add_ps(v, _mm256_mul_ps(_mm256_i32gather_ps(line, index, 4), _mm256_loadu_ps(&taps.by_tap[t * n + x])));
+                }
+                store8_rounded(v, dst + x);
+            }
+            horizontal_scalar(line, dst, taps, 1, x);
+        }
+
+        /// the pairs of adjacent bytes of two rows are summed with maddubs
+        VIDI_UTILS_TARGET("ssse3")
+        inline void box_2x_8u_c1_sse(const uint8_t * r0, const uint8_t * r1, uint8_t * dst, size_t n)
+        {
+            const __m128i ones = _mm_set1_epi8(1), two = _mm_set1_epi16(2);
+            size_t k = 0;
+            for (; k + 16 <= n; k += 16)
+            {
+                __m128i a = _mm_add_epi16(_mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(r0 + 2 * k)), ones),
+                    _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(r1 + 2 * k)), ones));
+                __m128i b = _mm_add_epi16(_mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(r0 + 2 * k + 16)), ones),
+                    _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(r1 + 2 * k + 16)), ones));
+                a = _mm_srli_epi16(_mm_add_epi16(a, two), 2);
+                b = _mm_srli_epi16(_mm_add_epi16(b, two), 2);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + k), _mm_packus_epi16(a, b));
+            }
+            box_2x_8u_c1_scalar(r0 + 2 * k, r1 + 2 * k, dst + k, n - k);
+        }
+
+        VIDI_UTILS_TARGET("avx2")
+        inline void box_2x_8u_c1_avx2(const uint8_t * r0, const uint8_t * r1, uint8_t * dst, size_t n)
+        {
+            const __m256i ones = _mm256_set1_epi8(1), two = _mm256_set1_epi16(2);
+            size_t k = 0;
+            for (; k + 32 <= n; k += 32)
+            {
+                __m256i a = _mm256_add_epi16(_mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(r0 + 2 * k)), ones),
+                    _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(r1 + 2 * k)), ones));
+                __m256i b = _mm256_add_epi16(_mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(r0 + 2 * k + 32)), ones),
+                    _mm256_maddubs_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(r1 + 2 * k + 32)), ones));
+                a = _mm256_srli_epi16(_mm256_add_epi16(a, two), 2);
+                b = _mm256_srli_epi16(_mm256_add_epi16(b, two), 2);
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + k), pack_ordered(a, b));
+            }
+            box_2x_8u_c1_sse(r0 + 2 * k, r1 + 2 * k, dst + k, n - k);
+        }
+#endif
+
+        /**
+         * @brief destination rows [y0, y1) of a resize
+         */
+        template<class T>
+        void resize_rows(const image_view & src, const image_view & dst, const resample_taps & x_taps, const resample_taps & y_taps,
+            VIDI_UINT y0, VIDI_UINT y1, simd_level level)
+        {
+            // the taps of weight 0 past the end of a row read the zeros of the padding
+            size_t n = static_cast<size_t>(src.width()) * src.channels();
+            std::vector<float> line(n + x_taps.max_count * src.channels(), 0.f);
+            std::vector<const T *> rows(y_taps.max_count);
+
+            for (VIDI_UINT y = y0; y < y1; ++y)
+            {
+                for (VIDI_UINT t = 0; t < y_taps.max_count; ++t)
+                    rows[t] = reinterpret_cast<const T *>(src.row(std::min<VIDI_UINT>(y_taps.first[y] + t, src.height() - 1)));
+                const float * weights = &y_taps.weights[y * y_taps.max_count];
+                T * d = reinterpret_cast<T *>(dst.row(y));
+#if defined(VIDI_UTILS_X86_SIMD)
+                if (level == simd_avx2)
+                {
+                    vertical_avx2(&rows[0], weights, y_taps.max_count, &line[0], n);
+                    if (src.channels() == 1)
+                        horizontal_avx2(&line[0], d, x_taps);
+                    else
+                        horizontal_scalar(&line[0], d, x_taps, src.channels(), 0);
+                    continue;
+                }
+                if (level == simd_sse)
+                {
+                    vertical_sse(&rows[0], weights, y_taps.max_count, &line[0], n);
+                    horizontal_scalar(&line[0], d, x_taps, src.channels(), 0);
+                    continue;
+                }
+#endif
+                (void)level;
+                vertical_scalar(&rows[0], weights, y_taps.max_count, &line[0], 0, n);
+                horizontal_scalar(&line[0], d, x_taps, src.channels(), 0);
+            }
+        }
+
+        template<class T>
+        void box_2x_rows(const image_view & src, const image_view & dst, VIDI_UINT y0, VIDI_UINT y1, simd_level level)
+        {
+            VIDI_UINT c = src.channels();
+            for (VIDI_UINT y = y0; y < y1; ++y)
+            {
+                const T * r0 = reinterpret_cast<const T *>(src.row(2 * y));
+                const T * r1 = reinterpret_cast<const T *>(src.row(2 * y + 1));
+                T * d = reinterpret_cast<T *>(dst.row(y));
+#if defined(VIDI_UTILS_X86_SIMD)
+                if (sizeof(T) == 1 && c == 1 && level != simd_scalar)
+                {
+                    const uint8_t * b0 = reinterpret_cast<const uint8_t *>(r0), * b1 = reinterpret_cast<const uint8_t *>(r1);
+                    uint8_t * bd = reinterpret_cast<uint8_t *>(d);
+                    if (level == simd_avx2)
+                        box_2x_8u_c1_avx2(b0, b1, bd, dst.width());
+                    else
+                        box_2x_8u_c1_sse(b0, b1, bd, dst.width());
+                    continue;
+                }
+#endif
+                (void)level;
+                for (VIDI_UINT x = 0; x < dst.width(); ++x)
+                {
+                    for (VIDI_UINT k = 0; k < c; ++k)
+                    {
+                        size_t i = 2 * static_cast<size_t>(x) * c + k;
+                        d[x * c + k] = static_cast<T>((r0[i] + r0[i + c] + r1[i] + r1[i + c] + 2) >> 2);
+                    }
+                }
+            }
+        }
+
+        /**
+         * @brief calls f(y0, y1) on bands of rows, from the threads of the pool when there is one
+         */
+        template<class F>
+        void for_each_band(VIDI_UINT height, thread_pool * pool, F f)
+        {
+            if (!pool || pool->size() == 1)
+            {
+                f(0, height);
+                return;
+            }
+            // about 4 bands per thread, bands of at least 16 rows
+            size_t band = std::max<size_t>(16, height / (4 * pool->size()));
+            pool->parallel_for(height, band, [&f](size_t y0, size_t y1) { f(static_cast<VIDI_UINT>(y0), static_cast<VIDI_UINT>(y1)); });
+        }
+
+        inline bool resample_formats_match(const image_view & src, const image_view & dst)
+        {
+            return !src.empty() && !dst.empty() && src.channels() == dst.channels() && src.channel_depth() == dst.channel_depth()
+                && (src.channel_depth() == VIDI_IMG_8U || src.channel_depth() == VIDI_IMG_16U);
+        }
+    }
+
+    /**
+     * @brief resizes src to the size of dst
+     */
+    inline bool resize(const image_view & src, const image_view & dst, resample_method method,
+        thread_pool * pool = 0, simd_level level = best_simd_level())
+    {
+        if (!detail::resample_formats_match(src, dst))
+            return false;
+
+        detail::resample_taps x_taps = detail::make_taps(src.width(), dst.width(), method);
+        detail::resample_taps y_taps = detail::make_taps(src.height(), dst.height(), method);
+        detail::for_each_band(dst.height(), pool, [&](VIDI_UINT y0, VIDI_UINT y1)
+        {
+            if (src.channel_depth() == VIDI_IMG_8U)
+                detail::resize_rows<uint8_t>(src, dst, x_taps, y_taps, y0, y1, level);
+            else
+                detail::resize_rows<uint16_t>(src, dst, x_taps, y_taps, y0, y1, level);
+        });
+        return true;
+    }
+
+    /**
+     * @brief averages the blocks of 2x2 pixels of src into dst, of half its size rounded down
+     */
+    inline bool downscale_2x(const image_view & src, const image_view & dst,
+        thread_pool * pool = 0, simd_level level = best_simd_level())
+    {
+        if (!detail::resample_formats_match(src, dst) || dst.width() != src.width() / 2 || dst.height() != src.height() / 2)
+            return false;
+
+        detail::for_each_band(dst.height(), pool, [&](VIDI_UINT y0, VIDI_UINT y1)
+        {
+            if (src.channel_depth() == VIDI_IMG_8U)
+                detail::box_2x_rows<uint8_t>(src, dst, y0, y1, level);
+            else
+                detail::box_2x_rows<uint16_t>(src, dst, y0, y1, level);
+        });
+        return true;
+    }
+
+    /**
+     * @brief an image followed by its successive 2x downscalings
+     *
+     * Level 0 is a copy of the source; the buffers are kept from one build() to the next while
+     * the sizes do not change.
+     */
+    class image_pyramid
+    {
+    public:
+        image_pyramid() {}
+
+        /**
+         * @param n_levels number of levels including the source, fewer when an image gets smaller than 1x1
+         */
+        bool build(const image_view & src, size_t n_levels, thread_pool * pool = 0, simd_level level = best_simd_level())
+        {
+            if (!detail::resample_formats_match(src, src) || !n_levels)
+                return false;
+
+            m_levels.resize(n_levels);
+            m_buffers.resize(n_levels);
+            size_t n = 0;
+            for (VIDI_UINT w = src.width(), h = src.height(); n < n_levels && w && h; ++n, w /= 2, h /= 2)
+            {
+                // rows padded to 64 bytes
+                size_t step = (w * src.pixel_size() + 63) & ~static_cast<size_t>(63);
+                m_buffers[n].resize(step * h);
+                m_levels[n] = image_view(&m_buffers[n][0], w, h, src.channels(), src.channel_depth(), static_cast<VIDI_UINT>(step));
+                if (n == 0)
+                    copy_pixels(src, m_levels[0]);
+                else
+                    downscale_2x(m_levels[n - 1], m_levels[n], pool, level);
+            }
+            m_levels.resize(n);
+            m_buffers.resize(n);
+            return true;
+        }
+
+        size_t size() const { return m_levels.size(); }
+        const image_view & level(size_t k) const { return m_levels[k]; }
+
+        /**
+         * @brief the level as an image for the library, valid until the next build()
+         */
+        VIDI_IMAGE image(size_t k) const { return m_levels[k].image(); }
+
+    private:
+        image_pyramid(const image_pyramid &);
+        image_pyramid & operator=(const image_pyramid &);
+
+        std::vector<image_view> m_levels;
+        std::vector<std::vector<unsigned char> > m_buffers;
+    };
+}
+
+#endif
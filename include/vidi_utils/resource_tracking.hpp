@@ -0,0 +1,265 @@
+/**
+ * @file resource_tracking.hpp
+ * @brief Optional accounting of the VIDI_BUFFER and VIDI_IMAGE objects alive in a process
+ *
+ * vidi_deinitialize() frees whatever was not freed before, so a buffer or image that is never
+ * freed in a long running process only shows up as memory growth after a long time. Using
+ * the macros below instead of calling the library directly:
+ *
+ *     VIDI_INIT_BUFFER(&buffer);  VIDI_FREE_BUFFER(&buffer);
+ *     VIDI_INIT_IMAGE(&image);    VIDI_FREE_IMAGE(&image);
+ *
+ * and defining VIDI_UTILS_TRACK_RESOURCES before including this file records, for every
+ * place in the code that initializes an object, how many are alive, how many bytes they
+ * hold and the high-water marks of both. VIDI_REPORT_LEAKS(os) lists the ones still alive,
+ * typically right before vidi_deinitialize().
+ *
+ * Without VIDI_UTILS_TRACK_RESOURCES the macros are the plain library calls.
+ *
+ * The library grows buffers and fills images after they are initialized, so their size is
+ * sampled when they are freed, or earlier with VIDI_TRACK_SIZE(&object).
+ */
+
+#ifndef VIDI_UTILS_RESOURCE_TRACKING_HPP_INCLUDED
+#define VIDI_UTILS_RESOURCE_TRACKING_HPP_INCLUDED
+
+#include "vidi.h"
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace vidi_utils
+{
+    /**
+     * @brief counters of one place in the code initializing buffers or images
+     */
+    struct resource_site_stats
+    {
+        resource_site_stats()
+            : kind("")
+            , file("")
+            , line(0)
+            , created(0)
+            , live(0)
+            , live_bytes(0)
+            , reinitialized(0)
+            , high_water_live(0)
+            , high_water_bytes(0)
+        {
+        }
+
+        const char * kind;      ///< "buffer" or "image"
+        const char * file;
+        int line;
+        size_t created;         ///< objects initialized so far
+        size_t live;            ///< objects initialized and not yet freed
+        size_t live_bytes;      ///< last known size of the live objects
+        size_t reinitialized;   ///< objects initialized again elsewhere before being freed, whatever they held is leaked
+        size_t high_water_live;
+        size_t high_water_bytes;
+    };
+
+    class resource_tracker
+    {
+    public:
+        static resource_tracker & instance()
+        {
+            static resource_tracker tracker;
+            return tracker;
+        }
+
+        static size_t size_of(const VIDI_BUFFER * buffer)
+        {
+            return buffer->data ? buffer->size : 0;
+        }
+
+        /// step is the size of a row in bytes
+        static size_t size_of(const VIDI_IMAGE * image)
+        {
+            return image->data ? static_cast<size_t>(image->step) * image->height : 0;
+        }
+
+        void on_init(const void * object, const char * kind, const char * file, int line)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            // an object initialized again without being freed no longer counts as alive at its previous site,
+            // whatever it held is lost and reported as such
+            std::map<const void *, live_object>::iterator previous = m_live.find(object);
+            if (previous != m_live.end())
+            {
+                resource_site_stats & lost = m_sites[previous->second.site];
+                --lost.live;
+                lost.live_bytes -= previous->second.bytes;
+                ++lost.reinitialized;
+            }
+
+            site_key key(file, line);
+            resource_site_stats & site = m_sites[key];
+            site.kind = kind;
+            site.file = file;
+            site.line = line;
+            ++site.created;
+            ++site.live;
+            if (site.live > site.high_water_live)
+                site.high_water_live = site.live;
+
+            m_live[object] = live_object(key, 0);
+        }
+
+        void on_size(const void * object, size_t bytes)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::map<const void *, live_object>::iterator it = m_live.find(object);
+            if (it == m_live.end())
+                return;
+            resource_site_stats & site = m_sites[it->second.site];
+            site.live_bytes = site.live_bytes - it->second.bytes + bytes;
+            it->second.bytes = bytes;
+            if (site.live_bytes > site.high_water_bytes)
+                site.high_water_bytes = site.live_bytes;
+        }
+
+        void on_free(const void * object, size_t bytes)
+        {
+            on_size(object, bytes);
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::map<const void *, live_object>::iterator it = m_live.find(object);
+            if (it == m_live.end())
+                return;
+            resource_site_stats & site = m_sites[it->second.site];
+            --site.live;
+            site.live_bytes -= it->second.bytes;
+            m_live.erase(it);
+        }
+
+        /**
+         * @brief copy of the counters of every site
+         */
+        std::vector<resource_site_stats> snapshot() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::vector<resource_site_stats> sites;
+            for (std::map<site_key, resource_site_stats>::const_iterator it = m_sites.begin(); it != m_sites.end(); ++it)
+                sites.push_back(it->second);
+            return sites;
+        }
+
+        /**
+         * @brief prints the sites whose objects are still alive or were initialized again before being freed
+         *
+         * @return the number of objects still alive or initialized again
+         */
+        size_t report_leaks(std::ostream & os) const
+        {
+            size_t leaked = 0;
+            std::vector<resource_site_stats> sites = snapshot();
+            for (size_t k = 0; k < sites.size(); ++k)
+            {
+                if (!sites[k].live && !sites[k].reinitialized)
+                    continue;
+                leaked += sites[k].live + sites[k].reinitialized;
+                os << sites[k].file << "(" << sites[k].line << "): ";
+                if (sites[k].live)
+                    os << sites[k].live << " " << sites[k].kind << "(s) of " << sites[k].created << " never freed, "
+                        << sites[k].live_bytes << " bytes";
+                if (sites[k].live && sites[k].reinitialized)
+                    os << ", ";
+                if (sites[k].reinitialized)
+                    os << sites[k].reinitialized << " " << sites[k].kind << "(s) of " << sites[k].created
+                        << " initialized again before being freed";
+                os << std::endl;
+            }
+            return leaked;
+        }
+
+        /**
+         * @brief prints the counters of every site
+         */
+        void report(std::ostream & os) const
+        {
+            std::vector<resource_site_stats> sites = snapshot();
+            for (size_t k = 0; k < sites.size(); ++k)
+            {
+                os << sites[k].file << "(" << sites[k].line << "): " << sites[k].kind << " created " << sites[k].created
+                    << ", live " << sites[k].live << " (" << sites[k].live_bytes << " bytes), high-water "
+                    << sites[k].high_water_live << " (" << sites[k].high_water_bytes << " bytes)" << std::endl;
+            }
+        }
+
+    private:
+        typedef std::pair<std::string, int> site_key;
+
+        struct live_object
+        {
+            live_object() : bytes(0) {}
+            live_object(const site_key & s, size_t b) : site(s), bytes(b) {}
+
+            site_key site;
+            size_t bytes;
+        };
+
+        std::map<site_key, resource_site_stats> m_sites;
+        std::map<const void *, live_object> m_live;
+        mutable std::mutex m_mutex;
+    };
+
+    inline VIDI_UINT tracked_init_buffer(VIDI_BUFFER * buffer, const char * file, int line)
+    {
+        VIDI_UINT status = vidi_init_buffer(buffer);
+        if (status == VIDI_SUCCESS)
+            resource_tracker::instance().on_init(buffer, "buffer", file, line);
+        return status;
+    }
+
+    inline VIDI_UINT tracked_free_buffer(VIDI_BUFFER * buffer)
+    {
+        resource_tracker::instance().on_free(buffer, resource_tracker::size_of(buffer));
+        return vidi_free_buffer(buffer);
+    }
+
+    inline VIDI_UINT tracked_init_image(VIDI_IMAGE * image, const char * file, int line)
+    {
+        VIDI_UINT status = vidi_init_image(image);
+        if (status == VIDI_SUCCESS)
+            resource_tracker::instance().on_init(image, "image", file, line);
+        return status;
+    }
+
+    inline VIDI_UINT tracked_free_image(VIDI_IMAGE * image)
+    {
+        resource_tracker::instance().on_free(image, resource_tracker::size_of(image));
+        return vidi_free_image(image);
+    }
+
+    /**
+     * @brief what VIDI_REPORT_LEAKS() does without VIDI_UTILS_TRACK_RESOURCES
+     */
+    inline size_t untracked_leaks(std::ostream &)
+    {
+        return 0;
+    }
+}
+
+#ifdef VIDI_UTILS_TRACK_RESOURCES
+    #define VIDI_INIT_BUFFER(buffer) vidi_utils::tracked_init_buffer((buffer), __FILE__, __LINE__)
+    #define VIDI_FREE_BUFFER(buffer) vidi_utils::tracked_free_buffer(buffer)
+    #define VIDI_INIT_IMAGE(image) vidi_utils::tracked_init_image((image), __FILE__, __LINE__)
+    #define VIDI_FREE_IMAGE(image) vidi_utils::tracked_free_image(image)
+    #define VIDI_TRACK_SIZE(object) vidi_utils::resource_tracker::instance().on_size((object), vidi_utils::resource_tracker::size_of(object))
+    #define VIDI_REPORT_LEAKS(os) vidi_utils::resource_tracker::instance().report_leaks(os)
+#else
+    #define VIDI_INIT_BUFFER(buffer) vidi_init_buffer(buffer)
+    #define VIDI_FREE_BUFFER(buffer) vidi_free_buffer(buffer)
+    #define VIDI_INIT_IMAGE(image) vidi_init_image(image)
+    #define VIDI_FREE_IMAGE(image) vidi_free_image(image)
+    #define VIDI_TRACK_SIZE(object) ((void)0)
+    #define VIDI_REPORT_LEAKS(os) vidi_utils::untracked_leaks(os)
+#endif
+
+#endif
@@ -0,0 +1,213 @@
+/**
+ * @file result.hpp
+ * @brief Exception-free result type holding either a value or a vidi_utils::error
+ *
+ * result<T> lets steps of a processing sequence be chained instead of repeating
+ * "if (status != VIDI_SUCCESS) { ...; return -1; }" after every call:
+ *
+ *     check(vidi_runtime_create_sample("ws", "default", "s"), "failed to create sample")
+ *         .and_then([&] { return check(vidi_runtime_sample_add_image("ws", "default", "s", &image), "failed to add image"); })
+ *         .and_then([&] { return check(vidi_runtime_sample_process("ws", "default", "analyze", "s", ""), "failed to process sample"); });
+ *
+ * The first failure is carried through the rest of the chain, whose steps are skipped.
+ * The value is stored in place, so nothing is allocated on the success path, and building a
+ * failure is kept out of line so the compiler lays out the success path as the hot one.
+ */
+
+#ifndef VIDI_UTILS_RESULT_HPP_INCLUDED
+#define VIDI_UTILS_RESULT_HPP_INCLUDED
+
+#include "vidi.h"
+#include "error.hpp"
+
+#include <cassert>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#if defined(__GNUC__)
+    #define VIDI_UTILS_LIKELY(x) __builtin_expect(!!(x), 1)
+    #define VIDI_UTILS_COLD __attribute__((cold, noinline))
+#elif defined(_MSC_VER)
+    #define VIDI_UTILS_LIKELY(x) (x)
+    #define VIDI_UTILS_COLD __declspec(noinline)
+#else
+    #define VIDI_UTILS_LIKELY(x) (x)
+    #define VIDI_UTILS_COLD
+#endif
+
+namespace vidi_utils
+{
+    /**
+     * @brief either a value of type T or the error that prevented computing it
+     */
+    template<class T>
+    class result
+    {
+    public:
+        typedef T value_type;
+
+        result(const T & value)
+        {
+            new (&m_storage) T(value);
+        }
+
+        result(T && value)
+        {
+            new (&m_storage) T(std::move(value));
+        }
+
+        result(const vidi_utils::error & e)
+            : m_error(e)
+        {
+            assert(e.failed());
+        }
+
+        result(const result & other)
+            : m_error(other.m_error)
+        {
+            if (other.ok())
+                new (&m_storage) T(*other.ptr());
+        }
+
+        result(result && other)
+            : m_error(other.m_error)
+        {
+            if (other.ok())
+                new (&m_storage) T(std::move(*other.ptr()));
+        }
+
+        ~result()
+        {
+            if (ok())
+                ptr()->~T();
+        }
+
+        result & operator=(result other)
+        {
+            if (ok())
+                ptr()->~T();
+            m_error = other.m_error;
+            if (other.ok())
+                new (&m_storage) T(std::move(*other.ptr()));
+            return *this;
+        }
+
+        bool ok() const { return !m_error.failed(); }
+        explicit operator bool() const { return ok(); }
+
+        T & value() { assert(ok()); return *ptr(); }
+        const T & value() const { assert(ok()); return *ptr(); }
+
+        T value_or(T fallback) const { return ok() ? *ptr() : fallback; }
+
+        /**
+         * @brief the error, whose status is VIDI_SUCCESS if a value is held
+         */
+        const vidi_utils::error & error() const { return m_error; }
+
+        /**
+         * @brief calls f(value), which returns a result, or passes the error on without calling it
+         */
+        template<class F>
+        decltype(std::declval<F &>()(std::declval<T &>())) and_then(F f)
+        {
+            typedef decltype(std::declval<F &>()(std::declval<T &>())) next;
+            if (VIDI_UTILS_LIKELY(ok()))
+                return f(*ptr());
+            return next(m_error);
+        }
+
+        /**
+         * @brief wraps f(value), which returns a plain value, or passes the error on without calling it
+         */
+        template<class F>
+        result<decltype(std::declval<F &>()(std::declval<T &>()))> map(F f)
+        {
+            typedef result<decltype(std::declval<F &>()(std::declval<T &>()))> next;
+            if (VIDI_UTILS_LIKELY(ok()))
+                return next(f(*ptr()));
+            return next(m_error);
+        }
+
+    private:
+        T * ptr() { return reinterpret_cast<T *>(&m_storage); }
+        const T * ptr() const { return reinterpret_cast<const T *>(&m_storage); }
+
+        typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type m_storage;
+        vidi_utils::error m_error;
+    };
+
+    /**
+     * @brief outcome of a step producing no value
+     */
+    template<>
+    class result<void>
+    {
+    public:
+        typedef void value_type;
+
+        result()
+        {
+        }
+
+        result(const vidi_utils::error & e)
+            : m_error(e)
+        {
+        }
+
+        bool ok() const { return !m_error.failed(); }
+        explicit operator bool() const { return ok(); }
+
+        const vidi_utils::error & error() const { return m_error; }
+
+        /**
+         * @brief calls f(), which returns a result, or passes the error on without calling it
+         */
+        template<class F>
+        decltype(std::declval<F &>()()) and_then(F f)
+        {
+            typedef decltype(std::declval<F &>()()) next;
+            if (VIDI_UTILS_LIKELY(ok()))
+                return f();
+            return next(m_error);
+        }
+
+        /**
+         * @brief wraps f(), which returns a plain value, or passes the error on without calling it
+         */
+        template<class F>
+        result<decltype(std::declval<F &>()())> map(F f)
+        {
+            typedef result<decltype(std::declval<F &>()())> next;
+            if (VIDI_UTILS_LIKELY(ok()))
+                return next(f());
+            return next(m_error);
+        }
+
+    private:
+        vidi_utils::error m_error;
+    };
+
+    namespace detail
+    {
+        VIDI_UTILS_COLD inline result<void> failure(VIDI_UINT status, const char * context)
+        {
+            return result<void>(error(status, context));
+        }
+    }
+
+    /**
+     * @brief turns the status returned by a library call into a result
+     *
+     * @param context static string printed with the error, e.g. "failed to process sample"
+     */
+    inline result<void> check(VIDI_UINT status, const char * context = 0)
+    {
+        if (VIDI_UTILS_LIKELY(status == VIDI_SUCCESS))
+            return result<void>();
+        return detail::failure(status, context);
+    }
+}
+
+#endif
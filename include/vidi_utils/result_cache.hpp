@@ -0,0 +1,240 @@
+/**
+ * @file result_cache.hpp
+ * @brief Cache of processing results keyed by the content of the image, to skip identical frames
+ *
+ * On conveyor lines the same frame is often sent again, or inspected again. result_cache keeps
+ * the xml returned by vidi_runtime_get_sample(), keyed by the hash of the pixels together with
+ * the workspace, stream, tool and parameters it was computed with, and returns it instead of
+ * processing the sample again:
+ *
+ *     vidi_utils::result_cache cache(64 << 20);
+ *     std::string xml;
+ *     auto processed = cache.process("workspace", "default", "analyze", "my_sample", "", &image, xml);
+ *
+ * Entries are dropped least recently used first once their total size goes over the limit.
+ * Two frames are taken as identical when their 64-bit content hashes are equal; accidental
+ * collisions are possible in principle but far less likely than a bit flip on the way from the
+ * camera. The cache is thread-safe.
+ */
+
+#ifndef VIDI_UTILS_RESULT_CACHE_HPP_INCLUDED
+#define VIDI_UTILS_RESULT_CACHE_HPP_INCLUDED
+
+#include "vidi_runtime.h"
+#include "buffer_view.hpp"
+#include "content_hash.hpp"
+#include "image_view.hpp"
+#include "runtime.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+
+namespace vidi_utils
+{
+    /**
+     * @brief what identifies a result: the image and everything it was processed with
+     */
+    struct result_key
+    {
+        uint64_t content;       ///< hash of the size, format and pixels of the image
+        std::string context;    ///< workspace, stream, tool and parameters, separated by zeros
+
+        bool operator<(const result_key & other) const
+        {
+            return content != other.content ? content < other.content : context < other.context;
+        }
+    };
+
+    inline result_key make_result_key(const char * workspace, const char * stream, const char * tool, const char * parameters,
+        const image_view & image, simd_level level = best_simd_level())
+    {
+        result_key key;
+        key.content = hash_pixels(image, level);
+        const char * parts[] = { workspace, stream, tool, parameters };
+        for (size_t k = 0; k < 4; ++k)
+        {
+            key.context += parts[k] ? parts[k] : "";
+            key.context += '\0';
+        }
+        return key;
+    }
+
+    struct result_cache_stats
+    {
+        result_cache_stats()
+            : hits(0)
+            , misses(0)
+            , insertions(0)
+            , evictions(0)
+            , entries(0)
+            , bytes(0)
+        {
+        }
+
+        size_t hits;            ///< lookups answered from the cache
+        size_t misses;          ///< lookups that had to process the sample
+        size_t insertions;
+        size_t evictions;       ///< entries dropped to stay under the size limit
+        size_t entries;
+        size_t bytes;           ///< size of the cached xml and keys
+
+        double hit_rate() const { return hits + misses ? double(hits) / (hits + misses) : 0; }
+    };
+
+    class result_cache
+    {
+    public:
+        /**
+         * @param max_bytes limit on the total size of the cached results and their keys
+         */
+        explicit result_cache(size_t max_bytes = 64 << 20)
+            : m_max_bytes(max_bytes)
+        {
+        }
+
+        /**
+         * @brief copies the result stored for the key to xml, counting a hit or a miss
+         */
+        bool find(const result_key & key, std::string & xml)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::map<result_key, entry>::iterator it = m_entries.find(key);
+            if (it == m_entries.end())
+            {
+                ++m_stats.misses;
+                return false;
+            }
+            ++m_stats.hits;
+            m_lru.splice(m_lru.begin(), m_lru, it->second.position);
+            xml = it->second.xml;
+            return true;
+        }
+
+        /**
+         * @brief stores a result, replacing the one already stored for the key; results larger than the limit are not stored
+         */
+        void insert(const result_key & key, const std::string & xml)
+        {
+            size_t size = entry_size(key, xml);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::map<result_key, entry>::iterator it = m_entries.find(key);
+            if (it != m_entries.end())
+                erase(it);
+            if (size > m_max_bytes)
+                return;
+
+            while (m_stats.bytes + size > m_max_bytes)
+            {
+                erase(m_entries.find(m_lru.back()));
+                ++m_stats.evictions;
+            }
+            m_lru.push_front(key);
+            entry e = { xml, m_lru.begin() };
+            m_entries.insert(std::make_pair(key, e));
+            m_stats.bytes += size;
+            ++m_stats.entries;
+            ++m_stats.insertions;
+        }
+
+        /**
+         * @brief returns the result of processing the image with the tool, from the cache if it is there
+         *
+         * On a miss the sample is created, the image added and the tool processed; the sample
+         * is freed before returning, and the result stored if processing succeeded.
+         *
+         * @return whether the result came from the cache, or the error of the first step that failed
+         */
+        result<bool> process(const char * workspace, const char * stream, const char * tool, const char * sample,
+            const char * parameters, VIDI_IMAGE * image, std::string & xml)
+        {
+            result_key key = make_result_key(workspace, stream, tool, parameters, image_view(*image));
+            if (find(key, xml))
+                return true;
+
+            VIDI_BUFFER buffer;
+            vidi_init_buffer(&buffer);
+            auto created = runtime::create_sample(workspace, stream, sample);
+            auto processed = created
+                .and_then([&] { return runtime::sample_add_image(workspace, stream, sample, image); })
+                .and_then([&] { return runtime::sample_process(workspace, stream, tool, sample, parameters); })
+                .and_then([&] { return runtime::get_sample(workspace, stream, sample, &buffer); });
+            if (processed)
+            {
+                buffer_view view(buffer);
+                xml.assign(view.data(), view.size());
+                insert(key, xml);
+            }
+            vidi_free_buffer(&buffer);
+
+            if (created)
+            {
+                auto freed = runtime::free_sample(workspace, stream, sample);
+                if (processed && !freed)
+                    return freed.error();
+            }
+            if (!processed)
+                return processed.error();
+            return false;
+        }
+
+        result_cache_stats stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_stats;
+        }
+
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_entries.clear();
+            m_lru.clear();
+            m_stats.entries = 0;
+            m_stats.bytes = 0;
+        }
+
+        void report(std::ostream & os) const
+        {
+            result_cache_stats s = stats();
+            os << "result cache: " << s.hits << " hits, " << s.misses << " misses (" << 100 * s.hit_rate() << "% hit rate), "
+                << s.entries << " entries, " << s.bytes / 1024 << " KB, " << s.evictions << " evicted" << std::endl;
+        }
+
+    private:
+        result_cache(const result_cache &);
+        result_cache & operator=(const result_cache &);
+
+        struct entry
+        {
+            std::string xml;
+            std::list<result_key>::iterator position;
+        };
+
+        /// the xml and the key, plus about what the map and list nodes take
+        static size_t entry_size(const result_key & key, const std::string & xml)
+        {
+            return xml.size() + 2 * key.context.size() + 128;
+        }
+
+        void erase(std::map<result_key, entry>::iterator it)
+        {
+            m_stats.bytes -= entry_size(it->first, it->second.xml);
+            --m_stats.entries;
+            m_lru.erase(it->second.position);
+            m_entries.erase(it);
+        }
+
+        size_t m_max_bytes;
+        std::map<result_key, entry> m_entries;
+        std::list<result_key> m_lru;
+        result_cache_stats m_stats;
+        mutable std::mutex m_mutex;
+    };
+}
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * @file runtime.hpp
+ * @brief result returning wrappers of the runtime library calls
+ *
+ * Each wrapper forwards to the C function of the same name and attaches the usual message of
+ * the examples to its status, so that a processing sequence can be written as one chain:
+ *
+ *     runtime::create_sample("workspace", "default", "my_sample")
+ *         .and_then([&] { return runtime::sample_add_image("workspace", "default", "my_sample", &image); })
+ *         .and_then([&] { return runtime::sample_process("workspace", "default", "analyze", "my_sample", ""); })
+ *         .and_then([&] { return runtime::get_sample("workspace", "default", "my_sample", &buffer); });
+ */
+
+#ifndef VIDI_UTILS_RUNTIME_HPP_INCLUDED
+#define VIDI_UTILS_RUNTIME_HPP_INCLUDED
+
+#include "vidi_runtime.h"
+#include "result.hpp"
+
+namespace vidi_utils
+{
+    namespace runtime
+    {
+        inline result<void> debug_infos(VIDI_UINT sink, const char * path)
+        {
+            return check(vidi_debug_infos(sink, path), "failed to enable debug infos");
+        }
+
+        inline result<void> initialize(VIDI_UINT gpu_mode, const char * devices)
+        {
+            return check(vidi_initialize(gpu_mode, devices), "failed to initialize library");
+        }
+
+        inline result<void> init_buffer(VIDI_BUFFER * buffer)
+        {
+            return check(vidi_init_buffer(buffer), "failed to initialize vidi buffer");
+        }
+
+        inline result<void> init_image(VIDI_IMAGE * image)
+        {
+            return check(vidi_init_image(image), "failed to initialize image");
+        }
+
+        inline result<void> load_image(const char * path, VIDI_IMAGE * image)
+        {
+            return check(vidi_load_image(path, image), "failed to read image");
+        }
+
+        inline result<void> open_workspace_from_file(const char * workspace, const char * path)
+        {
+            return check(vidi_runtime_open_workspace_from_file(workspace, path), "failed to open workspace");
+        }
+
+        inline result<void> create_sample(const char * workspace, const char * stream, const char * sample)
+        {
+            return check(vidi_runtime_create_sample(workspace, stream, sample), "failed to initialize sample");
+        }
+
+        inline result<void> sample_add_image(const char * workspace, const char * stream, const char * sample, VIDI_IMAGE * image)
+        {
+            return check(vidi_runtime_sample_add_image(workspace, stream, sample, image), "failed to add image");
+        }
+
+        inline result<void> sample_process(const char * workspace, const char * stream, const char * tool, const char * sample, const char * parameters)
+        {
+            return check(vidi_runtime_sample_process(workspace, stream, tool, sample, parameters), "failed to process sample");
+        }
+
+        inline result<void> get_sample(const char * workspace, const char * stream, const char * sample, VIDI_BUFFER * buffer)
+        {
+            return check(vidi_runtime_get_sample(workspace, stream, sample, buffer), "failed to get results from sample");
+        }
+
+        inline result<void> free_sample(const char * workspace, const char * stream, const char * sample)
+        {
+            return check(vidi_runtime_free_sample(workspace, stream, sample), "failed to free sample");
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,427 @@
+/**
+ * @file sample_pool.hpp
+ * @brief Named runtime samples created once per worker and reused from frame to frame
+ *
+ * The examples create a sample, add the image, process it and free the sample for every
+ * frame, building the name of the sample with string concatenation each time. sample_pool
+ * builds the names once, creates the samples once, and lends them out as handles:
+ *
+ *     vidi_utils::sample_pool samples("workspace", "default", n_workers);
+ *     samples.create();
+ *     ...
+ *     // worker k
+ *     vidi_utils::sample_handle sample = samples.acquire(k);
+ *     auto processed = sample.add_image(frame.get())
+ *         .and_then([&] { return sample.process("analyze"); });
+ *     // the handle gives the sample back when it goes out of scope
+ *
+ * acquire() only returns an empty handle once every slot of the worker is lent out, which
+ * happens when a worker holds several samples at once, for instance while pipelining.
+ * Every worker has its own slots, so that workers do not contend for them, and a slot is
+ * identified by its index: the names, "sample_<worker>_<slot>", are only built by the pool.
+ *
+ * With sample_recreate, the default, a slot frees its sample on release and creates it again
+ * for the next frame, as the examples do, and only the names are saved. With sample_keep, a
+ * slot keeps its sample from one frame to the next, which relies on
+ * vidi_runtime_sample_add_image() replacing the image of a sample that already has one. The
+ * library documentation does not say so: if a version adds the image next to the previous
+ * ones instead, a kept sample grows with every frame and its results mix several frames.
+ * Check it for the library version in use before turning sample_keep on; Example.Cpp.SamplePool
+ * compares the results of a kept sample with those of a fresh one. A slot where a call failed
+ * is freed and created again before its next use, so that an error does not carry over.
+ */
+
+#ifndef VIDI_UTILS_SAMPLE_POOL_HPP_INCLUDED
+#define VIDI_UTILS_SAMPLE_POOL_HPP_INCLUDED
+
+#include "vidi_runtime.h"
+#include "result.hpp"
+#include "runtime.hpp"
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace vidi_utils
+{
+    enum sample_recycling
+    {
+        sample_keep,        ///< samples live as long as the pool, for library versions where adding an image replaces the previous one
+        sample_recreate     ///< samples are created on first use and freed on release
+    };
+
+    struct sample_pool_options
+    {
+        sample_pool_options()
+            : slots_per_worker(2)
+            , recycling(sample_recreate)
+            , prefix("sample_")
+        {
+        }
+
+        size_t slots_per_worker;    ///< samples a worker can hold at once
+        sample_recycling recycling;
+        std::string prefix;         ///< of the sample names, to keep them apart from the other samples of the stream
+    };
+
+    struct sample_pool_stats
+    {
+        sample_pool_stats()
+            : acquired(0)
+            , exhausted(0)
+            , created(0)
+            , freed(0)
+            , failed(0)
+        {
+        }
+
+        size_t acquired;            ///< handles handed out
+        size_t exhausted;           ///< acquire() calls finding every slot of the worker in use
+        size_t created;             ///< samples created
+        size_t freed;               ///< samples freed
+        size_t failed;              ///< calls through a handle that failed, whose sample was then recreated
+
+        /**
+         * @brief acquisitions which found their sample already created
+         */
+        size_t reused() const { return acquired > created ? acquired - created : 0; }
+    };
+
+    class sample_pool;
+
+    /**
+     * @brief move-only loan of a sample of the pool, given back on destruction
+     */
+    class sample_handle
+    {
+    public:
+        sample_handle()
+            : m_pool(0)
+            , m_worker(0)
+            , m_slot(0)
+        {
+        }
+
+        sample_handle(sample_handle && other)
+            : m_pool(other.m_pool)
+            , m_worker(other.m_worker)
+            , m_slot(other.m_slot)
+        {
+            other.m_pool = 0;
+        }
+
+        sample_handle & operator=(sample_handle && other)
+        {
+            if (this != &other)
+            {
+                release();
+                m_pool = other.m_pool;
+                m_worker = other.m_worker;
+                m_slot = other.m_slot;
+                other.m_pool = 0;
+            }
+            return *this;
+        }
+
+        ~sample_handle()
+        {
+            release();
+        }
+
+        /**
+         * @brief false if every slot of the worker was in use; the other calls need a sample
+         */
+        explicit operator bool() const { return m_pool != 0; }
+
+        const char * name() const;
+        size_t worker() const { return m_worker; }
+        size_t slot() const { return m_slot; }
+
+        result<void> add_image(VIDI_IMAGE * image);
+        result<void> process(const char * tool, const char * parameters = "");
+        result<void> get_sample(VIDI_BUFFER * buffer);
+
+        /**
+         * @brief gives the sample back before the handle is destroyed
+         */
+        void release();
+
+    private:
+        friend class sample_pool;
+
+        sample_handle(sample_pool * pool, size_t worker, size_t slot)
+            : m_pool(pool)
+            , m_worker(worker)
+            , m_slot(slot)
+        {
+        }
+
+        sample_handle(const sample_handle &);
+        sample_handle & operator=(const sample_handle &);
+
+        template<class F>
+        result<void> call(F f);
+
+        sample_pool * m_pool;
+        size_t m_worker;
+        size_t m_slot;
+    };
+
+    class sample_pool
+    {
+    public:
+        /**
+         * @param workspace, stream where the samples are created, kept by the pool
+         */
+        sample_pool(const std::string & workspace, const std::string & stream, size_t n_workers,
+            const sample_pool_options & options = sample_pool_options())
+            : m_workspace(workspace)
+            , m_stream(stream)
+            , m_options(options)
+        {
+            if (!m_options.slots_per_worker)
+                m_options.slots_per_worker = 1;
+            for (size_t w = 0; w < (n_workers ? n_workers : 1); ++w)
+            {
+                m_workers.push_back(std::unique_ptr<worker_slots>(new worker_slots));
+                worker_slots & ws = *m_workers.back();
+                for (size_t s = 0; s < m_options.slots_per_worker; ++s)
+                {
+                    std::ostringstream name;
+                    name << m_options.prefix << w << "_" << s;
+                    ws.slots.push_back(slot(name.str()));
+                    // the first slots are handed out first
+                    ws.idle.push_back(m_options.slots_per_worker - 1 - s);
+                }
+            }
+        }
+
+        /**
+         * @brief frees the samples; the handles must have been released
+         */
+        ~sample_pool()
+        {
+            for (size_t w = 0; w < m_workers.size(); ++w)
+            {
+                for (size_t s = 0; s < m_workers[w]->slots.size(); ++s)
+                {
+                    if (m_workers[w]->slots[s].created)
+                        vidi_runtime_free_sample(m_workspace.c_str(), m_stream.c_str(), m_workers[w]->slots[s].name.c_str());
+                }
+            }
+        }
+
+        /**
+         * @brief creates every sample up front with sample_keep, so that the first frames do not pay for it
+         */
+        result<void> create()
+        {
+            if (m_options.recycling != sample_keep)
+                return result<void>();
+            for (size_t w = 0; w < m_workers.size(); ++w)
+            {
+                std::lock_guard<std::mutex> lock(m_workers[w]->mutex);
+                for (size_t s = 0; s < m_workers[w]->slots.size(); ++s)
+                {
+                    result<void> created = ensure_created(*m_workers[w], s);
+                    if (!created)
+                        return created;
+                }
+            }
+            return result<void>();
+        }
+
+        /**
+         * @brief lends a sample of the worker; a sample that does not exist yet is created by the first call of the handle
+         *
+         * @return the handle, empty if every slot of the worker is in use
+         */
+        sample_handle acquire(size_t worker)
+        {
+            worker %= m_workers.size();
+            worker_slots & ws = *m_workers[worker];
+            std::lock_guard<std::mutex> lock(ws.mutex);
+            if (ws.idle.empty())
+            {
+                ++ws.stats.exhausted;
+                return sample_handle();
+            }
+            size_t s = ws.idle.back();
+            ws.idle.pop_back();
+            ++ws.stats.acquired;
+            return sample_handle(this, worker, s);
+        }
+
+        const std::string & workspace() const { return m_workspace; }
+        const std::string & stream() const { return m_stream; }
+        size_t workers() const { return m_workers.size(); }
+        const sample_pool_options & options() const { return m_options; }
+
+        const char * name(size_t worker, size_t slot) const
+        {
+            return m_workers[worker]->slots[slot].name.c_str();
+        }
+
+        sample_pool_stats stats() const
+        {
+            sample_pool_stats total;
+            for (size_t w = 0; w < m_workers.size(); ++w)
+            {
+                std::lock_guard<std::mutex> lock(m_workers[w]->mutex);
+                const sample_pool_stats & s = m_workers[w]->stats;
+                total.acquired += s.acquired;
+                total.exhausted += s.exhausted;
+                total.created += s.created;
+                total.freed += s.freed;
+                total.failed += s.failed;
+            }
+            return total;
+        }
+
+        void report(std::ostream & os) const
+        {
+            sample_pool_stats s = stats();
+            os << "sample pool (" << m_workers.size() << " workers x " << m_options.slots_per_worker << " slots, "
+                << (m_options.recycling == sample_keep ? "keep" : "recreate") << "): " << s.acquired << " acquired, "
+                << s.reused() << " reused, " << s.created << " created, " << s.freed << " freed, "
+                << s.exhausted << " exhausted, " << s.failed << " failed" << std::endl;
+        }
+
+    private:
+        friend class sample_handle;
+
+        sample_pool(const sample_pool &);
+        sample_pool & operator=(const sample_pool &);
+
+        struct slot
+        {
+            explicit slot(const std::string & n)
+                : name(n)
+                , created(false)
+                , failed(false)
+            {
+            }
+
+            std::string name;
+            bool created;
+            bool failed;            ///< a call failed since the sample was created
+        };
+
+        struct worker_slots
+        {
+            std::vector<slot> slots;
+            std::vector<size_t> idle;
+            sample_pool_stats stats;
+            mutable std::mutex mutex;
+        };
+
+        /// with the mutex of the worker held
+        result<void> ensure_created(worker_slots & ws, size_t s)
+        {
+            slot & sl = ws.slots[s];
+            if (sl.created)
+                return result<void>();
+            result<void> created = runtime::create_sample(m_workspace.c_str(), m_stream.c_str(), sl.name.c_str());
+            if (created)
+            {
+                sl.created = true;
+                sl.failed = false;
+                ++ws.stats.created;
+            }
+            return created;
+        }
+
+        result<void> prepare(size_t worker, size_t s)
+        {
+            worker_slots & ws = *m_workers[worker];
+            std::lock_guard<std::mutex> lock(ws.mutex);
+            return ensure_created(ws, s);
+        }
+
+        void give_back(size_t worker, size_t s)
+        {
+            worker_slots & ws = *m_workers[worker];
+            std::lock_guard<std::mutex> lock(ws.mutex);
+            slot & sl = ws.slots[s];
+            if (sl.created && (sl.failed || m_options.recycling == sample_recreate))
+            {
+                vidi_runtime_free_sample(m_workspace.c_str(), m_stream.c_str(), sl.name.c_str());
+                sl.created = false;
+                ++ws.stats.freed;
+            }
+            ws.idle.push_back(s);
+        }
+
+        void mark_failed(size_t worker, size_t s)
+        {
+            worker_slots & ws = *m_workers[worker];
+            std::lock_guard<std::mutex> lock(ws.mutex);
+            ws.slots[s].failed = true;
+            ++ws.stats.failed;
+        }
+
+        const std::string m_workspace;
+        const std::string m_stream;
+        sample_pool_options m_options;
+        std::vector<std::unique_ptr<worker_slots> > m_workers;
+    };
+
+    inline const char * sample_handle::name() const
+    {
+        return m_pool ? m_pool->name(m_worker, m_slot) : "";
+    }
+
+    /// creates the sample if needed, then calls f(workspace, stream, name), marking the slot for recreation if anything fails
+    template<class F>
+    inline result<void> sample_handle::call(F f)
+    {
+        assert(m_pool);
+        const char * workspace = m_pool->m_workspace.c_str();
+        const char * stream = m_pool->m_stream.c_str();
+        const char * sample = name();
+        result<void> r = m_pool->prepare(m_worker, m_slot).and_then([&] { return f(workspace, stream, sample); });
+        if (!r)
+            m_pool->mark_failed(m_worker, m_slot);
+        return r;
+    }
+
+    inline result<void> sample_handle::add_image(VIDI_IMAGE * image)
+    {
+        return call([&](const char * workspace, const char * stream, const char * sample)
+        {
+            return runtime::sample_add_image(workspace, stream, sample, image);
+        });
+    }
+
+    inline result<void> sample_handle::process(const char * tool, const char * parameters)
+    {
+        return call([&](const char * workspace, const char * stream, const char * sample)
+        {
+            return runtime::sample_process(workspace, stream, tool, sample, parameters);
+        });
+    }
+
+    inline result<void> sample_handle::get_sample(VIDI_BUFFER * buffer)
+    {
+        return call([&](const char * workspace, const char * stream, const char * sample)
+        {
+            return runtime::get_sample(workspace, stream, sample, buffer);
+        });
+    }
+
+    inline void sample_handle::release()
+    {
+        if (m_pool)
+        {
+            m_pool->give_back(m_worker, m_slot);
+            m_pool = 0;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,444 @@
+/**
+ * @file stage_pipeline.hpp
+ * @brief Runs the steps of an inspection as stages on their own threads, connected by bounded queues
+ *
+ * Loading, adding the image, processing, fetching, parsing and saving the results one after
+ * the other leaves every resource idle while the others work: the disk while the GPU
+ * processes, the GPU while the results are parsed. stage_pipeline gives every step its own
+ * threads, so that the steps of successive images overlap:
+ *
+ *     // the last stage saves the results: nothing is popped from the pipeline
+ *     vidi_utils::stage_pipeline<inspection> pipeline(8, true);
+ *     pipeline.add_stage("load", 2, [](inspection & i) { return load(i); });
+ *     // ordered: the single thread of the next stage saves the images in the order they were pushed
+ *     pipeline.add_stage("process", 2, [](inspection & i) { return process(i); }, true);
+ *     pipeline.add_stage("persist", 1, [](inspection & i) { return save(i); });
+ *     pipeline.start();
+ *     for (auto & path : paths)
+ *         pipeline.push(inspection(path));
+ *     pipeline.close();
+ *     pipeline.wait();
+ *     pipeline.report(std::cout);
+ *
+ * Every stage has its own number of threads and takes its items from a bounded frame_ring:
+ * a stage that falls behind fills its queue, which holds back the stages before it and, in
+ * the end, push(). An item is numbered when it is pushed; a stage marked ordered passes its
+ * items on in that order whatever the order its threads finish in, and the others pass them
+ * on as soon as they are done.
+ *
+ * The items that went through every stage wait in a last queue for pop(), which must then be
+ * called while pushing, from another thread, or the full queue holds the whole pipeline back.
+ * A pipeline whose last stage saves the results discards them instead.
+ *
+ * A stage function returning false fails the item: the following stages skip it and it does
+ * not come out of the pipeline, though it still goes through their queues so that the
+ * ordered stages know not to wait for it.
+ *
+ * report() gives, for every stage, the share of its threads' time spent in the stage
+ * function, waiting for an item and waiting for room downstream. The stage whose threads are
+ * busy the most is the bottleneck; giving it more threads, if it can use them, is what
+ * speeds the pipeline up.
+ */
+
+#ifndef VIDI_UTILS_STAGE_PIPELINE_HPP_INCLUDED
+#define VIDI_UTILS_STAGE_PIPELINE_HPP_INCLUDED
+
+#include "frame_ring.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace vidi_utils
+{
+    struct stage_stats
+    {
+        stage_stats()
+            : n_threads(0)
+            , items(0)
+            , failed(0)
+            , busy_seconds(0.0)
+            , starved_seconds(0.0)
+            , blocked_seconds(0.0)
+            , thread_seconds(0.0)
+        {
+        }
+
+        std::string name;
+        size_t n_threads;
+        size_t items;               ///< given to the stage function
+        size_t failed;              ///< for which it returned false
+        double busy_seconds;        ///< in the stage function, summed over the threads
+        double starved_seconds;     ///< waiting for an item
+        double blocked_seconds;     ///< waiting for room in the next queue, or for the items before to be ordered
+        double thread_seconds;      ///< the lifetime of the threads, summed
+
+        double utilization() const { return thread_seconds > 0 ? busy_seconds / thread_seconds : 0.0; }
+        double ms_per_item() const { return items ? busy_seconds * 1000 / items : 0.0; }
+    };
+
+    template<class T>
+    class stage_pipeline
+    {
+    public:
+        typedef std::function<bool(T &)> stage_function;
+
+        /**
+         * @param queue_capacity of the queues in front of the stages that do not give their own
+         * @param discard_output drop the items that went through every stage instead of keeping them for pop()
+         */
+        explicit stage_pipeline(size_t queue_capacity = 8, bool discard_output = false)
+            : m_queue_capacity(queue_capacity ? queue_capacity : 1)
+            , m_discard_output(discard_output)
+            , m_output(m_queue_capacity)
+            , m_next_index(0)
+            , m_started(false)
+            , m_abort(false)
+        {
+        }
+
+        /**
+         * @brief stops the threads, dropping the items still in the pipeline
+         */
+        ~stage_pipeline()
+        {
+            m_abort = true;
+            for (size_t k = 0; k < m_stages.size(); ++k)
+                m_stages[k]->input.close();
+            m_output.close();
+            join();
+        }
+
+        /**
+         * @brief appends a stage, before start()
+         *
+         * @param n_threads threads calling f, at least 1
+         * @param ordered pass the items on in the order they were pushed
+         * @param queue_capacity of the queue in front of the stage, 0 for the one of the pipeline
+         */
+        bool add_stage(const std::string & name, size_t n_threads, stage_function f, bool ordered = false, size_t queue_capacity = 0)
+        {
+            if (m_started || !f)
+                return false;
+            m_stages.push_back(std::unique_ptr<stage>(new stage(name, std::max<size_t>(1, n_threads), f, ordered,
+                queue_capacity ? queue_capacity : m_queue_capacity)));
+            return true;
+        }
+
+        bool start()
+        {
+            if (m_started || m_stages.empty())
+                return false;
+            m_started = true;
+            m_begin = std::chrono::steady_clock::now();
+            for (size_t k = 0; k < m_stages.size(); ++k)
+            {
+                m_stages[k]->running = m_stages[k]->n_threads;
+                for (size_t t = 0; t < m_stages[k]->n_threads; ++t)
+                    m_threads.push_back(std::thread([this, k] { stage_loop(k); }));
+            }
+            return true;
+        }
+
+        /**
+         * @brief enqueues an item, waiting while the first stage is behind
+         *
+         * @return false if the pipeline was not started or was closed
+         */
+        bool push(T value)
+        {
+            if (!m_started)
+                return false;
+            // the number and the position in the queue must be given together, or an ordered stage would wait for a number never pushed
+            std::lock_guard<std::mutex> lock(m_push_mutex);
+            envelope e;
+            e.index = m_next_index.load();
+            e.value = std::move(value);
+            if (!m_stages.front()->input.push(std::move(e)))
+                return false;
+            ++m_next_index;
+            return true;
+        }
+
+        /**
+         * @brief no more items; pop() returns false once the items pushed went through
+         */
+        void close()
+        {
+            if (!m_stages.empty())
+                m_stages.front()->input.close();
+            if (!m_started)
+                m_output.close();
+        }
+
+        /**
+         * @brief waits for an item that went through every stage
+         *
+         * @return false once the pipeline is closed and every item came out
+         */
+        bool pop(T & value)
+        {
+            envelope e;
+            if (!m_output.pop(e))
+                return false;
+            value = std::move(e.value);
+            return true;
+        }
+
+        /**
+         * @brief pops and drops the items, if any were kept, until the pipeline is closed and empty, then joins the threads
+         */
+        void wait()
+        {
+            envelope e;
+            while (m_output.pop(e))
+                ;
+            join();
+        }
+
+        size_t pushed() const { return m_next_index; }
+
+        std::vector<stage_stats> stats() const
+        {
+            std::vector<stage_stats> all;
+            double now = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_begin).count();
+            for (size_t k = 0; k < m_stages.size(); ++k)
+            {
+                std::lock_guard<std::mutex> lock(m_stages[k]->mutex);
+                stage_stats s = m_stages[k]->stats;
+                // the threads still running count up to now
+                s.thread_seconds += m_started ? m_stages[k]->running * now : 0.0;
+                all.push_back(s);
+            }
+            return all;
+        }
+
+        void report(std::ostream & os) const
+        {
+            std::vector<stage_stats> all = stats();
+            size_t bottleneck = 0;
+            for (size_t k = 1; k < all.size(); ++k)
+            {
+                if (all[k].utilization() > all[bottleneck].utilization())
+                    bottleneck = k;
+            }
+            double elapsed = m_started ? std::chrono::duration<double>(std::chrono::steady_clock::now() - m_begin).count() : 0.0;
+            os << "pipeline of " << all.size() << " stages: " << m_next_index << " items in " << elapsed * 1000 << " ms" << std::endl;
+            for (size_t k = 0; k < all.size(); ++k)
+            {
+                const stage_stats & s = all[k];
+                double total = s.thread_seconds > 0 ? s.thread_seconds : 1.0;
+                os << "    " << s.name << " (" << s.n_threads << (s.n_threads > 1 ? " threads" : " thread")
+                    << (m_stages[k]->ordered ? ", ordered" : "") << "): " << s.items << " items, " << s.failed << " failed, "
+                    << s.ms_per_item() << " ms each, busy " << 100 * s.utilization() << "%, starved "
+                    << 100 * s.starved_seconds / total << "%, blocked " << 100 * s.blocked_seconds / total << "%"
+                    << (k == bottleneck ? "  <- bottleneck" : "") << std::endl;
+            }
+        }
+
+    private:
+        stage_pipeline(const stage_pipeline &);
+        stage_pipeline & operator=(const stage_pipeline &);
+
+        struct envelope
+        {
+            envelope()
+                : index(0)
+                , failed(false)
+            {
+            }
+
+            // written out: Visual Studio 2013 does not generate move constructors and assignments
+            envelope(envelope && other)
+                : index(other.index)
+                , failed(other.failed)
+                , value(std::move(other.value))
+            {
+            }
+
+            envelope & operator=(envelope && other)
+            {
+                if (this != &other)
+                {
+                    index = other.index;
+                    failed = other.failed;
+                    value = std::move(other.value);
+                }
+                return *this;
+            }
+
+            uint64_t index;
+            bool failed;            ///< skipped by the following stages
+            T value;
+
+        private:
+            envelope(const envelope &);
+            envelope & operator=(const envelope &);
+        };
+
+        struct stage
+        {
+            stage(const std::string & n, size_t threads, stage_function fn, bool o, size_t capacity)
+                : f(fn)
+                , n_threads(threads)
+                , ordered(o)
+                , input(capacity)
+                , running(0)
+                , next_out(0)
+            {
+                stats.name = n;
+                stats.n_threads = threads;
+            }
+
+            stage_function f;
+            const size_t n_threads;
+            const bool ordered;
+            frame_ring<envelope> input;
+
+            mutable std::mutex mutex;
+            stage_stats stats;
+            size_t running;             ///< threads not finished yet
+            std::map<uint64_t, envelope> pending;
+            uint64_t next_out;
+        };
+
+        frame_ring<envelope> & next_queue(size_t k)
+        {
+            return k + 1 < m_stages.size() ? m_stages[k + 1]->input : m_output;
+        }
+
+        void stage_loop(size_t k)
+        {
+            typedef std::chrono::steady_clock clock;
+            stage & s = *m_stages[k];
+            frame_ring<envelope> & out = next_queue(k);
+            double busy = 0, starved = 0, blocked = 0;
+            size_t items = 0, failed = 0, unpublished = 0;
+
+            envelope e;
+            for (;;)
+            {
+                clock::time_point t0 = clock::now();
+                if (!s.input.pop(e))
+                {
+                    starved += std::chrono::duration<double>(clock::now() - t0).count();
+                    break;
+                }
+                clock::time_point t1 = clock::now();
+                if (!e.failed && !m_abort)
+                {
+                    e.failed = !s.f(e.value);
+                    ++items;
+                    failed += e.failed;
+                }
+                clock::time_point t2 = clock::now();
+                bool passed = s.ordered ? pass_ordered(s, out, e) : pass(out, e);
+                clock::time_point t3 = clock::now();
+
+                starved += std::chrono::duration<double>(t1 - t0).count();
+                busy += std::chrono::duration<double>(t2 - t1).count();
+                blocked += std::chrono::duration<double>(t3 - t2).count();
+                e = envelope();
+                if (!passed)
+                    break;
+                // publish as it goes so that a report during the run is up to date
+                if (++unpublished == 16)
+                {
+                    flush(s, busy, starved, blocked, items, failed);
+                    unpublished = 0;
+                }
+            }
+            flush(s, busy, starved, blocked, items, failed);
+
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.stats.thread_seconds += std::chrono::duration<double>(clock::now() - m_begin).count();
+            // the last thread of a stage closes the queue of the next one
+            if (--s.running == 0)
+            {
+                out.close();
+                s.pending.clear();
+            }
+        }
+
+        /**
+         * @brief failed items go on to the last stage, so that the ordered stages see every number, but do not come out
+         */
+        bool pass(frame_ring<envelope> & out, envelope & e)
+        {
+            if (&out == &m_output && (e.failed || m_discard_output))
+            {
+                // released on the stage thread, as a kept item would be by the thread popping it
+                e = envelope();
+                return true;
+            }
+            return out.push(std::move(e));
+        }
+
+        /**
+         * @brief passes the item and every following one already done, in the order of their numbers
+         *
+         * Pushing under the lock keeps the order; a full next queue holds back the other threads of the stage.
+         */
+        bool pass_ordered(stage & s, frame_ring<envelope> & out, envelope & e)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.pending.insert(std::make_pair(e.index, std::move(e)));
+            for (auto it = s.pending.find(s.next_out); it != s.pending.end(); it = s.pending.find(s.next_out))
+            {
+                bool ok = pass(out, it->second);
+                s.pending.erase(it);
+                ++s.next_out;
+                if (!ok)
+                    return false;
+            }
+            return true;
+        }
+
+        void flush(stage & s, double & busy, double & starved, double & blocked, size_t & items, size_t & failed)
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            s.stats.busy_seconds += busy;
+            s.stats.starved_seconds += starved;
+            s.stats.blocked_seconds += blocked;
+            s.stats.items += items;
+            s.stats.failed += failed;
+            busy = starved = blocked = 0;
+            items = failed = 0;
+        }
+
+        void join()
+        {
+            for (size_t k = 0; k < m_threads.size(); ++k)
+            {
+                if (m_threads[k].joinable())
+                    m_threads[k].join();
+            }
+        }
+
+        const size_t m_queue_capacity;
+        const bool m_discard_output;
+        std::vector<std::unique_ptr<stage> > m_stages;
+        frame_ring<envelope> m_output;
+
+        std::mutex m_push_mutex;
+        std::atomic<uint64_t> m_next_index;
+
+        bool m_started;
+        std::atomic<bool> m_abort;
+        std::chrono::steady_clock::time_point m_begin;
+        std::vector<std::thread> m_threads;
+    };
+}
+
+#endif
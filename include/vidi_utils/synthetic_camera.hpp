@@ -0,0 +1,389 @@
+/**
+ * @file synthetic_camera.hpp
+ * @brief Frame source producing camera-like images at a steady rate, for load tests without a camera
+ *
+ * Processing the same image in a loop keeps it in the caches and never exercises the ingest
+ * path: no frame is ever acquired, filled or handed over between threads. synthetic_camera
+ * renders a new frame, into an image_pool, at the rate of a real camera and pushes it into a
+ * frame_ring, from its own thread:
+ *
+ *     vidi_utils::image_pool images;
+ *     vidi_utils::frame_ring<vidi_utils::camera_frame> ring(8, vidi_utils::ring_drop_oldest);
+ *     vidi_utils::synthetic_camera_options options;
+ *     options.fps = 25;
+ *     vidi_utils::synthetic_camera camera(options, images, ring);
+ *     camera.start();
+ *
+ *     vidi_utils::camera_frame frame;
+ *     while (ring.pop(frame))
+ *         vidi_runtime_sample_add_image("workspace", "default", "my_sample", frame.image.get());
+ *
+ * Every frame is a textured scene shifted by a few pixels, with a slow drift of the lighting,
+ * fresh sensor noise and, now and then, a dark spot standing for a defect. The scene is
+ * rendered once; a frame copies it with its shift, drift and noise, which keeps the camera
+ * well ahead of any tool on a single core. A frame only depends on the options and its index,
+ * so that render() also gives the same frames to a test that does not need the thread.
+ *
+ * When the ring uses ring_block and the consumers fall behind, push() waits and the camera
+ * misses its schedule; the stats count those frames as late. With ring_drop_oldest the
+ * camera keeps its rate and the ring counts the frames it discarded.
+ */
+
+#ifndef VIDI_UTILS_SYNTHETIC_CAMERA_HPP_INCLUDED
+#define VIDI_UTILS_SYNTHETIC_CAMERA_HPP_INCLUDED
+
+#include "vidi.h"
+#include "frame_ring.hpp"
+#include "image_pool.hpp"
+#include "image_view.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace vidi_utils
+{
+    /**
+     * @brief a frame of the camera, move-only since it owns a pooled image
+     */
+    struct camera_frame
+    {
+        camera_frame()
+            : index(0)
+            , defect(false)
+        {
+        }
+
+        // written out: Visual Studio 2013 does not generate move constructors and assignments
+        camera_frame(camera_frame && other)
+            : image(std::move(other.image))
+            , index(other.index)
+            , timestamp(other.timestamp)
+            , defect(other.defect)
+        {
+        }
+
+        camera_frame & operator=(camera_frame && other)
+        {
+            if (this != &other)
+            {
+                image = std::move(other.image);
+                index = other.index;
+                timestamp = other.timestamp;
+                defect = other.defect;
+            }
+            return *this;
+        }
+
+        pooled_image image;
+        uint64_t index;                                     ///< from 0, in the order of rendering
+        std::chrono::steady_clock::time_point timestamp;    ///< when the frame was ready
+        bool defect;                                        ///< a defect was drawn in the frame
+
+    private:
+        camera_frame(const camera_frame &);
+        camera_frame & operator=(const camera_frame &);
+    };
+
+    struct synthetic_camera_options
+    {
+        synthetic_camera_options()
+            : width(2448)
+            , height(2048)
+            , channels(1)
+            , channel_depth(VIDI_IMG_8U)
+            , fps(25.0)
+            , frames(0)
+            , noise(2.0)
+            , drift(8.0)
+            , jitter(3)
+            , defect_rate(0.05)
+            , seed(42)
+        {
+        }
+
+        VIDI_UINT width;
+        VIDI_UINT height;
+        VIDI_UINT channels;
+        VIDI_UINT channel_depth;    ///< VIDI_IMG_8U, or VIDI_IMG_16U for 12 significant bits
+        double fps;                 ///< 0 renders as fast as the ring and the pool allow
+        uint64_t frames;            ///< the camera stops and closes the ring after so many, 0 to go on until stop()
+        double noise;               ///< standard deviation of the sensor noise, in 8-bit grey levels
+        double drift;               ///< amplitude of the lighting changes, in 8-bit grey levels
+        VIDI_UINT jitter;           ///< the largest shift of the scene, in pixels, in each direction
+        double defect_rate;         ///< probability that a frame has a defect
+        uint32_t seed;
+    };
+
+    struct synthetic_camera_stats
+    {
+        synthetic_camera_stats()
+            : frames(0)
+            , defects(0)
+            , late(0)
+            , refused(0)
+            , render_seconds(0.0)
+            , push_seconds(0.0)
+            , elapsed_seconds(0.0)
+        {
+        }
+
+        uint64_t frames;            ///< pushed into the ring
+        uint64_t defects;           ///< of which had a defect
+        uint64_t late;              ///< frames pushed more than a period behind schedule
+        uint64_t refused;           ///< frames lost because the image pool refused the image
+        double render_seconds;
+        double push_seconds;        ///< waiting for room in a ring_block ring
+        double elapsed_seconds;
+
+        double fps() const { return elapsed_seconds > 0 ? frames / elapsed_seconds : 0.0; }
+    };
+
+    class synthetic_camera
+    {
+    public:
+        /**
+         * @param images where the frames are acquired, must outlive the camera and its frames
+         * @param ring where the frames go, must outlive the camera; the camera is its only producer
+         */
+        synthetic_camera(const synthetic_camera_options & options, image_pool & images, frame_ring<camera_frame> & ring)
+            : m_options(options)
+            , m_images(images)
+            , m_ring(ring)
+            , m_scene_width(options.width + 2 * options.jitter)
+            , m_stop(false)
+        {
+            if (m_options.channel_depth != VIDI_IMG_16U)
+                m_options.channel_depth = VIDI_IMG_8U;
+            m_options.channels = std::max<VIDI_UINT>(1, std::min<VIDI_UINT>(4, m_options.channels));
+            render_scene();
+        }
+
+        ~synthetic_camera()
+        {
+            stop();
+        }
+
+        /**
+         * @brief starts the camera thread
+         *
+         * A camera runs once: when it stops, it closes the ring to tell the consumers that the
+         * stream ended, and the ring stays closed. Starting again takes a new ring and camera.
+         *
+         * @return false if it is running or has already run
+         */
+        bool start()
+        {
+            if (m_thread.joinable() || m_ring.closed())
+                return false;
+            m_stop = false;
+            m_thread = std::thread([this] { run(); });
+            return true;
+        }
+
+        /**
+         * @brief stops the camera thread and closes the ring; the frames in the ring can still be popped
+         */
+        void stop()
+        {
+            // closing first releases a push() waiting for room in a ring_block ring
+            m_stop = true;
+            m_ring.close();
+            if (m_thread.joinable())
+                m_thread.join();
+        }
+
+        /**
+         * @brief renders frame index into an image of the size, channels and depth of the options
+         *
+         * @return false if the image does not match the options
+         */
+        bool render(uint64_t index, const image_view & image, bool & defect) const
+        {
+            const VIDI_UINT w = m_options.width, h = m_options.height, ch = m_options.channels;
+            if (image.width() != w || image.height() != h || image.channels() != ch || image.channel_depth() != m_options.channel_depth)
+                return false;
+
+            std::mt19937 rng(m_options.seed ^ static_cast<uint32_t>(index * 2654435761u));
+            const int span = 2 * static_cast<int>(m_options.jitter) + 1;
+            const size_t dx = rng() % span, dy = rng() % span;
+            // in 16ths of a grey level, like the noise
+            const int light = static_cast<int>(std::floor(16 * m_options.drift * std::sin(index * 0.05) + 0.5));
+            const size_t n = size_t(w) * ch;
+
+            for (VIDI_UINT y = 0; y < h; ++y)
+            {
+                const uint8_t * scene = &m_scene[((y + dy) * m_scene_width + dx) * ch];
+                const int16_t * noise = &m_noise[rng() % (m_noise.size() - n)];
+                if (m_options.channel_depth == VIDI_IMG_8U)
+                {
+                    uint8_t * row = image.row(y);
+                    for (size_t k = 0; k < n; ++k)
+                    {
+                        int v = (scene[k] * 16 + light + noise[k] + 8) >> 4;
+                        row[k] = static_cast<uint8_t>(v < 0 ? 0 : v > 255 ? 255 : v);
+                    }
+                }
+                else
+                {
+                    uint16_t * row = reinterpret_cast<uint16_t *>(image.row(y));
+                    for (size_t k = 0; k < n; ++k)
+                    {
+                        int v = scene[k] * 16 + light + noise[k];
+                        row[k] = static_cast<uint16_t>(v < 0 ? 0 : v > 4095 ? 4095 : v);
+                    }
+                }
+            }
+
+            defect = std::uniform_real_distribution<double>(0.0, 1.0)(rng) < m_options.defect_rate;
+            if (defect)
+                draw_spot(image, rng);
+            return true;
+        }
+
+        const synthetic_camera_options & options() const { return m_options; }
+
+        synthetic_camera_stats stats() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_stats;
+        }
+
+        void report(std::ostream & os) const
+        {
+            synthetic_camera_stats s = stats();
+            os << "synthetic camera (" << m_options.width << "x" << m_options.height << "x" << m_options.channels
+                << (m_options.channel_depth == VIDI_IMG_16U ? ", 16 bits" : ", 8 bits") << ", "
+                << m_options.fps << " fps asked, ring of " << m_ring.capacity() << ", " << ring_policy_name(m_ring.policy()) << "): "
+                << s.frames << " frames at " << s.fps() << " fps, " << s.defects << " with defects, "
+                << s.late << " late, " << s.refused << " refused by the pool, " << m_ring.dropped() << " dropped by the ring, "
+                << (s.frames ? s.render_seconds * 1000 / s.frames : 0.0) << " ms rendering per frame, "
+                << s.push_seconds * 1000 << " ms waiting for the ring" << std::endl;
+        }
+
+    private:
+        synthetic_camera(const synthetic_camera &);
+        synthetic_camera & operator=(const synthetic_camera &);
+
+        /**
+         * @brief the scene with a margin of jitter pixels, and a table of noise to take rows from
+         */
+        void render_scene()
+        {
+            const VIDI_UINT ch = m_options.channels, rows = m_options.height + 2 * m_options.jitter;
+            m_scene.resize(size_t(m_scene_width) * rows * ch);
+            std::mt19937 rng(m_options.seed);
+            std::uniform_real_distribution<double> phase(0.0, 6.28);
+            const double p0 = phase(rng), p1 = phase(rng);
+            for (VIDI_UINT y = 0; y < rows; ++y)
+            {
+                for (VIDI_UINT x = 0; x < m_scene_width; ++x)
+                {
+                    // a shaded weave, with the channels slightly apart as the colour planes of a real part
+                    double v = 104 + 40.0 * x / m_scene_width + 28 * std::sin(x * 0.21 + p0) * std::sin(y * 0.19 + p1);
+                    for (VIDI_UINT c = 0; c < ch; ++c)
+                        m_scene[(size_t(y) * m_scene_width + x) * ch + c] = static_cast<uint8_t>(std::min(255.0, std::max(0.0, v - 12.0 * c)));
+                }
+            }
+
+            m_noise.resize(size_t(m_options.width) * ch + (1 << 16));
+            std::normal_distribution<double> normal(0.0, 16 * m_options.noise);
+            for (size_t k = 0; k < m_noise.size(); ++k)
+                m_noise[k] = static_cast<int16_t>(std::max(-2047.0, std::min(2047.0, std::floor(normal(rng) + 0.5))));
+        }
+
+        void draw_spot(const image_view & image, std::mt19937 & rng) const
+        {
+            const int radius = 6 + static_cast<int>(rng() % 24);
+            const int cx = static_cast<int>(rng() % image.width()), cy = static_cast<int>(rng() % image.height());
+            const size_t ch = image.channels();
+            for (int y = std::max(0, cy - radius); y < std::min<int>(image.height(), cy + radius + 1); ++y)
+            {
+                for (int x = std::max(0, cx - radius); x < std::min<int>(image.width(), cx + radius + 1); ++x)
+                {
+                    if ((x - cx) * (x - cx) + (y - cy) * (y - cy) > radius * radius)
+                        continue;
+                    for (size_t c = 0; c < ch; ++c)
+                    {
+                        if (image.channel_depth() == VIDI_IMG_8U)
+                            image.row(y)[x * ch + c] /= 3;
+                        else
+                            reinterpret_cast<uint16_t *>(image.row(y))[x * ch + c] /= 3;
+                    }
+                }
+            }
+        }
+
+        void run()
+        {
+            typedef std::chrono::steady_clock clock;
+            const clock::duration period = m_options.fps > 0
+                ? std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / m_options.fps))
+                : clock::duration::zero();
+            const clock::time_point begin = clock::now();
+            clock::time_point next = begin;
+            for (uint64_t index = 0; !m_stop && (!m_options.frames || index < m_options.frames); ++index)
+            {
+                if (period != clock::duration::zero())
+                    std::this_thread::sleep_until(next);
+
+                camera_frame frame;
+                frame.index = index;
+                frame.image = m_images.acquire(m_options.width, m_options.height, m_options.channels, m_options.channel_depth);
+                clock::time_point start = clock::now();
+                if (frame.image)
+                    render(index, frame.image.view(), frame.defect);
+                const clock::time_point ready = frame.timestamp = clock::now();
+
+                bool defect = frame.defect, ok = frame.image && m_ring.push(std::move(frame));
+                clock::time_point pushed = clock::now();
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_stats.render_seconds += std::chrono::duration<double>(ready - start).count();
+                    m_stats.push_seconds += std::chrono::duration<double>(pushed - ready).count();
+                    m_stats.elapsed_seconds = std::chrono::duration<double>(pushed - begin).count();
+                    if (ok)
+                    {
+                        ++m_stats.frames;
+                        m_stats.defects += defect;
+                    }
+                    else if (!m_ring.closed())
+                        ++m_stats.refused;
+                    // a camera does not catch up on the frames it missed, it goes on from now
+                    next += period;
+                    if (period != clock::duration::zero() && pushed > next + period)
+                    {
+                        ++m_stats.late;
+                        next = pushed;
+                    }
+                }
+                if (!ok && m_ring.closed())
+                    break;
+            }
+            m_ring.close();
+        }
+
+        synthetic_camera_options m_options;
+        image_pool & m_images;
+        frame_ring<camera_frame> & m_ring;
+        const VIDI_UINT m_scene_width;
+        std::vector<uint8_t> m_scene;
+        std::vector<int16_t> m_noise;       ///< in 16ths of a grey level
+
+        std::thread m_thread;
+        std::atomic<bool> m_stop;
+        mutable std::mutex m_mutex;
+        synthetic_camera_stats m_stats;
+    };
+}
+
+#endif
@@ -0,0 +1,217 @@
+/**
+ * @file thread_pool.hpp
+ * @brief Fixed size thread pool running data-parallel loops with work stealing
+ *
+ * parallel_for() cuts [0, n) into chunks and gives each participant a contiguous share of them.
+ * A participant takes chunks from the front of its own share and, once it runs out, steals
+ * chunks from the back of the others' shares, so uneven per-item costs still balance out.
+ * The calling thread takes part in the loop as participant 0.
+ */
+
+#ifndef VIDI_UTILS_THREAD_POOL_HPP_INCLUDED
+#define VIDI_UTILS_THREAD_POOL_HPP_INCLUDED
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vidi_utils
+{
+    class thread_pool
+    {
+    public:
+        /**
+         * @brief starts n_threads - 1 workers, 0 uses std::thread::hardware_concurrency()
+         */
+        explicit thread_pool(size_t n_threads = 0)
+            : m_generation(0)
+            , m_pending(0)
+            , m_stop(false)
+            , m_n(0)
+            , m_chunk(1)
+        {
+            if (!n_threads)
+                n_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+            for (size_t k = 0; k < n_threads; ++k)
+                m_shares.push_back(std::unique_ptr<share>(new share()));
+
+            for (size_t k = 1; k < n_threads; ++k)
+                m_workers.push_back(std::thread([this, k]() { worker_loop(k); }));
+        }
+
+        ~thread_pool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_start.notify_all();
+            for (auto & th : m_workers)
+                th.join();
+        }
+
+        /**
+         * @brief number of threads taking part in a loop, including the caller
+         */
+        size_t size() const
+        {
+            return m_shares.size();
+        }
+
+        /**
+         * @brief calls f(begin, end) on chunks of [0, n) from all the threads of the pool and waits for them
+         *
+         * @param chunk number of indices per call; 0 picks a size giving about 8 chunks per thread
+         *
+         * The first exception thrown by f is rethrown here once all threads are done.
+         * Loops must not be started concurrently on the same pool, nor from inside f.
+         */
+        template<class F>
+        void parallel_for(size_t n, size_t chunk, F f)
+        {
+            if (!n)
+                return;
+            if (!chunk)
+                chunk = std::max<size_t>(1, n / (8 * size()));
+
+            size_t n_chunks = (n + chunk - 1) / chunk;
+            if (n_chunks == 1 || size() == 1)
+            {
+                for (size_t begin = 0; begin < n; begin += chunk)
+                    f(begin, std::min(n, begin + chunk));
+                return;
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_job = [&f](size_t begin, size_t end) { f(begin, end); };
+                m_n = n;
+                m_chunk = chunk;
+                m_error = std::exception_ptr();
+                for (size_t k = 0; k < size(); ++k)
+                {
+                    m_shares[k]->begin = n_chunks * k / size();
+                    m_shares[k]->end = n_chunks * (k + 1) / size();
+                }
+                m_pending = m_workers.size();
+                ++m_generation;
+            }
+            m_start.notify_all();
+
+            run_share(0);
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done.wait(lock, [this] { return m_pending == 0; });
+            m_job = std::function<void(size_t, size_t)>();
+            if (m_error)
+                std::rethrow_exception(m_error);
+        }
+
+    private:
+        thread_pool(const thread_pool &);
+        thread_pool & operator=(const thread_pool &);
+
+        // the chunks [begin, end) not yet taken from one participant's share
+        struct share
+        {
+            share() : begin(0), end(0) {}
+
+            std::mutex mutex;
+            size_t begin;
+            size_t end;
+        };
+
+        bool take_own(size_t self, size_t & chunk_index)
+        {
+            share & s = *m_shares[self];
+            std::lock_guard<std::mutex> lock(s.mutex);
+            if (s.begin == s.end)
+                return false;
+            chunk_index = s.begin++;
+            return true;
+        }
+
+        bool steal(size_t self, size_t & chunk_index)
+        {
+            for (size_t k = 1; k < size(); ++k)
+            {
+                share & s = *m_shares[(self + k) % size()];
+                std::lock_guard<std::mutex> lock(s.mutex);
+                if (s.begin != s.end)
+                {
+                    chunk_index = --s.end;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void run_share(size_t self)
+        {
+            size_t chunk_index;
+            while (take_own(self, chunk_index) || steal(self, chunk_index))
+            {
+                size_t begin = chunk_index * m_chunk;
+                try
+                {
+                    m_job(begin, std::min(m_n, begin + m_chunk));
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    if (!m_error)
+                        m_error = std::current_exception();
+                }
+            }
+        }
+
+        void worker_loop(size_t self)
+        {
+            size_t seen = 0;
+            for (;;)
+            {
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_start.wait(lock, [&] { return m_stop || m_generation != seen; });
+                    if (m_stop)
+                        return;
+                    seen = m_generation;
+                }
+
+                run_share(self);
+
+                bool last;
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    last = --m_pending == 0;
+                }
+                if (last)
+                    m_done.notify_one();
+            }
+        }
+
+        std::vector<std::unique_ptr<share> > m_shares;
+        std::vector<std::thread> m_workers;
+
+        std::mutex m_mutex;
+        std::condition_variable m_start;
+        std::condition_variable m_done;
+        size_t m_generation;
+        size_t m_pending;
+        bool m_stop;
+
+        std::function<void(size_t, size_t)> m_job;
+        size_t m_n;
+        size_t m_chunk;
+        std::exception_ptr m_error;
+    };
+}
+
+#endif
@@ -0,0 +1,221 @@
+/**
+ * @file xml_batch_loader.hpp
+ * @brief Loads and parses large sets of result xml files in parallel
+ *
+ * Reading a file with rapidxml::file and parsing it one after the other leaves all but one
+ * core idle and puts every disk access on the critical path. load_xml_batch() splits the
+ * work in two stages connected by a bounded queue:
+ *  - reader threads load whole files into recycled buffers (the read-ahead),
+ *  - parser threads parse them in-situ, each into its own reused xml_document, and hand
+ *    the document to a user supplied visitor.
+ */
+
+#ifndef VIDI_UTILS_XML_BATCH_LOADER_HPP_INCLUDED
+#define VIDI_UTILS_XML_BATCH_LOADER_HPP_INCLUDED
+
+#include "../rapidxml/rapidxml.hpp"
+#include "bounded_queue.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace vidi_utils
+{
+    struct xml_batch_options
+    {
+        xml_batch_options()
+            : n_parsers(0)
+            , n_readers(2)
+            , read_ahead(0)
+        {
+        }
+
+        size_t n_parsers;   ///< number of parsing threads, 0 uses std::thread::hardware_concurrency()
+        size_t n_readers;   ///< number of threads reading files from the disk
+        size_t read_ahead;  ///< number of loaded files waiting to be parsed, 0 uses 2 per parser
+    };
+
+    struct xml_batch_stats
+    {
+        xml_batch_stats()
+            : files(0)
+            , bytes(0)
+            , seconds(0.0)
+        {
+        }
+
+        double files_per_second() const { return seconds > 0.0 ? files / seconds : 0.0; }
+        double mb_per_second() const { return seconds > 0.0 ? bytes / (1024.0 * 1024.0) / seconds : 0.0; }
+
+        size_t files;   ///< number of files successfully parsed and visited
+        size_t bytes;   ///< total size of these files
+        double seconds; ///< wall clock time of the whole batch
+        std::vector<std::pair<std::string, std::string> > failures; ///< path and reason of each file that was skipped
+    };
+
+    namespace detail
+    {
+        struct loaded_xml
+        {
+            loaded_xml() : index(0) {}
+
+            size_t index;
+            std::vector<char> data;
+        };
+
+        /**
+         * @brief reads the whole file and appends the terminating zero needed by in-situ parsing
+         *
+         * @return false if the file cannot be opened or read
+         */
+        inline bool read_xml_file(const std::string & path, std::vector<char> & data)
+        {
+            std::FILE * f = std::fopen(path.c_str(), "rb");
+            if (!f)
+                return false;
+
+            bool ok = std::fseek(f, 0, SEEK_END) == 0;
+            long size = ok ? std::ftell(f) : -1;
+            ok = size >= 0 && std::fseek(f, 0, SEEK_SET) == 0;
+            if (ok)
+            {
+                // resize() keeps the capacity, so recycled buffers stop allocating once large enough
+                data.resize(static_cast<size_t>(size) + 1);
+                ok = std::fread(data.data(), 1, static_cast<size_t>(size), f) == static_cast<size_t>(size);
+                data[static_cast<size_t>(size)] = 0;
+            }
+            std::fclose(f);
+            return ok;
+        }
+    }
+
+    /**
+     * @brief loads, parses and visits every file of the list
+     *
+     * The visitor is called as visitor(index, path, document) from several threads at once and must
+     * therefore be thread-safe. The document and the strings it points to are only valid for the
+     * duration of the call since they are reused for the next file. Files are visited in no
+     * particular order; index is the position of the file in the list.
+     *
+     * @return timings and the list of files that could not be read or parsed
+     */
+    template<int Flags, class Visitor>
+    xml_batch_stats load_xml_batch(const std::vector<std::string> & paths, Visitor visitor, xml_batch_options options = xml_batch_options())
+    {
+        size_t n_parsers = options.n_parsers ? options.n_parsers : std::max<size_t>(1, std::thread::hardware_concurrency());
+        size_t n_readers = std::max<size_t>(1, std::min(options.n_readers, paths.size()));
+        size_t read_ahead = options.read_ahead ? options.read_ahead : 2 * n_parsers;
+
+        xml_batch_stats stats;
+        std::mutex stats_mutex;
+
+        bounded_queue<detail::loaded_xml> loaded(read_ahead);
+        // parsed buffers are handed back to the readers so their capacity gets reused
+        bounded_queue<std::vector<char> > recycled(read_ahead + n_parsers);
+
+        size_t next_path = 0;
+        std::mutex next_path_mutex;
+
+        auto record_failure = [&](size_t index, const std::string & reason)
+        {
+            std::lock_guard<std::mutex> lock(stats_mutex);
+            stats.failures.push_back(std::make_pair(paths[index], reason));
+        };
+
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> readers;
+        for (size_t r = 0; r < n_readers; ++r)
+        {
+            readers.push_back(std::thread([&]()
+            {
+                for (;;)
+                {
+                    size_t index;
+                    {
+                        std::lock_guard<std::mutex> lock(next_path_mutex);
+                        if (next_path == paths.size())
+                            return;
+                        index = next_path++;
+                    }
+
+                    detail::loaded_xml file;
+                    file.index = index;
+                    recycled.try_pop(file.data);
+                    if (!detail::read_xml_file(paths[index], file.data))
+                    {
+                        record_failure(index, "cannot read file");
+                        continue;
+                    }
+                    if (!loaded.push(std::move(file)))
+                        return;
+                }
+            }));
+        }
+
+        std::vector<std::thread> parsers;
+        for (size_t p = 0; p < n_parsers; ++p)
+        {
+            parsers.push_back(std::thread([&]()
+            {
+                rapidxml::xml_document<> doc;
+                detail::loaded_xml file;
+                size_t files = 0;
+                size_t bytes = 0;
+                while (loaded.pop(file))
+                {
+                    try
+                    {
+                        // clear() also releases the dynamic pool blocks grown by the previous file
+                        doc.clear();
+                        doc.parse<Flags>(file.data.data());
+                        visitor(file.index, paths[file.index], doc);
+                        ++files;
+                        bytes += file.data.size() - 1;
+                    }
+                    catch (const rapidxml::parse_error & e)
+                    {
+                        record_failure(file.index, std::string("parse error: ") + e.what());
+                    }
+                    catch (const std::exception & e)
+                    {
+                        record_failure(file.index, e.what());
+                    }
+                    recycled.try_push(std::move(file.data));
+                    file.data = std::vector<char>();
+                }
+
+                std::lock_guard<std::mutex> lock(stats_mutex);
+                stats.files += files;
+                stats.bytes += bytes;
+            }));
+        }
+
+        for (auto & th : readers)
+            th.join();
+        loaded.close();
+        for (auto & th : parsers)
+            th.join();
+
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+
+    /**
+     * @brief same as above using the default parse flags
+     */
+    template<class Visitor>
+    xml_batch_stats load_xml_batch(const std::vector<std::string> & paths, Visitor visitor, xml_batch_options options = xml_batch_options())
+    {
+        return load_xml_batch<0>(paths, visitor, options);
+    }
+}
+
+#endif